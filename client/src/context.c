@@ -1,9 +1,12 @@
 
-#include <sys/statvfs.h>
+#include <sys/random.h>
 #include <sys/stat.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "context.h"
 #include "pkg.defs.h"
@@ -29,31 +32,102 @@ Context* context_create(void) {
 }
 
 /*
- *  context_init_download() - 
+ *  session_pick() -
  *
- *  Initializes the download context.
+ *  Picks the identifier of a new session, at random so that sessions of
+ *  the same client, even from different runs, tell apart.
+ *
+ *  return:
+ *    - The session identifier.
+ */
+static uint32_t session_pick(void) {
+
+    uint32_t sess;
+
+    if(getrandom(&sess, sizeof sess, GRND_NONBLOCK) != sizeof sess) {
+        sess = (uint32_t)(pkgtime() ^ ((size_t)getpid() << 16));
+    }
+
+    return sess;
+}
+
+/*
+ *  init_pkg_with_request() -
+ *
+ *  Initializes the request package of a context, carrying the parameters
+ *  the client supports followed by the asset name.
  *
  *  @ctx : Pointer to the context structure.
- *  @path: Path of the file to be downloaded.
+ *  @type: Type of the request package.
+ *  @name: Name of the asset, or 'NULL' if the request carries none.
+ */
+static void init_pkg_with_request(Context* ctx, PkgType type, const char* name) {
+
+    size_t n;
+    PkgParams params;
+    uint8_t buf[sizeof params + NAME_MAX];
+
+    assert(ctx);
+
+    memset(&params, 0, sizeof params);
+    params.version = PKG_VERSION;
+    params.csum    = CSUM_SUPPORTED;
+    params.mtu     = ctx->mtu;
+    params.window  = ctx->window;
+    params.start   = (uint64_t)ctx->range.start;
+    params.end     = (uint64_t)ctx->range.end;
+    memcpy(buf, &params, sizeof params);
+
+    n = 0;
+    if(name) {
+        n = strlen(name);
+        if(n > NAME_MAX) {
+            n = NAME_MAX;
+        }
+        memcpy(buf + sizeof params, name, n);
+    }
+
+    pkginit(&ctx->win.buf, sizeof params + n, 0, type, buf, ctx->check, ctx->sess);
+}
+
+/*
+ *  context_init_download() - 
+ *
+ *  Initializes the download context of a range of the file, recording
+ *  its progress in the sidecar file. The context writes through a
+ *  descriptor of the file of its own.
+ *
+ *  @ctx  : Pointer to the context structure.
+ *  @path : Path of the file to be downloaded.
+ *  @range: Pointer to the range of the file to fetch.
  *
  *  return:
  *    - '1' if the context is successfully initialized.
  *    - '0' otherwise.
  */
-static int context_init_download(Context* ctx, const char* path) {
+static int context_init_download(Context* ctx, const char* path, const CtxRange* range) {
 
+    int fd;
     int ret;
 
     assert(ctx);
     assert(path);
+    assert(range);
 
     ret = 0;
 
     ctx->win.i = 1;
-    ctx->desc.fp = fopen(path, "wb");
-    if(ctx->desc.fp) {
-        pkginit(&ctx->win.buf, strlen(path), 0, PKG_DOWNLOAD, (uint8_t*)path);
-        ret = 1;
+    ctx->range = *range;
+    fd = dup(range->fd);
+    if(fd >= 0) {
+        ctx->desc.wr = writer_open(fd, range->start);
+        if(ctx->desc.wr) {
+            writer_record(ctx->desc.wr, range->part, range->slot);
+            init_pkg_with_request(ctx, PKG_DOWNLOAD, path);
+            ret = 1;
+        } else {
+            close(fd);
+        }
     }
 
     return ret;
@@ -76,17 +150,38 @@ static int context_init_ls(Context* ctx) {
     assert(ctx);
 
     ctx->win.i = 1;
-    pkginit(
-        &ctx->win.buf,
-        0,
-        0,
-        PKG_LS,
-        NULL
-    );
+    init_pkg_with_request(ctx, PKG_LS, NULL);
 
     return 1;
 }
 
+/*
+ *  window_frames() -
+ *
+ *  Converts a number of bytes in flight into a number of frames.
+ *
+ *  @bytes  : Number of bytes to keep in flight.
+ *  @payload: Number of content bytes each frame carries.
+ *
+ *  return:
+ *    - The number of frames, between '1' and 'CTX_MAX_WINDOW'.
+ */
+static inline size_t window_frames(size_t bytes, size_t payload) {
+
+    size_t frames;
+
+    frames = bytes / payload;
+    if(frames < 1) {
+        frames = 1;
+    }
+
+    if(frames > CTX_MAX_WINDOW) {
+        frames = CTX_MAX_WINDOW;
+    }
+
+    return frames;
+}
+
 /*
  *  context_init() -
  *
@@ -95,21 +190,29 @@ static int context_init_ls(Context* ctx) {
  *  @ctx : Pointer to the context structure to initialize.
  *  @type: Type of the context (e.g., download or list).
  *  @path: Path of the file to be downloaded (if applicable).
+ *  @mtu : Largest frame the local interface can carry.
+ *  @window: Number of bytes the client offers to hold out of order.
+ *  @range: Pointer to the range of the file a download fetches, or
+ *          'NULL' for a list.
  *
  *  return:
  *    - '1' if the context is successfully initialized.
  *    - '0' if the context type is not recognized or if 
  *      initialization fails.
  */
-int context_init(Context* ctx, CtxType type, const char* path) {
+int context_init(Context* ctx, CtxType type, const char* path, size_t mtu, size_t window, const CtxRange* range) {
 
     assert(ctx);
 
-    ctx->indx = 0;
-    ctx->type = type;
+    ctx->indx   = 0;
+    ctx->type   = type;
+    ctx->mtu    = mtu;
+    ctx->window = window_frames(window, CtxPayload(ctx));
+    ctx->check  = csum_pick(CSUM_SUPPORTED);
+    ctx->sess   = session_pick();
 
     if(Download(type)) {
-        return context_init_download(ctx, path);
+        return context_init_download(ctx, path, range);
     } else {
         if(Ls(type)) {
             return context_init_ls(ctx);
@@ -119,21 +222,73 @@ int context_init(Context* ctx, CtxType type, const char* path) {
     return 0;
 }
 
+/*
+ *  context_handshake() -
+ *
+ *  Applies the parameters carried by the 'PKG_ACK' answering the
+ *  context request.
+ *
+ *  @ctx: Pointer to the context structure.
+ *  @pkg: Pointer to the received 'PKG_ACK' package.
+ *
+ *  return:
+ *    - '1' if the server agreed on parameters the client supports.
+ *    - '0' otherwise.
+ */
+int context_handshake(Context* ctx, Pkg* pkg) {
+
+    PkgParams params;
+
+    assert(ctx);
+    assert(pkg);
+
+    pkg_rmv_sentinel_bytes(pkg);
+    if(!pkgparams(pkg, &params) || params.mtu > ctx->mtu || params.window > ctx->window) {
+        return 0;
+    }
+
+    if(!csum_known(params.csum) || params.csum != PkgCheck(pkg)) {
+        return 0;
+    }
+
+    if(params.start != (uint64_t)ctx->range.start) {
+        return 0;
+    }
+
+    ctx->mtu     = params.mtu;
+    ctx->window  = params.window;
+    ctx->check   = params.csum;
+    ctx->ooo.off = ctx->range.start;
+    ctx->ooo.got = calloc(ctx->window, 1);
+    ctx->ooo.end = calloc(ctx->window, sizeof *ctx->ooo.end);
+    if(!ctx->ooo.got || !ctx->ooo.end) {
+        return 0;
+    }
+
+    debug("handshake completed (mtu %zu, checksum %d, window %zu).\n", ctx->mtu, ctx->check, ctx->window);
+
+    return 1;
+}
+
 /*
  *  init_pkg_with_ack() -
  *
  *  Initializes a package with an acknowledgment (ACK) type.
  *
- *  @pkg: Pointer to the package to initialize.
+ *  @pkg  : Pointer to the package to initialize.
+ *  @check: Checksum algorithm agreed on for the context.
+ *  @sess : Session of the context.
  */
-static inline void init_pkg_with_ack(Pkg* pkg) {
+static inline void init_pkg_with_ack(Pkg* pkg, int check, uint32_t sess) {
     
     pkginit(
         pkg,
         0,
         0,
         PKG_ACK,
-        NULL
+        NULL,
+        check,
+        sess
     );
 }
 
@@ -142,93 +297,149 @@ static inline void init_pkg_with_ack(Pkg* pkg) {
  *
  *  Initializes a package with a negative acknowledgment (NACK) type.
  *
- *  @pkg : Pointer to the package to initialize.
- *  @indx: Index to be included in the NACK package.
+ *  @pkg  : Pointer to the package to initialize.
+ *  @indx : Index to be included in the NACK package.
+ *  @check: Checksum algorithm agreed on for the context.
+ *  @sess : Session of the context.
  */
-static inline void init_pkg_with_nack(Pkg* pkg, size_t indx) {
+static inline void init_pkg_with_nack(Pkg* pkg, size_t indx, int check, uint32_t sess) {
 
     pkginit(
         pkg,
         0,
-        (uint8_t)indx,
+        indx,
         PKG_NACK,
-        NULL
+        NULL,
+        check,
+        sess
     );
 }
 
 /*
- *  context_update_with_data() -
+ *  init_pkg_with_sack() -
  *
- *  Updates the context with data from a received package.
+ *  Initializes the response package with a selective acknowledgment (SACK)
+ *  of the frames received so far, advertising the receive window. The
+ *  window shrinks to the frames the write pipeline has room for from the
+ *  next expected one on, so the server slows down to the disk rather
+ *  than send frames the pipeline drops. The bitmap covers the window past
+ *  the next expected frame as far as it fits a frame once stuffed.
  *
  *  @ctx: Pointer to the context structure.
- *  @pkg: Pointer to the received package.
- *
- *  return:
- *    - '1' if the context is successfully updated.
- *    - '0' if there was an error updating the context.
  */
-static int context_update_with_data(Context* ctx, Pkg* pkg) {
+static void init_pkg_with_sack(Context* ctx) {
 
-    int nack;
-    int valid;
+    size_t j;
+    size_t bits;
+    size_t room;
+    uint32_t rwnd;
+    uint8_t map[sizeof ctx->win.buf.data.content];
 
     assert(ctx);
-    assert(pkg);
 
-    ctx->win.i = WINSZ;
+    bits = ctx->window - 1;
+    if(bits > 8 * ((CtxPayload(ctx) - 1) / 2 - sizeof rwnd)) {
+        bits = 8 * ((CtxPayload(ctx) - 1) / 2 - sizeof rwnd);
+    }
 
-    nack  = 1;
-    valid = pkgvalid(pkg);
-    if(valid) {
-        if(pkg->data.indx == ctx->indx) {
-            pkg_rmv_sentinel_bytes(pkg);
-            ctx->recv += pkg->data.size;
-            ctx->k++;
-            fwrite(pkg->data.content, pkg->data.size, 1, ctx->desc.fp);
-            init_pkg_with_ack(&ctx->win.buf);
-            incindx(ctx);
-            nack = 0;
-        } 
+    room = writer_room(ctx->desc.wr, ctx->ooo.off) / CtxPayload(ctx);
+    rwnd = (uint32_t)(room < ctx->window ? room : ctx->window);
+    memcpy(map, &rwnd, sizeof rwnd);
+    memset(map + sizeof rwnd, 0, (bits + 7) / 8);
+    for(j = 0; j < bits; j++) {
+        if(CtxGot(ctx, ctx->indx + 1 + j)) {
+            map[sizeof rwnd + j / 8] |= 1 << (j % 8);
+        }
     }
 
-    if(nack) {
-        debug("waiting package %zu.\n", ctx->indx);
-        debug("sending nack %zu.\n", ctx->indx);
-        init_pkg_with_nack(&ctx->win.buf, ctx->indx);
-        ctx->skip = 1;
+    pkginit(&ctx->win.buf, sizeof rwnd + (bits + 7) / 8, ctx->indx, PKG_SACK, map, ctx->check, ctx->sess);
+}
+
+/*
+ *  write_data() -
+ *
+ *  Puts the content of a data package at the file offset it carries
+ *  through the write pipeline of the file.
+ *
+ *  @ctx: Pointer to the context structure.
+ *  @pkg: Pointer to the data package, with sentinel bytes removed.
+ *
+ *  return:
+ *    - '1' if the content was taken.
+ *    - '0' if it lies too far ahead of the bytes still missing.
+ */
+static inline int write_data(Context* ctx, const Pkg* pkg) {
+
+    if(!writer_put(ctx->desc.wr, PkgOff(pkg), pkg->data.content, pkg->data.size)) {
+        return 0;
     }
 
+    ctx->recv += pkg->data.size;
+    ctx->k++;
 
     return 1;
 }
 
 /*
- *  has_disk_space() -
+ *  context_update_with_data() -
  *
- *  Checks if there is enough disk space for a given size.
+ *  Updates the context with data from a received package, whose content
+ *  is written at its file offset whether or not the packages before it
+ *  arrived. A package further ahead than the write pipeline can hold is
+ *  dropped, to be sent again. The next expected package moves the
+ *  context past it and every package following it that arrived earlier.
  *
- *  @size: Required size in bytes.
+ *  @ctx: Pointer to the context structure.
+ *  @pkg: Pointer to the received package.
  *
  *  return:
- *    - '1' if there is enough disk space.
- *    - '0' if there is not enough disk space.
+ *    - '1' if the context is successfully updated.
+ *    - '0' if there was an error updating the context.
  */
-static int has_disk_space(size_t size) {
+static int context_update_with_data(Context* ctx, Pkg* pkg) {
 
-    struct statvfs st;
+    size_t d;
 
-    if(statvfs(".", &st) < 0) {
-        return 0;
+    assert(ctx);
+    assert(pkg);
+
+    ctx->win.i = ctx->window < CTX_ACK_EVERY ? ctx->window : CTX_ACK_EVERY;
+
+    if(pkgvalid(pkg)) {
+
+        d = (PkgIndx(pkg) - ctx->indx) % PKG_MAX_IND;
+        if(d < ctx->window && !CtxGot(ctx, ctx->indx + d)) {
+            pkg_rmv_sentinel_bytes(pkg);
+            if(write_data(ctx, pkg)) {
+                CtxGot(ctx, ctx->indx + d)    = 1;
+                CtxGotEnd(ctx, ctx->indx + d) = PkgOff(pkg) + (off_t)pkg->data.size;
+                if(d) {
+                    debug("holding package %zu.\n", ctx->indx + d);
+                }
+            }
+
+            while(CtxGot(ctx, ctx->indx)) {
+                CtxGot(ctx, ctx->indx) = 0;
+                ctx->ooo.off = CtxGotEnd(ctx, ctx->indx);
+                incindx(ctx);
+            }
+        }
     }
 
-    return st.f_bsize * st.f_bavail > size;
+    debug("sending sack %zu.\n", ctx->indx);
+    init_pkg_with_sack(ctx);
+
+    return 1;
 }
 
 /*
  *  context_update_with_descriptor() -
  *
- *  Updates the context with a descriptor from a received package.
+ *  Updates the context with a descriptor from a received package, which
+ *  carries the size of the file. The size is recorded in the sidecar file
+ *  unless known already. A download fails if the size changed since it
+ *  was. The download reserves the blocks of the file once it learns the
+ *  size, not every context.
  *
  *  @ctx: Pointer to the context structure.
  *  @pkg: Pointer to the received package.
@@ -246,23 +457,36 @@ static int context_update_with_descriptor(Context* ctx, Pkg* pkg) {
     assert(ctx);
     assert(pkg);
 
-
     ret = 0;
     size = 0;
     valid = pkgvalid(pkg);
     if(valid) {
-        if(pkg->data.indx == ctx->indx) {
-            size = (size_t)pkg->data.size;
-            if(has_disk_space(size)) {
-                init_pkg_with_ack(&ctx->win.buf);
+        if(PkgIndx(pkg) == SeqWire(ctx->indx)) {
+            pkg_rmv_sentinel_bytes(pkg);
+            if(pkg->data.size >= sizeof size) {
+                memcpy(&size, pkg->data.content, sizeof size);
+                if(ctx->range.size && ctx->range.size != size) {
+                    ctx->invalid = 1;
+                    ctx->completed = 1;
+                    return 0;
+                }
+
+                if(!ctx->range.size) {
+                    ctx->range.size = size;
+                    if(pwrite(ctx->range.part, &ctx->range.size, sizeof ctx->range.size, 0) != sizeof ctx->range.size) {
+                        debug("failed to record the size of the file.\n");
+                    }
+                }
+
+                init_pkg_with_ack(&ctx->win.buf, ctx->check, ctx->sess);
                 ret = 1;
-                ctx->recv += size;
+                ctx->recv += pkg->data.size;
             }
         }
     }
 
     if(!ret) {
-        init_pkg_with_nack(&ctx->win.buf, ctx->indx);
+        init_pkg_with_nack(&ctx->win.buf, ctx->indx, ctx->check, ctx->sess);
     }
 
     return ret;
@@ -283,7 +507,7 @@ static int context_update_with_descriptor(Context* ctx, Pkg* pkg) {
 static int context_update_with_show(Context* ctx, Pkg* pkg) {
 
     int valid;
-    char str[64];
+    char str[sizeof pkg->data.content + 1];
     size_t size;
 
     assert(ctx);
@@ -293,9 +517,9 @@ static int context_update_with_show(Context* ctx, Pkg* pkg) {
     if(valid) {
 
         size = pkg->data.size;
-        if(pkg->data.indx == ctx->indx) {
+        if(PkgIndx(pkg) == SeqWire(ctx->indx)) {
             ctx->recv += size;
-            init_pkg_with_ack(&ctx->win.buf);
+            init_pkg_with_ack(&ctx->win.buf, ctx->check, ctx->sess);
             memcpy(str, pkg->data.content, size);
             str[size] = 0;
             printf(RED"- %s"RESET"\n", str);
@@ -305,7 +529,7 @@ static int context_update_with_show(Context* ctx, Pkg* pkg) {
         }
     }
 
-    init_pkg_with_nack(pkg, ctx->indx);
+    init_pkg_with_nack(pkg, ctx->indx, ctx->check, ctx->sess);
 
     return 1;
 }
@@ -313,7 +537,8 @@ static int context_update_with_show(Context* ctx, Pkg* pkg) {
 /*
  *  context_update_with_meta_pkgs() -
  *
- *  Updates the context with meta packages.
+ *  Updates the context with meta packages. An 'error' package ends the
+ *  context as an 'end' one does, but failed.
  *
  *  @ctx: Pointer to the context structure.
  *  @pkg: Pointer to the received package.
@@ -334,6 +559,12 @@ static int context_update_with_meta_pkgs(Context* ctx, Pkg* pkg) {
         if(PkgEnd(pkg)) {
             return ctx->completed = 1;
         }
+
+        if(PkgError(pkg)) {
+            debug("server failed the context.\n");
+            ctx->error = 1;
+            return ctx->completed = 1;
+        }
     }
 
     return 0;
@@ -408,6 +639,10 @@ int context_update(Context* ctx, Pkg* pkg) {
     assert(ctx);
     assert(pkg);
 
+    if(PkgCheck(pkg) != ctx->check) {
+        return 0;
+    }
+
     if(CtxDownload(ctx)) {
         return context_download_update(ctx, pkg);
     } else {
@@ -430,8 +665,12 @@ int context_update(Context* ctx, Pkg* pkg) {
  */
 static inline void context_deinit_download(Context* ctx) {
 
-    if(ctx && ctx->desc.fp) {
-        fclose(ctx->desc.fp);
+    if(ctx && ctx->desc.wr) {
+        if(!writer_close(ctx->desc.wr, ctx->ooo.off)) {
+            debug("failed to write the file.\n");
+            ctx->error = 1;
+        }
+        ctx->desc.wr = NULL;
     }
 }
 
@@ -446,6 +685,11 @@ static inline void context_deinit_download(Context* ctx) {
 void context_deinit(Context* ctx) {
 
     if(ctx) {
+        free(ctx->ooo.got);
+        free(ctx->ooo.end);
+        ctx->ooo.got = NULL;
+        ctx->ooo.end = NULL;
+
         if(CtxDownload(ctx)) {
             context_deinit_download(ctx);
         } 
@@ -1,25 +1,60 @@
 #ifndef CONTEXT_DEFS_H
 #define CONTEXT_DEFS_H
 
-#define WINSZ 5
+/*
+ *  Window geometry. Unless told otherwise the client offers to hold
+ *  'CTX_WINDOW' bytes out of order, about the bandwidth-delay product of a
+ *  10 Gbit/s link with a 3 ms round trip, cut into as many frames as its
+ *  MTU allows but never more than 'CTX_MAX_WINDOW'.
+ */
+#define CTX_WINDOW      (1 << 22)
+#define CTX_MAX_WINDOW  (1 << 15)
+
+/*
+ *  Retransmission timeout of the request, in microseconds. It starts at
+ *  'CTX_RTO_INIT' and is doubled on every expiry up to 'CTX_RTO_MAX'.
+ */
+#define CTX_RTO_INIT    (100 * 1000)
+#define CTX_RTO_MAX     (5 * 1000 * 1000)
+
+/*
+ *  Data frames are acknowledged at least every 'CTX_ACK_EVERY' frames, so
+ *  the server learns how fast they are delivered while a flight is still
+ *  arriving, besides right away when a frame asks for it. Frames left
+ *  unacknowledged are acknowledged once no other arrived for
+ *  'CTX_ACK_DELAY' microseconds, well below the retransmission timeout
+ *  of the server, in case the frame asking for an answer was lost.
+ */
+#define CTX_ACK_EVERY   16
+#define CTX_ACK_DELAY   500
 
 #define Download(type)      ((type) == CTX_DOWNLOAD)
 #define Ls(type)            ((type) == CTX_LS)
 
-#define CtxEnd(ctx)         ((ctx)->end)
 #define CtxCompleted(ctx)   ((ctx)->completed)
 #define CtxDownload(ctx)    (Download((ctx)->type))
 #define CtxLs(ctx)          (Ls((ctx)->type))
+#define CtxPayload(ctx)     ((ctx)->mtu - PKG_HDR_SIZE)
+#define CtxGot(ctx, seq)    ((ctx)->ooo.got[(seq) % (ctx)->window])
+#define CtxGotEnd(ctx, seq) ((ctx)->ooo.end[(seq) % (ctx)->window])
+
+/*
+ *  SeqWire() -
+ *
+ *  Contexts count sequence numbers in full while frames only carry their
+ *  low 32 bits, so the window never sees them wrap. Gives the sequence
+ *  number a frame carries for a full one.
+ *
+ *  @seq: Full sequence number.
+ */
+#define SeqWire(seq)        ((seq) % PKG_MAX_IND)
 
 /*
  *  incindx() -
  *
  *  @ctx:
  */
-#define incindx(ctx)                                        \
-    do {                                                    \
-        (ctx)->indx = ((ctx)->indx + 1) % PKG_MAX_IND;      \
-    } while(0)
+#define incindx(ctx)    ((ctx)->indx++)
 
 #define RED     "\033[31m"
 #define RESET   "\033[0m"
@@ -7,6 +7,7 @@
 #include "context.defs.h"
 #include "utils.h"
 #include "pkg.h"
+#include "writer.h"
 
 enum CtxType {
 
@@ -16,6 +17,26 @@ enum CtxType {
 
 typedef enum CtxType CtxType;
 
+/*
+ *  Range of a file a download context fetches: the bytes of the asset
+ *  from 'start' up to 'end', or up to its end if 'end' is zero, written
+ *  to the file 'fd'. The sidecar file 'part' records the ranges of the
+ *  file written so far: the 'size' of the asset, zero until known, then
+ *  a 'WriterMark' per context that wrote to the file, the context's own
+ *  at the offset 'slot'.
+ */
+struct CtxRange {
+
+    int      fd;
+    int      part;
+    off_t    slot;
+    off_t    start;
+    off_t    end;
+    uint64_t size;
+};
+
+typedef struct CtxRange CtxRange;
+
 struct Context {
 
     CtxType type;
@@ -23,22 +44,43 @@ struct Context {
     int completed;
     int invalid;
     int ack;
-    int skip;
     int error;
 
+    size_t mtu;
+    size_t window;
+    int    check;
     size_t indx;
     size_t recv;
     size_t k;
 
+    uint32_t sess;
+
     struct  {
 
         size_t i;
         Pkg buf;
     } win;
 
+    /*
+     *  Frames received ahead of the next expected one, the frame 'seq'
+     *  marked in the slot 'seq % window' of 'got' and the file offset its
+     *  content ends at in that of 'end'. Their content is written at the
+     *  file offset they carry as soon as they arrive, so only the marks
+     *  wait for the frames before them. The next expected frame starts at
+     *  the file offset 'off'.
+     */
+    struct {
+
+        uint8_t* got;
+        off_t*   end;
+        off_t    off;
+    } ooo;
+
+    CtxRange range;
+
     union {
 
-        FILE* fp;
+        Writer* wr;
     } desc;
 };
 
@@ -63,13 +105,32 @@ extern Context* context_create(void);
  *  @ctx : Pointer to the context structure to initialize.
  *  @type: Type of the context (e.g., download or list).
  *  @path: Path of the file to be downloaded (if applicable).
+ *  @mtu : Largest frame the local interface can carry.
+ *  @window: Number of bytes the client offers to hold out of order.
+ *  @range: Pointer to the range of the file a download fetches, or
+ *          'NULL' for a list.
  *
  *  return:
  *    - '1' if the context is successfully initialized.
  *    - '0' if the context type is not recognized or if 
  *      initialization fails.
  */
-extern int context_init(Context* ctx, CtxType type, const char* path);
+extern int context_init(Context* ctx, CtxType type, const char* path, size_t mtu, size_t window, const CtxRange* range);
+
+/*
+ *  context_handshake() -
+ *
+ *  Applies the parameters carried by the 'PKG_ACK' answering the
+ *  context request.
+ *
+ *  @ctx: Pointer to the context structure.
+ *  @pkg: Pointer to the received 'PKG_ACK' package.
+ *
+ *  return:
+ *    - '1' if the server agreed on parameters the client supports.
+ *    - '0' otherwise.
+ */
+extern int context_handshake(Context* ctx, Pkg* pkg);
 
 /*
  *  context_update() - 
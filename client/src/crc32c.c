@@ -0,0 +1,162 @@
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#   include <immintrin.h>
+#   define CRC32C_X86
+#endif
+
+#include "crc32c.h"
+
+#define CRC32C_POLY 0x82F63B78u
+
+typedef uint32_t (*Crc32cFn)(uint32_t, const uint8_t*, size_t);
+
+static uint32_t crc32c_slice[8][256];
+static Crc32cFn crc32c_fn;
+
+/*
+ *  crc32c_sw() -
+ *
+ *  Portable 'crc32c()' kernel, folding eight bytes per step through the
+ *  slicing-by-8 tables.
+ */
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t* buf, size_t n) {
+
+    size_t i;
+    uint32_t lo;
+    uint32_t hi;
+
+    crc = ~crc;
+    for(i = 0; i + 8 <= n; i += 8) {
+        memcpy(&lo, buf + i, sizeof lo);
+        memcpy(&hi, buf + i + 4, sizeof hi);
+        lo ^= crc;
+        crc = crc32c_slice[7][lo & 0xff] ^
+              crc32c_slice[6][(lo >> 8) & 0xff] ^
+              crc32c_slice[5][(lo >> 16) & 0xff] ^
+              crc32c_slice[4][lo >> 24] ^
+              crc32c_slice[3][hi & 0xff] ^
+              crc32c_slice[2][(hi >> 8) & 0xff] ^
+              crc32c_slice[1][(hi >> 16) & 0xff] ^
+              crc32c_slice[0][hi >> 24];
+    }
+
+    for(; i < n; i++) {
+        crc = crc32c_slice[0][(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+#ifdef CRC32C_X86
+
+/*
+ *  crc32c_hw() -
+ *
+ *  SSE4.2 'crc32c()' kernel, using the 'crc32' instruction on eight bytes
+ *  at a time.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t* buf, size_t n) {
+
+    size_t i;
+    uint64_t w;
+    uint64_t c;
+
+    c = ~crc;
+    for(i = 0; i + sizeof w <= n; i += sizeof w) {
+        memcpy(&w, buf + i, sizeof w);
+        c = _mm_crc32_u64(c, w);
+    }
+
+    crc = (uint32_t)c;
+    for(; i < n; i++) {
+        crc = _mm_crc32_u8(crc, buf[i]);
+    }
+
+    return ~crc;
+}
+
+#endif  /* CRC32C_X86 */
+
+/*
+ *  crc32c_init() -
+ *
+ *  Builds the slicing-by-8 tables and selects the fastest kernel.
+ */
+__attribute__((constructor))
+static void crc32c_init(void) {
+
+    size_t i;
+    size_t k;
+    uint32_t crc;
+
+    for(i = 0; i < 256; i++) {
+        crc = (uint32_t)i;
+        for(k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+        }
+        crc32c_slice[0][i] = crc;
+    }
+
+    for(i = 0; i < 256; i++) {
+        for(k = 1; k < 8; k++) {
+            crc = crc32c_slice[k - 1][i];
+            crc32c_slice[k][i] = crc32c_slice[0][crc & 0xff] ^ (crc >> 8);
+        }
+    }
+
+    crc32c_kernel(NULL);
+}
+
+/*
+ *  crc32c_kernel() -
+ *
+ *  Selects the kernel used by 'crc32c()'.
+ *
+ *  @name: Name of the kernel ("sse4.2" or "slice8"), or 'NULL' to pick the
+ *         fastest one the CPU supports.
+ *
+ *  return:
+ *    - The name of the selected kernel.
+ *    - 'NULL' if the requested kernel is not supported.
+ */
+const char* crc32c_kernel(const char* name) {
+
+#ifdef CRC32C_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse4.2") && (!name || !strcmp(name, "sse4.2"))) {
+        crc32c_fn = crc32c_hw;
+        return "sse4.2";
+    }
+#endif  /* CRC32C_X86 */
+
+    if(!name || !strcmp(name, "slice8")) {
+        crc32c_fn = crc32c_sw;
+        return "slice8";
+    }
+
+    return NULL;
+}
+
+/*
+ *  crc32c() -
+ *
+ *  Computes the CRC-32C (Castagnoli) checksum of a buffer, continuing from
+ *  a previous value.
+ *
+ *  @crc: The CRC-32C of the preceding data, or '0' to start a new checksum.
+ *  @buf: Pointer to the data buffer.
+ *  @n  : The number of bytes in the data buffer.
+ *
+ *  return:
+ *    - The CRC-32C of the preceding data followed by the buffer.
+ */
+uint32_t crc32c(uint32_t crc, const uint8_t* buf, size_t n) {
+
+    assert(buf || !n);
+
+    return crc32c_fn(crc, buf, n);
+}
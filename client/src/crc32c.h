@@ -0,0 +1,38 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ *  crc32c() -
+ *
+ *  Computes the CRC-32C (Castagnoli) checksum of a buffer, continuing from
+ *  a previous value. CRC-32C catches every burst error up to 32 bits long,
+ *  where CRC-8 lets one corrupted frame in 256 through.
+ *
+ *  @crc: The CRC-32C of the preceding data, or '0' to start a new checksum.
+ *  @buf: Pointer to the data buffer.
+ *  @n  : The number of bytes in the data buffer.
+ *
+ *  return:
+ *    - The CRC-32C of the preceding data followed by the buffer.
+ */
+extern uint32_t crc32c(uint32_t crc, const uint8_t* buf, size_t n);
+
+/*
+ *  crc32c_kernel() -
+ *
+ *  Selects the kernel used by 'crc32c()'. The fastest kernel the CPU
+ *  supports is picked at startup, so this is only needed to force a choice.
+ *
+ *  @name: Name of the kernel ("sse4.2" or "slice8"), or 'NULL' to pick the
+ *         fastest one the CPU supports.
+ *
+ *  return:
+ *    - The name of the selected kernel.
+ *    - 'NULL' if the requested kernel is not supported.
+ */
+extern const char* crc32c_kernel(const char* name);
+
+#endif  /* CRC32C_H */
@@ -0,0 +1,52 @@
+
+#include "csum.h"
+
+/*
+ *  csum() -
+ *
+ *  Computes the checksum of a buffer with the given algorithm, continuing
+ *  from a previous value.
+ *
+ *  @type: Checksum algorithm.
+ *  @crc : The checksum of the preceding data, or '0' to start a new one.
+ *  @buf : Pointer to the data buffer.
+ *  @n   : The number of bytes in the data buffer.
+ *
+ *  return:
+ *    - The checksum of the preceding data followed by the buffer.
+ *    - '0' if the algorithm is not supported.
+ */
+uint32_t csum(int type, uint32_t crc, const uint8_t* buf, size_t n) {
+
+    switch(type) {
+
+        case CSUM_CRC8:
+            return crc8((uint8_t)crc, buf, n);
+
+        case CSUM_CRC32C:
+            return crc32c(crc, buf, n);
+    }
+
+    return 0;
+}
+
+/*
+ *  csum_pick() -
+ *
+ *  Picks the strongest supported algorithm among the offered ones.
+ *
+ *  @offer: Bit mask of the offered algorithms.
+ *
+ *  return:
+ *    - The picked algorithm.
+ *    - '0' if none of the offered algorithms is supported.
+ */
+int csum_pick(int offer) {
+
+    offer &= CSUM_SUPPORTED;
+    if(offer & CSUM_CRC32C) {
+        return CSUM_CRC32C;
+    }
+
+    return offer & CSUM_CRC8;
+}
@@ -0,0 +1,56 @@
+#ifndef CSUM_H
+#define CSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "crc8.h"
+#include "crc32c.h"
+
+/*
+ *  Checksum algorithms a frame may be protected with. The values are bits,
+ *  so a handshake request can offer several of them at once.
+ */
+enum CsumType {
+
+    CSUM_CRC8   = 0x01,
+    CSUM_CRC32C = 0x02
+};
+
+typedef enum CsumType CsumType;
+
+#define CSUM_SUPPORTED  (CSUM_CRC8 | CSUM_CRC32C)
+
+#define csum_known(type)    ((type) == CSUM_CRC8 || (type) == CSUM_CRC32C)
+
+/*
+ *  csum() -
+ *
+ *  Computes the checksum of a buffer with the given algorithm, continuing
+ *  from a previous value.
+ *
+ *  @type: Checksum algorithm.
+ *  @crc : The checksum of the preceding data, or '0' to start a new one.
+ *  @buf : Pointer to the data buffer.
+ *  @n   : The number of bytes in the data buffer.
+ *
+ *  return:
+ *    - The checksum of the preceding data followed by the buffer.
+ *    - '0' if the algorithm is not supported.
+ */
+extern uint32_t csum(int type, uint32_t crc, const uint8_t* buf, size_t n);
+
+/*
+ *  csum_pick() -
+ *
+ *  Picks the strongest supported algorithm among the offered ones.
+ *
+ *  @offer: Bit mask of the offered algorithms.
+ *
+ *  return:
+ *    - The picked algorithm.
+ *    - '0' if none of the offered algorithms is supported.
+ */
+extern int csum_pick(int offer);
+
+#endif  /* CSUM_H */
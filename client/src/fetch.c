@@ -0,0 +1,784 @@
+
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fetch.h"
+#include "writer.h"
+
+/*
+ *  process_error() -
+ *
+ *  Processes an error package.
+ *
+ *  @pkg: The package containing the error message.
+ *  @sock: Pointer to the socket.
+ */
+static void process_error(const Pkg* pkg, Socket* sock) {
+
+    char str[sizeof pkg->data.content + 1];
+    size_t n;
+
+    assert(pkg);
+
+    n = pkg->data.size;
+    str[n] = 0;
+    memcpy(str, pkg->data.content, n);
+    printf(RED"%s"RESET"\n", str);
+
+    pkgsend_ack(sock, PkgCheck(pkg), PkgSess(pkg));
+}
+
+/*
+ *  fetch_reserve() -
+ *
+ *  Reserves the blocks of the file for the asset, once per download.
+ *  Free space is only needed for the bytes still to be written, and only
+ *  for those whose blocks are not allocated yet, as those of a resumed
+ *  download may be.
+ *
+ *  @fetch: Pointer to the download, whose size is known.
+ *  @left : Number of bytes of the asset still to be written.
+ *
+ *  return:
+ *    - '1' if the file has room for the asset, or if that cannot be told.
+ *    - '0' if there is no room for it.
+ */
+static int fetch_reserve(Fetch* fetch, off_t left) {
+
+    off_t need;
+    struct stat st;
+    struct statvfs vfs;
+
+    need = (off_t)fetch->size;
+    if(!fstat(fetch->fd, &st)) {
+        need -= (off_t)st.st_blocks * 512;
+    }
+
+    if(need > left) {
+        need = left;
+    }
+
+    if(need > 0 && !fstatvfs(fetch->fd, &vfs) && (off_t)(vfs.f_frsize * vfs.f_bavail) < need) {
+        printf(RED"Not enough disk space for the asset."RESET"\n");
+        return 0;
+    }
+
+    if(!writer_reserve(fetch->fd, fetch->size)) {
+        printf(RED"Not enough disk space for the asset."RESET"\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ *  fetch_sized() -
+ *
+ *  Learns the size of the asset from the context that fetched the first
+ *  piece, which tells where the rest of the asset lies, reserves the
+ *  blocks of the file and lets the streams waiting for it go on. The
+ *  download fails if the file has no room for the asset.
+ *
+ *  @fetch: Pointer to the download.
+ *  @size : Size of the asset.
+ *  @end  : File offset the first piece ends at, or zero if it spans the
+ *          rest of the asset.
+ *
+ *  return:
+ *    - '1' if the download goes on.
+ *    - '0' if it failed.
+ */
+static int fetch_sized(Fetch* fetch, uint64_t size, off_t end) {
+
+    int ret;
+
+    pthread_mutex_lock(&fetch->lock);
+    if(!fetch->sized) {
+        fetch->sized       = 1;
+        fetch->size        = size;
+        fetch->gaps[0].end = (off_t)size;
+        fetch->next        = end && end < (off_t)size ? end : (off_t)size;
+        fetch->left        = (off_t)size - fetch->next;
+        if(!fetch->left) {
+            fetch->cur = fetch->n;
+        }
+
+        if(!fetch_reserve(fetch, (off_t)size)) {
+            fetch->failed = 1;
+        }
+        pthread_cond_broadcast(&fetch->cond);
+    }
+    ret = !fetch->failed;
+    pthread_mutex_unlock(&fetch->lock);
+
+    return ret;
+}
+
+/*
+ *  process_context() -
+ *
+ *  Handles the context processing loop by receiving the packages of the
+ *  session, updating the context accordingly and answering every few
+ *  packages, as soon as the server asks for it or once packages stop
+ *  coming, and handling the context end condition. The download the
+ *  context fetches a piece of learns the size of the asset as soon as
+ *  the context does. The context is cancelled, and fails, if the
+ *  download fails then, and is cancelled once it received its piece up
+ *  to where another stream took the rest over. A context that receives
+ *  nothing for 'FETCH_STALL' microseconds is cancelled and stalls.
+ *
+ *  @ctx : Pointer to the 'Context' structure.
+ *  @sock: Pointer to the socket.
+ *  @fs  : Pointer to the stream of the download, or 'NULL'.
+ *
+ *  return:
+ *    - '1' if the context ended.
+ *    - '0' if it stalled.
+ */
+static int process_context(Context* ctx, Socket* sock, FetchStream* fs) {
+
+    int push;
+    size_t count;
+    off_t end;
+    Pkg pkg;
+    Pkg* rcv;
+    Fetch* fetch;
+
+    assert(ctx);
+
+    fetch = fs ? fs->fetch : NULL;
+    count = 0;
+    for(;;) {
+        rcv = pkgrecv(&pkg, sock, count ? CTX_ACK_DELAY : FETCH_STALL);
+        if(!rcv && count) {
+            debug("sending delayed response.\n");
+            pkgsend(&ctx->win.buf, sock);
+            count = 0;
+            continue;
+        }
+
+        if(!rcv) {
+            debug("context stalled: %zu packages received.\n", ctx->k);
+            pkgsend_cancel(sock, ctx->check, ctx->sess);
+            return 0;
+        }
+
+        if(ispkg(rcv) && PkgSess(rcv) == ctx->sess) {
+            count++;
+            push = PkgPush(rcv);
+            debug("received package %zu.\n", (size_t)rcv->data.indx);
+            context_update(ctx, rcv);
+            if(fetch && ctx->range.size && !ctx->invalid) {
+                if(!fetch_sized(fetch, ctx->range.size, ctx->range.end)) {
+                    debug("cancelling context.\n");
+                    pkgsend_cancel(sock, ctx->check, ctx->sess);
+                    ctx->error = 1;
+                    break;
+                }
+                fetch = NULL;
+            }
+
+            if(CtxCompleted(ctx)) {
+                debug("finalizing context.\n");
+                pkgsend_ack(sock, ctx->check, ctx->sess);
+                break;
+            }
+
+            if(fs) {
+                __atomic_store_n(&fs->pos, ctx->ooo.off, __ATOMIC_RELAXED);
+                end = __atomic_load_n(&fs->end, __ATOMIC_RELAXED);
+                if(end < ctx->range.end && ctx->ooo.off >= end) {
+                    debug("piece taken over from %lld.\n", (long long)end);
+                    pkgsend_cancel(sock, ctx->check, ctx->sess);
+                    ctx->completed = 1;
+                    break;
+                }
+            }
+
+            if(push || count >= ctx->win.i) {
+                debug("sending response.\n");
+                pkgsend(&ctx->win.buf, sock);
+                count = 0;
+            }
+        }
+    }
+
+    debug("context completed: %zu packages received.\n", ctx->k);
+
+    return 1;
+}
+
+/*
+ *  fetch_context() -
+ *
+ *  Runs a context through a socket: sends its request until the server
+ *  answers, backing the retransmission timeout off while it does not,
+ *  then receives the packages of the session until the context
+ *  completes. The socket only receives the frames of the session. A
+ *  request left unanswered for 'FETCH_STALL' microseconds is given up.
+ *
+ *  @ctx : Pointer to the initialized context.
+ *  @sock: Pointer to the socket.
+ *  @fs  : Pointer to the stream of the download the context fetches a
+ *         piece of, told the size of the asset once known, or 'NULL'.
+ *
+ *  return:
+ *    - '1' if the context completed.
+ *    - '0' if the server refused it, answered with unsupported
+ *      parameters or stopped answering.
+ */
+int fetch_context(Context* ctx, Socket* sock, FetchStream* fs) {
+
+    size_t rto;
+    size_t waited;
+    Pkg pkg;
+    Pkg* rcv;
+
+    assert(ctx);
+    assert(sock);
+
+    if(!socket_session(sock, ctx->sess)) {
+        return 0;
+    }
+
+    rto = CTX_RTO_INIT;
+    waited = 0;
+    for(;;) {
+        pkgsend(&ctx->win.buf, sock);
+        rcv = pkgrecv(&pkg, sock, rto);
+        if(!rcv) {
+            waited += rto;
+            if(waited >= FETCH_STALL) {
+                printf(RED"The server does not answer."RESET"\n");
+                return 0;
+            }
+            rto = rto < CTX_RTO_MAX / 2 ? 2 * rto : CTX_RTO_MAX;
+            continue;
+        }
+
+        if(pkgvalid(rcv) && PkgSess(rcv) == ctx->sess) {
+            if(PkgAck(rcv)) {
+                if(context_handshake(ctx, rcv)) {
+                    socket_peer(sock, sock->from);
+                    return process_context(ctx, sock, fs);
+                }
+                printf(RED"Unsupported server parameters."RESET"\n");
+                return 0;
+            } else {
+                if(PkgError(rcv)) {
+                    socket_peer(sock, sock->from);
+                    process_error(rcv, sock);
+                    return 0;
+                }
+            }
+        }
+    }
+}
+
+/*
+ *  fetch_order() -
+ *
+ *  Orders records of a sidecar file by the offset they start at.
+ *
+ *  @a: Pointer to a record.
+ *  @b: Pointer to another record.
+ *
+ *  return:
+ *    - A negative, zero or positive number as the first record starts
+ *      before, at or after the other.
+ */
+static int fetch_order(const void* a, const void* b) {
+
+    const WriterMark* x = a;
+    const WriterMark* y = b;
+
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+/*
+ *  fetch_resume() -
+ *
+ *  Reads the sidecar file left by earlier downloads of the file and finds
+ *  the gaps between the ranges they wrote, which are left to fetch. The
+ *  records of the download follow theirs.
+ *
+ *  @fetch: Pointer to the download, whose files are open.
+ *
+ *  return:
+ *    - '1' if the download can go on from where they stopped.
+ *    - '0' if it has to start over.
+ */
+static int fetch_resume(Fetch* fetch) {
+
+    size_t i;
+    size_t n;
+    ssize_t len;
+    off_t pos;
+    struct stat st;
+    WriterMark marks[FETCH_MARKS];
+
+    if(pread(fetch->part, &fetch->size, sizeof fetch->size, 0) != sizeof fetch->size || !fetch->size) {
+        return 0;
+    }
+
+    len = pread(fetch->part, marks, sizeof marks, sizeof fetch->size);
+    if(len < 0 || fstat(fetch->fd, &st)) {
+        return 0;
+    }
+
+    n = (size_t)len / sizeof *marks;
+    if(n == FETCH_MARKS) {
+        return 0;
+    }
+
+    qsort(marks, n, sizeof *marks, fetch_order);
+
+    pos = 0;
+    fetch->n    = 0;
+    fetch->left = 0;
+    for(i = 0; i < n; i++) {
+        if(marks[i].done > fetch->size || (off_t)marks[i].done > st.st_size) {
+            return 0;
+        }
+
+        if((off_t)marks[i].start > pos) {
+            fetch->gaps[fetch->n].start = pos;
+            fetch->gaps[fetch->n].end   = (off_t)marks[i].start;
+            fetch->left += (off_t)marks[i].start - pos;
+            fetch->n++;
+        }
+
+        if((off_t)marks[i].done > pos) {
+            pos = (off_t)marks[i].done;
+        }
+    }
+
+    if(pos < (off_t)fetch->size) {
+        fetch->gaps[fetch->n].start = pos;
+        fetch->gaps[fetch->n].end   = (off_t)fetch->size;
+        fetch->left += (off_t)fetch->size - pos;
+        fetch->n++;
+    }
+
+    fetch->sized = 1;
+    fetch->marks = n;
+    fetch->cur   = 0;
+    fetch->next  = fetch->n ? fetch->gaps[0].start : 0;
+
+    debug("resuming with %zu bytes left in %zu gaps.\n", (size_t)fetch->left, fetch->n);
+
+    return 1;
+}
+
+/*
+ *  fetch_open() -
+ *
+ *  Opens the sidecar file of a download and the file itself, going on
+ *  from where earlier downloads stopped if asked to and if their sidecar
+ *  file tells where, and starting over otherwise. A download that goes on
+ *  reserves the file right away and fails if the gaps left do not fit.
+ *
+ *  @fetch : Pointer to the download.
+ *  @resume: Whether to go on from where earlier downloads stopped.
+ *
+ *  return:
+ *    - '1' if the files are open.
+ *    - '0' on failure.
+ */
+static int fetch_open(Fetch* fetch, int resume) {
+
+    size_t n;
+
+    n = strlen(fetch->path);
+    fetch->name = malloc(n + sizeof FETCH_SUFFIX);
+    if(!fetch->name) {
+        return 0;
+    }
+
+    memcpy(fetch->name, fetch->path, n);
+    memcpy(fetch->name + n, FETCH_SUFFIX, sizeof FETCH_SUFFIX);
+
+    if(resume) {
+        fetch->part = open(fetch->name, O_RDWR);
+        fetch->fd   = open(fetch->path, O_WRONLY);
+        if(fetch->part >= 0 && fetch->fd >= 0 && fetch_resume(fetch)) {
+            if(!fetch_reserve(fetch, fetch->left)) {
+                fetch->failed = 1;
+            }
+            return 1;
+        }
+
+        if(fetch->part >= 0) {
+            close(fetch->part);
+        }
+
+        if(fetch->fd >= 0) {
+            close(fetch->fd);
+        }
+    }
+
+    fetch->size  = 0;
+    fetch->sized = 0;
+    fetch->marks = 0;
+    fetch->left  = 0;
+    fetch->next  = 0;
+    fetch->cur   = 0;
+    fetch->n     = 1;
+    fetch->gaps[0].start = 0;
+    fetch->gaps[0].end   = 0;
+
+    fetch->part = open(fetch->name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    fetch->fd   = open(fetch->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    return fetch->part >= 0 && fetch->fd >= 0;
+}
+
+/*
+ *  fetch_split() -
+ *
+ *  Takes over the second half of the piece with the most bytes left to
+ *  receive for a stream with no piece left to take, if either half is at
+ *  least 'FETCH_PIECE_MIN' bytes long. The stream fetching the piece
+ *  stops where the half taken over starts. Called with the download
+ *  locked.
+ *
+ *  @fs   : Pointer to the stream.
+ *  @range: Pointer to the range that will hold the half.
+ *
+ *  return:
+ *    - '1' if the stream took a half over.
+ *    - '0' if no piece is long enough to split.
+ */
+static int fetch_split(FetchStream* fs, CtxRange* range) {
+
+    size_t i;
+    off_t pos;
+    off_t most;
+    Fetch* fetch;
+    FetchStream* big;
+
+    fetch = fs->fetch;
+    big  = NULL;
+    most = 0;
+    for(i = 0; i < fetch->streams; i++) {
+        pos = __atomic_load_n(&fetch->stream[i].pos, __ATOMIC_RELAXED);
+        if(fetch->stream[i].end - pos > most) {
+            big  = &fetch->stream[i];
+            most = big->end - pos;
+            range->start = pos + most / 2;
+            range->end   = big->end;
+        }
+    }
+
+    if(most < 2 * FETCH_PIECE_MIN) {
+        return 0;
+    }
+
+    debug("splitting the piece ending at %lld.\n", (long long)big->end);
+    __atomic_store_n(&big->end, range->start, __ATOMIC_RELAXED);
+
+    return 1;
+}
+
+/*
+ *  fetch_take() -
+ *
+ *  Takes the next piece of the asset for a stream, waiting for the size
+ *  of the asset if the first piece is being fetched without it. A single
+ *  stream takes whole gaps. Once every gap is handed out, the stream
+ *  takes over half of the piece of another stream instead.
+ *
+ *  @fs   : Pointer to the stream.
+ *  @range: Pointer to the range that will hold the piece.
+ *
+ *  return:
+ *    - '1' if the stream has a piece to fetch.
+ *    - '0' if none is left, or if the download failed.
+ */
+static int fetch_take(FetchStream* fs, CtxRange* range) {
+
+    int ret;
+    off_t len;
+    Fetch* fetch;
+    FetchGap* gap;
+
+    ret = 0;
+    fetch = fs->fetch;
+    pthread_mutex_lock(&fetch->lock);
+    while(!fetch->failed && !fetch->sized && fetch->busy) {
+        pthread_cond_wait(&fetch->cond, &fetch->lock);
+    }
+
+    if(!fetch->failed && fetch->cur < fetch->n) {
+        gap = &fetch->gaps[fetch->cur];
+        range->start = fetch->next;
+        if(!fetch->sized) {
+            range->end  = fetch->streams > 1 ? fetch->next + FETCH_PIECE_MIN : 0;
+            fetch->next = range->end;
+        } else {
+            len = fetch->left / (off_t)(FETCH_SHARE * fetch->streams);
+            if(len < FETCH_PIECE_MIN) {
+                len = FETCH_PIECE_MIN;
+            }
+
+            if(fetch->streams == 1 || len > gap->end - fetch->next) {
+                len = gap->end - fetch->next;
+            }
+
+            range->end    = fetch->next + len;
+            fetch->next  += len;
+            fetch->left  -= len;
+            if(fetch->next >= gap->end) {
+                fetch->cur++;
+                if(fetch->cur < fetch->n) {
+                    fetch->next = fetch->gaps[fetch->cur].start;
+                }
+            }
+        }
+        ret = 1;
+    } else {
+        if(!fetch->failed && fetch->marks < FETCH_MARKS) {
+            ret = fetch_split(fs, range);
+        }
+    }
+
+    if(ret) {
+        range->fd   = fetch->fd;
+        range->part = fetch->part;
+        range->size = fetch->sized ? fetch->size : 0;
+        range->slot = (off_t)(sizeof fetch->size + fetch->marks * sizeof(WriterMark));
+        fetch->marks++;
+        fetch->busy++;
+        fs->pos = range->start;
+        __atomic_store_n(&fs->end, range->end, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&fetch->lock);
+
+    return ret;
+}
+
+/*
+ *  fetch_requeue() -
+ *
+ *  Hands the bytes of a piece a stalled context did not receive back to
+ *  the download, as a gap after the others, for a stream to fetch them
+ *  again.
+ *
+ *  @fs : Pointer to the stream whose context stalled.
+ *  @off: File offset the context received the piece up to.
+ *
+ *  return:
+ *    - '1' if the rest of the piece will be fetched again.
+ *    - '0' if it cannot be.
+ */
+static int fetch_requeue(FetchStream* fs, off_t off) {
+
+    int ret;
+    off_t end;
+    Fetch* fetch;
+
+    ret = 0;
+    fetch = fs->fetch;
+    pthread_mutex_lock(&fetch->lock);
+    end = fs->end;
+    if(!end || end > (off_t)fetch->size) {
+        end = (off_t)fetch->size;
+    }
+
+    if(fetch->sized && fetch->n <= FETCH_MARKS) {
+        if(off < end) {
+            debug("fetching bytes %lld to %lld again.\n", (long long)off, (long long)end);
+            if(fetch->cur == fetch->n) {
+                fetch->next = off;
+            }
+            fetch->gaps[fetch->n].start = off;
+            fetch->gaps[fetch->n].end   = end;
+            fetch->left += end - off;
+            fetch->n++;
+        }
+        ret = 1;
+    }
+    pthread_mutex_unlock(&fetch->lock);
+
+    return ret;
+}
+
+/*
+ *  fetch_done() -
+ *
+ *  Accounts for the end of the context a stream fetched a piece with. A
+ *  first piece that ended without telling the size of the asset leaves
+ *  nothing to fetch.
+ *
+ *  @fs     : Pointer to the stream.
+ *  @ok     : Whether every byte of the piece was written, or will be.
+ *  @changed: Whether the asset changed since the download started.
+ */
+static void fetch_done(FetchStream* fs, int ok, int changed) {
+
+    Fetch* fetch;
+
+    fetch = fs->fetch;
+    pthread_mutex_lock(&fetch->lock);
+    fetch->busy--;
+    __atomic_store_n(&fs->end, 0, __ATOMIC_RELAXED);
+    fs->pos = 0;
+    if(!ok) {
+        fetch->failed = 1;
+    }
+
+    if(changed) {
+        fetch->changed = 1;
+    }
+
+    if(!fetch->sized) {
+        fetch->sized = 1;
+        fetch->cur   = fetch->n;
+    }
+    pthread_cond_broadcast(&fetch->cond);
+    pthread_mutex_unlock(&fetch->lock);
+}
+
+/*
+ *  fetch_stream() -
+ *
+ *  Runs a stream: fetches one piece of the asset after another through
+ *  the socket of the stream, each with a context of its own, until none
+ *  is left. The bytes of a piece whose context stalled are fetched again
+ *  if it received any, and the download fails otherwise.
+ *
+ *  @arg: Pointer to the stream.
+ *
+ *  return:
+ *    - 'NULL' once no piece is left.
+ */
+static void* fetch_stream(void* arg) {
+
+    int ok;
+    CtxRange range;
+    Context* ctx;
+    Fetch* fetch;
+    FetchStream* fs;
+
+    fs    = arg;
+    fetch = fs->fetch;
+    while(fetch_take(fs, &range)) {
+        debug("fetching bytes %lld to %lld.\n", (long long)range.start, (long long)range.end);
+
+        ok  = 0;
+        ctx = context_create();
+        if(ctx && context_init(ctx, CTX_DOWNLOAD, fetch->path, fetch->mtu, fetch->window, &range)) {
+            ok = fetch_context(ctx, fs->sock, fs);
+            context_deinit(ctx);
+            if(!CtxCompleted(ctx) && !ctx->error && ctx->ooo.off > range.start) {
+                ok = fetch_requeue(fs, ctx->ooo.off);
+            } else {
+                ok = ok && CtxCompleted(ctx) && !ctx->invalid && !ctx->error;
+            }
+        }
+
+        fetch_done(fs, ok, ctx && ctx->invalid);
+        context_free(&ctx);
+    }
+
+    return NULL;
+}
+
+/*
+ *  fetch_download() -
+ *
+ *  Downloads an asset over one stream per socket, each fetching pieces of
+ *  it until none is left. The first stream runs on the calling thread,
+ *  the others on threads of their own. The download goes on from where
+ *  earlier ones of the same file stopped if asked to, and the sidecar
+ *  file recording its progress goes once every byte is written.
+ *
+ *  @socks  : Sockets of the streams.
+ *  @n      : Number of streams, at most 'FETCH_MAX'.
+ *  @path   : Name of the asset, and path of the file.
+ *  @mtu    : Largest frame the local interface can carry.
+ *  @window : Number of bytes each stream offers to hold out of order.
+ *  @resume : Whether to go on from where earlier downloads stopped.
+ *
+ *  return:
+ *    - '1' if every byte of the asset was written.
+ *    - '0' otherwise.
+ */
+int fetch_download(Socket** socks, size_t n, const char* path, size_t mtu, size_t window, int resume) {
+
+    int ret;
+    size_t i;
+    size_t started;
+    Fetch* fetch;
+    FetchStream streams[FETCH_MAX];
+
+    assert(socks);
+    assert(n && n <= FETCH_MAX);
+
+    fetch = calloc(1, sizeof *fetch);
+    if(!fetch) {
+        return 0;
+    }
+
+    fetch->path    = path;
+    fetch->mtu     = mtu;
+    fetch->window  = window;
+    fetch->streams = n;
+    fetch->fd      = -1;
+    fetch->part    = -1;
+
+    ret = 0;
+    if(fetch_open(fetch, resume)) {
+        pthread_mutex_init(&fetch->lock, NULL);
+        pthread_cond_init(&fetch->cond, NULL);
+
+        fetch->stream = streams;
+        for(i = 0; i < n; i++) {
+            streams[i].fetch = fetch;
+            streams[i].sock  = socks[i];
+            streams[i].pos   = 0;
+            streams[i].end   = 0;
+        }
+
+        for(started = 1; started < n; started++) {
+            if(pthread_create(&streams[started].thread, NULL, fetch_stream, &streams[started])) {
+                break;
+            }
+        }
+
+        fetch_stream(&streams[0]);
+        for(i = 1; i < started; i++) {
+            pthread_join(streams[i].thread, NULL);
+        }
+
+        ret = !fetch->failed && fetch->sized && fetch->cur == fetch->n;
+        if(fetch->changed) {
+            printf(RED"The asset changed since the download stopped, download it again without '--resume'."RESET"\n");
+        }
+
+        pthread_cond_destroy(&fetch->cond);
+        pthread_mutex_destroy(&fetch->lock);
+    }
+
+    if(fetch->fd >= 0) {
+        close(fetch->fd);
+    }
+
+    if(fetch->part >= 0) {
+        close(fetch->part);
+    }
+
+    if(ret) {
+        unlink(fetch->name);
+    }
+
+    free(fetch->name);
+    free(fetch);
+
+    return ret;
+}
@@ -0,0 +1,39 @@
+#ifndef FETCH_DEFS_H
+#define FETCH_DEFS_H
+
+/*
+ *  A download over several streams is cut into pieces, each fetched by a
+ *  context of its own on whichever stream is free. A piece is a share of
+ *  1 / ('FETCH_SHARE' * streams) of the bytes left, but never shorter than
+ *  'FETCH_PIECE_MIN' bytes, so pieces shrink towards the end of the asset
+ *  and a slow stream holds few of the last bytes back. While the size of
+ *  the asset is unknown, the first piece is 'FETCH_PIECE_MIN' bytes long
+ *  and the other streams wait for its descriptor. At most 'FETCH_MAX'
+ *  streams run at once.
+ */
+#define FETCH_PIECE_MIN ((off_t)1 << 24)
+#define FETCH_SHARE     2
+#define FETCH_MAX       16
+
+/*
+ *  A stream with no piece left to take splits the piece with the most
+ *  bytes left to receive in two and fetches the second half, as long as
+ *  either half is at least 'FETCH_PIECE_MIN' bytes long, so the streams
+ *  keep fetching until the last bytes arrive. A context that receives
+ *  nothing of its session for 'FETCH_STALL' microseconds, well beyond
+ *  the retransmission timeout of the server, or whose request goes
+ *  unanswered as long, is given up; the bytes of its piece it did not
+ *  receive are fetched again, if it received any.
+ */
+#define FETCH_STALL     (4 * CTX_RTO_MAX)
+
+/*
+ *  The sidecar file of a download is named after the file, with this
+ *  suffix, and removed once the download completes. A download starts
+ *  over rather than go on from a sidecar file holding 'FETCH_MARKS'
+ *  records or more.
+ */
+#define FETCH_SUFFIX    ".part"
+#define FETCH_MARKS     1024
+
+#endif  /* FETCH_DEFS_H */
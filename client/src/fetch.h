@@ -0,0 +1,118 @@
+#ifndef FETCH_H
+#define FETCH_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "fetch.defs.h"
+#include "context.h"
+#include "socket.h"
+
+/*
+ *  Range of the file still missing, from the offset 'start' up to 'end'.
+ */
+struct FetchGap {
+
+    off_t start;
+    off_t end;
+};
+
+typedef struct FetchGap FetchGap;
+typedef struct FetchStream FetchStream;
+
+/*
+ *  Download of the asset 'path' over the 'streams' streams of 'stream'
+ *  into the file 'fd', whose progress the sidecar file 'part', named
+ *  'name', records. The bytes not handed to a stream yet are the 'n'
+ *  gaps of 'gaps' from 'cur' on, the first of them from 'next' on, 'left'
+ *  bytes in all. The 'size' of the asset is known once 'sized' is set;
+ *  until then the only gap ends with the asset. The sidecar file holds
+ *  'marks' records. 'busy' streams are fetching a piece; 'failed' tells
+ *  one of them failed, 'changed' that the asset changed since the
+ *  download started.
+ */
+struct Fetch {
+
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    const char*     path;
+    char*           name;
+    size_t          mtu;
+    size_t          window;
+    size_t          streams;
+    FetchStream*    stream;
+    int             fd;
+    int             part;
+    uint64_t        size;
+    int             sized;
+    size_t          marks;
+    size_t          busy;
+    int             failed;
+    int             changed;
+    off_t           left;
+    off_t           next;
+    size_t          cur;
+    size_t          n;
+    FetchGap        gaps[FETCH_MARKS + 1];
+};
+
+typedef struct Fetch Fetch;
+
+/*
+ *  Stream of a download: a socket through which the contexts fetching
+ *  pieces of the asset run one after the other, on a thread of its own.
+ *  The piece it fetches ends at 'end', zero once it has none, and was
+ *  received up to 'pos'. Another stream may move 'end' back to take over
+ *  the rest of the piece, so both are accessed atomically.
+ */
+struct FetchStream {
+
+    Fetch*    fetch;
+    Socket*   sock;
+    pthread_t thread;
+    off_t     pos;
+    off_t     end;
+};
+
+/*
+ *  fetch_context() -
+ *
+ *  Runs a context through a socket: sends its request until the server
+ *  answers, then receives the packages of the session until the context
+ *  completes. A server silent for 'FETCH_STALL' microseconds is given up.
+ *
+ *  @ctx : Pointer to the initialized context.
+ *  @sock: Pointer to the socket.
+ *  @fs  : Pointer to the stream of the download the context fetches a
+ *         piece of, told the size of the asset once known, or 'NULL'.
+ *
+ *  return:
+ *    - '1' if the context completed.
+ *    - '0' if the server refused it, answered with unsupported
+ *      parameters or stopped answering.
+ */
+extern int fetch_context(Context* ctx, Socket* sock, FetchStream* fs);
+
+/*
+ *  fetch_download() -
+ *
+ *  Downloads an asset over one stream per socket, each fetching pieces of
+ *  it until none is left. The download goes on from where earlier ones
+ *  of the same file stopped if asked to.
+ *
+ *  @socks  : Sockets of the streams.
+ *  @n      : Number of streams, at most 'FETCH_MAX'.
+ *  @path   : Name of the asset, and path of the file.
+ *  @mtu    : Largest frame the local interface can carry.
+ *  @window : Number of bytes each stream offers to hold out of order.
+ *  @resume : Whether to go on from where earlier downloads stopped.
+ *
+ *  return:
+ *    - '1' if every byte of the asset was written.
+ *    - '0' otherwise.
+ */
+extern int fetch_download(Socket** socks, size_t n, const char* path, size_t mtu, size_t window, int resume);
+
+#endif  /* FETCH_H */
@@ -4,9 +4,9 @@
 #include <unistd.h>
 
 #include "context.h"
+#include "fetch.h"
 #include "socket.h"
 
-#define TIMEOUT 0
 #define DELTA   40
 
 /*
@@ -21,9 +21,10 @@ static void usage(const char* exec) {
 
     printf(
         "usage:\n"
-        "%s --i <network-interface> --list\n"
-        "%s --i <network-interface> --download <name>\n"
-        "%s --i <network-intergace> --download <name> --exec <executable>\n",
+        "%s --i <network-interface | udp:<host>:<port>> --list [options]\n"
+        "%s --i <network-interface | udp:<host>:<port>> --download <name> [options]\n"
+        "%s --i <network-interface | udp:<host>:<port>> --download <name> --exec <executable> [options]\n"
+        "options: [--rx-ring] [--tx-ring] [--xdp] [--ethertype <type>] [--promisc] [--window <bytes>] [--resume] [--streams <n>]\n",
         exec,
         exec,
         exec
@@ -39,24 +40,54 @@ static void usage(const char* exec) {
  *  @argc: Number of arguments passed on the command line.
  *  @argv: List of arguments passed on the command line.
  *  @type: Pointer to store the context type (list or download).
- *  @intf: Pointer to store the network interface.
+ *  @intf: Pointer to store the network interface, or the UDP address of
+ *         the server.
  *  @path: Pointer to store the file path to be downloaded.
  *  @exec: Pointer to store the executable's name.
+ *  @rings: Pointer to store the rings frames are exchanged through.
+ *  @ethertype: Pointer to store the EtherType of the frames to receive.
+ *  @promisc: Pointer to store whether to use promiscuous mode.
+ *  @window: Pointer to store the number of bytes to hold out of order,
+ *           best set to the bandwidth-delay product of the link.
+ *  @resume: Pointer to store whether a download goes on from where an
+ *           earlier one stopped.
+ *  @streams: Pointer to store the number of streams a download runs over,
+ *            which AF_XDP sockets do not allow more than one of.
  *
  *  return:
  *    - '1' if the arguments were parsed correctly.
  *    - '0' if there was an error parsing the arguments.
  */
-static int parse_args(int argc, char** argv, CtxType* type, char** intf, char** path, char** exec) {
+static int parse_args(int argc, char** argv, CtxType* type, char** intf, char** path, char** exec, int* rings, int* ethertype, int* promisc, size_t* window, int* resume, size_t* streams) {
 
     int ctx;
     int infc;
     int i;
+    char* end;
+    long val;
 
     assert(argv);
     assert(type);
     assert(path);
     assert(intf);
+    assert(exec);
+    assert(rings);
+    assert(ethertype);
+    assert(promisc);
+    assert(window);
+    assert(resume);
+    assert(streams);
+
+    *type = CTX_LS;
+    *intf = NULL;
+    *path = NULL;
+    *exec = NULL;
+    *rings = 0;
+    *ethertype = PKG_ETHERTYPE;
+    *promisc = 0;
+    *window = CTX_WINDOW;
+    *resume = 0;
+    *streams = 1;
 
     ctx = 0;
     infc = 0;
@@ -101,6 +132,58 @@ static int parse_args(int argc, char** argv, CtxType* type, char** intf, char**
                         } 
                         return 0;
                     } else {
+
+                        if(!strcmp(argv[i], "--rx-ring")) {
+                            *rings |= SOCKET_RX_RING;
+                            continue;
+                        }
+
+                        if(!strcmp(argv[i], "--tx-ring")) {
+                            *rings |= SOCKET_TX_RING;
+                            continue;
+                        }
+
+                        if(!strcmp(argv[i], "--xdp")) {
+                            *rings |= SOCKET_XDP;
+                            continue;
+                        }
+
+                        if(!strcmp(argv[i], "--promisc")) {
+                            *promisc = 1;
+                            continue;
+                        }
+
+                        if(!strcmp(argv[i], "--resume")) {
+                            *resume = 1;
+                            continue;
+                        }
+
+                        if(!strcmp(argv[i], "--ethertype") && i + 1 < argc) {
+                            val = strtol(argv[++i], &end, 0);
+                            if(*end || val <= 0 || val > UINT16_MAX) {
+                                return 0;
+                            }
+                            *ethertype = (int)val;
+                            continue;
+                        }
+
+                        if(!strcmp(argv[i], "--streams") && i + 1 < argc) {
+                            val = strtol(argv[++i], &end, 0);
+                            if(*end || val <= 0 || val > FETCH_MAX) {
+                                return 0;
+                            }
+                            *streams = (size_t)val;
+                            continue;
+                        }
+
+                        if(!strcmp(argv[i], "--window") && i + 1 < argc) {
+                            val = strtol(argv[++i], &end, 0);
+                            if(*end || val <= 0) {
+                                return 0;
+                            }
+                            *window = (size_t)val;
+                            continue;
+                        }
                         return 0;
                     }
                 }
@@ -109,7 +192,7 @@ static int parse_args(int argc, char** argv, CtxType* type, char** intf, char**
 
     }
 
-    return infc && ctx;
+    return infc && ctx && (*streams == 1 || !(*rings & SOCKET_XDP));
 }
 
 /*
@@ -157,125 +240,105 @@ static int runapp(const char* exec, const char* arg) {
 }
 
 /*
- *  process_error() - 
+ *  open_socket() -
  *
- *  Processes an error package.
+ *  Opens a socket on the interface, maps its rings if asked to and sizes
+ *  its buffers for the window, telling what failed if anything does.
  *
- *  @pkg: The package containing the error message.
- *  @sock: The socket descriptor.
- */
-static void process_error(const Pkg* pkg, int sock) {
-
-    char str[64];
-    size_t n;
-
-    assert(pkg);
-
-    n = pkg->data.size;
-    str[n] = 0;
-    memcpy(str, pkg->data.content, n);
-    printf(RED"%s"RESET"\n", str);
-
-    pkgsend_ack(sock);
-}
-
-/*
- *  process_context() -
- *
- *  Handles the context processing loop by sending windowed data and receiving
- *  packages, updating the context accordingly, and handling the context end
- *  condition.
+ *  @intf     : Network interface, or UDP address of the server.
+ *  @ethertype: EtherType of the frames to receive.
+ *  @promisc  : Whether to use promiscuous mode.
+ *  @rings    : Rings frames are exchanged through.
+ *  @window   : Number of bytes to hold out of order.
  *
- *  @ctx : Pointer to the 'Context' structure.
- *  @sock: Socket file descriptor.
+ *  return:
+ *    - Pointer to the socket.
+ *    - 'NULL' on failure.
  */
-static void process_context(Context* ctx, int sock) {
+static Socket* open_socket(const char* intf, int ethertype, int promisc, int rings, size_t window) {
 
-    size_t i;
-    size_t count;
-    Pkg pkg;
-
-    assert(ctx);
-
-    count = 0;
-    for(;;) {
-        for(i = 0; i < ctx->win.i; i++) {
-            if(pkgrecv(&pkg, sock, TIMEOUT) && ispkg(&pkg)) {
-                count++;   
-                if(!ctx->skip) {
-                    debug("received package %zu.\n", (size_t)pkg.data.indx);
-                    context_update(ctx, &pkg);
-                    if(CtxCompleted(ctx)) {
-                        debug("finalizing context.\n");
-                        pkgsend_ack(sock);
-                        goto _end;
-                    } else {
-                        if(ctx->ack) {
-                            i = 0;
-                            ctx->ack = 0;
-                        } 
-                    }
-                } 
-            }
+    Socket* sock;
 
-            if(count == ctx->win.i) {
-                debug("sending response.\n");
-                pkgsend(&ctx->win.buf, sock);
-                ctx->skip = 0;
-                count = 0;
-            }
-        }
+    sock = socket_create(intf, ethertype, promisc);
+    if(!sock) {
+        perror("error - failed to open socket");
+        return NULL;
+    }
+
+    if(rings && !socket_ring(sock, rings)) {
+        perror("error - failed to map socket rings");
+        socket_close(sock);
+        return NULL;
     }
 
-_end:
-    debug("context completed: %zu packages received.\n", ctx->k);
+    if(!socket_buffer(sock, window)) {
+        perror("error - failed to size socket buffers");
+        socket_close(sock);
+        return NULL;
+    }
 
+    return sock;
 }
 
 int main(int argc, char** argv) {
 
-    int sock;
+    int rings;
+    int promisc;
+    int resume;
+    int ethertype;
+    size_t i;
+    size_t n;
+    size_t mtu;
+    size_t window;
+    size_t streams;
     char* path;
     char* exec;
     char* intf;
 
-    Pkg pkg;
     CtxType type;
+    Socket* socks[FETCH_MAX];
     Context* ctx;
 
-    exec = NULL;
-    if(!parse_args(argc, argv, &type, &intf, &path, &exec)) {
+    if(!parse_args(argc, argv, &type, &intf, &path, &exec, &rings, &ethertype, &promisc, &window, &resume, &streams)) {
         usage(argv[0]);
         exit(1);
     }
 
-    sock = socket_create(intf);
-    if(sock < 0) {
-        perror("error - failed to open socket");
+    n = Download(type) ? streams : 1;
+    for(i = 0; i < n; i++) {
+        socks[i] = open_socket(intf, ethertype, promisc, rings, window);
+        if(!socks[i]) {
+            while(i--) {
+                socket_close(socks[i]);
+            }
+            return 1;
+        }
+    }
+
+    mtu = socket_mtu(socks[0], intf);
+    if(!mtu) {
+        perror("error - failed to get interface mtu");
+        for(i = 0; i < n; i++) {
+            socket_close(socks[i]);
+        }
         return 1;
     }
 
-    ctx = context_create();
-    if(ctx && context_init(ctx, type, path)) {
-        for(;;) {
-            pkgsend(&ctx->win.buf, sock);
-            if(pkgrecv(&pkg, sock, 0) && pkgvalid(&pkg)) {
-                if(PkgAck(&pkg)) {
-                    process_context(ctx, sock);
-                    break;
-                } else {
-                    if(PkgError(&pkg)) {
-                        process_error(&pkg, sock);
-                        exec = NULL;
-                        break;
-                    }
-                }
-            }
+    if(Download(type)) {
+        if(!fetch_download(socks, n, path, mtu, window, resume)) {
+            exec = NULL;
+        }
+    } else {
+        ctx = context_create();
+        if(!ctx || !context_init(ctx, type, path, mtu, window, NULL) || !fetch_context(ctx, socks[0], NULL)) {
+            exec = NULL;
         }
+        context_free(&ctx);
     }
 
-    context_free(&ctx);
-    socket_close(sock);
+    for(i = 0; i < n; i++) {
+        socket_close(socks[i]);
+    }
 
     if(exec) {
         if(!runapp(exec, path)) {
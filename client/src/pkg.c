@@ -1,72 +1,41 @@
 
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <time.h>
 #include <assert.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
 
 #include "pkg.h"
 #include "pkg.defs.h"
+#include "stuff.h"
 
 /*
- *  add_byte_to_pkg() -
+ *  pkgcsum() -
  *
- *  Adds a byte to the package at the specified index, with special 
- *  handling for certain byte values.
+ *  Computes the checksum of a package, covering the header fields that
+ *  follow the marker and precede the checksum, and then the content.
  *
- *  @pkg : Pointer to the Pkg structure where the byte will be added.
- *  @byte: Byte value to add to the package.
- */
-static void add_byte_to_pkg(Pkg* pkg, uint8_t byte) {
-
-    size_t i;
-
-    assert(pkg);
-
-    i = pkg->data.size;
-    pkg->data.content[i] = byte;
-    if(byte == 0x81 || byte == 0x88) {
-        if(i + 1 < sizeof pkg->data.content) {
-            pkg->data.content[i + 1] = 0xff;
-            i++;
-        }
-    }
-    pkg->data.size = ++i;
-}
-
-/*
- *  pkgread() - 
- *
- *  Reads data from a file into the package, handling special byte values.
- *
- *  @pkg: Pointer to the Pkg structure where the data will be stored.
- *  @fp : Pointer to the FILE object from which data will be read.
+ *  @pkg: Pointer to the Pkg structure.
  *
  *  return:
- *    -  '1' if the data is successfully read and stored in the package.
- *    -  '0' if there is an error reading from the file.
- *    - '-1' if there was nothing left to read.
+ *    - The checksum of the package, with the algorithm named in its header.
  */
-int pkgread(Pkg* pkg, FILE* fp) {
+static inline uint32_t pkgcsum(const Pkg* pkg) {
 
-    int ret;
-    uint8_t byte;
+    uint32_t crc;
 
     assert(pkg);
-    assert(fp);
-   
-    ret = 1;
-    pkg->data.size = 0;
-    for(; pkg->data.size < sizeof pkg->data.content;) {
-        if(fread(&byte, sizeof byte, 1, fp) != 1) {
-            if(feof(fp)) {
-                ret = -1;
-                break;
-            }
-        }
-        add_byte_to_pkg(pkg, byte);
-    }
 
-    return ret;
+    crc = csum(
+        pkg->data.check,
+        0,
+        &pkg->data.version,
+        offsetof(Pkg, data.csum) - offsetof(Pkg, data.version)
+    );
+
+    return csum(pkg->data.check, crc, pkg->data.content, pkg->data.size);
 }
 
 /*
@@ -83,161 +52,253 @@ int pkgread(Pkg* pkg, FILE* fp) {
 int ispkg(const Pkg* pkg) {
 
     assert(pkg);
-    return pkg->data.marker == PKG_MARKER;
+    return pkg->data.marker == PKG_MARKER && pkg->data.version == PKG_VERSION;
 }
 
 /*
- *  timestamp() -
+ *  pkgtime() -
  *
- *  Gets the current timestamp in milliseconds.
+ *  Gets the current time of a clock that never jumps, in microseconds.
  *
  *  return:
- *    - The current timestamp in milliseconds since the Epoch.
+ *    - The current time in microseconds since an unspecified point.
  */
-static inline size_t timestamp(void) {
+size_t pkgtime(void) {
     
-    struct timeval t;
+    struct timespec t;
 
-    gettimeofday(&t, NULL);
-    return t.tv_sec * 1000 + t.tv_usec / 1000;
-}
-
-/*
- *  settimeout() -
- *
- *  Sets the receive timeout option for a socket.
- *
- *  @sock   : The socket file descriptor on which to set the timeout.
- *  @timeout: The timeout value in milliseconds. If 'timeout' 
- *            is zero, the timeout will be disabled.
- */
-static inline void settimeout(int sock, size_t timeout) {
-
-    struct timeval tval;
-
-    memset(&tval, 0, sizeof tval);
-    if(timeout) {
-        tval.tv_sec  = timeout / 1000;
-        tval.tv_usec = (timeout % 1000) * 1000;
-    }
-    
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tval, sizeof tval);
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000 + t.tv_nsec / 1000;
 }
 
 /*
  *  pkgrecv_timeout() -
  *
  *  Receives data into a package from a socket with a specified timeout.
+ *  The timeout is left set on the socket for the next call, so packages
+ *  that keep coming cost a single system call each. Once a frame that is
+ *  no package arrived, the socket only waits for the time left.
  *
  *  @pkg    : Pointer to the Pkg structure where the received data will be
  *            stored.
- *  @sock   : File descriptor of the socket from which data will be received.
- *  @timeout: Timeout value in milliseconds for receiving data.
+ *  @sock   : Pointer to the socket from which data will be received.
+ *  @timeout: Timeout value in microseconds for receiving data.
  *
  *  return:
  *    - '1' if the data is successfully received within the timeout period.
  *    - '0' if there is an error or if the timeout period expires before
  *      receiving the data.
  */
-static int pkgrecv_timeout(Pkg* pkg, int sock, size_t timeout) {
+static int pkgrecv_timeout(Pkg* pkg, Socket* sock, size_t timeout) {
 
-    int ret;
-    int end;
+    ssize_t n;
+    size_t left;
     size_t start;
+    size_t spent;
 
     assert(pkg);
 
-    ret = 0;
-    end = 0;
+    start = pkgtime();
+    left  = timeout;
+    for(;;) {
+        socket_timeout(sock, left);
+        errno = 0;
+        n = socket_recv(sock, pkg->raw, sizeof pkg->raw);
+        if(n > 0 && ispkg(pkg)) {
+            return 1;
+        }
 
-    start = timestamp();
-    settimeout(sock, timeout);
-    for(; !end ;) {
-        if(recv(sock, pkg->raw, sizeof pkg->raw, 0) > 0) {
-            if(ispkg(pkg)) {
-                ret = 1;
-                break;
-            }
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+
+        spent = pkgtime() - start;
+        if(spent >= timeout) {
+            break;
         }
-        end = timestamp() - start > timeout;
+        left = timeout - spent;
     }
-    settimeout(sock, 0);
 
-    return ret;
+    return 0;
 }
 /*
  *  pkgrecv_notimeout() - 
  *
  *  Receives data into a package from a socket without using a timeout.
  *
- *  @pkg   : Pointer to the Pkg structure where the received data will be stored.
- *  @sockfd: File descriptor of the socket from which data will be received.
+ *  @pkg : Pointer to the Pkg structure where the received data will be stored.
+ *  @sock: Pointer to the socket from which data will be received.
  *
  *  return:
  *    - '1' if the data receive refers to a pkg.
  *    - '0' otherwise.
  */
-static int pkgrecv_notimeout(Pkg* pkg, int sockfd) {
+static int pkgrecv_notimeout(Pkg* pkg, Socket* sock) {
 
     assert(pkg);
-    recv(sockfd, pkg->raw, sizeof pkg->raw, 0);
+
+    socket_timeout(sock, 0);
+    if(socket_recv(sock, pkg->raw, sizeof pkg->raw) < 0) {
+        return 0;
+    }
 
     return 1; 
 }
 
+/*
+ *  pkgrecv_ring() -
+ *
+ *  Walks the receive ring, or the AF_XDP socket, of a socket up to its
+ *  next package, which is left in place instead of being copied out.
+ *
+ *  @sock   : Pointer to a socket handing out its frames in place.
+ *  @timeout: Timeout value in microseconds for receiving data. If zero, no
+ *            timeout is used.
+ *
+ *  return:
+ *    - Pointer to the package inside the ring.
+ *    - 'NULL' if the timeout period expires before receiving a package.
+ */
+static Pkg* pkgrecv_ring(Socket* sock, size_t timeout) {
+
+    Pkg* pkg;
+    size_t len;
+    size_t wait;
+    size_t start;
+    size_t elapsed;
+
+    assert(sock);
+
+    wait  = timeout;
+    start = pkgtime();
+    for(;;) {
+        pkg = (Pkg*)socket_next(sock, &len, wait);
+        if(!pkg) {
+            break;
+        }
+
+        if(len >= PKG_HDR_SIZE && ispkg(pkg) && PKG_HDR_SIZE + (size_t)pkg->data.size <= len) {
+            return pkg;
+        }
+
+        if(timeout) {
+            elapsed = pkgtime() - start;
+            if(elapsed >= timeout) {
+                break;
+            }
+            wait = timeout - elapsed;
+        }
+    }
+
+    return NULL;
+}
+
 /*
  *  pkgrecv() -
  *
- *  Receives data into a package from a socket, with optional timeout.
+ *  Receives a package from a socket, with optional timeout. Sockets with a
+ *  receive ring, an AF_XDP socket and datagram sockets hand out the
+ *  package in place, which stays valid until the next call; any other
+ *  socket copies it into the given buffer.
  *
  *  @pkg    : Pointer to the Pkg structure where the received data will be
- *            stored.
- *  @sock   : File descriptor of the socket from which data will be received.
- *  @timeout: Timeout value in milliseconds for receiving data. If zero, no
+ *            stored if the socket does not hand it out in place.
+ *  @sock   : Pointer to the socket from which data will be received.
+ *  @timeout: Timeout value in microseconds for receiving data. If zero, no
  *            timeout is used.
  *
  *  return:
- *    - '1' if the data is successfully received.
- *    - '0' if there is an error receiving the data.
+ *    - Pointer to the received package.
+ *    - 'NULL' if there is an error receiving the data.
  */
-int pkgrecv(Pkg* pkg, int sock, size_t timeout) {
+Pkg* pkgrecv(Pkg* pkg, Socket* sock, size_t timeout) {
 
     assert(pkg);
+    assert(sock);
+
+    if(SocketInPlace(sock)) {
+        return pkgrecv_ring(sock, timeout);
+    }
+
     if(timeout) {
-        return pkgrecv_timeout(pkg, sock, timeout);
+        return pkgrecv_timeout(pkg, sock, timeout) ? pkg : NULL;
     }
 
-    return pkgrecv_notimeout(pkg, sock);
+    return pkgrecv_notimeout(pkg, sock) ? pkg : NULL;
 }
 
 /*
- *  pkgsend() - 
+ *  pkgqueue() -
  *
- *  Sends the raw data of the package over a socket.
+ *  Queues the raw data of the package for transmission over a socket. It
+ *  reaches the wire on the next 'pkgflush()', and unless the socket has a
+ *  transmit ring the package must stay untouched until then. A frame
+ *  shorter than 'PKG_MIN_FRAME' is padded with zeros first.
  *
  *  @pkg : Pointer to the Pkg structure containing the data to be sent.
- *  @sock: File descriptor of the socket over which data will be sent.
+ *  @sock: Pointer to the socket over which data will be sent.
  *
  *  return:
- *    - '1' if the data is successfully sent.
+ *    - '1' if the package was queued.
  *    - '0' if there is an error sending the data.
  */
-int pkgsend(const Pkg* pkg, int sockfd) {
+int pkgqueue(Pkg* pkg, Socket* sock) {
+
+    size_t n;
 
     assert(pkg);
+    assert(sock);
 
-    if(send(sockfd, pkg->raw, sizeof pkg->raw, 0) < 0) {
-        return 0;
+    n = PKG_HDR_SIZE + pkg->data.size;
+    if(n < PKG_MIN_FRAME) {
+        memset(pkg->raw + n, 0, PKG_MIN_FRAME - n);
+        n = PKG_MIN_FRAME;
     }
 
-    return 1;
+    return socket_queue(sock, pkg->raw, n);
+}
+
+/*
+ *  pkgflush() -
+ *
+ *  Sends every package queued on a socket at once.
+ *
+ *  @sock: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if every queued package was sent.
+ *    - '0' if there is an error sending the data.
+ */
+int pkgflush(Socket* sock) {
+
+    assert(sock);
+    return socket_flush(sock);
+}
+
+/*
+ *  pkgsend() - 
+ *
+ *  Sends the raw data of the package over a socket, along with any
+ *  package queued before it.
+ *
+ *  @pkg : Pointer to the Pkg structure containing the data to be sent.
+ *  @sock: Pointer to the socket over which data will be sent.
+ *
+ *  return:
+ *    - '1' if the data is successfully sent.
+ *    - '0' if there is an error sending the data.
+ */
+int pkgsend(Pkg* pkg, Socket* sock) {
+
+    return pkgqueue(pkg, sock) && pkgflush(sock);
 }
 
 /*
  *  pkgvalid() -
  *
- *  Validates the integrity of a package by calculating the CRC8 checksum
- *  and comparing it with the stored checksum in the package data.
+ *  Validates the integrity of a package by calculating its checksum, with
+ *  the algorithm named in its header, and comparing it with the stored
+ *  checksum in the package data.
  *
  *  @pkg: Pointer to the package structure to validate.
  *
@@ -247,12 +308,15 @@ int pkgsend(const Pkg* pkg, int sockfd) {
  */
 int pkgvalid(const Pkg* pkg) {
 
-    uint8_t crc;
-
     assert(pkg);
+    if(pkg->data.size > sizeof pkg->data.content) {
+        return 0;
+    }
 
-    crc8(pkg->raw + sizeof pkg->data.marker, 2 + pkg->data.size, &crc);
-    return crc == pkg->data.crc8;
+    if(!csum_known(pkg->data.check)) {
+        return 0;
+    }
+    return pkgcsum(pkg) == pkg->data.csum;
 }
 
 /*
@@ -260,32 +324,87 @@ int pkgvalid(const Pkg* pkg) {
  *
  *  Initializes a Pkg structure with provided values and data buffer.
  *
- *  @pkg : Pointer to the Pkg structure to be initialized.
- *  @size: Size of the data buffer.
- *  @indx: Index value to be set in the Pkg structure.
- *  @type: Type value to be set in the Pkg structure.
- *  @buf : Pointer to the data buffer to be copied into the 'Pkg' structure.
+ *  @pkg  : Pointer to the Pkg structure to be initialized.
+ *  @size : Size of the data buffer.
+ *  @indx : Index value to be set in the Pkg structure.
+ *  @type : Type value to be set in the Pkg structure.
+ *  @buf  : Pointer to the data buffer to be copied into the 'Pkg' structure.
+ *  @check: Checksum algorithm protecting the package.
+ *  @sess : Session the package belongs to.
  */
-void pkginit(Pkg* pkg, uint8_t size, uint8_t indx, int type, const uint8_t* buf) {
+void pkginit(Pkg* pkg, size_t size, size_t indx, int type, const uint8_t* buf, int check, uint32_t sess) {
 
-    size_t i;
+    size_t n;
+    size_t used;
 
     assert(pkg);
-    memset(pkg, 0, sizeof *pkg);
-
-    pkg->data.marker = PKG_MARKER;
-    pkg->data.size   = 0;
-    pkg->data.indx   = indx;
-    pkg->data.type   = type;
+    memset(pkg, 0, PKG_HDR_SIZE);
+
+    pkg->data.marker  = PKG_MARKER;
+    pkg->data.version = PKG_VERSION;
+    pkg->data.size    = 0;
+    pkg->data.indx    = indx;
+    pkg->data.sess    = sess;
+    pkg->data.type    = type;
     
     if(buf) {
-        for(i = 0; i < size; i++) {
-            add_byte_to_pkg(pkg, buf[i]);
-        }
-        pkg->data.size++;
+        n = stuff(pkg->data.content, sizeof pkg->data.content - 1, buf, size, &used);
+        pkg->data.content[n++] = 0;
+        pkg->data.size = (uint16_t)n;
+    }
+
+    pkgseal(pkg, check);
+}
+
+/*
+ *  pkgseal() -
+ *
+ *  Sets the checksum algorithm of a package and computes its checksum.
+ *  Must be called again whenever the header or the content changes.
+ *
+ *  @pkg  : Pointer to the Pkg structure to be sealed.
+ *  @check: Checksum algorithm protecting the package.
+ */
+void pkgseal(Pkg* pkg, int check) {
+
+    assert(pkg);
+
+    pkg->data.check = check;
+    pkg->data.csum  = pkgcsum(pkg);
+}
+
+/*
+ *  pkgparams() -
+ *
+ *  Extracts the handshake parameters carried at the start of a request or
+ *  of the 'PKG_ACK' answering it.
+ *
+ *  @pkg   : Pointer to the Pkg structure, with sentinel bytes removed.
+ *  @params: Pointer to the PkgParams structure that will hold them.
+ *
+ *  return:
+ *    - '1' if the package carries parameters for a known version.
+ *    - '0' otherwise.
+ */
+int pkgparams(const Pkg* pkg, PkgParams* params) {
+
+    assert(pkg);
+    assert(params);
+
+    if(pkg->data.size < sizeof *params) {
+        return 0;
+    }
+
+    memcpy(params, pkg->data.content, sizeof *params);
+    if(params->version != PKG_VERSION || params->mtu < PKG_MIN_MTU || !params->window) {
+        return 0;
     }
 
-    crc8(pkg->raw + sizeof pkg->data.marker, 2 + pkg->data.size, &pkg->data.crc8);
+    if(params->mtu > PKG_MAX_FRAME) {
+        params->mtu = PKG_MAX_FRAME;
+    }
+
+    return 1;
 }
 
 /*
@@ -299,34 +418,8 @@ void pkginit(Pkg* pkg, uint8_t size, uint8_t indx, int type, const uint8_t* buf)
  */
 void pkg_rmv_sentinel_bytes(Pkg* pkg) {
 
-    int flag;
-    size_t i;
-    size_t n;
-    size_t s;
-    uint8_t byte;
-    uint8_t buf[64];
-    
     assert(pkg);
-
-    flag = 0;
-
-    s = 0;
-    n = pkg->data.size;
-    for(i = 0; i < n; i++) {
-        byte = pkg->data.content[i];
-        if(!flag) {
-            if(byte == 0x81 || byte == 0x88) {
-                flag = 1;
-            }
-            buf[s] = byte;
-            s++;
-        } else {
-            flag = 0;
-        }
-    }
-
-    pkg->data.size = (uint8_t)s;
-    memcpy(pkg->data.content, buf, pkg->data.size);
+    pkg->data.size = (uint16_t)unstuff(pkg->data.content, pkg->data.size);
 }
 
 #ifdef DEBUG
@@ -345,15 +438,19 @@ void (pkgprint)(const Pkg* pkg) {
     assert(pkg);
     
     debug("%x ", pkg->data.marker);
+    debug("%x ", pkg->data.version);
+    debug("%x ", pkg->data.check);
     debug("%x ", pkg->data.size);
+    debug("%llx ", (unsigned long long)pkg->data.off);
     debug("%x ", pkg->data.indx);
+    debug("%x ", pkg->data.sess);
     debug("%x ", pkg->data.type);
 
     for(i = 0; i < pkg->data.size; i++) {
         debug("%x ", pkg->data.content[i]);
     }
 
-    debug("%x\n", pkg->data.crc8);
+    debug("%x\n", pkg->data.csum);
 }
 
 #endif  /* DEBUG */
@@ -1,6 +1,7 @@
 #ifndef PKG_DEFS_H
 #define PKG_DEFS_H
 
+#include <stdint.h>
 #include <string.h>
 
 #ifdef DEBUG
@@ -9,23 +10,50 @@
 #   define pkgprint(pkg) (void)0
 #endif  /* DEBUG */
 
-#define PKG_MAX_IND 32
-#define PKG_MARKER  0x7E
+#define PKG_MARKER      0x7E
+#define PKG_VERSION     5
+#define PKG_TYPE_MAX    0x1F
+
+/*
+ *  Header flags. 'PKG_FLAG_PUSH' marks the last frame of a flight, which
+ *  the receiver answers right away.
+ */
+#define PKG_FLAG_PUSH   0x0001
+
+/*
+ *  Packages travel as the payload of Ethernet frames of this EtherType,
+ *  reserved by IEEE 802 for local experimental use.
+ */
+#define PKG_ETHERTYPE   0x88B5
+
+/*
+ *  Frame geometry. 'PKG_MAX_FRAME' bounds the frame (header plus content)
+ *  on jumbo-capable interfaces, while the size actually used by a context
+ *  is negotiated during the 'PKG_LS'/'PKG_DOWNLOAD' handshake and never
+ *  exceeds the MTU of either endpoint. Frames shorter than 'PKG_MIN_FRAME'
+ *  are padded with zeros to the minimum Ethernet payload length on the wire.
+ */
+#define PKG_HDR_SIZE    28
+#define PKG_MIN_FRAME   46
+#define PKG_MIN_MTU     68
+#define PKG_MAX_FRAME   9000
+#define PKG_MAX_IND     ((size_t)UINT32_MAX + 1)
 
 /*
  *  pkgsend_ack() -
  *
  *  Sends an acknowledgment package through the specified socket.
  *
- *  @sock: File descriptor of the socket through which the 
- *         acknowledgment package will be sent.
+ *  @sock : File descriptor of the socket through which the 
+ *          acknowledgment package will be sent.
+ *  @check: Checksum algorithm protecting the package.
+ *  @sess : Session the package belongs to.
  */
-#define pkgsend_ack(sock)                                           \
-    do {                                                            \
-        Pkg pa;                                                     \
-        memset(&pa, 0, sizeof pa);                                  \
-        pkginit(&pa, 0, 0, PKG_ACK, NULL);                          \
-        pkgsend(&pa, sock);                                         \
+#define pkgsend_ack(sock, check, sess)                                      \
+    do {                                                                    \
+        Pkg pa;                                                             \
+        pkginit(&pa, 0, 0, PKG_ACK, NULL, check, sess);                     \
+        pkgsend(&pa, sock);                                                 \
     } while(0)
 
 /*
@@ -33,15 +61,16 @@
  *
  *  Sends a 'NACK' package through the specified socket.
  *
- *  @sock: File descriptor of the socket through which the 
- *         'NACK' package will be sent.
+ *  @sock : File descriptor of the socket through which the 
+ *          'NACK' package will be sent.
+ *  @check: Checksum algorithm protecting the package.
+ *  @sess : Session the package belongs to.
  */
-#define pkgsend_nack(sock)                                          \
-    do {                                                            \
-        Pkg pn;                                                     \
-        memset(&pn, 0, sizeof pn);                                  \
-        pkginit(&pn, 0, 0, PKG_ACK, NULL);                          \
-        pkgsend(&pn, sock);                                         \
+#define pkgsend_nack(sock, check, sess)                                     \
+    do {                                                                    \
+        Pkg pn;                                                             \
+        pkginit(&pn, 0, 0, PKG_ACK, NULL, check, sess);                     \
+        pkgsend(&pn, sock);                                                 \
     } while(0)
 
 /*
@@ -50,15 +79,16 @@
  *  
  *  Sends an 'end' package through the specified socket.
  *
- *  @sock: File descriptor of the socket through which the 
- *         'end' package will be sent.
+ *  @sock : File descriptor of the socket through which the 
+ *          'end' package will be sent.
+ *  @check: Checksum algorithm protecting the package.
+ *  @sess : Session the package belongs to.
  */
-#define pkgsend_end(sock)                                           \
-    do {                                                            \
-        Pkg pe;                                                     \
-        memset(&pe, 0, sizeof pe);                                  \
-        pkginit(&pe, 0, 0, PKG_END, NULL);                          \
-        pkgsend(&pe, sock);                                         \
+#define pkgsend_end(sock, check, sess)                                      \
+    do {                                                                    \
+        Pkg pe;                                                             \
+        pkginit(&pe, 0, 0, PKG_END, NULL, check, sess);                     \
+        pkgsend(&pe, sock);                                                 \
     } while(0)
 
 /*
@@ -67,22 +97,41 @@
  *  
  *  Sends an 'error' package through the specified socket.
  *
- *  @sock: File descriptor of the socket through which the 
- *         'error' package will be sent.
+ *  @sock : File descriptor of the socket through which the 
+ *          'error' package will be sent.
+ *  @check: Checksum algorithm protecting the package.
+ *  @sess : Session the package belongs to.
  */
-#define pkgsend_error(sock)                                         \
-    do {                                                            \
-        Pkg pe;                                                     \
-        char buf[] = "Invalid Operation";                           \
-        memset(&pe, 0, sizeof pe);                                  \
-        pkginit(&pe, sizeof buf, 0, PKG_END, (uint8_t*)buf);        \
-        pkgsend(&pe, sock);                                         \
+#define pkgsend_error(sock, check, sess)                                    \
+    do {                                                                    \
+        Pkg pe;                                                             \
+        char buf[] = "Invalid Operation";                                   \
+        pkginit(&pe, sizeof buf, 0, PKG_END, (uint8_t*)buf, check, sess);   \
+        pkgsend(&pe, sock);                                                 \
     } while(0)
 
+/*
+ *  pkgsend_cancel() -
+ *
+ *  Sends an empty 'error' package through the specified socket, which
+ *  has the server stop serving the session.
+ *
+ *  @sock : Pointer to the socket.
+ *  @check: Checksum algorithm protecting the package.
+ *  @sess : Session the package belongs to.
+ */
+#define pkgsend_cancel(sock, check, sess)                                   \
+    do {                                                                    \
+        Pkg pe;                                                             \
+        pkginit(&pe, 0, 0, PKG_ERROR, NULL, check, sess);                   \
+        pkgsend(&pe, sock);                                                 \
+    } while(0)
 
 #define PkgAck(pkg)         ((pkg)->data.type == PKG_ACK)
 #define PkgEnd(pkg)         ((pkg)->data.type == PKG_END)
 #define PkgNack(pkg)        ((pkg)->data.type == PKG_NACK)
+#define PkgSack(pkg)        ((pkg)->data.type == PKG_SACK)
+#define PkgPush(pkg)        ((pkg)->data.flags & PKG_FLAG_PUSH)
 #define PkgError(pkg)       ((pkg)->data.type == PKG_ERROR)
 #define PkgData(pkg)        ((pkg)->data.type == PKG_DATA)
 #define PkgShow(pkg)        ((pkg)->data.type == PKG_SHOW)
@@ -90,6 +139,9 @@
 #define PkgDescriptor(pkg)  ((pkg)->data.type == PKG_DESCRIPTOR)
 #define PkgLs(pkg)          ((pkg)->data.type == PKG_LS)
 #define PkgIndx(pkg)        ((pkg)->data.indx)
+#define PkgOff(pkg)         ((off_t)(pkg)->data.off)
+#define PkgCheck(pkg)       ((pkg)->data.check)
+#define PkgSess(pkg)        ((pkg)->data.sess)
 
 #define iscontext(pkg)      ((pkg)->data.type == PKG_LS || (pkg)->data.type == PKG_DOWNLOAD)
 
@@ -4,14 +4,17 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
 
 #include "pkg.defs.h"
 #include "utils.h"
-#include "crc8.h"
+#include "csum.h"
+#include "socket.h"
 
 enum PkgType {
     PKG_ACK         = 0x00, 
     PKG_NACK        = 0x01, 
+    PKG_SACK        = 0x02,
     PKG_LS          = 0x0A, 
     PKG_DOWNLOAD    = 0x0B,
     PKG_SHOW        = 0x10,
@@ -23,52 +26,87 @@ enum PkgType {
 
 typedef enum PkgType PkgType;
 
+/*
+ *  Version 5 frame. Only the header and the first 'size' content bytes
+ *  are put on the wire, so 'raw' is just large enough to hold the biggest
+ *  (jumbo) frame. 'check' names the algorithm of the checksum 'csum', which
+ *  covers the rest of the header and the content. 'sess' names the session
+ *  the frame belongs to: the client picks it for its request and every
+ *  frame of the context carries it, both ways. A 'PKG_DATA' frame holds in
+ *  'off' the file offset of the first byte its content decodes to, so that
+ *  it can be written wherever it lands; other frames leave it at zero.
+ */
 union Pkg {
 
-    uint8_t raw[68];
+    uint8_t raw[PKG_MAX_FRAME];
     struct {
         uint8_t  marker;
-        uint16_t size : 6;
-        uint16_t indx : 5;
-        uint16_t type : 5;
-        uint8_t  content[63];
-        uint8_t  crc8;
+        uint8_t  version;
+        uint8_t  type;
+        uint8_t  check;
+        uint16_t size;
+        uint16_t flags;
+        uint64_t off;
+        uint32_t indx;
+        uint32_t sess;
+        uint32_t csum;
+        uint8_t  content[PKG_MAX_FRAME - PKG_HDR_SIZE];
     } data;
 };
 
 typedef union Pkg Pkg;
 
 /*
- *  pkgread() - 
- *
- *  Reads data from a file into the package, handling special byte values.
- *
- *  @pkg: Pointer to the Pkg structure where the data will be stored.
- *  @fp : Pointer to the FILE object from which data will be read.
- *
- *  return:
- *    -  '1' if the data is successfully read and stored in the package.
- *    -  '0' if there is an error reading from the file.
- *    - '-1' if there was nothing left to read.
+ *  Parameters carried by the 'PKG_LS'/'PKG_DOWNLOAD' request, where they
+ *  are followed by the asset name, and by the 'PKG_ACK' answering it,
+ *  where they hold the values agreed on for the rest of the context. The
+ *  request offers a mask of checksum algorithms, the answer picks one. The
+ *  request also offers the number of frames the client can hold out of
+ *  order, the answer the window, never larger, used for the transfer. A
+ *  'PKG_DOWNLOAD' asks for the bytes of the asset from the file offset
+ *  'start' up to 'end', or up to its end if 'end' is zero; the answer
+ *  holds the range served, 'end' clamped to the size of the asset.
+ */
+struct PkgParams {
+
+    uint8_t  version;
+    uint8_t  csum;
+    uint16_t mtu;
+    uint32_t window;
+    uint64_t start;
+    uint64_t end;
+};
+
+typedef struct PkgParams PkgParams;
+
+/*
+ *  A 'PKG_SACK' acknowledges data frames selectively. Its 'indx' holds the
+ *  next sequence number the receiver expects, every frame before it having
+ *  arrived. Its content starts with the receive window, a 32-bit number of
+ *  frames from 'indx' on the receiver accepts, followed by a bitmap of the
+ *  frames it already holds past 'indx': bit 'j % 8' of byte 'j / 8' stands
+ *  for frame 'indx + 1 + j'.
  */
-extern int pkgread(Pkg* pkg, FILE* fp);
 
 /*
  *  pkgrecv() -
  *
- *  Receives data into a package from a socket, with optional timeout.
+ *  Receives a package from a socket, with optional timeout. Sockets with a
+ *  receive ring, an AF_XDP socket and datagram sockets hand out the
+ *  package in place, which stays valid until the next call; any other
+ *  socket copies it into the given buffer.
  *
  *  @pkg    : Pointer to the Pkg structure where the received data will be
- *            stored.
- *  @sock   : File descriptor of the socket from which data will be received.
- *  @timeout: Timeout value in milliseconds for receiving data. If zero, no
+ *            stored if the socket does not hand it out in place.
+ *  @sock   : Pointer to the socket from which data will be received.
+ *  @timeout: Timeout value in microseconds for receiving data. If zero, no
  *            timeout is used.
  *
  *  return:
- *    - '1' if the data is successfully received.
- *    - '0' if there is an error receiving the data.
+ *    - Pointer to the received package.
+ *    - 'NULL' if there is an error receiving the data.
  */
-extern int pkgrecv(Pkg* pkg, int sock, size_t timeout);
+extern Pkg* pkgrecv(Pkg* pkg, Socket* sock, size_t timeout);
 
 /*
  *  ispkg() - 
@@ -83,25 +121,67 @@ extern int pkgrecv(Pkg* pkg, int sock, size_t timeout);
  */
 extern int ispkg(const Pkg* pkg);
 
+/*
+ *  pkgqueue() -
+ *
+ *  Queues the raw data of the package for transmission over a socket. It
+ *  reaches the wire on the next 'pkgflush()', and unless the socket has a
+ *  transmit ring the package must stay untouched until then. A frame
+ *  shorter than 'PKG_MIN_FRAME' is padded with zeros first.
+ *
+ *  @pkg : Pointer to the Pkg structure containing the data to be sent.
+ *  @sock: Pointer to the socket over which data will be sent.
+ *
+ *  return:
+ *    - '1' if the package was queued.
+ *    - '0' if there is an error sending the data.
+ */
+extern int pkgqueue(Pkg* pkg, Socket* sock);
+
+/*
+ *  pkgflush() -
+ *
+ *  Sends every package queued on a socket at once.
+ *
+ *  @sock: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if every queued package was sent.
+ *    - '0' if there is an error sending the data.
+ */
+extern int pkgflush(Socket* sock);
+
 /*
  *  pkgsend() - 
  *
- *  Sends the raw data of the package over a socket.
+ *  Sends the raw data of the package over a socket, along with any
+ *  package queued before it.
  *
  *  @pkg : Pointer to the Pkg structure containing the data to be sent.
- *  @sock: File descriptor of the socket over which data will be sent.
+ *  @sock: Pointer to the socket over which data will be sent.
  *
  *  return:
  *    - '1' if the data is successfully sent.
  *    - '0' if there is an error sending the data.
  */
-extern int pkgsend(const Pkg* pkg, int sock);
+extern int pkgsend(Pkg* pkg, Socket* sock);
+
+/*
+ *  pkgtime() -
+ *
+ *  Gets the current time of a clock that never jumps, in microseconds.
+ *
+ *  return:
+ *    - The current time in microseconds since an unspecified point.
+ */
+extern size_t pkgtime(void);
 
 /*
  *  pkgvalid() -
  *
- *  Validates the integrity of a package by calculating the CRC8 checksum
- *  and comparing it with the stored checksum in the package data.
+ *  Validates the integrity of a package by calculating its checksum, with
+ *  the algorithm named in its header, and comparing it with the stored
+ *  checksum in the package data.
  *
  *  @pkg: Pointer to the package structure to validate.
  *
@@ -119,10 +199,38 @@ extern int pkgvalid(const Pkg* pkg);
  *  @pkg : Pointer to the Pkg structure to be initialized.
  *  @size: Size of the data buffer.
  *  @indx: Index value to be set in the Pkg structure.
- *  @type: Type value to be set in the Pkg structure.
- *  @buf : Pointer to the data buffer to be copied into the 'Pkg' structure.
+ *  @type : Type value to be set in the Pkg structure.
+ *  @buf  : Pointer to the data buffer to be copied into the 'Pkg' structure.
+ *  @check: Checksum algorithm protecting the package.
+ *  @sess : Session the package belongs to.
+ */
+extern void pkginit(Pkg* pkg, size_t size, size_t indx, int type, const uint8_t* buf, int check, uint32_t sess);
+
+/*
+ *  pkgseal() -
+ *
+ *  Sets the checksum algorithm of a package and computes its checksum.
+ *  Must be called again whenever the header or the content changes.
+ *
+ *  @pkg  : Pointer to the Pkg structure to be sealed.
+ *  @check: Checksum algorithm protecting the package.
+ */
+extern void pkgseal(Pkg* pkg, int check);
+
+/*
+ *  pkgparams() -
+ *
+ *  Extracts the handshake parameters carried at the start of a request or
+ *  of the 'PKG_ACK' answering it.
+ *
+ *  @pkg   : Pointer to the Pkg structure, with sentinel bytes removed.
+ *  @params: Pointer to the PkgParams structure that will hold them.
+ *
+ *  return:
+ *    - '1' if the package carries parameters for a known version.
+ *    - '0' otherwise.
  */
-extern void pkginit(Pkg* pkg, uint8_t size, uint8_t indx, int type, const uint8_t* buf);
+extern int pkgparams(const Pkg* pkg, PkgParams* params);
 
 /*
  *  pkg_rmv_sentinel_bytes() -
@@ -0,0 +1,83 @@
+#ifndef SOCKET_DEFS_H
+#define SOCKET_DEFS_H
+
+/*
+ *  Geometry of the TPACKET_V3 receive ring. The kernel fills one block at
+ *  a time with as many frames as fit and hands it over once it is full or
+ *  once 'SOCKET_RING_TIMEOUT' milliseconds have passed since its first
+ *  frame, so a nearly idle link still sees its frames promptly.
+ */
+#define SOCKET_RING_BLOCK_SIZE  (1 << 18)
+#define SOCKET_RING_BLOCKS      64
+#define SOCKET_RING_FRAME_SIZE  (1 << 11)
+#define SOCKET_RING_TIMEOUT     1
+
+/*
+ *  Geometry of the transmit ring. Unlike the receive ring it is made of
+ *  fixed-size slots, each large enough for the biggest frame.
+ */
+#define SOCKET_TX_BLOCK_SIZE    (1 << 16)
+#define SOCKET_TX_BLOCKS        64
+#define SOCKET_TX_FRAME_SIZE    (1 << 14)
+
+/*
+ *  Number of frames a socket without a transmit ring gathers before
+ *  handing them to the kernel with a single 'sendmmsg()'.
+ */
+#define SOCKET_BATCH            64
+
+/*
+ *  Largest number of pieces a frame queued through 'socket_queuev()' may
+ *  be gathered from.
+ */
+#define SOCKET_IOV_MAX          32
+
+/*
+ *  Size of the addresses hosts are known by, large enough for an IPv6
+ *  address followed by a UDP port. A MAC address takes the first bytes.
+ */
+#define SOCKET_ADDR_LEN         18
+
+/*
+ *  Largest frame a UDP socket sends, so that a datagram fits a 1500-byte
+ *  packet even over IPv6.
+ */
+#define SOCKET_UDP_MTU          (1500 - 40 - 8)
+
+/*
+ *  Datagram sockets receive up to 'SOCKET_DGRAM_MSGS' datagrams at a time,
+ *  of up to 'SOCKET_DGRAM_SIZE' bytes each, the most the kernel coalesces
+ *  received UDP datagrams into. A row of frames a UDP socket sends as one
+ *  datagram the kernel segments is kept below 'SOCKET_UDP_GSO_SIZE' bytes
+ *  and 'SOCKET_UDP_GSO_SEGS' frames.
+ */
+#define SOCKET_DGRAM_MSGS       8
+#define SOCKET_DGRAM_SIZE       (1 << 16)
+#define SOCKET_UDP_GSO_SIZE     65000
+#define SOCKET_UDP_GSO_SEGS     64
+
+/*
+ *  Rings 'socket_ring()' can set up.
+ */
+#define SOCKET_RX_RING          0x01
+#define SOCKET_TX_RING          0x02
+#define SOCKET_XDP              0x04
+
+/*
+ *  Odd multiplier mixing the key of a frame before a fanout group picks
+ *  one of its sockets by it, the 32-bit golden ratio.
+ */
+#define SOCKET_FANOUT_MIX       0x9E3779B1
+
+/*
+ *  Descriptor to wait on for received frames.
+ */
+#define SocketFd(sock)          ((sock)->xsk ? (sock)->xsk->fd : (sock)->fd)
+
+/*
+ *  Whether the socket hands out received frames in place, through
+ *  'socket_next()', rather than copying them through 'socket_recv()'.
+ */
+#define SocketInPlace(sock)     (!(sock)->ops->recv || (sock)->rx.map || (sock)->xsk)
+
+#endif  /* SOCKET_DEFS_H */
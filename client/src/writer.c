@@ -0,0 +1,379 @@
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "writer.h"
+
+/*
+ *  writer_write() -
+ *
+ *  Writes a buffer at its file offset, going on after short writes.
+ *
+ *  @fd : File descriptor to write to.
+ *  @buf: Pointer to the buffer.
+ *
+ *  return:
+ *    - '1' if every byte was written.
+ *    - '0' on failure.
+ */
+static int writer_write(int fd, const WriterBuf* buf) {
+
+    size_t i;
+    ssize_t n;
+
+    for(i = 0; i < buf->len; i += (size_t)n) {
+        do {
+            n = pwrite(fd, buf->data + i, buf->len - i, buf->off + (off_t)i);
+        } while(n < 0 && errno == EINTR);
+
+        if(n <= 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ *  writer_mark() -
+ *
+ *  Syncs the bytes written so far and records them, so that a record
+ *  never claims bytes a crash could lose.
+ *
+ *  @wr: Pointer to the pipeline.
+ */
+static void writer_mark(Writer* wr) {
+
+    WriterMark mark;
+
+    if(fdatasync(wr->fd)) {
+        return;
+    }
+
+    mark.start = (uint64_t)wr->start;
+    mark.done  = (uint64_t)wr->written;
+    if(pwrite(wr->part, &mark, sizeof mark, wr->at) == sizeof mark) {
+        wr->marked = wr->written;
+    }
+}
+
+/*
+ *  writer_run() -
+ *
+ *  Runs the thread of a pipeline: writes the buffers handed over in the
+ *  order they were, giving each back empty once written, until told to
+ *  stop. Progress is recorded every so often, if asked for.
+ *
+ *  @arg: Pointer to the pipeline.
+ *
+ *  return:
+ *    - 'NULL' once every buffer handed over is written.
+ */
+static void* writer_run(void* arg) {
+
+    int ok;
+    Writer* wr;
+    WriterBuf* buf;
+
+    wr = arg;
+    pthread_mutex_lock(&wr->lock);
+    for(;;) {
+        while(!wr->queued && !wr->done) {
+            pthread_cond_wait(&wr->cond, &wr->lock);
+        }
+
+        if(!wr->queued) {
+            break;
+        }
+
+        buf = &wr->bufs[wr->flush];
+        pthread_mutex_unlock(&wr->lock);
+        ok = wr->err || writer_write(wr->fd, buf);
+        if(ok && !wr->err) {
+            wr->written = buf->off + (off_t)buf->len;
+            if(wr->part >= 0 && wr->written - wr->marked >= WRITER_CHECKPOINT) {
+                writer_mark(wr);
+            }
+        }
+        pthread_mutex_lock(&wr->lock);
+
+        if(!ok) {
+            wr->err = 1;
+        }
+
+        buf->len  = 0;
+        wr->flush = (wr->flush + 1) % WRITER_BUFS;
+        wr->queued--;
+        pthread_cond_broadcast(&wr->cond);
+    }
+    pthread_mutex_unlock(&wr->lock);
+
+    return NULL;
+}
+
+/*
+ *  writer_hand() -
+ *
+ *  Hands the buffer of the first span over to the thread and moves on to
+ *  the next span, waiting for the thread to give a buffer back if none
+ *  is left to cover spans ahead.
+ *
+ *  @wr: Pointer to the pipeline.
+ */
+static void writer_hand(Writer* wr) {
+
+    wr->bufs[wr->fill].off = wr->base;
+
+    pthread_mutex_lock(&wr->lock);
+    wr->queued++;
+    pthread_cond_broadcast(&wr->cond);
+    while(wr->queued == WRITER_BUFS) {
+        pthread_cond_wait(&wr->cond, &wr->lock);
+    }
+    pthread_mutex_unlock(&wr->lock);
+
+    wr->fill  = (wr->fill + 1) % WRITER_BUFS;
+    wr->base += WRITER_BUF_SIZE;
+}
+
+/*
+ *  writer_open() -
+ *
+ *  Sets up the write pipeline of an open file and starts its thread.
+ *
+ *  @fd   : File descriptor the data will be written to.
+ *  @start: File offset of the first byte the pipeline takes.
+ *
+ *  return:
+ *    - Pointer to the pipeline, which owns the descriptor from then on.
+ *    - 'NULL' on failure.
+ */
+Writer* writer_open(int fd, off_t start) {
+
+    size_t i;
+    void* data;
+    Writer* wr;
+
+    wr = calloc(1, sizeof *wr);
+    if(!wr) {
+        return NULL;
+    }
+
+    wr->fd      = fd;
+    wr->part    = -1;
+    wr->base    = start;
+    wr->start   = start;
+    wr->written = start;
+    wr->marked  = start;
+    for(i = 0; i < WRITER_BUFS; i++) {
+        if(posix_memalign(&data, WRITER_ALIGN, WRITER_BUF_SIZE)) {
+            break;
+        }
+        wr->bufs[i].data = data;
+    }
+
+    if(i < WRITER_BUFS || pthread_mutex_init(&wr->lock, NULL)) {
+        while(i--) {
+            free(wr->bufs[i].data);
+        }
+        free(wr);
+        return NULL;
+    }
+
+    pthread_cond_init(&wr->cond, NULL);
+    if(pthread_create(&wr->thread, NULL, writer_run, wr)) {
+        pthread_cond_destroy(&wr->cond);
+        pthread_mutex_destroy(&wr->lock);
+        for(i = 0; i < WRITER_BUFS; i++) {
+            free(wr->bufs[i].data);
+        }
+        free(wr);
+        return NULL;
+    }
+
+    return wr;
+}
+
+/*
+ *  writer_reserve() -
+ *
+ *  Reserves the blocks of the whole file up front, without changing its
+ *  size, where the file system allows it, so that writes neither allocate
+ *  them one at a time nor run out of room halfway. Blocks allocated
+ *  already are left as they are.
+ *
+ *  @fd  : File descriptor of the file.
+ *  @size: Size of the file.
+ *
+ *  return:
+ *    - '1' if the blocks were reserved or cannot be.
+ *    - '0' if there is no room for them.
+ */
+int writer_reserve(int fd, size_t size) {
+
+    if(!size) {
+        return 1;
+    }
+
+    return !fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size) || (errno != ENOSPC && errno != EFBIG);
+}
+
+/*
+ *  writer_record() -
+ *
+ *  Has the pipeline record its progress in a 'WriterMark' of another file
+ *  from then on. Bytes are only recorded once synced.
+ *
+ *  @wr  : Pointer to the pipeline, before any byte was put.
+ *  @part: File descriptor of the file holding the record.
+ *  @at  : File offset of the record.
+ */
+void writer_record(Writer* wr, int part, off_t at) {
+
+    assert(wr);
+
+    wr->part = part;
+    wr->at   = at;
+}
+
+/*
+ *  writer_put() -
+ *
+ *  Puts bytes at their file offset through the pipeline, in the buffers
+ *  covering them, handing the buffers of the first spans over as they
+ *  complete. Every byte of the file is put once.
+ *
+ *  @wr  : Pointer to the pipeline.
+ *  @off : File offset of the first byte.
+ *  @data: Pointer to the bytes.
+ *  @n   : Number of bytes.
+ *
+ *  return:
+ *    - '1' if the bytes were taken.
+ *    - '0' if they lie beyond the spans the pipeline may hold yet.
+ */
+int writer_put(Writer* wr, off_t off, const uint8_t* data, size_t n) {
+
+    size_t i;
+    size_t k;
+    size_t room;
+    off_t start;
+    WriterBuf* buf;
+
+    assert(wr);
+
+    pthread_mutex_lock(&wr->lock);
+    room = WRITER_BUFS - wr->queued;
+    pthread_mutex_unlock(&wr->lock);
+
+    if(off < wr->base || (size_t)(off - wr->base) + n > room * WRITER_BUF_SIZE) {
+        return 0;
+    }
+
+    while(n) {
+        i     = (size_t)(off - wr->base) / WRITER_BUF_SIZE;
+        buf   = &wr->bufs[(wr->fill + i) % WRITER_BUFS];
+        start = wr->base + (off_t)(i * WRITER_BUF_SIZE);
+        k     = (size_t)(start - off) + WRITER_BUF_SIZE;
+        if(k > n) {
+            k = n;
+        }
+
+        memcpy(buf->data + (off - start), data, k);
+        buf->len += k;
+        off      += (off_t)k;
+        data     += k;
+        n        -= k;
+    }
+
+    while(wr->bufs[wr->fill].len == WRITER_BUF_SIZE) {
+        writer_hand(wr);
+    }
+
+    return 1;
+}
+
+/*
+ *  writer_room() -
+ *
+ *  Tells how many bytes from a file offset on the pipeline takes now: up
+ *  to the end of the spans of the buffers not waiting for the disk. The
+ *  room only grows as the thread writes buffers out.
+ *
+ *  @wr : Pointer to the pipeline.
+ *  @off: File offset, at or past the first byte still missing.
+ *
+ *  return:
+ *    - The number of bytes 'writer_put()' takes from 'off' on.
+ */
+size_t writer_room(Writer* wr, off_t off) {
+
+    size_t room;
+    off_t end;
+
+    assert(wr);
+
+    pthread_mutex_lock(&wr->lock);
+    room = WRITER_BUFS - wr->queued;
+    pthread_mutex_unlock(&wr->lock);
+
+    end = wr->base + (off_t)(room * WRITER_BUF_SIZE);
+
+    return off < end ? (size_t)(end - off) : 0;
+}
+
+/*
+ *  writer_close() -
+ *
+ *  Writes out the span the pipeline was completing up to the first byte
+ *  still missing, stops its thread, records how far it got, closes the
+ *  file and releases the pipeline. Bytes put beyond a gap belong to a
+ *  file left incomplete, or to a range cut short, and are dropped.
+ *
+ *  @wr  : Pointer to the pipeline.
+ *  @done: File offset every byte before which was put.
+ *
+ *  return:
+ *    - '1' if every byte was written.
+ *    - '0' otherwise.
+ */
+int writer_close(Writer* wr, off_t done) {
+
+    int ret;
+    size_t i;
+
+    if(!wr) {
+        return 1;
+    }
+
+    if(done > wr->base) {
+        wr->bufs[wr->fill].len = (size_t)(done - wr->base);
+        writer_hand(wr);
+    }
+
+    pthread_mutex_lock(&wr->lock);
+    wr->done = 1;
+    pthread_cond_broadcast(&wr->cond);
+    pthread_mutex_unlock(&wr->lock);
+    pthread_join(wr->thread, NULL);
+
+    if(!wr->err && wr->part >= 0 && wr->written > wr->marked) {
+        writer_mark(wr);
+    }
+
+    ret = !wr->err && !close(wr->fd);
+
+    pthread_cond_destroy(&wr->cond);
+    pthread_mutex_destroy(&wr->lock);
+    for(i = 0; i < WRITER_BUFS; i++) {
+        free(wr->bufs[i].data);
+    }
+    free(wr);
+
+    return ret;
+}
@@ -0,0 +1,24 @@
+#ifndef WRITER_DEFS_H
+#define WRITER_DEFS_H
+
+/*
+ *  Write pipeline geometry. Received bytes are gathered in 'WRITER_BUFS'
+ *  buffers of 'WRITER_BUF_SIZE' bytes aligned to 'WRITER_ALIGN', each
+ *  covering a span of the file and written out with a single positional
+ *  write once every byte of the span is in. Bytes may arrive up to the
+ *  spans of the buffers not waiting for the disk ahead of the first
+ *  missing one, and a client advertises no more than that as its receive
+ *  window. The receive loop only waits for the disk once every buffer is
+ *  waiting for it.
+ */
+#define WRITER_BUF_SIZE (1 << 22)
+#define WRITER_BUFS     8
+#define WRITER_ALIGN    4096
+
+/*
+ *  A pipeline recording its progress syncs the file and records how far
+ *  it got every 'WRITER_CHECKPOINT' bytes written, and once it closes.
+ */
+#define WRITER_CHECKPOINT   (1 << 26)
+
+#endif  /* WRITER_DEFS_H */
@@ -0,0 +1,161 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "writer.defs.h"
+
+/*
+ *  Buffer of the write pipeline, holding 'len' bytes of the span starting
+ *  at the file offset 'off'.
+ */
+struct WriterBuf {
+
+    uint8_t* data;
+    off_t    off;
+    size_t   len;
+};
+
+typedef struct WriterBuf WriterBuf;
+
+/*
+ *  Record of the progress of a pipeline: the bytes of the file from the
+ *  offset 'start' up to 'done' are written and synced.
+ */
+struct WriterMark {
+
+    uint64_t start;
+    uint64_t done;
+};
+
+typedef struct WriterMark WriterMark;
+
+/*
+ *  Write pipeline of a file, reassembling the bytes received out of order
+ *  by their file offset. The buffers from 'fill' on that are not handed
+ *  over cover consecutive spans of the file from the offset 'base'; bytes
+ *  are put in whichever covers them, and the buffer 'fill' is handed over
+ *  once its span is complete. A thread of its own writes the 'queued'
+ *  buffers handed over, from 'flush' on, so the receive loop never waits
+ *  for the disk while a buffer is free. 'err' records the first write
+ *  that failed; 'done' tells the thread to leave once every buffer is
+ *  written.
+ *
+ *  The pipeline takes the bytes from the offset 'start' on, and they are
+ *  written up to 'written'. A pipeline recording its progress keeps a
+ *  'WriterMark' at the offset 'at' of the file 'part', which tells they
+ *  were synced up to 'marked'.
+ */
+struct Writer {
+
+    int             fd;
+    int             err;
+    int             done;
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    size_t          fill;
+    size_t          flush;
+    size_t          queued;
+    off_t           base;
+    off_t           start;
+    off_t           written;
+    off_t           marked;
+    int             part;
+    off_t           at;
+    WriterBuf       bufs[WRITER_BUFS];
+};
+
+typedef struct Writer Writer;
+
+/*
+ *  writer_open() -
+ *
+ *  Sets up the write pipeline of an open file and starts its thread.
+ *
+ *  @fd   : File descriptor the data will be written to.
+ *  @start: File offset of the first byte the pipeline takes.
+ *
+ *  return:
+ *    - Pointer to the pipeline, which owns the descriptor from then on.
+ *    - 'NULL' on failure.
+ */
+extern Writer* writer_open(int fd, off_t start);
+
+/*
+ *  writer_reserve() -
+ *
+ *  Reserves the blocks of the whole file up front, without changing its
+ *  size, where the file system allows it.
+ *
+ *  @fd  : File descriptor of the file.
+ *  @size: Size of the file.
+ *
+ *  return:
+ *    - '1' if the blocks were reserved or cannot be.
+ *    - '0' if there is no room for them.
+ */
+extern int writer_reserve(int fd, size_t size);
+
+/*
+ *  writer_record() -
+ *
+ *  Has the pipeline record its progress in a 'WriterMark' of another file
+ *  from then on. Bytes are only recorded once synced.
+ *
+ *  @wr  : Pointer to the pipeline, before any byte was put.
+ *  @part: File descriptor of the file holding the record.
+ *  @at  : File offset of the record.
+ */
+extern void writer_record(Writer* wr, int part, off_t at);
+
+/*
+ *  writer_put() -
+ *
+ *  Puts bytes at their file offset through the pipeline. Every byte of
+ *  the file is put once.
+ *
+ *  @wr  : Pointer to the pipeline.
+ *  @off : File offset of the first byte.
+ *  @data: Pointer to the bytes.
+ *  @n   : Number of bytes.
+ *
+ *  return:
+ *    - '1' if the bytes were taken.
+ *    - '0' if they lie beyond the spans the pipeline may hold yet.
+ */
+extern int writer_put(Writer* wr, off_t off, const uint8_t* data, size_t n);
+
+/*
+ *  writer_room() -
+ *
+ *  Tells how many bytes from a file offset on the pipeline takes now.
+ *
+ *  @wr : Pointer to the pipeline.
+ *  @off: File offset, at or past the first byte still missing.
+ *
+ *  return:
+ *    - The number of bytes 'writer_put()' takes from 'off' on.
+ */
+extern size_t writer_room(Writer* wr, off_t off);
+
+/*
+ *  writer_close() -
+ *
+ *  Writes out the span the pipeline was completing up to the first byte
+ *  still missing, stops its thread, records how far it got, closes the
+ *  file and releases the pipeline.
+ *
+ *  @wr  : Pointer to the pipeline.
+ *  @done: File offset every byte before which was put.
+ *
+ *  return:
+ *    - '1' if every byte was written.
+ *    - '0' otherwise.
+ */
+extern int writer_close(Writer* wr, off_t done);
+
+#endif  /* WRITER_H */
@@ -0,0 +1,581 @@
+#define _GNU_SOURCE
+
+#include <linux/if_link.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <arpa/inet.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "xsk.h"
+#include "pkg.defs.h"
+
+/*
+ *  sys_bpf() -
+ *
+ *  Issues a 'bpf()' system call, which the C library does not wrap.
+ *
+ *  @cmd : Command.
+ *  @attr: Pointer to the attributes of the command.
+ *
+ *  return:
+ *    - The result of the command, a descriptor for those creating one.
+ *    - '-1' on failure.
+ */
+static inline int sys_bpf(int cmd, union bpf_attr* attr) {
+
+    return (int)syscall(SYS_bpf, cmd, attr, sizeof *attr);
+}
+
+/*
+ *  xsk_map_create() -
+ *
+ *  Creates the map the steering program redirects frames through, from
+ *  the number of their receive queue to the socket serving it.
+ *
+ *  return:
+ *    - Descriptor of the map.
+ *    - '-1' on failure.
+ */
+static int xsk_map_create(void) {
+
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof attr);
+    attr.map_type    = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size    = sizeof(uint32_t);
+    attr.value_size  = sizeof(uint32_t);
+    attr.max_entries = XSK_QUEUES;
+
+    return sys_bpf(BPF_MAP_CREATE, &attr);
+}
+
+/*
+ *  xsk_prog_load() -
+ *
+ *  Loads the steering program. It redirects the frames long enough to
+ *  hold the Ethernet header and the marker, and carrying the protocol
+ *  EtherType and marker, to the socket of their queue; every other frame,
+ *  or any frame of a queue without a socket, goes on to the kernel stack.
+ *
+ *  @xskmap   : Descriptor of the map of sockets.
+ *  @ethertype: EtherType of the frames to steer.
+ *
+ *  return:
+ *    - Descriptor of the program.
+ *    - '-1' on failure.
+ */
+static int xsk_prog_load(int xskmap, int ethertype) {
+
+    union bpf_attr attr;
+    struct bpf_insn prog[] = {
+        /* r2 = data, r3 = data_end */
+        XSK_INSN(BPF_LDX | BPF_W | BPF_MEM,     BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, data), 0),
+        XSK_INSN(BPF_LDX | BPF_W | BPF_MEM,     BPF_REG_3, BPF_REG_1, offsetof(struct xdp_md, data_end), 0),
+        /* if(data + ETHER_HDR_LEN + 1 > data_end) goto pass */
+        XSK_INSN(BPF_ALU64 | BPF_MOV | BPF_X,   BPF_REG_4, BPF_REG_2, 0, 0),
+        XSK_INSN(BPF_ALU64 | BPF_ADD | BPF_K,   BPF_REG_4, 0, 0, ETHER_HDR_LEN + 1),
+        XSK_INSN(BPF_JMP | BPF_JGT | BPF_X,     BPF_REG_4, BPF_REG_3, 10, 0),
+        /* if(ether_type != ethertype || marker != PKG_MARKER) goto pass */
+        XSK_INSN(BPF_LDX | BPF_H | BPF_MEM,     BPF_REG_4, BPF_REG_2, offsetof(struct ether_header, ether_type), 0),
+        XSK_INSN(BPF_JMP | BPF_JNE | BPF_K,     BPF_REG_4, 0, 8, htons(ethertype)),
+        XSK_INSN(BPF_LDX | BPF_B | BPF_MEM,     BPF_REG_4, BPF_REG_2, ETHER_HDR_LEN, 0),
+        XSK_INSN(BPF_JMP | BPF_JNE | BPF_K,     BPF_REG_4, 0, 6, PKG_MARKER),
+        /* return bpf_redirect_map(xskmap, rx_queue_index, XDP_PASS) */
+        XSK_INSN(BPF_LDX | BPF_W | BPF_MEM,     BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, rx_queue_index), 0),
+        XSK_INSN(BPF_LD | BPF_DW | BPF_IMM,     BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, xskmap),
+        XSK_INSN(0,                             0, 0, 0, 0),
+        XSK_INSN(BPF_ALU64 | BPF_MOV | BPF_K,   BPF_REG_3, 0, 0, XDP_PASS),
+        XSK_INSN(BPF_JMP | BPF_CALL,            0, 0, 0, BPF_FUNC_redirect_map),
+        XSK_INSN(BPF_JMP | BPF_EXIT,            0, 0, 0, 0),
+        /* pass: return XDP_PASS */
+        XSK_INSN(BPF_ALU64 | BPF_MOV | BPF_K,   BPF_REG_0, 0, 0, XDP_PASS),
+        XSK_INSN(BPF_JMP | BPF_EXIT,            0, 0, 0, 0)
+    };
+
+    memset(&attr, 0, sizeof attr);
+    attr.prog_type            = BPF_PROG_TYPE_XDP;
+    attr.expected_attach_type = BPF_XDP;
+    attr.insns                = (uintptr_t)prog;
+    attr.insn_cnt             = sizeof prog / sizeof prog[0];
+    attr.license              = (uintptr_t)"GPL";
+
+    return sys_bpf(BPF_PROG_LOAD, &attr);
+}
+
+/*
+ *  xsk_prog_attach() -
+ *
+ *  Attaches the steering program to an interface through a link, which
+ *  detaches it once closed, even if the process dies. Native mode is
+ *  tried first, generic mode, which any driver supports, second.
+ *
+ *  @prog   : Descriptor of the program.
+ *  @ifindex: Index of the network interface.
+ *
+ *  return:
+ *    - Descriptor of the link.
+ *    - '-1' on failure.
+ */
+static int xsk_prog_attach(int prog, int ifindex) {
+
+    int link;
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof attr);
+    attr.link_create.prog_fd        = prog;
+    attr.link_create.target_ifindex = ifindex;
+    attr.link_create.attach_type    = BPF_XDP;
+    attr.link_create.flags          = XDP_FLAGS_DRV_MODE;
+
+    link = sys_bpf(BPF_LINK_CREATE, &attr);
+    if(link < 0) {
+        attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+        link = sys_bpf(BPF_LINK_CREATE, &attr);
+    }
+
+    return link;
+}
+
+/*
+ *  xsk_ring_map() -
+ *
+ *  Maps one of the rings of the socket, sized beforehand.
+ *
+ *  @xsk  : Pointer to the socket.
+ *  @ring : Pointer to the ring.
+ *  @pgoff: Offset the ring is mapped at.
+ *  @off  : Offsets of the ring fields within its mapping.
+ *  @n    : Number of slots, a power of two.
+ *  @item : Size of a slot.
+ *
+ *  return:
+ *    - '1' if the ring was mapped.
+ *    - '0' on failure.
+ */
+static int xsk_ring_map(Xsk* xsk, XskRing* ring, off_t pgoff, const struct xdp_ring_offset* off, uint32_t n, size_t item) {
+
+    uint8_t* map;
+
+    ring->size = off->desc + n * item;
+    map = mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xsk->fd, pgoff);
+    if(map == MAP_FAILED) {
+        ring->size = 0;
+        return 0;
+    }
+
+    ring->map      = map;
+    ring->producer = (uint32_t*)(map + off->producer);
+    ring->consumer = (uint32_t*)(map + off->consumer);
+    ring->flags    = (uint32_t*)(map + off->flags);
+    ring->desc     = map + off->desc;
+    ring->mask     = n - 1;
+    ring->head     = 0;
+
+    return 1;
+}
+
+/*
+ *  xsk_rings() -
+ *
+ *  Sizes and maps the four rings of the socket, then stocks the fill ring
+ *  with every frame lent to the kernel.
+ *
+ *  @xsk: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if the rings were mapped.
+ *    - '0' on failure.
+ */
+static int xsk_rings(Xsk* xsk) {
+
+    size_t i;
+    uint32_t rx;
+    uint32_t tx;
+    socklen_t optlen;
+    struct xdp_mmap_offsets off;
+
+    rx = XSK_RX_FRAMES;
+    tx = XSK_TX_FRAMES;
+    if(setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_FILL_RING, &rx, sizeof rx) < 0 ||
+       setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &tx, sizeof tx) < 0 ||
+       setsockopt(xsk->fd, SOL_XDP, XDP_RX_RING, &rx, sizeof rx) < 0 ||
+       setsockopt(xsk->fd, SOL_XDP, XDP_TX_RING, &tx, sizeof tx) < 0) {
+        return 0;
+    }
+
+    optlen = sizeof off;
+    if(getsockopt(xsk->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) {
+        return 0;
+    }
+
+    if(!xsk_ring_map(xsk, &xsk->rx, XDP_PGOFF_RX_RING, &off.rx, rx, sizeof(struct xdp_desc)) ||
+       !xsk_ring_map(xsk, &xsk->tx, XDP_PGOFF_TX_RING, &off.tx, tx, sizeof(struct xdp_desc)) ||
+       !xsk_ring_map(xsk, &xsk->fill, XDP_UMEM_PGOFF_FILL_RING, &off.fr, rx, sizeof(uint64_t)) ||
+       !xsk_ring_map(xsk, &xsk->comp, XDP_UMEM_PGOFF_COMPLETION_RING, &off.cr, tx, sizeof(uint64_t))) {
+        return 0;
+    }
+
+    for(i = 0; i < XSK_RX_FRAMES; i++) {
+        *XskRingAt(&xsk->fill, uint64_t, xsk->fill.head++) = i * XSK_FRAME_SIZE;
+    }
+    __atomic_store_n(xsk->fill.producer, xsk->fill.head, __ATOMIC_RELEASE);
+
+    for(i = 0; i < XSK_TX_FRAMES; i++) {
+        xsk->free[i] = (XSK_RX_FRAMES + i) * XSK_FRAME_SIZE;
+    }
+    xsk->nfree = XSK_TX_FRAMES;
+
+    return 1;
+}
+
+/*
+ *  xsk_bind() -
+ *
+ *  Binds the socket to a queue of an interface, sharing the UMEM without
+ *  copies if the driver allows it and through copies otherwise.
+ *
+ *  @xsk    : Pointer to the socket.
+ *  @ifindex: Index of the network interface.
+ *  @queue  : Receive queue of the interface.
+ *
+ *  return:
+ *    - '1' if the socket was bound.
+ *    - '0' on failure.
+ */
+static int xsk_bind(Xsk* xsk, int ifindex, int queue) {
+
+    struct sockaddr_xdp sxdp;
+
+    memset(&sxdp, 0, sizeof sxdp);
+    sxdp.sxdp_family   = AF_XDP;
+    sxdp.sxdp_ifindex  = ifindex;
+    sxdp.sxdp_queue_id = queue;
+    sxdp.sxdp_flags    = XDP_USE_NEED_WAKEUP | XDP_ZEROCOPY;
+    if(!bind(xsk->fd, (struct sockaddr*)&sxdp, sizeof sxdp)) {
+        return 1;
+    }
+
+    sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_COPY;
+
+    return !bind(xsk->fd, (struct sockaddr*)&sxdp, sizeof sxdp);
+}
+
+/*
+ *  xsk_open() -
+ *
+ *  Opens an AF_XDP socket on a receive queue of an interface and attaches
+ *  the program steering the frames of the protocol to it, in native mode
+ *  if the driver supports it and in generic mode otherwise. The UMEM is
+ *  shared without copies whenever the driver allows it.
+ *
+ *  @ifindex  : Index of the network interface.
+ *  @queue    : Receive queue of the interface.
+ *  @ethertype: EtherType of the frames to steer.
+ *
+ *  return:
+ *    - Pointer to the socket.
+ *    - 'NULL' on failure.
+ */
+Xsk* xsk_open(int ifindex, int queue, int ethertype) {
+
+    uint32_t key;
+    uint8_t* umem;
+    union bpf_attr attr;
+    struct xdp_umem_reg reg;
+    Xsk* xsk;
+
+    xsk = calloc(1, sizeof *xsk);
+    if(!xsk) {
+        return NULL;
+    }
+
+    xsk->xskmap = -1;
+    xsk->prog   = -1;
+    xsk->link   = -1;
+    xsk->held   = XSK_NONE;
+    xsk->fd     = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if(xsk->fd < 0) {
+        xsk_close(xsk);
+        return NULL;
+    }
+
+    umem = mmap(NULL, (size_t)XSK_FRAMES * XSK_FRAME_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if(umem == MAP_FAILED) {
+        xsk_close(xsk);
+        return NULL;
+    }
+
+    xsk->umem = umem;
+    xsk->size = (size_t)XSK_FRAMES * XSK_FRAME_SIZE;
+
+    memset(&reg, 0, sizeof reg);
+    reg.addr       = (uintptr_t)umem;
+    reg.len        = xsk->size;
+    reg.chunk_size = XSK_FRAME_SIZE;
+    reg.headroom   = XSK_HEADROOM;
+    if(setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof reg) < 0 || !xsk_rings(xsk) || !xsk_bind(xsk, ifindex, queue)) {
+        xsk_close(xsk);
+        return NULL;
+    }
+
+    xsk->xskmap = xsk_map_create();
+    xsk->prog   = xsk->xskmap < 0 ? -1 : xsk_prog_load(xsk->xskmap, ethertype);
+    if(xsk->prog < 0) {
+        xsk_close(xsk);
+        return NULL;
+    }
+
+    key = (uint32_t)queue;
+    memset(&attr, 0, sizeof attr);
+    attr.map_fd = xsk->xskmap;
+    attr.key    = (uintptr_t)&key;
+    attr.value  = (uintptr_t)&xsk->fd;
+    if(sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        xsk_close(xsk);
+        return NULL;
+    }
+
+    xsk->link = xsk_prog_attach(xsk->prog, ifindex);
+    if(xsk->link < 0) {
+        xsk_close(xsk);
+        return NULL;
+    }
+
+    return xsk;
+}
+
+/*
+ *  xsk_wait() -
+ *
+ *  Waits for the socket to become ready.
+ *
+ *  @xsk    : Pointer to the socket.
+ *  @events : Events to wait for.
+ *  @timeout: Timeout value in microseconds. If zero, no timeout is used.
+ *  @nonblock: Whether not to wait at all when no timeout is given.
+ *
+ *  return:
+ *    - '1' if the socket is ready.
+ *    - '0' if the timeout expired or on error.
+ */
+static int xsk_wait(Xsk* xsk, short events, size_t timeout, int nonblock) {
+
+    struct pollfd pfd;
+    struct timespec ts;
+
+    ts.tv_sec  = timeout / 1000000;
+    ts.tv_nsec = (timeout % 1000000) * 1000;
+
+    memset(&pfd, 0, sizeof pfd);
+    pfd.fd     = xsk->fd;
+    pfd.events = events;
+
+    return ppoll(&pfd, 1, timeout || nonblock ? &ts : NULL, NULL) > 0;
+}
+
+/*
+ *  xsk_next() -
+ *
+ *  Takes the next received frame off the receive ring, waiting for one
+ *  if none is pending. The frame stays valid until the next call.
+ *
+ *  @xsk     : Pointer to the socket.
+ *  @len     : Pointer to store the length of the frame.
+ *  @timeout : Timeout value in microseconds. If zero, no timeout is used.
+ *  @nonblock: Whether to return right away when no timeout is given.
+ *
+ *  return:
+ *    - Pointer to the frame, starting with its Ethernet header.
+ *    - 'NULL' if the timeout expired or on error.
+ */
+uint8_t* xsk_next(Xsk* xsk, size_t* len, size_t timeout, int nonblock) {
+
+    struct xdp_desc* desc;
+
+    assert(xsk);
+    assert(len);
+
+    if(xsk->held != XSK_NONE) {
+        *XskRingAt(&xsk->fill, uint64_t, xsk->fill.head++) = xsk->held;
+        __atomic_store_n(xsk->fill.producer, xsk->fill.head, __ATOMIC_RELEASE);
+        xsk->held = XSK_NONE;
+    }
+
+    while(__atomic_load_n(xsk->rx.producer, __ATOMIC_ACQUIRE) == xsk->rx.head) {
+        if(!xsk_wait(xsk, POLLIN, timeout, nonblock)) {
+            return NULL;
+        }
+    }
+
+    desc = XskRingAt(&xsk->rx, struct xdp_desc, xsk->rx.head++);
+    *len = desc->len;
+    xsk->held = desc->addr - desc->addr % XSK_FRAME_SIZE;
+    __atomic_store_n(xsk->rx.consumer, xsk->rx.head, __ATOMIC_RELEASE);
+
+    return xsk->umem + desc->addr;
+}
+
+/*
+ *  xsk_reclaim() -
+ *
+ *  Takes the frames the kernel sent off the completion ring, making them
+ *  free again.
+ *
+ *  @xsk: Pointer to the socket.
+ */
+static void xsk_reclaim(Xsk* xsk) {
+
+    uint32_t prod;
+    uint64_t addr;
+
+    prod = __atomic_load_n(xsk->comp.producer, __ATOMIC_ACQUIRE);
+    while(xsk->comp.head != prod) {
+        addr = *XskRingAt(&xsk->comp, uint64_t, xsk->comp.head++);
+        xsk->free[xsk->nfree++] = addr - addr % XSK_FRAME_SIZE;
+    }
+    __atomic_store_n(xsk->comp.consumer, xsk->comp.head, __ATOMIC_RELEASE);
+}
+
+/*
+ *  xsk_slot() -
+ *
+ *  Gets a free frame to be filled and queued with 'xsk_queue()', flushing
+ *  and waiting for the kernel to send earlier ones if none is free.
+ *
+ *  @xsk: Pointer to the socket.
+ *
+ *  return:
+ *    - Pointer to the frame.
+ *    - 'NULL' on error.
+ */
+uint8_t* xsk_slot(Xsk* xsk) {
+
+    assert(xsk);
+
+    xsk_reclaim(xsk);
+    while(!xsk->nfree) {
+        if(!xsk_flush(xsk)) {
+            return NULL;
+        }
+
+        xsk_reclaim(xsk);
+        if(!xsk->nfree) {
+            xsk_wait(xsk, POLLOUT, 0, 0);
+        }
+    }
+
+    return xsk->umem + xsk->free[xsk->nfree - 1] + XSK_HEADROOM;
+}
+
+/*
+ *  xsk_queue() -
+ *
+ *  Queues the frame last got from 'xsk_slot()' for transmission.
+ *
+ *  @xsk: Pointer to the socket.
+ *  @len: Length of the frame, Ethernet header included.
+ */
+void xsk_queue(Xsk* xsk, size_t len) {
+
+    struct xdp_desc* desc;
+
+    assert(xsk);
+    assert(xsk->nfree);
+
+    desc = XskRingAt(&xsk->tx, struct xdp_desc, xsk->tx.head++);
+    desc->addr    = xsk->free[--xsk->nfree] + XSK_HEADROOM;
+    desc->len     = len;
+    desc->options = 0;
+    xsk->queued++;
+}
+
+/*
+ *  xsk_flush() -
+ *
+ *  Hands every queued frame to the kernel. A copying socket sends a
+ *  bounded number of frames per wakeup, so it is woken up until the
+ *  transmit ring is drained.
+ *
+ *  @xsk: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if every queued frame was handed over.
+ *    - '0' on failure.
+ */
+int xsk_flush(Xsk* xsk) {
+
+    assert(xsk);
+
+    if(xsk->queued) {
+        xsk->queued = 0;
+        __atomic_store_n(xsk->tx.producer, xsk->tx.head, __ATOMIC_RELEASE);
+    }
+
+    while(__atomic_load_n(xsk->tx.consumer, __ATOMIC_ACQUIRE) != xsk->tx.head && XskNeedWakeup(&xsk->tx)) {
+        if(sendto(xsk->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+           errno != EAGAIN && errno != EBUSY && errno != ENOBUFS && errno != EINTR) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ *  xsk_ring_unmap() -
+ *
+ *  Unmaps one of the rings of the socket, if mapped.
+ *
+ *  @ring: Pointer to the ring.
+ */
+static inline void xsk_ring_unmap(XskRing* ring) {
+
+    if(ring->map) {
+        munmap(ring->map, ring->size);
+    }
+}
+
+/*
+ *  xsk_close() -
+ *
+ *  Detaches the steering program, closes the socket and releases it.
+ *
+ *  @xsk: Pointer to the socket.
+ */
+void xsk_close(Xsk* xsk) {
+
+    if(xsk) {
+        if(xsk->link >= 0) {
+            close(xsk->link);
+        }
+
+        if(xsk->prog >= 0) {
+            close(xsk->prog);
+        }
+
+        if(xsk->xskmap >= 0) {
+            close(xsk->xskmap);
+        }
+
+        xsk_ring_unmap(&xsk->rx);
+        xsk_ring_unmap(&xsk->tx);
+        xsk_ring_unmap(&xsk->fill);
+        xsk_ring_unmap(&xsk->comp);
+
+        if(xsk->fd >= 0) {
+            close(xsk->fd);
+        }
+
+        if(xsk->umem) {
+            munmap(xsk->umem, xsk->size);
+        }
+
+        free(xsk);
+    }
+}
@@ -0,0 +1,143 @@
+#ifndef XSK_H
+#define XSK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <net/ethernet.h>
+#include <linux/bpf.h>
+#include <linux/if_xdp.h>
+
+#include "xsk.defs.h"
+
+/*
+ *  One of the rings shared with the kernel, of 'mask + 1' slots at 'desc'.
+ *  'head' is the local copy of the index this side moves: the producer of
+ *  the fill and transmit rings, the consumer of the receive and completion
+ *  rings. The mapping is 'size' bytes at 'map'.
+ */
+struct XskRing {
+
+    uint32_t* producer;
+    uint32_t* consumer;
+    uint32_t* flags;
+    void*     desc;
+    uint32_t  mask;
+    uint32_t  head;
+    uint8_t*  map;
+    size_t    size;
+};
+
+typedef struct XskRing XskRing;
+
+/*
+ *  AF_XDP socket bound to a queue of an interface, whose frames a small
+ *  XDP program steers to it through the map 'xskmap' when they carry the
+ *  protocol EtherType and marker; the kernel stack keeps everything else.
+ *  The program stays attached as long as 'link' is open. Frames live in
+ *  the 'size' bytes of 'umem'. 'held' is the received frame handed out
+ *  last, given back to the kernel on the next receive. The 'nfree' frames
+ *  in 'free' are ready to be filled and sent; 'queued' frames wait for
+ *  the next flush.
+ */
+struct Xsk {
+
+    int      fd;
+    int      xskmap;
+    int      prog;
+    int      link;
+    uint8_t* umem;
+    size_t   size;
+    XskRing  rx;
+    XskRing  tx;
+    XskRing  fill;
+    XskRing  comp;
+    uint64_t held;
+    size_t   queued;
+    size_t   nfree;
+    uint64_t free[XSK_TX_FRAMES];
+};
+
+typedef struct Xsk Xsk;
+
+/*
+ *  xsk_open() -
+ *
+ *  Opens an AF_XDP socket on a receive queue of an interface and attaches
+ *  the program steering the frames of the protocol to it, in native mode
+ *  if the driver supports it and in generic mode otherwise. The UMEM is
+ *  shared without copies whenever the driver allows it.
+ *
+ *  @ifindex  : Index of the network interface.
+ *  @queue    : Receive queue of the interface.
+ *  @ethertype: EtherType of the frames to steer.
+ *
+ *  return:
+ *    - Pointer to the socket.
+ *    - 'NULL' on failure.
+ */
+extern Xsk* xsk_open(int ifindex, int queue, int ethertype);
+
+/*
+ *  xsk_next() -
+ *
+ *  Takes the next received frame off the receive ring, waiting for one
+ *  if none is pending. The frame stays valid until the next call.
+ *
+ *  @xsk     : Pointer to the socket.
+ *  @len     : Pointer to store the length of the frame.
+ *  @timeout : Timeout value in microseconds. If zero, no timeout is used.
+ *  @nonblock: Whether to return right away when no timeout is given.
+ *
+ *  return:
+ *    - Pointer to the frame, starting with its Ethernet header.
+ *    - 'NULL' if the timeout expired or on error.
+ */
+extern uint8_t* xsk_next(Xsk* xsk, size_t* len, size_t timeout, int nonblock);
+
+/*
+ *  xsk_slot() -
+ *
+ *  Gets a free frame to be filled and queued with 'xsk_queue()', flushing
+ *  and waiting for the kernel to send earlier ones if none is free.
+ *
+ *  @xsk: Pointer to the socket.
+ *
+ *  return:
+ *    - Pointer to the frame.
+ *    - 'NULL' on error.
+ */
+extern uint8_t* xsk_slot(Xsk* xsk);
+
+/*
+ *  xsk_queue() -
+ *
+ *  Queues the frame last got from 'xsk_slot()' for transmission.
+ *
+ *  @xsk: Pointer to the socket.
+ *  @len: Length of the frame, Ethernet header included.
+ */
+extern void xsk_queue(Xsk* xsk, size_t len);
+
+/*
+ *  xsk_flush() -
+ *
+ *  Hands every queued frame to the kernel.
+ *
+ *  @xsk: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if every queued frame was handed over.
+ *    - '0' on failure.
+ */
+extern int xsk_flush(Xsk* xsk);
+
+/*
+ *  xsk_close() -
+ *
+ *  Detaches the steering program, closes the socket and releases it.
+ *
+ *  @xsk: Pointer to the socket.
+ */
+extern void xsk_close(Xsk* xsk);
+
+#endif  /* XSK_H */
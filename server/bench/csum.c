@@ -0,0 +1,127 @@
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "csum.h"
+
+#define BENCH_SIZE      ((size_t)64 << 20)
+#define BENCH_FRAME     1488
+#define BENCH_ROUNDS    8
+
+/*
+ *  now() -
+ *
+ *  Gets the current time in seconds.
+ *
+ *  return:
+ *    - The current time in seconds since the Epoch.
+ */
+static double now(void) {
+
+    struct timeval t;
+
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec / 1e6;
+}
+
+/*
+ *  crc8_bytewise() -
+ *
+ *  One table lookup per byte, as 'crc8()' did before slicing-by-8.
+ */
+static uint8_t crc8_bytewise(const uint8_t* buf, size_t n) {
+
+    size_t i;
+    uint8_t crc;
+
+    crc = 0;
+    for(i = 0; i < n; i++) {
+        crc = crc8(crc, buf + i, 1);
+    }
+
+    return crc;
+}
+
+/*
+ *  run() -
+ *
+ *  Checksums a buffer frame by frame and prints the throughput.
+ *
+ *  @name: Name of the algorithm and kernel.
+ *  @type: Checksum algorithm.
+ *  @buf : Pointer to the buffer.
+ *  @n   : Number of bytes in the buffer.
+ */
+static void run(const char* name, int type, const uint8_t* buf, size_t n) {
+
+    int r;
+    size_t i;
+    uint32_t acc;
+    double start;
+
+    acc   = 0;
+    start = now();
+    for(r = 0; r < BENCH_ROUNDS; r++) {
+        for(i = 0; i < n; i += BENCH_FRAME) {
+            acc += csum(type, 0, buf + i, n - i < BENCH_FRAME ? n - i : BENCH_FRAME);
+        }
+    }
+
+    printf(
+        "  %-16s %8.1f MiB/s  (%08x)\n",
+        name,
+        (double)n * BENCH_ROUNDS / (now() - start) / (1 << 20),
+        acc
+    );
+}
+
+int main(void) {
+
+    size_t i;
+    uint8_t* buf;
+    uint64_t x;
+
+    static const uint8_t check[] = "123456789";
+
+    buf = malloc(BENCH_SIZE);
+    if(!buf) {
+        perror("error - failed to allocate buffer");
+        return 1;
+    }
+
+    x = 88172645463325252ULL;
+    for(i = 0; i < BENCH_SIZE; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = (uint8_t)x;
+    }
+
+    printf(
+        "check values: crc8 %02x (f4), crc32c %08x (e3069283)\n",
+        crc8(0, check, sizeof check - 1),
+        crc32c(0, check, sizeof check - 1)
+    );
+
+    for(i = 0; i < 4096; i++) {
+        if(crc8(0, buf, i) != crc8_bytewise(buf, i)) {
+            printf("error - slicing-by-8 crc8 mismatch at %zu bytes\n", i);
+            return 1;
+        }
+    }
+
+    printf("%d-byte frames:\n", BENCH_FRAME);
+    run("crc8 slice8", CSUM_CRC8, buf, BENCH_SIZE);
+    if(crc32c_kernel("slice8")) {
+        run("crc32c slice8", CSUM_CRC32C, buf, BENCH_SIZE);
+    }
+    if(crc32c_kernel("sse4.2")) {
+        run("crc32c sse4.2", CSUM_CRC32C, buf, BENCH_SIZE);
+    }
+
+    free(buf);
+
+    return 0;
+}
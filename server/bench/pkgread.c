@@ -0,0 +1,237 @@
+
+#include <sys/time.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "pkg.h"
+#include "pkg.defs.h"
+
+#define BENCH_PATH      "/tmp/pkgread.bench"
+#define BENCH_SIZE      ((size_t)1 << 30)
+#define BENCH_PAYLOAD   (1500 - PKG_HDR_SIZE)
+
+/*
+ *  usage() -
+ *
+ *  Prints the usage information for the benchmark.
+ *
+ *  @exec: The name of the executable.
+ */
+static void usage(const char* exec) {
+
+    printf(
+        "usage: %s [<asset> [<bytes> [<payload>]]]\n",
+        exec
+    );
+}
+
+/*
+ *  now() -
+ *
+ *  Gets the current time in seconds.
+ *
+ *  return:
+ *    - The current time in seconds since the Epoch.
+ */
+static double now(void) {
+
+    struct timeval t;
+
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec / 1e6;
+}
+
+/*
+ *  mkasset() -
+ *
+ *  Creates the benchmark asset filled with pseudo-random bytes, unless a
+ *  file of the requested size already exists.
+ *
+ *  @path: Path of the asset.
+ *  @size: Size of the asset in bytes.
+ *
+ *  return:
+ *    - '1' if the asset is ready.
+ *    - '0' otherwise.
+ */
+static int mkasset(const char* path, size_t size) {
+
+    FILE* fp;
+    size_t i;
+    size_t n;
+    uint64_t x;
+    uint64_t buf[8192];
+
+    fp = fopen(path, "rb");
+    if(fp) {
+        fseek(fp, 0, SEEK_END);
+        n = (size_t)ftell(fp);
+        fclose(fp);
+        if(n == size) {
+            return 1;
+        }
+    }
+
+    fp = fopen(path, "wb");
+    if(!fp) {
+        return 0;
+    }
+
+    x = 88172645463325252ULL;
+    for(n = 0; n < size; n += sizeof buf) {
+        for(i = 0; i < sizeof buf / sizeof buf[0]; i++) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            buf[i] = x;
+        }
+        fwrite(buf, 1, size - n < sizeof buf ? size - n : sizeof buf, fp);
+    }
+
+    fclose(fp);
+
+    return 1;
+}
+
+/*
+ *  pkgread_bytewise() -
+ *
+ *  The reader 'pkgread()' replaced: one 'fread()' and one escape check
+ *  per byte.
+ *
+ *  @pkg: Pointer to the Pkg structure where the data will be stored.
+ *  @fp : Pointer to the FILE object from which data will be read.
+ *  @n  : Number of content bytes the package may hold.
+ *
+ *  return:
+ *    -  '1' if the data is successfully read and stored in the package.
+ *    - '-1' if there was nothing left to read.
+ */
+static int pkgread_bytewise(Pkg* pkg, FILE* fp, size_t n) {
+
+    size_t i;
+    uint8_t byte;
+
+    pkg->data.size = 0;
+    for(i = 0; i < n;) {
+        if(fread(&byte, sizeof byte, 1, fp) != 1) {
+            pkg->data.size = i;
+            return -1;
+        }
+        pkg->data.content[i] = byte;
+        if((byte == 0x81 || byte == 0x88) && i + 1 < n) {
+            pkg->data.content[++i] = 0xff;
+        }
+        i++;
+    }
+    pkg->data.size = i;
+
+    return 1;
+}
+
+/*
+ *  report() -
+ *
+ *  Prints the throughput of one run.
+ *
+ *  @name : Name of the reader.
+ *  @bytes: Number of content bytes produced.
+ *  @secs : Duration of the run in seconds.
+ */
+static void report(const char* name, size_t bytes, double secs) {
+
+    printf(
+        "%-10s %10.1f MiB/s  (%zu bytes in %.3f s)\n",
+        name,
+        bytes / secs / (1 << 20),
+        bytes,
+        secs
+    );
+}
+
+int main(int argc, char** argv) {
+
+    int i;
+    int fd;
+    int ret;
+    FILE* fp;
+    size_t size;
+    size_t payload;
+    size_t bytes;
+    double start;
+
+    static Pkg pkg;
+    static PkgVec vec;
+    PkgStage st;
+    Uring* ur;
+
+    static const char* names[] = { "copied", "referenced", "read-ahead", "direct" };
+
+    if(argc > 1 && argv[1][0] == '-') {
+        usage(argv[0]);
+        return 1;
+    }
+
+    size    = argc > 2 ? strtoull(argv[2], NULL, 0) : BENCH_SIZE;
+    payload = argc > 3 ? strtoull(argv[3], NULL, 0) : BENCH_PAYLOAD;
+    if(payload < 2 || payload > sizeof pkg.data.content) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(!mkasset(argc > 1 ? argv[1] : BENCH_PATH, size)) {
+        perror("error - failed to create asset");
+        return 1;
+    }
+
+    fp = fopen(argc > 1 ? argv[1] : BENCH_PATH, "rb");
+    if(!fp) {
+        perror("error - failed to open asset");
+        return 1;
+    }
+
+    bytes = 0;
+    start = now();
+    while(pkgread_bytewise(&pkg, fp, payload) > 0) {
+        bytes += pkg.data.size;
+    }
+    bytes += pkg.data.size;
+    report("bytewise", bytes, now() - start);
+    fclose(fp);
+
+    for(i = 0; i < 4; i++) {
+        ur = NULL;
+        if(i >= 2) {
+            ur = uring_open(URING_ENTRIES);
+            if(!ur) {
+                perror("error - failed to set up read-ahead");
+                return 1;
+            }
+        }
+
+        fd = open(argc > 1 ? argv[1] : BENCH_PATH, O_RDONLY);
+        if(fd < 0 || !pkgstage_init(&st, fd, ur, i == 3, 0, 0)) {
+            perror("error - failed to open asset");
+            return 1;
+        }
+
+        bytes = 0;
+        start = now();
+        while((ret = pkgread(&pkg, i == 1 ? &vec : NULL, &st, payload)) > 0) {
+            if(ret == PKG_AGAIN) {
+                uring_submit(ur, 1);
+                pkgstage_reap(ur);
+                continue;
+            }
+            bytes += pkg.data.size;
+        }
+        bytes += pkg.data.size;
+        report(names[i], bytes, now() - start);
+        pkgstage_deinit(&st);
+        uring_close(ur);
+    }
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stuff.h"
+
+#define BENCH_SIZE      ((size_t)64 << 20)
+#define BENCH_FRAME     1488
+#define BENCH_ROUNDS    8
+
+/*
+ *  now() -
+ *
+ *  Gets the current time in seconds.
+ *
+ *  return:
+ *    - The current time in seconds since the Epoch.
+ */
+static double now(void) {
+
+    struct timeval t;
+
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec / 1e6;
+}
+
+/*
+ *  fill() -
+ *
+ *  Fills a buffer with pseudo-random bytes, optionally free of sentinels.
+ *
+ *  @buf  : Pointer to the buffer.
+ *  @n    : Number of bytes in the buffer.
+ *  @clean: Whether sentinel bytes must be replaced.
+ */
+static void fill(uint8_t* buf, size_t n, int clean) {
+
+    size_t i;
+    uint64_t x;
+
+    x = 88172645463325252ULL;
+    for(i = 0; i < n; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = (uint8_t)x;
+        if(clean && issentinel(buf[i])) {
+            buf[i] = 0;
+        }
+    }
+}
+
+/*
+ *  run() -
+ *
+ *  Stuffs a buffer into frame-sized chunks and unstuffs them back in place,
+ *  printing the throughput of both directions.
+ *
+ *  @name: Name of the kernels, or 'NULL' for plain 'memcpy()'.
+ *  @src : Pointer to the source buffer.
+ *  @dst : Pointer to the destination buffer, twice as large as 'src'.
+ *  @n   : Number of bytes in the source buffer.
+ */
+static void run(const char* name, const uint8_t* src, uint8_t* dst, size_t n) {
+
+    int r;
+    size_t i;
+    size_t o;
+    size_t k;
+    size_t used;
+    double t0;
+    double t1;
+    double t2;
+
+    o  = 0;
+    t0 = now();
+    for(r = 0; r < BENCH_ROUNDS; r++) {
+        for(i = 0, o = 0; i < n; i += used, o += k) {
+            if(name) {
+                k = stuff(dst + o, BENCH_FRAME, src + i, n - i, &used);
+            } else {
+                used = k = n - i < BENCH_FRAME ? n - i : BENCH_FRAME;
+                memcpy(dst + o, src + i, k);
+            }
+        }
+    }
+
+    t1 = now();
+    for(r = 0; r < BENCH_ROUNDS && name; r++) {
+        for(i = 0; i < o; i += BENCH_FRAME) {
+            unstuff(dst + i, o - i < BENCH_FRAME ? o - i : BENCH_FRAME);
+        }
+    }
+    t2 = now();
+
+    if(!name) {
+        printf(
+            "  %-8s copy  %8.1f MiB/s\n",
+            "memcpy",
+            (double)n * BENCH_ROUNDS / (t1 - t0) / (1 << 20)
+        );
+        return;
+    }
+
+    printf(
+        "  %-8s stuff %8.1f MiB/s   unstuff %8.1f MiB/s\n",
+        name,
+        (double)n * BENCH_ROUNDS / (t1 - t0) / (1 << 20),
+        (double)o * BENCH_ROUNDS / (t2 - t1) / (1 << 20)
+    );
+}
+
+int main(void) {
+
+    int clean;
+    size_t i;
+    uint8_t* src;
+    uint8_t* dst;
+
+    static const char* kernels[] = { "scalar", "sse2", "avx2" };
+
+    src = malloc(BENCH_SIZE);
+    dst = malloc(2 * BENCH_SIZE);
+    if(!src || !dst) {
+        perror("error - failed to allocate buffers");
+        return 1;
+    }
+
+    for(clean = 0; clean < 2; clean++) {
+        fill(src, BENCH_SIZE, clean);
+        printf("%s data:\n", clean ? "sentinel-free" : "random");
+        run(NULL, src, dst, BENCH_SIZE);
+        for(i = 0; i < sizeof kernels / sizeof kernels[0]; i++) {
+            if(stuff_kernel(kernels[i])) {
+                run(kernels[i], src, dst, BENCH_SIZE);
+            }
+        }
+    }
+
+    free(src);
+    free(dst);
+
+    return 0;
+}
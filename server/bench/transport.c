@@ -0,0 +1,122 @@
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "socket.h"
+#include "pkg.h"
+
+#define BENCH_FRAMES    ((size_t)1 << 18)
+#define BENCH_TIMEOUT   100000
+#define BENCH_BUFFER    ((size_t)8 << 20)
+#define BENCH_PORT      "47815"
+
+/*
+ *  now() -
+ *
+ *  Gets the current time in seconds.
+ *
+ *  return:
+ *    - The current time in seconds since the Epoch.
+ */
+static double now(void) {
+
+    struct timeval t;
+
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec / 1e6;
+}
+
+/*
+ *  run() -
+ *
+ *  Pushes frames from a socket to another one, a batch at a time, and
+ *  prints the throughput along with the frames that went missing.
+ *
+ *  @name: Name of the transport.
+ *  @tx  : Pointer to the sending socket.
+ *  @rx  : Pointer to the receiving socket.
+ *  @size: Size of the frames.
+ */
+static void run(const char* name, Socket* tx, Socket* rx, size_t size) {
+
+    size_t i;
+    size_t len;
+    size_t got;
+    size_t sent;
+    double start;
+    uint8_t* frame;
+    static uint8_t buf[SOCKET_BATCH][PKG_MAX_FRAME];
+
+    for(i = 0; i < SOCKET_BATCH; i++) {
+        memset(buf[i], (int)i, size);
+    }
+
+    got   = 0;
+    start = now();
+    for(sent = 0; sent < BENCH_FRAMES; sent += SOCKET_BATCH) {
+
+        for(i = 0; i < SOCKET_BATCH; i++) {
+            socket_queue(tx, buf[i], size);
+        }
+        socket_flush(tx);
+
+        for(i = 0; i < SOCKET_BATCH; i++) {
+            frame = socket_next(rx, &len, BENCH_TIMEOUT);
+            if(!frame) {
+                break;
+            }
+            got++;
+        }
+    }
+
+    printf(
+        "  %-6s %5zu bytes %8.1f kframes/s %8.1f MiB/s  (%zu lost, gso %d, gro %d)\n",
+        name,
+        size,
+        (double)got / (now() - start) / 1e3,
+        (double)got * size / (now() - start) / (1 << 20),
+        BENCH_FRAMES - got,
+        tx->gso,
+        rx->gro
+    );
+}
+
+int main(void) {
+
+    Socket* pair[2];
+    Socket* srv;
+    Socket* cli;
+
+    if(!socket_pair(pair)) {
+        perror("error - failed to create socket pair");
+        return 1;
+    }
+
+    srv = socket_create("udp:" BENCH_PORT, 0, 0);
+    cli = socket_create("udp:127.0.0.1:" BENCH_PORT, 0, 0);
+    if(!srv || !cli) {
+        perror("error - failed to open udp sockets");
+        return 1;
+    }
+
+    socket_buffer(pair[0], BENCH_BUFFER);
+    socket_buffer(pair[1], BENCH_BUFFER);
+    socket_buffer(srv, BENCH_BUFFER);
+    socket_buffer(cli, BENCH_BUFFER);
+
+    run("unix", pair[0], pair[1], SOCKET_UDP_MTU);
+    run("unix", pair[0], pair[1], socket_mtu(pair[0], ""));
+    run("udp",  cli, srv, socket_mtu(cli, ""));
+
+    cli->gso = 0;
+    run("udp",  cli, srv, socket_mtu(cli, ""));
+
+    socket_close(pair[0]);
+    socket_close(pair[1]);
+    socket_close(srv);
+    socket_close(cli);
+
+    return 0;
+}
@@ -0,0 +1,456 @@
+#include <assert.h>
+#include <string.h>
+
+#include "cc.h"
+
+/*
+ *  Pacing gains BBR cycles through while probing for bandwidth, one
+ *  minimum round trip each: probe above the estimate, drain the queue
+ *  the probe built, then cruise.
+ */
+static const size_t bbr_cycle[CC_BBR_CYCLE] = {
+    1250, 750, 1000, 1000, 1000, 1000, 1000, 1000
+};
+
+/*
+ *  clamp_cwnd() -
+ *
+ *  Keeps a window between 'CC_MIN_CWND' and the limit of the controller.
+ *
+ *  @cc  : Pointer to the Cc structure.
+ *  @cwnd: Window, in frames.
+ *
+ *  return:
+ *    - The clamped window.
+ */
+static inline size_t clamp_cwnd(const Cc* cc, size_t cwnd) {
+
+    if(cwnd < CC_MIN_CWND) {
+        cwnd = CC_MIN_CWND;
+    }
+
+    if(cwnd > cc->limit) {
+        cwnd = cc->limit;
+    }
+
+    return cwnd;
+}
+
+/*
+ *  aimd_init() -
+ *
+ *  Starts in slow start with the initial window.
+ *
+ *  @cc: Pointer to the Cc structure.
+ */
+static void aimd_init(Cc* cc) {
+
+    cc->cwnd     = CC_INIT_CWND;
+    cc->ssthresh = (size_t)-1;
+    cc->grow     = 0;
+}
+
+/*
+ *  aimd_ack() -
+ *
+ *  Opens the window by a frame per acknowledged frame in slow start and by
+ *  a frame per window in congestion avoidance, and paces a window per
+ *  smoothed round trip, faster while the window still doubles.
+ *
+ *  @cc: Pointer to the Cc structure.
+ *  @s : What the acknowledgment told.
+ */
+static void aimd_ack(Cc* cc, const CcSample* s) {
+
+    size_t gain;
+
+    if(cc->cwnd < cc->ssthresh) {
+        cc->cwnd += s->acked;
+    } else {
+        cc->grow += s->acked;
+        while(cc->grow >= cc->cwnd) {
+            cc->grow -= cc->cwnd;
+            cc->cwnd++;
+        }
+    }
+
+    cc->cwnd = clamp_cwnd(cc, cc->cwnd);
+
+    gain = cc->cwnd < cc->ssthresh ? CC_AIMD_SS_GAIN : CC_AIMD_CA_GAIN;
+    cc->rate = 0;
+    if(s->srtt) {
+        cc->rate = cc->cwnd * cc->mss * USEC / s->srtt * gain / CC_GAIN_UNIT;
+    }
+}
+
+/*
+ *  aimd_loss() -
+ *
+ *  Halves the window.
+ *
+ *  @cc: Pointer to the Cc structure.
+ */
+static void aimd_loss(Cc* cc) {
+
+    cc->ssthresh = clamp_cwnd(cc, cc->cwnd / 2);
+    cc->cwnd     = cc->ssthresh;
+    cc->grow     = 0;
+}
+
+/*
+ *  aimd_timeout() -
+ *
+ *  Halves the slow start threshold and starts over from a single frame.
+ *
+ *  @cc: Pointer to the Cc structure.
+ */
+static void aimd_timeout(Cc* cc) {
+
+    cc->ssthresh = clamp_cwnd(cc, cc->cwnd / 2);
+    cc->cwnd     = 1;
+    cc->grow     = 0;
+}
+
+/*
+ *  bbr_bw() -
+ *
+ *  Gets the bandwidth estimate, the highest delivery rate of the last
+ *  rounds.
+ *
+ *  @cc: Pointer to the Cc structure.
+ *
+ *  return:
+ *    - The bandwidth in bytes per second, '0' until the first sample.
+ */
+static size_t bbr_bw(const Cc* cc) {
+
+    size_t i;
+    size_t bw;
+
+    bw = 0;
+    for(i = 0; i < CC_BBR_BW_ROUNDS; i++) {
+        if(cc->bbr.bw[i] > bw) {
+            bw = cc->bbr.bw[i];
+        }
+    }
+
+    return bw;
+}
+
+/*
+ *  bbr_init() -
+ *
+ *  Starts probing for bandwidth with the initial window.
+ *
+ *  @cc: Pointer to the Cc structure.
+ */
+static void bbr_init(Cc* cc) {
+
+    memset(&cc->bbr, 0, sizeof cc->bbr);
+    cc->bbr.mode = CC_BBR_STARTUP;
+    cc->cwnd     = CC_INIT_CWND;
+    cc->ssthresh = (size_t)-1;
+}
+
+/*
+ *  bbr_ack() -
+ *
+ *  Feeds the delivery rate and round trip to their filters, moves through
+ *  the startup, drain and bandwidth probing phases, then sizes the window
+ *  after the estimated bandwidth-delay product and paces at the estimated
+ *  bandwidth, both scaled by the gains of the phase.
+ *
+ *  @cc: Pointer to the Cc structure.
+ *  @s : What the acknowledgment told.
+ */
+static void bbr_ack(Cc* cc, const CcSample* s) {
+
+    size_t bw;
+    size_t bdp;
+    size_t gain;
+    size_t target;
+
+    if(s->round) {
+        cc->bbr.round++;
+        cc->bbr.bw[cc->bbr.round % CC_BBR_BW_ROUNDS] = 0;
+    }
+
+    if(s->rate > cc->bbr.bw[cc->bbr.round % CC_BBR_BW_ROUNDS]) {
+        cc->bbr.bw[cc->bbr.round % CC_BBR_BW_ROUNDS] = s->rate;
+    }
+
+    if(s->rtt && (!cc->bbr.minrtt || s->rtt <= cc->bbr.minrtt || s->now - cc->bbr.minstamp > CC_BBR_RTT_WINDOW)) {
+        cc->bbr.minrtt   = s->rtt;
+        cc->bbr.minstamp = s->now;
+    }
+
+    bw = bbr_bw(cc);
+    if(!bw || !cc->bbr.minrtt) {
+        return;
+    }
+
+    bdp = bw * cc->bbr.minrtt / USEC / cc->mss;
+
+    switch(cc->bbr.mode) {
+        case CC_BBR_STARTUP:
+            if(s->round) {
+                if(bw >= cc->bbr.fullbw / CC_GAIN_UNIT * 1250) {
+                    cc->bbr.fullbw = bw;
+                    cc->bbr.full   = 0;
+                } else {
+                    if(++cc->bbr.full >= CC_BBR_FULL_ROUNDS) {
+                        cc->bbr.mode = CC_BBR_DRAIN;
+                    }
+                }
+            }
+            break;
+        case CC_BBR_DRAIN:
+            if(s->inflight <= bdp) {
+                cc->bbr.mode       = CC_BBR_PROBE_BW;
+                cc->bbr.cycle      = 2;
+                cc->bbr.cyclestamp = s->now;
+            }
+            break;
+        case CC_BBR_PROBE_BW:
+            if(s->now - cc->bbr.cyclestamp > cc->bbr.minrtt) {
+                cc->bbr.cycle      = (cc->bbr.cycle + 1) % CC_BBR_CYCLE;
+                cc->bbr.cyclestamp = s->now;
+            }
+            break;
+    }
+
+    gain = CC_BBR_HIGH_GAIN;
+    if(cc->bbr.mode == CC_BBR_DRAIN) {
+        gain = CC_BBR_DRAIN_GAIN;
+    } else {
+        if(cc->bbr.mode == CC_BBR_PROBE_BW) {
+            gain = bbr_cycle[cc->bbr.cycle];
+        }
+    }
+
+    cc->rate = bw / CC_GAIN_UNIT * gain;
+
+    /*
+     *  The window grows with acknowledgments up to the target, so a
+     *  burst of them cannot open it at once. It may only shrink to the
+     *  target once the pipe was filled.
+     */
+    target = bdp * (cc->bbr.mode == CC_BBR_PROBE_BW ? CC_BBR_CWND_GAIN : CC_BBR_HIGH_GAIN) / CC_GAIN_UNIT;
+    if(cc->bbr.mode != CC_BBR_STARTUP) {
+        cc->cwnd = cc->cwnd + s->acked < target ? cc->cwnd + s->acked : target;
+    } else {
+        if(cc->cwnd < target) {
+            cc->cwnd += s->acked;
+        }
+    }
+
+    cc->cwnd = clamp_cwnd(cc, cc->cwnd);
+}
+
+/*
+ *  bbr_loss() -
+ *
+ *  Losses do not tell BBR the pipe is full, the delivery rate does.
+ *
+ *  @cc: Pointer to the Cc structure.
+ */
+static void bbr_loss(Cc* cc) {
+
+    (void)cc;
+}
+
+/*
+ *  bbr_timeout() -
+ *
+ *  Falls back to the smallest window, which the next acknowledgments open
+ *  again towards the bandwidth-delay product.
+ *
+ *  @cc: Pointer to the Cc structure.
+ */
+static void bbr_timeout(Cc* cc) {
+
+    cc->cwnd = CC_MIN_CWND;
+}
+
+static const CcOps cc_algos[] = {
+    { "aimd", aimd_init, aimd_ack, aimd_loss, aimd_timeout },
+    { "bbr",  bbr_init,  bbr_ack,  bbr_loss,  bbr_timeout  }
+};
+
+/*
+ *  cc_find() -
+ *
+ *  Looks a congestion control algorithm up by name.
+ *
+ *  @name: Name of the algorithm ("aimd" or "bbr"), or 'NULL' for the
+ *         default one.
+ *
+ *  return:
+ *    - Pointer to the algorithm.
+ *    - 'NULL' if there is no such algorithm.
+ */
+const CcOps* cc_find(const char* name) {
+
+    size_t i;
+
+    if(!name) {
+        return &cc_algos[0];
+    }
+
+    for(i = 0; i < sizeof cc_algos / sizeof *cc_algos; i++) {
+        if(!strcmp(name, cc_algos[i].name)) {
+            return &cc_algos[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ *  cc_init() -
+ *
+ *  Initializes a congestion controller. Frames leave unpaced until the
+ *  first acknowledgments tell how fast they may.
+ *
+ *  @cc   : Pointer to the Cc structure.
+ *  @ops  : Algorithm it runs.
+ *  @mss  : Number of bytes a frame takes on the wire.
+ *  @limit: Largest window, in frames, the controller may open.
+ */
+void cc_init(Cc* cc, const CcOps* ops, size_t mss, size_t limit) {
+
+    assert(cc);
+    assert(ops);
+
+    memset(cc, 0, sizeof *cc);
+    cc->ops   = ops;
+    cc->mss   = mss;
+    cc->limit = limit < CC_MIN_CWND ? CC_MIN_CWND : limit;
+    ops->init(cc);
+}
+
+/*
+ *  cc_ack() -
+ *
+ *  Lets the controller react to the acknowledgment of new frames.
+ *
+ *  @cc: Pointer to the Cc structure.
+ *  @s : What the acknowledgment told.
+ */
+void cc_ack(Cc* cc, const CcSample* s) {
+
+    assert(cc);
+    assert(s);
+
+    cc->ops->ack(cc, s);
+}
+
+/*
+ *  cc_loss() -
+ *
+ *  Lets the controller react to a frame deemed lost, once per window:
+ *  frames sent before the last reaction are lost to the same congestion.
+ *
+ *  @cc  : Pointer to the Cc structure.
+ *  @tx  : Transmission number of the lost frame.
+ *  @last: Number of the last transmission so far.
+ */
+void cc_loss(Cc* cc, size_t tx, size_t last) {
+
+    assert(cc);
+
+    if(tx > cc->recover) {
+        cc->recover = last;
+        cc->ops->loss(cc);
+    }
+}
+
+/*
+ *  cc_timeout() -
+ *
+ *  Lets the controller react to an expired retransmission timeout.
+ *
+ *  @cc  : Pointer to the Cc structure.
+ *  @last: Number of the last transmission so far.
+ */
+void cc_timeout(Cc* cc, size_t last) {
+
+    assert(cc);
+
+    cc->recover = last;
+    cc->ops->timeout(cc);
+}
+
+/*
+ *  cc_ready() -
+ *
+ *  Refills the pacing token bucket and tells whether a frame may leave.
+ *  The bucket holds at most 'CC_BURST' frames worth of bytes. Time is only
+ *  accounted for once it earned a whole byte, so slow rates lose nothing
+ *  to rounding.
+ *
+ *  @cc : Pointer to the Cc structure.
+ *  @now: Current time, in microseconds.
+ *
+ *  return:
+ *    - '1' if a frame may be sent now.
+ *    - '0' if the pacing rate holds it back.
+ */
+int cc_ready(Cc* cc, size_t now) {
+
+    size_t add;
+
+    assert(cc);
+
+    if(!cc->rate) {
+        cc->stamp = now;
+        return 1;
+    }
+
+    add = (now - cc->stamp) * cc->rate / USEC;
+    if(add) {
+        cc->tokens += add;
+        cc->stamp   = now;
+        if(cc->tokens > CC_BURST * cc->mss) {
+            cc->tokens = CC_BURST * cc->mss;
+        }
+    }
+
+    return cc->tokens >= cc->mss;
+}
+
+/*
+ *  cc_spend() -
+ *
+ *  Takes the bytes of a frame just sent from the token bucket.
+ *
+ *  @cc   : Pointer to the Cc structure.
+ *  @bytes: Number of bytes sent.
+ */
+void cc_spend(Cc* cc, size_t bytes) {
+
+    assert(cc);
+
+    cc->tokens = cc->tokens > bytes ? cc->tokens - bytes : 0;
+}
+
+/*
+ *  cc_delay() -
+ *
+ *  Tells how long the pacing rate holds the next frame back.
+ *
+ *  @cc : Pointer to the Cc structure.
+ *
+ *  return:
+ *    - Number of microseconds until a frame may be sent.
+ */
+size_t cc_delay(const Cc* cc) {
+
+    assert(cc);
+
+    if(!cc->rate || cc->tokens >= cc->mss) {
+        return 0;
+    }
+
+    return (cc->mss - cc->tokens) * USEC / cc->rate + 1;
+}
@@ -0,0 +1,43 @@
+#ifndef CC_DEFS_H
+#define CC_DEFS_H
+
+/*
+ *  Congestion window bounds, in frames. A controller starts with
+ *  'CC_INIT_CWND' frames and never goes below 'CC_MIN_CWND' but after a
+ *  retransmission timeout.
+ */
+#define CC_INIT_CWND        10
+#define CC_MIN_CWND         4
+
+/*
+ *  Pacing. The token bucket holds at most 'CC_BURST' frames worth of
+ *  bytes, so a sender woken up late catches up with a short burst.
+ */
+#define CC_BURST            16
+
+/*
+ *  Gains, in thousandths. 'CC_AIMD_*' multiply the rate of a window per
+ *  round trip into the pacing rate, 'CC_BBR_*' the estimated bandwidth
+ *  into the pacing rate and the bandwidth-delay product into the window.
+ */
+#define CC_GAIN_UNIT        1000
+#define CC_AIMD_SS_GAIN     2000
+#define CC_AIMD_CA_GAIN     1200
+#define CC_BBR_HIGH_GAIN    2885
+#define CC_BBR_DRAIN_GAIN   346
+#define CC_BBR_CWND_GAIN    2000
+
+/*
+ *  BBR filters: the bandwidth is the highest delivery rate of the last
+ *  'CC_BBR_BW_ROUNDS' round trips, the minimum round trip is kept for
+ *  'CC_BBR_RTT_WINDOW' microseconds. The pipe is deemed full once the
+ *  bandwidth grew by less than a quarter for 'CC_BBR_FULL_ROUNDS' rounds.
+ */
+#define CC_BBR_BW_ROUNDS    10
+#define CC_BBR_RTT_WINDOW   (10 * 1000 * 1000)
+#define CC_BBR_FULL_ROUNDS  3
+#define CC_BBR_CYCLE        8
+
+#define USEC                1000000
+
+#endif  /* CC_DEFS_H */
@@ -0,0 +1,184 @@
+#ifndef CC_H
+#define CC_H
+
+#include <stddef.h>
+
+#include "cc.defs.h"
+
+typedef struct Cc Cc;
+
+enum CcBbrMode {
+
+    CC_BBR_STARTUP,
+    CC_BBR_DRAIN,
+    CC_BBR_PROBE_BW
+};
+
+typedef enum CcBbrMode CcBbrMode;
+
+/*
+ *  What an acknowledgment tells the congestion controller. 'rtt' and
+ *  'rate' are '0' when the acknowledgment does not allow measuring them.
+ */
+struct CcSample {
+
+    size_t now;
+    size_t acked;
+    size_t inflight;
+    size_t rtt;
+    size_t srtt;
+    size_t rate;
+    int    round;
+};
+
+typedef struct CcSample CcSample;
+
+/*
+ *  A congestion control algorithm. 'ack' is called for every
+ *  acknowledgment of new frames, 'loss' once per window that lost
+ *  frames, 'timeout' whenever the retransmission timeout expires.
+ */
+struct CcOps {
+
+    const char* name;
+    void (*init)(Cc* cc);
+    void (*ack)(Cc* cc, const CcSample* s);
+    void (*loss)(Cc* cc);
+    void (*timeout)(Cc* cc);
+};
+
+typedef struct CcOps CcOps;
+
+/*
+ *  State of the congestion controller of a context. 'cwnd' bounds the
+ *  frames in flight and 'rate' paces them, in bytes per second, unless
+ *  it is '0', through a bucket of 'tokens' bytes last refilled at 'stamp'.
+ *  Frames sent up to transmission 'recover' belong to the window that last
+ *  reacted to a loss. 'grow' counts the frames acknowledged towards the
+ *  next increase of an AIMD window, 'bbr' holds the filters and phase of
+ *  BBR.
+ */
+struct Cc {
+
+    const CcOps* ops;
+
+    size_t mss;
+    size_t limit;
+    size_t cwnd;
+    size_t ssthresh;
+    size_t rate;
+    size_t recover;
+
+    size_t tokens;
+    size_t stamp;
+
+    size_t grow;
+
+    struct {
+
+        CcBbrMode mode;
+        size_t    bw[CC_BBR_BW_ROUNDS];
+        size_t    round;
+        size_t    minrtt;
+        size_t    minstamp;
+        size_t    fullbw;
+        size_t    full;
+        size_t    cycle;
+        size_t    cyclestamp;
+    } bbr;
+};
+
+/*
+ *  cc_find() -
+ *
+ *  Looks a congestion control algorithm up by name.
+ *
+ *  @name: Name of the algorithm ("aimd" or "bbr"), or 'NULL' for the
+ *         default one.
+ *
+ *  return:
+ *    - Pointer to the algorithm.
+ *    - 'NULL' if there is no such algorithm.
+ */
+extern const CcOps* cc_find(const char* name);
+
+/*
+ *  cc_init() -
+ *
+ *  Initializes a congestion controller.
+ *
+ *  @cc   : Pointer to the Cc structure.
+ *  @ops  : Algorithm it runs.
+ *  @mss  : Number of bytes a frame takes on the wire.
+ *  @limit: Largest window, in frames, the controller may open.
+ */
+extern void cc_init(Cc* cc, const CcOps* ops, size_t mss, size_t limit);
+
+/*
+ *  cc_ack() -
+ *
+ *  Lets the controller react to the acknowledgment of new frames.
+ *
+ *  @cc: Pointer to the Cc structure.
+ *  @s : What the acknowledgment told.
+ */
+extern void cc_ack(Cc* cc, const CcSample* s);
+
+/*
+ *  cc_loss() -
+ *
+ *  Lets the controller react to a frame deemed lost, once per window.
+ *
+ *  @cc  : Pointer to the Cc structure.
+ *  @tx  : Transmission number of the lost frame.
+ *  @last: Number of the last transmission so far.
+ */
+extern void cc_loss(Cc* cc, size_t tx, size_t last);
+
+/*
+ *  cc_timeout() -
+ *
+ *  Lets the controller react to an expired retransmission timeout.
+ *
+ *  @cc  : Pointer to the Cc structure.
+ *  @last: Number of the last transmission so far.
+ */
+extern void cc_timeout(Cc* cc, size_t last);
+
+/*
+ *  cc_ready() -
+ *
+ *  Refills the pacing token bucket and tells whether a frame may leave.
+ *
+ *  @cc : Pointer to the Cc structure.
+ *  @now: Current time, in microseconds.
+ *
+ *  return:
+ *    - '1' if a frame may be sent now.
+ *    - '0' if the pacing rate holds it back.
+ */
+extern int cc_ready(Cc* cc, size_t now);
+
+/*
+ *  cc_spend() -
+ *
+ *  Takes the bytes of a frame just sent from the token bucket.
+ *
+ *  @cc   : Pointer to the Cc structure.
+ *  @bytes: Number of bytes sent.
+ */
+extern void cc_spend(Cc* cc, size_t bytes);
+
+/*
+ *  cc_delay() -
+ *
+ *  Tells how long the pacing rate holds the next frame back.
+ *
+ *  @cc : Pointer to the Cc structure.
+ *
+ *  return:
+ *    - Number of microseconds until a frame may be sent.
+ */
+extern size_t cc_delay(const Cc* cc);
+
+#endif  /* CC_H */
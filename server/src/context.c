@@ -3,11 +3,14 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
 
 #include "context.h"
 #include "pkg.defs.h"
 #include "pkg.h"
+#include "stuff.h"
 
 static int context_ls_update_with_ack(Context*);
 
@@ -29,6 +32,8 @@ Context* context_create(void) {
         return NULL;
     }
 
+    ctx->rtt.rto = CTX_RTO_INIT;
+
     return ctx;
 }
 
@@ -60,11 +65,41 @@ static inline int get_file_size(const char* path, size_t* size) {
     return ret;
 }
 
+/*
+ *  window_hold() -
+ *
+ *  Puts the control package alone in the window, with the current
+ *  sequence number.
+ *
+ *  @ctx: Pointer to the Context structure.
+ */
+static inline void window_hold(Context* ctx) {
+
+    CtxFrame* frame;
+
+    assert(ctx);
+
+    frame = CtxFrameAt(ctx, ctx->indx);
+    frame->off   = 0;
+    frame->len   = 0;
+    frame->type  = ctx->win.ctl.data.type;
+    frame->acked = 0;
+    frame->tries = 0;
+    frame->tx    = 0;
+
+    ctx->win.base   = ctx->indx;
+    ctx->win.next   = ctx->indx + 1;
+    ctx->win.oldest = CTX_NONE;
+    ctx->win.newest = CTX_NONE;
+    ctx->win.sacked = 0;
+    ctx->rtt.deadline = 0;
+}
+
 /*
  *  init_download_initial_response() -
  *
- *  Initializes the initial response for a download by setting up the context
- *  window buffer with the size of the file.
+ *  Initializes the initial response for a download by putting a descriptor
+ *  holding the size of the file alone in the context window.
  *
  *  @ctx   : Pointer to the Context structure that holds the state and buffer for
  *           the download.
@@ -86,12 +121,16 @@ static int download_initial_response(Context* ctx, const char* path) {
     ret = get_file_size(path, &size); 
     if(ret) {
         pkginit(
-            &ctx->win.buf[0],
+            &ctx->win.ctl,
             sizeof size,
-            0,
+            ctx->indx,
             PKG_DESCRIPTOR,
-            (uint8_t*)&size
+            (uint8_t*)&size,
+            ctx->check,
+            ctx->sess
         );
+
+        window_hold(ctx);
     }
 
     return ret;
@@ -100,17 +139,23 @@ static int download_initial_response(Context* ctx, const char* path) {
 /*
  *  context_init_download() - 
  *
- *  Initializes the download context.
+ *  Initializes the download context, serving the range of the asset the
+ *  request asks for.
  *
- *  @ctx: Pointer to the Context structure to be initialized.
- *  @pkg: Pointer to the Pkg structure containing the package data.
+ *  @ctx   : Pointer to the Context structure to be initialized.
+ *  @pkg   : Pointer to the Pkg structure containing the package data.
+ *  @params: Pointer to the parameters of the request.
+ *  @ur    : Pointer to the ring the asset is read ahead through, or 'NULL'.
+ *  @direct: Whether reads ahead bypass the page cache.
  *
  *  return:
  *    - '1' if the context is successfully initialized
- *    - '0' if the initialization fails (e.g., file opening fails)
+ *    - '0' if the initialization fails (e.g., file opening fails, or the
+ *      range starts past the end of the asset)
  */
-static int context_init_download(Context* ctx, const Pkg* pkg) {
+static int context_init_download(Context* ctx, const Pkg* pkg, const PkgParams* params, Uring* ur, int direct) {
 
+    int fd;
     int ret;
     char* asset;
 
@@ -120,17 +165,19 @@ static int context_init_download(Context* ctx, const Pkg* pkg) {
     ret   = 0;
     asset = NULL;
 
-    ctx->win.i = 1;
     ctx->type  = CTX_DOWNLOAD;
 
-    asset = get_asset_path((char*)pkg->data.content, pkg->data.size);
+    asset = get_asset_path((char*)PkgName(pkg), PkgNameSize(pkg));
     if(asset) {
-        ctx->desc.fp = fopen(asset, "rb");
-        if(ctx->desc.fp) {
-            ret = download_initial_response(ctx, asset);
-            if(!ret) {
-                fclose(ctx->desc.fp);
-                ctx->desc.fp = NULL;
+        fd = open(asset, O_RDONLY);
+        if(fd >= 0) {
+            if(pkgstage_init(&ctx->desc.st, fd, ur, direct, (off_t)params->start, (off_t)params->end)) {
+                ret = download_initial_response(ctx, asset);
+                if(!ret) {
+                    pkgstage_deinit(&ctx->desc.st);
+                }
+            } else {
+                close(fd);
             }
         }
     }
@@ -178,7 +225,6 @@ static int context_init_ls(Context* ctx, const Pkg* pkg) {
 
     ret = 0;
 
-    ctx->win.i = 1;
     ctx->type  = CTX_LS;
 
     ctx->desc.dp = get_assets_dir();
@@ -193,6 +239,61 @@ static int context_init_ls(Context* ctx, const Pkg* pkg) {
     return ret;
 }
 
+/*
+ *  window_frames() -
+ *
+ *  Converts a number of bytes in flight into a number of frames.
+ *
+ *  @bytes  : Number of bytes to keep in flight.
+ *  @payload: Number of content bytes each frame carries.
+ *
+ *  return:
+ *    - The number of frames, between '1' and 'CTX_MAX_WINDOW'.
+ */
+static inline size_t window_frames(size_t bytes, size_t payload) {
+
+    size_t frames;
+
+    frames = bytes / payload;
+    if(frames < 1) {
+        frames = 1;
+    }
+
+    if(frames > CTX_MAX_WINDOW) {
+        frames = CTX_MAX_WINDOW;
+    }
+
+    return frames;
+}
+
+/*
+ *  window_init() -
+ *
+ *  Allocates the ring of frames in flight and the buffers frames are built
+ *  in for sending, each large enough for a frame of the negotiated MTU.
+ *
+ *  @ctx   : Pointer to the Context structure.
+ *  @frames: Number of frames the window holds.
+ *
+ *  return:
+ *    - '1' if the window was allocated.
+ *    - '0' otherwise.
+ */
+static int window_init(Context* ctx, size_t frames) {
+
+    assert(ctx);
+
+    ctx->win.size   = frames;
+    ctx->win.stride = (ctx->mtu + CTX_SLOT_ALIGN - 1) & ~(size_t)(CTX_SLOT_ALIGN - 1);
+    ctx->win.base   = 0;
+    ctx->win.next   = 0;
+    ctx->win.ring   = calloc(frames, sizeof *ctx->win.ring);
+    ctx->win.out    = malloc((SOCKET_BATCH + 1) * ctx->win.stride);
+    ctx->win.vec    = malloc((SOCKET_BATCH + 1) * sizeof *ctx->win.vec);
+
+    return ctx->win.ring && ctx->win.out && ctx->win.vec;
+}
+
 /*
  *  context_init() -
  *
@@ -200,22 +301,56 @@ static int context_init_ls(Context* ctx, const Pkg* pkg) {
  *
  *  @ctx: Pointer to the Context structure that will be initialized.
  *  @pkg: Pointer to the constant Pkg structure that contains 
- *        initialization data.
+ *        initialization data, with sentinel bytes removed.
+ *  @mtu: Largest frame the local interface can carry.
+ *  @window: Number of bytes the context may keep in flight. The window
+ *           never exceeds the number of frames the client offered to hold.
+ *  @cc : Congestion control algorithm of the context, which may open its
+ *        window up to the whole window.
+ *  @ur : Pointer to the ring assets are read ahead through, or 'NULL' to
+ *        read them as the window moves.
+ *  @direct: Whether reads ahead bypass the page cache.
  *
  *  return:
  *    - '1' if the context is successfully initialized.
- *    - '0' if the context type is not recognized or if no 
- *      initialization is required.
+ *    - '0' if the context type is not recognized, if the request 
+ *      parameters are not supported or if no initialization is required.
  */
-int context_init(Context* ctx, const Pkg* pkg) {
+int context_init(Context* ctx, const Pkg* pkg, size_t mtu, size_t window, const CcOps* cc, Uring* ur, int direct) {
+
+    size_t frames;
+    PkgParams params;
 
     assert(ctx);
     assert(pkg);
+    assert(cc);
+
+    ctx->indx  = 0;
+    ctx->check = PkgCheck(pkg);
+
+    if(!pkgparams(pkg, &params) || !csum_pick(params.csum)) {
+        return 0;
+    }
+
+    ctx->mtu   = params.mtu < mtu ? params.mtu : mtu;
+    ctx->check = csum_pick(params.csum);
+
+    frames = window_frames(window, CtxPayload(ctx));
+    if(frames > params.window) {
+        frames = params.window;
+    }
+
+    if(!window_init(ctx, frames)) {
+        return 0;
+    }
 
-    ctx->indx = 0;
+    ctx->win.rwnd    = frames;
+    ctx->stats.start = pkgtime();
+    ctx->stats.shown = ctx->stats.start;
+    cc_init(&ctx->cc, cc, ctx->mtu, frames);
 
     if(PkgDownload(pkg)) {
-        return context_init_download(ctx, pkg);
+        return context_init_download(ctx, pkg, &params, ur, direct);
     } else {
         if(PkgLs(pkg)) {
             return context_init_ls(ctx, pkg);
@@ -225,90 +360,561 @@ int context_init(Context* ctx, const Pkg* pkg) {
     return 0;
 }
 
+/*
+ *  context_accept() -
+ *
+ *  Initializes the 'PKG_ACK' package answering the request that created
+ *  the context, carrying the parameters agreed on for it and, for a
+ *  download, the range of the asset served.
+ *
+ *  @ctx: Pointer to the initialized Context structure.
+ *  @pkg: Pointer to the Pkg structure that will hold the answer.
+ */
+void context_accept(const Context* ctx, Pkg* pkg) {
+
+    PkgParams params;
+
+    assert(ctx);
+    assert(pkg);
+
+    memset(&params, 0, sizeof params);
+    params.version = PKG_VERSION;
+    params.csum    = ctx->check;
+    params.mtu     = ctx->mtu;
+    params.window  = ctx->win.size;
+    if(CtxDownload(ctx)) {
+        params.start = (uint64_t)ctx->desc.st.start;
+        params.end   = (uint64_t)ctx->desc.st.end;
+    }
+
+    pkginit(pkg, sizeof params, 0, PKG_ACK, (uint8_t*)&params, ctx->check, ctx->sess);
+}
+
 /*
  *  initpkg_data_meta() -
  *
  *  Initializes the metadata for a data package, including setting the marker,
- *  type, and index, and calculating the CRC8 checksum.
+ *  type, index and file offset. The checksum is computed once the flags are
+ *  known.
  *
- *  @pkg : Pointer to the 'Pkg' structure to initialize.
- *  @indx: Index value to set in the package metadata.
+ *  @pkg  : Pointer to the 'Pkg' structure to initialize.
+ *  @indx : Index value to set in the package metadata.
+ *  @off  : File offset of the first byte of the content.
+ *  @sess : Session the package belongs to.
  */
-static inline void initpkg_data_meta(Pkg* pkg, size_t indx) {
+static inline void initpkg_data_meta(Pkg* pkg, size_t indx, off_t off, uint32_t sess) {
 
     assert(pkg);
 
-    pkg->data.marker = PKG_MARKER;
-    pkg->data.type   = PKG_DATA;
-    pkg->data.indx   = indx;
+    pkg->data.marker  = PKG_MARKER;
+    pkg->data.version = PKG_VERSION;
+    pkg->data.type    = PKG_DATA;
+    pkg->data.flags   = 0;
+    pkg->data.off     = (uint64_t)off;
+    pkg->data.indx    = indx;
+    pkg->data.sess    = sess;
+}
 
-    crc8(
-        pkg->raw + sizeof pkg->data.marker,
-        pkg->data.size + 2,
-        &pkg->data.crc8
-    );
+/*
+ *  window_unlink() -
+ *
+ *  Takes a frame out of the list of unacknowledged frames.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *  @seq: Sequence number of the frame.
+ */
+static inline void window_unlink(Context* ctx, size_t seq) {
+
+    CtxFrame* frame;
+
+    frame = CtxFrameAt(ctx, seq);
+    if(frame->older != CTX_NONE) {
+        CtxFrameAt(ctx, frame->older)->newer = frame->newer;
+    } else {
+        ctx->win.oldest = frame->newer;
+    }
+
+    if(frame->newer != CTX_NONE) {
+        CtxFrameAt(ctx, frame->newer)->older = frame->older;
+    } else {
+        ctx->win.newest = frame->older;
+    }
 }
 
 /*
- *  fill_context_buf_from_index() -
+ *  window_send() -
  *
- *  Fills the context buffer by reading data from a file and initializing the
- *  package structures. It handles the wrapping of index values and prepares the
- *  buffer for processing.
+ *  Accounts for a transmission of a frame in flight: numbers it, moves it
+ *  to the end of the list of unacknowledged frames, notes how much was
+ *  delivered by then for the delivery rate estimation and takes its bytes
+ *  from the pacing token bucket. Delivery is deemed to start over whenever
+ *  nothing is in flight.
  *
- *  @ctx: Pointer to the 'Context' structure.
- *  @i  : Starting index to fill the buffer.
+ *  @ctx: Pointer to the Context structure.
+ *  @seq: Sequence number of the frame, taken out of the list already if
+ *        it was in.
+ *  @pkg: Pointer to the frame as built for sending.
+ */
+static inline void window_send(Context* ctx, size_t seq, const Pkg* pkg) {
+
+    size_t now;
+    CtxFrame* frame;
+
+    frame = CtxFrameAt(ctx, seq);
+    frame->older = ctx->win.newest;
+    frame->newer = CTX_NONE;
+    if(ctx->win.newest != CTX_NONE) {
+        CtxFrameAt(ctx, ctx->win.newest)->newer = seq;
+    } else {
+        ctx->win.oldest = seq;
+    }
+    ctx->win.newest = seq;
+
+    now = pkgtime();
+    if(CtxInflight(ctx) == ctx->win.sacked) {
+        ctx->dlv.stamp = now;
+        ctx->dlv.first = now;
+    }
+
+    frame->tx        = ++ctx->win.tx;
+    frame->sent      = now;
+    frame->first     = ctx->dlv.first;
+    frame->delivered = ctx->dlv.delivered;
+    frame->dstamp    = ctx->dlv.stamp;
+
+    cc_spend(&ctx->cc, PKG_HDR_SIZE + pkg->data.size);
+}
+
+/*
+ *  context_ready() -
+ *
+ *  Tells whether the pacing rate lets the next frame leave now.
+ *
+ *  @ctx: Pointer to the Context structure.
  *
  *  return:
- *    - '1' if the buffer was successfully filled and initialized.
- *    - '0' if there was an error reading from the file.
- *    - '-1' if the end of the file was reached and the buffer was finalized.
+ *    - '1' if a frame may be sent.
+ *    - '0' if it is held back.
  */
-static int fill_context_buf_from_index(Context* ctx, size_t i) {
+int context_ready(Context* ctx) {
 
-    int ret;
+    assert(ctx);
+
+    ctx->win.paced = !cc_ready(&ctx->cc, pkgtime());
+
+    return !ctx->win.paced;
+}
+
+/*
+ *  context_lost() -
+ *
+ *  Tells which frame in flight has to be sent next: the oldest one while
+ *  it was never sent or once the retransmission timeout expired, else the
+ *  one sent earliest among those deemed lost. As these lead the list of
+ *  unacknowledged frames, this takes constant time.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *
+ *  return:
+ *    - Sequence number of the frame.
+ *    - 'win.next' if no frame in flight has to be sent.
+ */
+size_t context_lost(const Context* ctx) {
 
     assert(ctx);
 
-    ret = 1;
-    for(; i < WINSZ && ret > 0; i++) {
+    if(!CtxInflight(ctx)) {
+        return ctx->win.next;
+    }
+
+    if(ctx->win.expired || !CtxFrameAt(ctx, ctx->win.base)->tries) {
+        return ctx->win.base;
+    }
+
+    if(ctx->win.oldest != CTX_NONE && CtxFrameAt(ctx, ctx->win.oldest)->tx < ctx->win.lost) {
+        return ctx->win.oldest;
+    }
+
+    return ctx->win.next;
+}
+
+/*
+ *  context_frame() -
+ *
+ *  Builds a frame in flight if it has to be sent: a control frame that was
+ *  never sent, or a frame deemed lost. The caller sets its flags and seals
+ *  it. A frame sent again is no longer timed, as its acknowledgment could
+ *  answer either copy. The first data frame deemed lost in a window tells
+ *  the congestion controller.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *  @seq: Sequence number of the frame, as told by 'context_lost()'.
+ *  @pkg: Pointer to the Pkg structure the frame may be built in.
+ *  @vec: Pointer to the PkgVec structure that may reference its content,
+ *        which references none for the control package.
+ *
+ *  return:
+ *    - Pointer to the frame, which may be the context's control package.
+ *    - 'NULL' if the frame needs no sending or if there is an error
+ *      reading from the file.
+ */
+Pkg* context_frame(Context* ctx, size_t seq, Pkg* pkg, PkgVec* vec) {
+
+    CtxFrame* frame;
 
-        ret = pkgread(&ctx->win.buf[i], ctx->desc.fp);
-        ctx->k++;
-        if(ret) {
+    assert(ctx);
+    assert(pkg);
+    assert(vec);
+
+    frame = CtxFrameAt(ctx, seq);
+    if(seq == ctx->win.base && ctx->win.expired) {
+        ctx->win.expired = 0;
+    } else {
+        if(frame->acked || (frame->tries && frame->tx >= ctx->win.lost)) {
+            return NULL;
+        }
 
-            ctx->sent += ctx->win.buf[i].data.size;
-            initpkg_data_meta(&ctx->win.buf[i], ctx->indx);
-            incindx(ctx);
+        if(frame->tries && frame->type == PKG_DATA) {
+            cc_loss(&ctx->cc, frame->tx, ctx->win.tx);
         }
     }
 
-    ctx->win.i = i;
+    if(frame->tries) {
+        window_unlink(ctx, seq);
+        ctx->stats.resent++;
+    }
+
+    if(frame->tries < UINT8_MAX) {
+        frame->tries++;
+    }
+
+    if(ctx->rtt.timing && ctx->rtt.seq == seq) {
+        ctx->rtt.timing = 0;
+    }
+
+    if(frame->type != PKG_DATA) {
+        window_send(ctx, seq, &ctx->win.ctl);
+        vec->n = 0;
+        return &ctx->win.ctl;
+    }
+
+    if(!pkgreread(pkg, vec, &ctx->desc.st, frame->off, frame->len)) {
+        return NULL;
+    }
+
+    initpkg_data_meta(pkg, seq, frame->off, ctx->sess);
+    window_send(ctx, seq, pkg);
+
+    return pkg;
+}
+
+/*
+ *  context_extend() -
+ *
+ *  Takes the next frame of the asset into the window, if the window has
+ *  room for it. The caller sets its flags and seals it. Data only follows
+ *  once the descriptor was acknowledged. Frames the client holds already
+ *  do not count against the congestion window, but do against its
+ *  receive window, which starts at the oldest frame in flight.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *  @pkg: Pointer to the Pkg structure the frame will be built in.
+ *  @vec: Pointer to the PkgVec structure that may reference its content.
+ *
+ *  return:
+ *    - Pointer to the frame.
+ *    - 'NULL' if the window, the congestion window or the client's receive
+ *      window is full, if the whole asset is in flight already, if its next
+ *      bytes are still being read ahead or if there is an error reading
+ *      from the file.
+ */
+Pkg* context_extend(Context* ctx, Pkg* pkg, PkgVec* vec) {
+
+    int ret;
+    off_t off;
+    CtxFrame* frame;
+
+    assert(ctx);
+    assert(pkg);
+    assert(vec);
+
+    if(!CtxDownload(ctx) || CtxEnd(ctx) || CtxInflight(ctx) >= ctx->win.size) {
+        return NULL;
+    }
+
+    if(CtxInflight(ctx) >= ctx->win.rwnd || CtxInflight(ctx) - ctx->win.sacked >= ctx->cc.cwnd) {
+        return NULL;
+    }
+
+    if(CtxInflight(ctx) && CtxFrameAt(ctx, ctx->win.base)->type != PKG_DATA) {
+        return NULL;
+    }
+
+    off = PkgStageTell(&ctx->desc.st);
+    ret = pkgread(pkg, vec, &ctx->desc.st, CtxPayload(ctx));
+    if(ret == PKG_AGAIN) {
+        return NULL;
+    }
+
+    ctx->k++;
+    if(!ret) {
+        return NULL;
+    }
+
+    frame = CtxFrameAt(ctx, ctx->win.next);
+    frame->off   = off;
+    frame->len   = (uint16_t)(PkgStageTell(&ctx->desc.st) - off);
+    frame->type  = PKG_DATA;
+    frame->acked = 0;
+    frame->tries = 1;
+
+    ctx->sent += pkg->data.size;
+    initpkg_data_meta(pkg, ctx->win.next, off, ctx->sess);
+    window_send(ctx, ctx->win.next, pkg);
+
+    ctx->win.next++;
+    ctx->indx = ctx->win.next;
     if(ret < 0) {
         ctx->end = 1;
     }
 
-    return ret;
+    return pkg;
+}
+
+/*
+ *  context_timer() -
+ *
+ *  Starts timing the round trip of the frame that closes the flight just
+ *  sent, unless it was sent before and an acknowledgment could not tell
+ *  which copy it answers, or another frame is being timed already. Arms
+ *  the retransmission timeout unless it runs already.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *  @seq: Sequence number of the frame.
+ */
+void context_timer(Context* ctx, size_t seq) {
+
+    size_t now;
+
+    assert(ctx);
+
+    now = pkgtime();
+    if(!ctx->rtt.deadline) {
+        ctx->rtt.deadline = now + ctx->rtt.rto;
+    }
+
+    if(ctx->rtt.timing) {
+        return;
+    }
+
+    ctx->rtt.seq    = seq;
+    ctx->rtt.stamp  = now;
+    ctx->rtt.timing = CtxFrameAt(ctx, seq)->tries == 1;
+}
+
+/*
+ *  context_wait() -
+ *
+ *  Tells how long to wait for the client before sending again: until the
+ *  retransmission timeout expires or the pacing rate lets the next frame
+ *  leave, whichever comes first.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *
+ *  return:
+ *    - Number of microseconds to wait, never '0'.
+ */
+size_t context_wait(const Context* ctx) {
+
+    size_t now;
+    size_t wait;
+    size_t delay;
+
+    assert(ctx);
+
+    wait = ctx->rtt.rto;
+    if(ctx->rtt.deadline) {
+        now  = pkgtime();
+        wait = ctx->rtt.deadline > now ? ctx->rtt.deadline - now : 0;
+    }
+
+    if(ctx->win.paced) {
+        delay = cc_delay(&ctx->cc);
+        if(delay < wait) {
+            wait = delay;
+        }
+    }
+
+    return wait ? wait : 1;
+}
+
+/*
+ *  context_expired() -
+ *
+ *  Tells whether the retransmission timeout expired.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *
+ *  return:
+ *    - '1' if it expired.
+ *    - '0' otherwise.
+ */
+int context_expired(const Context* ctx) {
+
+    assert(ctx);
+
+    return ctx->rtt.deadline && pkgtime() >= ctx->rtt.deadline;
+}
+
+/*
+ *  context_timeout() -
+ *
+ *  Backs the retransmission timeout off once it expired without an
+ *  answer from the client, and deems the oldest frame in flight lost. The
+ *  acknowledgment of its new copy reveals whichever others went missing.
+ *  The timeout is armed again once that copy is sent. A round trip being
+ *  measured is dropped, it would count the time the timeout waited.
+ *
+ *  @ctx: Pointer to the Context structure.
+ */
+void context_timeout(Context* ctx) {
+
+    assert(ctx);
+
+    ctx->win.expired  = 1;
+    ctx->rtt.deadline = 0;
+    ctx->rtt.timing   = 0;
+    ctx->rtt.rto = ctx->rtt.rto < CTX_RTO_MAX / 2 ? 2 * ctx->rtt.rto : CTX_RTO_MAX;
+
+    cc_timeout(&ctx->cc, ctx->win.tx);
+}
+
+/*
+ *  context_stats() -
+ *
+ *  Prints the goodput, counting the asset bytes acknowledged so far, the
+ *  congestion window, the pacing rate and the round trip of the context.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *  @fp : Stream to print to.
+ */
+void context_stats(const Context* ctx, FILE* fp) {
+
+    size_t elapsed;
+
+    assert(ctx);
+    assert(fp);
+
+    elapsed = pkgtime() - ctx->stats.start;
+    if(!elapsed) {
+        elapsed = 1;
+    }
+
+    fprintf(
+        fp,
+        "%s: %zu bytes in %zu ms, goodput %zu kbit/s, cwnd %zu, pacing %zu kbit/s, srtt %zu us, %zu resent.\n",
+        ctx->cc.ops->name,
+        ctx->stats.bytes,
+        elapsed / 1000,
+        ctx->stats.bytes * 8 * 1000 / elapsed,
+        ctx->cc.cwnd,
+        ctx->cc.rate * 8 / 1000,
+        ctx->rtt.srtt,
+        ctx->stats.resent
+    );
+    fflush(fp);
+}
+
+/*
+ *  rtt_rto() -
+ *
+ *  Derives the retransmission timeout from the smoothed round trip and its
+ *  variation, dropping any backoff.
+ *
+ *  @ctx: Pointer to the Context structure.
+ */
+static void rtt_rto(Context* ctx) {
+
+    assert(ctx);
+
+    if(!ctx->rtt.srtt) {
+        ctx->rtt.rto = CTX_RTO_INIT;
+        return;
+    }
+
+    ctx->rtt.rto = ctx->rtt.srtt + 4 * ctx->rtt.rttvar;
+    if(ctx->rtt.rto < CTX_RTO_MIN) {
+        ctx->rtt.rto = CTX_RTO_MIN;
+    }
+
+    if(ctx->rtt.rto > CTX_RTO_MAX) {
+        ctx->rtt.rto = CTX_RTO_MAX;
+    }
+}
+
+/*
+ *  rtt_sample() -
+ *
+ *  Feeds the round trip of the timed frame, just acknowledged, to the
+ *  smoothed estimators of Jacobson and Karels, and derives the
+ *  retransmission timeout from them.
+ *
+ *  @ctx: Pointer to the Context structure.
+ */
+static void rtt_sample(Context* ctx) {
+
+    size_t r;
+    size_t d;
+
+    assert(ctx);
+
+    r = pkgtime() - ctx->rtt.stamp;
+    if(!ctx->rtt.srtt) {
+        ctx->rtt.srtt   = r;
+        ctx->rtt.rttvar = r / 2;
+    } else {
+        d = ctx->rtt.srtt > r ? ctx->rtt.srtt - r : r - ctx->rtt.srtt;
+        ctx->rtt.rttvar = (3 * ctx->rtt.rttvar + d) / 4;
+        ctx->rtt.srtt   = (7 * ctx->rtt.srtt + r) / 8;
+    }
+
+    rtt_rto(ctx);
+    ctx->rtt.timing = 0;
+    debug("rtt %zu us, srtt %zu us, rto %zu us.\n", r, ctx->rtt.srtt, ctx->rtt.rto);
 }
 
 /*
  *  context_download_update_with_ack() -
  *
- *  Reads data from a file descriptor into the window buffer and initializes the
- *  package structure. It updates the context index and prepares the buffer for
- *  processing.
+ *  Handles the acknowledgment of the descriptor, which starts the transfer
+ *  by emptying the window for data. Once data flows every acknowledgment
+ *  is selective, so plain ones are ignored.
  *
  *  @ctx: Pointer to the 'Context' structure.
  *
  *  return:
- *    - '1' if the data was successfully read and the buffer was initialized.
- *    - '0' if there was an error reading from the file.
+ *    - '1' if the descriptor was acknowledged.
+ *    - '0' if there was nothing to do.
  */
 static int context_download_update_with_ack(Context* ctx) {
 
     assert(ctx);
 
-    return fill_context_buf_from_index(ctx, 0);
+    if(CtxInflight(ctx) != 1 || CtxFrameAt(ctx, ctx->win.base)->type != PKG_DESCRIPTOR) {
+        return 0;
+    }
+
+    if(ctx->rtt.timing && ctx->rtt.seq == ctx->win.base) {
+        rtt_sample(ctx);
+    }
+
+    ctx->win.base   = ctx->indx;
+    ctx->win.next   = ctx->indx;
+    ctx->win.oldest = CTX_NONE;
+    ctx->win.newest = CTX_NONE;
+    ctx->rtt.deadline = 0;
+
+    return 1;
 }
 
 /*
@@ -332,13 +938,21 @@ static int context_ls_update_with_ack(Context* ctx) {
     struct dirent* entry;
 
     assert(ctx);
+
+    if(ctx->rtt.timing && ctx->rtt.seq == ctx->win.base) {
+        rtt_sample(ctx);
+    }
     
     ret  = -1;
     while((entry = readdir(ctx->desc.dp))) {
         if(entry->d_type != DT_DIR) {
             fname = entry->d_name;
             size  = strlen(fname);
-            pkginit(&ctx->win.buf[0], size, ctx->indx, PKG_SHOW, (uint8_t*)fname);
+            if(size > (CtxPayload(ctx) - 1) / 2) {
+                size = (CtxPayload(ctx) - 1) / 2;
+            }
+            pkginit(&ctx->win.ctl, size, ctx->indx, PKG_SHOW, (uint8_t*)fname, ctx->check, ctx->sess);
+            window_hold(ctx);
             ctx->sent += size;
             ret = 1;
             break;
@@ -347,8 +961,13 @@ static int context_ls_update_with_ack(Context* ctx) {
 
     incindx(ctx);
     if(ret < 0) {
-        ctx->end = 1;
-        //ctx->completed = 1;
+        /*
+         *  The last entry was acknowledged already, nothing is left
+         *  in flight.
+         */
+        ctx->win.base  = ctx->win.next;
+        ctx->end       = 1;
+        ctx->completed = 1;
     }
 
     return ret;
@@ -372,11 +991,6 @@ static int context_update_with_ack(Context* ctx) {
 
     assert(ctx);
 
-    if(CtxEnd(ctx)) {
-        ctx->completed = 1;
-        return -1;
-    }
-
     if(CtxDownload(ctx)) {
         return context_download_update_with_ack(ctx);
     } else {
@@ -389,85 +1003,234 @@ static int context_update_with_ack(Context* ctx) {
 }
 
 /*
- *  find_nack_pkg() -
+ *  window_ack() -
  *
- *  This function searches for a package with a specific index (nack) in the
- *  context's window buffer and returns the position of that package.
+ *  Marks a frame in flight as acknowledged and takes it out of the list of
+ *  unacknowledged frames. Every frame sent before it still missing is
+ *  deemed lost.
  *
- *  @ctx : Pointer to the 'Context' structure containing the window buffer.
- *  @nack: The index of the package to search for.
- *  @indx: Pointer to a size_t variable where the function will store the
- *         position of the package if found.
+ *  @ctx : Pointer to the 'Context' structure.
+ *  @seq : Sequence number of the frame.
+ *  @last: Pointer to the frame last sent among those acknowledged so far,
+ *         updated.
  *
  *  return:
- *    - '1' if the package with the specified index is found.
- *    - '0' if the package with the specified index is not found.
+ *    - '1' if the frame was newly acknowledged.
+ *    - '0' if it was acknowledged before.
  */
-static int find_nack_pkg(const Context* ctx, size_t nack, size_t* indx) {
+static inline int window_ack(Context* ctx, size_t seq, CtxFrame** last) {
+
+    CtxFrame* frame;
+
+    frame = CtxFrameAt(ctx, seq);
+    if(frame->acked) {
+        return 0;
+    }
+
+    frame->acked = 1;
+    window_unlink(ctx, seq);
+    if(frame->tx > ctx->win.lost) {
+        ctx->win.lost = frame->tx;
+    }
+
+    if(!*last || frame->tx > (*last)->tx) {
+        *last = frame;
+    }
+
+    ctx->dlv.delivered++;
+    ctx->stats.bytes += frame->len;
+
+    return 1;
+}
+
+/*
+ *  window_delivered() -
+ *
+ *  Tells the congestion controller about newly acknowledged frames. The
+ *  delivery rate is measured over the frames acknowledged since the last
+ *  of them was sent, across the longer of the time it took to send them
+ *  and to acknowledge them, so compressed acknowledgments do not inflate
+ *  it. Its round trip is measured as well, unless it was sent before.
+ *  The retransmission timeout restarts as the client made progress.
+ *
+ *  @ctx  : Pointer to the 'Context' structure.
+ *  @last : Pointer to the acknowledged frame sent last.
+ *  @acked: Number of frames newly acknowledged.
+ */
+static void window_delivered(Context* ctx, const CtxFrame* last, size_t acked) {
+
+    size_t now;
+    size_t interval;
+    CcSample s;
 
-    int found;
-    size_t i;
-    
     assert(ctx);
+    assert(last);
 
-    found = 0;
-    for(i = 0; i < WINSZ; i++) {
-        if(ctx->win.buf[i].data.indx == nack) {
-            found = 1;
-            break;
+    now = pkgtime();
+    interval = now - last->dstamp;
+    if(last->sent - last->first > interval) {
+        interval = last->sent - last->first;
+    }
+
+    s.now      = now;
+    s.acked    = acked;
+    s.inflight = CtxInflight(ctx) - ctx->win.sacked;
+    s.rtt      = last->tries == 1 ? now - last->sent : 0;
+    s.srtt     = ctx->rtt.srtt;
+    s.rate     = 0;
+    if(interval) {
+        s.rate = (ctx->dlv.delivered - last->delivered) * ctx->cc.mss * USEC / interval;
+    }
+
+    s.round = last->delivered >= ctx->dlv.round;
+    if(s.round) {
+        ctx->dlv.round = ctx->dlv.delivered;
+    }
+
+    ctx->dlv.stamp = now;
+    ctx->dlv.first = last->sent;
+    ctx->rtt.deadline = CtxInflight(ctx) ? now + ctx->rtt.rto : 0;
+
+    cc_ack(&ctx->cc, &s);
+}
+
+/*
+ *  context_download_update_with_sack() -
+ *
+ *  Slides the window past every frame the client acknowledged
+ *  cumulatively and marks the frames it holds beyond them, so only the
+ *  holes are sent again. Sliding takes constant time per frame, marking
+ *  walks the bitmap the client sent, skipping its empty bytes, rather
+ *  than the window. Frames are never unmarked, the client does not drop
+ *  frames it holds.
+ *
+ *  @ctx : Pointer to the 'Context' structure.
+ *  @next: Next sequence number the client expects.
+ *  @rwnd: Number of frames from 'next' on the client accepts.
+ *  @map : Pointer to the bitmap of frames held past 'next', or 'NULL'.
+ *  @n   : Size of the bitmap in bytes.
+ *
+ *  return:
+ *    -  '1' if the window was successfully adjusted.
+ *    -  '0' if there is nothing to acknowledge.
+ *    - '-1' if the context was finalized.
+ */
+static int context_download_update_with_sack(Context* ctx, size_t next, size_t rwnd, const uint8_t* map, size_t n) {
+
+    size_t j;
+    size_t seq;
+    size_t base;
+    size_t acked;
+    CtxFrame* last;
+
+    assert(ctx);
+
+    /*
+     *  Only data frames are acknowledged selectively, while the window
+     *  still holds the descriptor there is nothing to slide.
+     */
+    if(!ctx->k) {
+        return 0;
+    }
+
+    /*
+     *  Acknowledgments for frames the window already left behind are
+     *  stale and carry nothing new.
+     */
+    base = SeqFrom(ctx->win.base, next);
+    if(base > ctx->win.next) {
+        return 1;
+    }
+
+    /*
+     *  The client makes progress again, the timeout needs no backoff.
+     */
+    if(base > ctx->win.base) {
+        rtt_rto(ctx);
+    }
+
+    acked = 0;
+    last  = NULL;
+    for(seq = ctx->win.base; seq < base; seq++) {
+        if(window_ack(ctx, seq, &last)) {
+            acked++;
+        } else {
+            ctx->win.sacked--;
         }
     }
 
-    if(found && indx) {
-        *indx = i;
+    ctx->win.base = base;
+    ctx->win.rwnd = rwnd < ctx->win.size ? rwnd : ctx->win.size;
+    for(j = 0; j / 8 < n && base + 1 + j < ctx->win.next; j++) {
+        if(!map[j / 8]) {
+            j |= 7;
+            continue;
+        }
+
+        if((map[j / 8] & (1 << (j % 8))) && window_ack(ctx, base + 1 + j, &last)) {
+            acked++;
+            ctx->win.sacked++;
+        }
+    }
+
+    if(ctx->rtt.timing && (ctx->rtt.seq < base || CtxAcked(ctx, ctx->rtt.seq))) {
+        rtt_sample(ctx);
+    }
+
+    if(acked) {
+        window_delivered(ctx, last, acked);
     }
 
-    return found;
+    if(base == ctx->win.next && ctx->end) {
+        ctx->completed = 1;
+        return -1;
+    }
+
+    return 1;
 }
 
 /*
- *  context_download_update_with_nack() -
+ *  context_update_with_sack() -
  *
- *  Handles a negative acknowledgment (NACK) for a download context 
- *  by adjusting the buffer and refilling it with the necessary data.
+ *  Handles a selective acknowledgment (SACK) of the data frames of a
+ *  download context, taking the receive window of the client from it.
  *
  *  @ctx: Pointer to the 'Context' structure.
  *  @pkg: Pointer to the received 'Pkg' structure.
  *
  *  return:
- *    -  '1' if the buffer was successfully adjusted and refilled.
+ *    -  '1' if the context was successfully updated.
  *    -  '0' if the context cannot be updated.
  *    - '-1' if the context was finalized.
  */
-static int context_download_update_with_nack(Context* ctx, const Pkg* pkg) {
+static int context_update_with_sack(Context* ctx, const Pkg* pkg) {
 
-    int found;
-    size_t failed;
-    size_t indx;
+    size_t n;
+    uint32_t rwnd;
+    uint8_t map[sizeof pkg->data.content];
 
     assert(ctx);
     assert(pkg);
 
-    indx  = (size_t)pkg->data.indx;
-    found = find_nack_pkg(ctx, indx, &failed);
-    if(found) {
-        if(failed > 0) {
-            memmove(&ctx->win.buf[0], &ctx->win.buf[failed], (ctx->win.i - failed) * sizeof ctx->win.buf[0]);
-            if(ctx->end) {
-                ctx->win.i = ctx->win.i - failed;
-                return 1;
-            }
+    if(!CtxDownload(ctx)) {
+        return 0;
+    }
 
-            return fill_context_buf_from_index(ctx, ctx->win.i - failed);
-        }
-        return 1;
+    n = pkg->data.size;
+    memcpy(map, pkg->data.content, n);
+    n = unstuff(map, n);
+    if(n < sizeof rwnd) {
+        return 0;
     }
 
-    /*
-     *  If the nack package is not in the context buffer, then
-     *  it was not sent yet.
-     */
-    return fill_context_buf_from_index(ctx, 0);
+    memcpy(&rwnd, map, sizeof rwnd);
+    if(!rwnd) {
+        rwnd = 1;
+    }
+
+    debug("received sack %zu, rwnd %u.\n", (size_t)PkgIndx(pkg), (unsigned)rwnd);
+
+    return context_download_update_with_sack(ctx, PkgIndx(pkg), rwnd, map + sizeof rwnd, n - sizeof rwnd);
 }
 
 /*
@@ -486,21 +1249,12 @@ static int context_download_update_with_nack(Context* ctx, const Pkg* pkg) {
  */
 static int context_update_with_nack(Context* ctx, const Pkg* pkg) {
 
-    int found;
-
     assert(ctx);
     assert(pkg);
 
     if(CtxDownload(ctx)) {
         debug("received nack %zu.\n", (size_t)pkg->data.indx);
-        if(CtxEnd(ctx)) {
-            found = find_nack_pkg(ctx, PkgIndx(pkg), NULL);
-            if(!found) {
-                ctx->completed = 1;
-                return -1;
-            }
-        }
-        return context_download_update_with_nack(ctx, pkg);
+        return context_download_update_with_sack(ctx, PkgIndx(pkg), ctx->win.rwnd, NULL, 0);
     } else {
         if(CtxLs(ctx)) {
             /*
@@ -534,12 +1288,20 @@ int context_update(Context* ctx, const Pkg* pkg) {
     assert(ctx);
     assert(pkg);
 
+    if(PkgCheck(pkg) != ctx->check) {
+        return 0;
+    }
+
     if(PkgAck(pkg)) {
         return context_update_with_ack(ctx);
     } else {
         if(PkgNack(pkg)) {
             return context_update_with_nack(ctx, pkg);
         }
+
+        if(PkgSack(pkg)) {
+            return context_update_with_sack(ctx, pkg);
+        }
     }
 
     return 0;
@@ -556,8 +1318,8 @@ int context_update(Context* ctx, const Pkg* pkg) {
  */
 static inline void context_deinit_download(Context* ctx) {
 
-    if(ctx && ctx->desc.fp) {
-        fclose(ctx->desc.fp);
+    if(ctx) {
+        pkgstage_deinit(&ctx->desc.st);
     }
 }
 
@@ -588,6 +1350,13 @@ static inline void context_deinit_ls(Context* ctx) {
 void context_deinit(Context* ctx) {
 
     if(ctx) {
+        free(ctx->win.ring);
+        free(ctx->win.out);
+        free(ctx->win.vec);
+        ctx->win.ring = NULL;
+        ctx->win.out  = NULL;
+        ctx->win.vec  = NULL;
+
         if(CtxDownload(ctx)) {
             context_deinit_download(ctx);
         } else {
@@ -1,24 +1,69 @@
 #ifndef CONTEXT_DEFS_H
 #define CONTEXT_DEFS_H
 
-#define WINSZ 5
+/*
+ *  Window geometry. Unless told otherwise a context keeps 'CTX_WINDOW'
+ *  bytes in flight, about the bandwidth-delay product of a 10 Gbit/s link
+ *  with a 3 ms round trip, cut into as many frames as the negotiated MTU
+ *  allows but never more than 'CTX_MAX_WINDOW'. Buffers frames are built
+ *  in for sending start on 'CTX_SLOT_ALIGN' byte boundaries.
+ */
+#define CTX_WINDOW      (1 << 22)
+#define CTX_MAX_WINDOW  (1 << 15)
+#define CTX_SLOT_ALIGN  16
+
+/*
+ *  Links of the list of frames in flight, in the order they were last
+ *  sent, end with 'CTX_NONE'.
+ */
+#define CTX_NONE        ((size_t)-1)
+
+/*
+ *  Retransmission timeout bounds, in microseconds. The timeout starts at
+ *  'CTX_RTO_INIT' until the first round trip is measured, and is doubled
+ *  on every expiry up to 'CTX_RTO_MAX'.
+ */
+#define CTX_RTO_INIT    (100 * 1000)
+#define CTX_RTO_MIN     (2 * 1000)
+#define CTX_RTO_MAX     (5 * 1000 * 1000)
+
+/*
+ *  Statistics of a context, when asked for, are printed every
+ *  'CTX_STATS_INTERVAL' microseconds and once it completes.
+ */
+#define CTX_STATS_INTERVAL  (1000 * 1000)
 
 #define CtxEnd(ctx)         ((ctx)->end)
 #define CtxCompleted(ctx)   ((ctx)->completed)
 #define CtxDownload(ctx)    ((ctx)->type == CTX_DOWNLOAD)
 #define CtxLs(ctx)          ((ctx)->type == CTX_LS)
+#define CtxPayload(ctx)     ((ctx)->mtu - PKG_HDR_SIZE)
+#define CtxInflight(ctx)    ((ctx)->win.next - (ctx)->win.base)
+#define CtxRto(ctx)         ((ctx)->rtt.rto)
+#define CtxFrameAt(ctx, seq) (&(ctx)->win.ring[(seq) % (ctx)->win.size])
+#define CtxAcked(ctx, seq)  (CtxFrameAt(ctx, seq)->acked)
+#define CtxOut(ctx, i)      ((Pkg*)((ctx)->win.out + ((i) % (SOCKET_BATCH + 1)) * (ctx)->win.stride))
+#define CtxVec(ctx, i)      (&(ctx)->win.vec[(i) % (SOCKET_BATCH + 1)])
+#define CtxGone(ctx)        (CtxDownload(ctx) && PkgStageGone(&(ctx)->desc.st))
+
+/*
+ *  SeqFrom() -
+ *
+ *  Contexts count sequence numbers in full while frames only carry their
+ *  low 32 bits, so the window never sees them wrap. Recovers the full
+ *  sequence number of a frame at or after 'base'; frames older than 'base'
+ *  come out more than 2^31 ahead of it.
+ *
+ *  @base: Full sequence number the frame is not older than.
+ *  @indx: Sequence number carried by the frame.
+ */
+#define SeqFrom(base, indx) ((base) + (((indx) - (base)) % PKG_MAX_IND))
 
 /*
  *  incindx() -
  *
  *  @ctx:
  */
-#define incindx(ctx)                        \
-    do {                                    \
-        (ctx)->indx++;                      \
-        if((ctx)->indx == PKG_MAX_IND) {    \
-            (ctx)->indx = 0;                \
-        }                                   \
-    } while(0)
+#define incindx(ctx)    ((ctx)->indx++)
 
 #endif  /* CONTEXT_DEFS_H */
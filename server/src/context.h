@@ -7,6 +7,7 @@
 #include "context.defs.h"
 #include "utils.h"
 #include "pkg.h"
+#include "cc.h"
 
 enum CtxType {
 
@@ -16,26 +17,151 @@ enum CtxType {
 
 typedef enum CtxType CtxType;
 
+/*
+ *  Stages a context goes through while served: it sends the asset, then
+ *  sends the 'PKG_END' (or 'PKG_ERROR') package held in its control
+ *  package until the client acknowledges it, and is done.
+ */
+enum CtxState {
+
+    CTX_SENDING,
+    CTX_ENDING,
+    CTX_DONE
+};
+
+typedef enum CtxState CtxState;
+
+/*
+ *  A frame in flight is kept as the range of the file its content comes
+ *  from and built again whenever it is sent. Frames other than data ones
+ *  are built once, in the context's control package. 'tx' numbers the
+ *  last of its 'tries' transmissions, which left at 'sent' when
+ *  'delivered' frames had been acknowledged, the last at 'dstamp' and
+ *  sent at 'first'.
+ */
+struct CtxFrame {
+
+    off_t    off;
+    size_t   tx;
+    size_t   sent;
+    size_t   first;
+    size_t   delivered;
+    size_t   dstamp;
+    size_t   older;
+    size_t   newer;
+    uint16_t len;
+    uint8_t  type;
+    uint8_t  acked;
+    uint8_t  tries;
+};
+
+typedef struct CtxFrame CtxFrame;
+
+/*
+ *  A context serves the session 'sess' of the client at 'addr'. 'idle'
+ *  counts the times in a row the retransmission timeout expired without
+ *  an answer.
+ */
 struct Context {
 
-    CtxType type;
+    CtxType  type;
+    CtxState state;
+    uint8_t  addr[SOCKET_ADDR_LEN];
+    uint32_t sess;
+    size_t   idle;
 
     size_t end;
     size_t completed;
+    size_t mtu;
+    int    check;
     size_t indx;
     size_t sent;
     size_t k;
 
-    struct  {
+    /*
+     *  Ring of 'size' frames. Sequence numbers 'base' up to, but excluding,
+     *  'next' are in flight, each in the slot 'seq % size'. Frames are
+     *  built for sending in 'out', 'SOCKET_BATCH + 1' buffers 'stride'
+     *  bytes apart, with as many 'vec' referencing their content. 'tx'
+     *  counts transmissions; unacknowledged frames last sent before
+     *  transmission 'lost' are deemed lost, since a frame sent after them
+     *  was acknowledged. So is the oldest one once 'expired' tells the
+     *  retransmission timeout expired. Unacknowledged frames are linked
+     *  from 'oldest' to 'newest' in the order they were last sent, so those
+     *  deemed lost lead the list. 'sacked' frames past 'base' are
+     *  acknowledged already, and the client accepts 'rwnd' from 'base' on.
+     *  'paced' tells the pacing rate held the last frame back.
+     */
+    struct {
 
-        size_t i;
-        Pkg buf[WINSZ];
+        size_t    size;
+        size_t    stride;
+        size_t    base;
+        size_t    next;
+        size_t    tx;
+        size_t    lost;
+        size_t    oldest;
+        size_t    newest;
+        size_t    sacked;
+        size_t    rwnd;
+        int       expired;
+        int       paced;
+        CtxFrame* ring;
+        uint8_t*  out;
+        PkgVec*   vec;
+        Pkg       ctl;
     } win;
 
+    /*
+     *  Round-trip time estimation, in microseconds. The last frame of a
+     *  flight, 'seq', is timed from 'stamp' while 'timing' is set, unless
+     *  it was sent before. The retransmission timeout expires at
+     *  'deadline', if set.
+     */
+    struct {
+
+        size_t srtt;
+        size_t rttvar;
+        size_t rto;
+        size_t seq;
+        size_t stamp;
+        size_t deadline;
+        int    timing;
+    } rtt;
+
+    /*
+     *  Delivery rate estimation. 'delivered' frames were acknowledged so
+     *  far, the last ones at 'stamp', the last of them sent at 'first'. A
+     *  round trip ends once a frame sent after 'round' frames were
+     *  delivered is acknowledged.
+     */
+    struct {
+
+        size_t delivered;
+        size_t stamp;
+        size_t first;
+        size_t round;
+    } dlv;
+
+    Cc cc;
+
+    /*
+     *  Per-flow statistics: 'bytes' of the asset were acknowledged since
+     *  'start', and 'resent' frames were sent more than once. They were
+     *  last printed at 'shown'.
+     */
+    struct {
+
+        size_t start;
+        size_t bytes;
+        size_t resent;
+        size_t shown;
+    } stats;
+
     union {
 
-        FILE* fp;
-        DIR*  dp;
+        PkgStage st;
+        DIR*     dp;
     } desc;
 };
 
@@ -59,14 +185,157 @@ extern Context* context_create(void);
  *
  *  @ctx: Pointer to the Context structure that will be initialized.
  *  @pkg: Pointer to the constant Pkg structure that contains initialization
- *        data.
+ *        data, with sentinel bytes removed.
+ *  @mtu: Largest frame the local interface can carry.
+ *  @window: Number of bytes the context may keep in flight.
+ *  @cc : Congestion control algorithm of the context.
+ *  @ur : Pointer to the ring assets are read ahead through, or 'NULL'.
+ *  @direct: Whether reads ahead bypass the page cache.
  *
  *  return:
  *    - '1' if the context is successfully initialized.
- *    - '0' if the context type is not recognized or if no initialization is
- *          required.
+ *    - '0' if the context type is not recognized, if the request parameters
+ *          are not supported or if no initialization is required.
+ */
+extern int context_init(Context* ctx, const Pkg* pkg, size_t mtu, size_t window, const CcOps* cc, Uring* ur, int direct);
+
+/*
+ *  context_accept() -
+ *
+ *  Initializes the 'PKG_ACK' package answering the request that created
+ *  the context, carrying the parameters agreed on for it.
+ *
+ *  @ctx: Pointer to the initialized Context structure.
+ *  @pkg: Pointer to the Pkg structure that will hold the answer.
+ */
+extern void context_accept(const Context* ctx, Pkg* pkg);
+
+/*
+ *  context_ready() -
+ *
+ *  Tells whether the pacing rate lets the next frame leave now.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *
+ *  return:
+ *    - '1' if a frame may be sent.
+ *    - '0' if it is held back.
+ */
+extern int context_ready(Context* ctx);
+
+/*
+ *  context_lost() -
+ *
+ *  Tells which frame in flight has to be sent next: the oldest one while
+ *  it was never sent or once the retransmission timeout expired, else the
+ *  one sent earliest among those deemed lost.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *
+ *  return:
+ *    - Sequence number of the frame.
+ *    - 'win.next' if no frame in flight has to be sent.
+ */
+extern size_t context_lost(const Context* ctx);
+
+/*
+ *  context_frame() -
+ *
+ *  Builds a frame in flight if it has to be sent: a control frame that was
+ *  never sent, or a frame deemed lost. The caller sets its flags and seals
+ *  it.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *  @seq: Sequence number of the frame, as told by 'context_lost()'.
+ *  @pkg: Pointer to the Pkg structure the frame may be built in.
+ *  @vec: Pointer to the PkgVec structure that may reference its content,
+ *        which references none for the control package.
+ *
+ *  return:
+ *    - Pointer to the frame, which may be the context's control package.
+ *    - 'NULL' if the frame needs no sending or if there is an error
+ *      reading from the file.
+ */
+extern Pkg* context_frame(Context* ctx, size_t seq, Pkg* pkg, PkgVec* vec);
+
+/*
+ *  context_extend() -
+ *
+ *  Takes the next frame of the asset into the window, if the window has
+ *  room for it. The caller sets its flags and seals it.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *  @pkg: Pointer to the Pkg structure the frame will be built in.
+ *  @vec: Pointer to the PkgVec structure that may reference its content.
+ *
+ *  return:
+ *    - Pointer to the frame.
+ *    - 'NULL' if the window, the congestion window or the client's receive
+ *      window is full, if the whole asset is in flight already, if its next
+ *      bytes are still being read ahead or if there is an error reading
+ *      from the file.
+ */
+extern Pkg* context_extend(Context* ctx, Pkg* pkg, PkgVec* vec);
+
+/*
+ *  context_timer() -
+ *
+ *  Starts timing the round trip of the frame that closes the flight just
+ *  sent, unless it was sent before and an acknowledgment could not tell
+ *  which copy it answers.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *  @seq: Sequence number of the frame.
+ */
+extern void context_timer(Context* ctx, size_t seq);
+
+/*
+ *  context_wait() -
+ *
+ *  Tells how long to wait for the client before sending again: until the
+ *  retransmission timeout expires or the pacing rate lets the next frame
+ *  leave, whichever comes first.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *
+ *  return:
+ *    - Number of microseconds to wait, never '0'.
+ */
+extern size_t context_wait(const Context* ctx);
+
+/*
+ *  context_expired() -
+ *
+ *  Tells whether the retransmission timeout expired.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *
+ *  return:
+ *    - '1' if it expired.
+ *    - '0' otherwise.
+ */
+extern int context_expired(const Context* ctx);
+
+/*
+ *  context_timeout() -
+ *
+ *  Backs the retransmission timeout off once it expired without an
+ *  answer from the client, and deems the oldest frame in flight lost.
+ *
+ *  @ctx: Pointer to the Context structure.
+ */
+extern void context_timeout(Context* ctx);
+
+/*
+ *  context_stats() -
+ *
+ *  Prints the goodput, congestion window, pacing rate and round trip of
+ *  the context.
+ *
+ *  @ctx: Pointer to the Context structure.
+ *  @fp : Stream to print to.
  */
-extern int context_init(Context* ctx, const Pkg* pkg);
+extern void context_stats(const Context* ctx, FILE* fp);
 
 /*
  *  context_update() - 
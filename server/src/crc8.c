@@ -38,30 +38,62 @@ static const uint8_t crc8_table[256] = {
     0xE6, 0xE1, 0xE8, 0xEF, 0xFA, 0xFD, 0xF4, 0xF3
 };
 
+static uint8_t crc8_slice[8][256];
+
+/*
+ *  crc8_init() -
+ *
+ *  Derives the slicing-by-8 tables from 'crc8_table': entry 'k' of a byte
+ *  is its CRC-8 followed by 'k' zero bytes.
+ */
+__attribute__((constructor))
+static void crc8_init(void) {
+
+    size_t i;
+    size_t k;
+
+    for(i = 0; i < 256; i++) {
+        crc8_slice[0][i] = crc8_table[i];
+        for(k = 1; k < 8; k++) {
+            crc8_slice[k][i] = crc8_table[crc8_slice[k - 1][i]];
+        }
+    }
+}
+
 /*
  *  crc8() -
  *
  *  This function computes the CRC-8 checksum for the data provided in the
- *  buffer and stores the result in the location pointed to by `crc`. The CRC-8
- *  is a cyclic redundancy check that provides a simple way to check the
- *  integrity of data.
+ *  buffer, continuing from a previous value. Eight bytes are folded in per
+ *  step through the slicing-by-8 tables, the remainder one byte at a time.
  *
+ *  @crc: The CRC-8 of the preceding data, or '0' to start a new checksum.
  *  @buf: Pointer to the data buffer for which the CRC-8 is to be calculated.
  *  @n  : The number of bytes in the data buffer.
- *  @crc: Pointer to the location where the calculated CRC-8 checksum will be
- *        stored.
+ *
+ *  return:
+ *    - The CRC-8 of the preceding data followed by the buffer.
  */
-void crc8(const uint8_t* buf, size_t n, uint8_t* crc) {
+uint8_t crc8(uint8_t crc, const uint8_t* buf, size_t n) {
 
     size_t i;
-    uint8_t crc8;
 
-    assert(buf);
-    assert(crc);
+    assert(buf || !n);
 
-    crc8 = 0;
-    for(i = 0; i < n; i++) {
-        crc8 = crc8_table[crc8 ^ buf[i]];
+    for(i = 0; i + 8 <= n; i += 8) {
+        crc = crc8_slice[7][crc ^ buf[i]] ^
+              crc8_slice[6][buf[i + 1]] ^
+              crc8_slice[5][buf[i + 2]] ^
+              crc8_slice[4][buf[i + 3]] ^
+              crc8_slice[3][buf[i + 4]] ^
+              crc8_slice[2][buf[i + 5]] ^
+              crc8_slice[1][buf[i + 6]] ^
+              crc8_slice[0][buf[i + 7]];
     }
-    *crc = crc8;
+
+    for(; i < n; i++) {
+        crc = crc8_table[crc ^ buf[i]];
+    }
+
+    return crc;
 }
@@ -8,15 +8,17 @@
  *  crc8() -
  *
  *  This function computes the CRC-8 checksum for the data provided in the
- *  buffer and stores the result in the location pointed to by `crc`. The CRC-8
- *  is a cyclic redundancy check that provides a simple way to check the
- *  integrity of data.
+ *  buffer, continuing from a previous value. The CRC-8 is a cyclic
+ *  redundancy check that provides a simple way to check the integrity of
+ *  data.
  *
+ *  @crc: The CRC-8 of the preceding data, or '0' to start a new checksum.
  *  @buf: Pointer to the data buffer for which the CRC-8 is to be calculated.
  *  @n  : The number of bytes in the data buffer.
- *  @crc: Pointer to the location where the calculated CRC-8 checksum will be
- *        stored.
+ *
+ *  return:
+ *    - The CRC-8 of the preceding data followed by the buffer.
  */
-extern void crc8(const uint8_t* buf, size_t n, uint8_t* crc);
+extern uint8_t crc8(uint8_t crc, const uint8_t* buf, size_t n);
 
 #endif  /* CRC8_H */
@@ -0,0 +1,647 @@
+#define _GNU_SOURCE
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "socket.h"
+#include "pkg.h"
+
+/*
+ *  Buffers a datagram is received into, besides its content: where it
+ *  came from and the control message telling the size of the frames a
+ *  coalesced datagram holds.
+ */
+struct DgramSlot {
+
+    struct iovec        iov;
+    struct sockaddr_in6 name;
+    union {
+        char            buf[CMSG_SPACE(sizeof(int))];
+        size_t          align;
+    } ctl;
+};
+
+typedef struct DgramSlot DgramSlot;
+
+/*
+ *  udp_addr() -
+ *
+ *  Turns a UDP socket address into the address of a host.
+ *
+ *  @addr: Pointer to the 'SOCKET_ADDR_LEN' bytes of the address.
+ *  @name: Pointer to the socket address.
+ */
+static inline void udp_addr(uint8_t* addr, const struct sockaddr_in6* name) {
+
+    memcpy(addr, &name->sin6_addr, sizeof name->sin6_addr);
+    memcpy(addr + sizeof name->sin6_addr, &name->sin6_port, sizeof name->sin6_port);
+}
+
+/*
+ *  udp_name() -
+ *
+ *  Turns the address of a host into a UDP socket address.
+ *
+ *  @name: Pointer to the socket address.
+ *  @addr: Pointer to the 'SOCKET_ADDR_LEN' bytes of the address.
+ */
+static inline void udp_name(struct sockaddr_in6* name, const uint8_t* addr) {
+
+    memset(name, 0, sizeof *name);
+    name->sin6_family = AF_INET6;
+    memcpy(&name->sin6_addr, addr, sizeof name->sin6_addr);
+    memcpy(&name->sin6_port, addr + sizeof name->sin6_addr, sizeof name->sin6_port);
+}
+
+/*
+ *  dgram_alloc() -
+ *
+ *  Allocates the buffers a datagram socket receives its datagrams into.
+ *
+ *  @sock: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if the buffers were allocated.
+ *    - '0' on failure.
+ */
+static int dgram_alloc(Socket* sock) {
+
+    size_t i;
+    DgramSlot* slots;
+    struct msghdr* hdr;
+
+    sock->in.buf  = malloc((size_t)SOCKET_DGRAM_MSGS * SOCKET_DGRAM_SIZE);
+    sock->in.msgs = calloc(SOCKET_DGRAM_MSGS, sizeof(struct mmsghdr) + sizeof(DgramSlot));
+    if(!sock->in.buf || !sock->in.msgs) {
+        return 0;
+    }
+
+    slots = (DgramSlot*)(sock->in.msgs + SOCKET_DGRAM_MSGS);
+    for(i = 0; i < SOCKET_DGRAM_MSGS; i++) {
+        slots[i].iov.iov_base = sock->in.buf + i * SOCKET_DGRAM_SIZE;
+
+        hdr = &sock->in.msgs[i].msg_hdr;
+        hdr->msg_iov        = &slots[i].iov;
+        hdr->msg_iovlen     = 1;
+        hdr->msg_name       = sock->ops == &socket_udp ? &slots[i].name : NULL;
+        hdr->msg_control    = slots[i].ctl.buf;
+    }
+
+    return 1;
+}
+
+/*
+ *  dgram_fill() -
+ *
+ *  Receives as many pending datagrams as the socket has buffers for,
+ *  waiting for the first one unless the socket does not block and was
+ *  given no timeout.
+ *
+ *  @sock   : Pointer to the socket.
+ *  @timeout: Timeout value in microseconds. If zero, no timeout is used.
+ *
+ *  return:
+ *    - '1' if at least a datagram was received.
+ *    - '0' if the timeout expired or on error.
+ */
+static int dgram_fill(Socket* sock, size_t timeout) {
+
+    int n;
+    int flags;
+    size_t i;
+    DgramSlot* slots;
+    struct pollfd pfd;
+    struct timespec ts;
+
+    flags = MSG_WAITFORONE;
+    if(timeout || sock->nonblock) {
+
+        ts.tv_sec  = timeout / 1000000;
+        ts.tv_nsec = (timeout % 1000000) * 1000;
+
+        memset(&pfd, 0, sizeof pfd);
+        pfd.fd     = sock->fd;
+        pfd.events = POLLIN;
+        if(ppoll(&pfd, 1, &ts, NULL) <= 0) {
+            return 0;
+        }
+        flags |= MSG_DONTWAIT;
+    }
+
+    slots = (DgramSlot*)(sock->in.msgs + SOCKET_DGRAM_MSGS);
+    for(i = 0; i < SOCKET_DGRAM_MSGS; i++) {
+        slots[i].iov.iov_len = SOCKET_DGRAM_SIZE;
+        sock->in.msgs[i].msg_hdr.msg_namelen    = sizeof slots[i].name;
+        sock->in.msgs[i].msg_hdr.msg_controllen = sizeof slots[i].ctl.buf;
+    }
+
+    n = recvmmsg(sock->fd, sock->in.msgs, SOCKET_DGRAM_MSGS, flags, NULL);
+    if(n <= 0) {
+        return 0;
+    }
+
+    sock->in.n   = (size_t)n;
+    sock->in.cur = 0;
+    sock->in.off = 0;
+
+    return 1;
+}
+
+/*
+ *  dgram_seg() -
+ *
+ *  Gets the size of the frames a received datagram holds: the size the
+ *  kernel coalesced it by, or its whole length.
+ *
+ *  @msg: Pointer to the received datagram.
+ *
+ *  return:
+ *    - Size of the frames of the datagram.
+ */
+static size_t dgram_seg(struct mmsghdr* msg) {
+
+    int seg;
+    struct cmsghdr* cmsg;
+
+    for(cmsg = CMSG_FIRSTHDR(&msg->msg_hdr); cmsg; cmsg = CMSG_NXTHDR(&msg->msg_hdr, cmsg)) {
+        if(cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            memcpy(&seg, CMSG_DATA(cmsg), sizeof seg);
+            if(seg > 0) {
+                return (size_t)seg;
+            }
+        }
+    }
+
+    return msg->msg_len;
+}
+
+/*
+ *  dgram_next() -
+ *
+ *  Walks the received datagrams, and the frames a coalesced one holds, to
+ *  the next frame, receiving a new batch of datagrams once every frame
+ *  was handed out. Frames from hosts other than the peer are skipped.
+ *
+ *  @sock   : Pointer to the socket.
+ *  @len    : Pointer to store the length of the frame.
+ *  @timeout: Timeout value in microseconds. If zero, no timeout is used.
+ *
+ *  return:
+ *    - Pointer to the frame, valid until the next call.
+ *    - 'NULL' if the timeout expired or on error.
+ */
+static uint8_t* dgram_next(Socket* sock, size_t* len, size_t timeout) {
+
+    size_t n;
+    uint8_t* frame;
+    struct mmsghdr* msg;
+
+    for(;;) {
+        if(sock->in.cur == sock->in.n && !dgram_fill(sock, timeout)) {
+            return NULL;
+        }
+
+        msg = &sock->in.msgs[sock->in.cur];
+        if(sock->in.off == msg->msg_len) {
+            sock->in.cur++;
+            sock->in.off = 0;
+            continue;
+        }
+
+        if(!sock->in.off) {
+            sock->in.seg = dgram_seg(msg);
+            if(msg->msg_hdr.msg_name) {
+                udp_addr(sock->from, msg->msg_hdr.msg_name);
+            }
+        }
+
+        n     = msg->msg_len - sock->in.off < sock->in.seg ? msg->msg_len - sock->in.off : sock->in.seg;
+        frame = sock->in.buf + sock->in.cur * SOCKET_DGRAM_SIZE + sock->in.off;
+        sock->in.off += n;
+
+        if(socket_accept(sock)) {
+            *len = n;
+            return frame;
+        }
+    }
+}
+
+/*
+ *  dgram_queue() -
+ *
+ *  Records where the pieces of a frame to send to the peer are, along
+ *  with the address of the peer, flushing the queue first if it is full.
+ *  The pieces must stay untouched until the next flush.
+ *
+ *  @sock: Pointer to the socket.
+ *  @iov : Pieces of the frame.
+ *  @n   : Number of pieces.
+ *
+ *  return:
+ *    - '1' if the frame was queued.
+ *    - '0' on failure.
+ */
+static int dgram_queue(Socket* sock, const struct iovec* iov, size_t n) {
+
+    size_t i;
+    size_t len;
+
+    if(sock->batch.n == SOCKET_BATCH && !socket_flush(sock)) {
+        return 0;
+    }
+
+    len = 0;
+    for(i = 0; i < n; i++) {
+        len += iov[i].iov_len;
+    }
+
+    memcpy(sock->batch.iov[sock->batch.n], iov, n * sizeof *iov);
+    memcpy(sock->batch.to[sock->batch.n], sock->peer, SOCKET_ADDR_LEN);
+    sock->batch.cnt[sock->batch.n] = n;
+    sock->batch.len[sock->batch.n] = len;
+    sock->batch.n++;
+
+    return 1;
+}
+
+/*
+ *  dgram_row() -
+ *
+ *  Counts the queued frames, from a given one on, a UDP socket can send
+ *  as a single datagram the kernel segments: they go to the same host
+ *  and, but the last one, have the same length. Their pieces must fit a
+ *  single message.
+ *
+ *  @sock : Pointer to the socket.
+ *  @first: Index of the first frame.
+ *
+ *  return:
+ *    - Number of frames of the row, at least one.
+ */
+static size_t dgram_row(const Socket* sock, size_t first) {
+
+    size_t i;
+    size_t seg;
+    size_t cnt;
+    size_t bytes;
+
+    seg   = sock->batch.len[first];
+    cnt   = sock->batch.cnt[first];
+    bytes = seg;
+    for(i = first + 1; sock->gso && i < sock->batch.n && i - first < SOCKET_UDP_GSO_SEGS; i++) {
+
+        if(sock->batch.len[i - 1] != seg || sock->batch.len[i] > seg) {
+            break;
+        }
+
+        if(bytes + sock->batch.len[i] > SOCKET_UDP_GSO_SIZE || cnt + sock->batch.cnt[i] > IOV_MAX) {
+            break;
+        }
+
+        if(memcmp(sock->batch.to[i], sock->batch.to[first], SOCKET_ADDR_LEN)) {
+            break;
+        }
+
+        bytes += sock->batch.len[i];
+        cnt   += sock->batch.cnt[i];
+    }
+
+    return i - first;
+}
+
+/*
+ *  dgram_flush() -
+ *
+ *  Sends every queued frame with as few 'sendmmsg()' calls as possible. A
+ *  UDP socket the kernel segments datagrams for sends each row of frames
+ *  going to the same host as a single datagram, and stops doing so for
+ *  good if the kernel turns one down.
+ *
+ *  @sock: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if every queued frame was sent.
+ *    - '0' on failure.
+ */
+static int dgram_flush(Socket* sock) {
+
+    int n;
+    int m;
+    size_t i;
+    size_t j;
+    size_t k;
+    size_t done;
+    uint16_t seg;
+    struct cmsghdr* cmsg;
+    size_t rows[SOCKET_BATCH];
+    struct mmsghdr msgs[SOCKET_BATCH];
+    struct iovec iov[SOCKET_BATCH * SOCKET_IOV_MAX];
+    struct sockaddr_in6 names[SOCKET_BATCH];
+    union {
+        char            buf[CMSG_SPACE(sizeof(uint16_t))];
+        size_t          align;
+    } ctl[SOCKET_BATCH];
+
+    for(done = 0; done < sock->batch.n; ) {
+
+        m = 0;
+        k = 0;
+        memset(msgs, 0, sizeof msgs);
+        for(i = done; i < sock->batch.n; i += rows[m++]) {
+
+            rows[m] = dgram_row(sock, i);
+            msgs[m].msg_hdr.msg_iov = &iov[k];
+            for(j = i; j < i + rows[m]; j++) {
+                memcpy(&iov[k], sock->batch.iov[j], sock->batch.cnt[j] * sizeof *iov);
+                k += sock->batch.cnt[j];
+            }
+            msgs[m].msg_hdr.msg_iovlen = (size_t)(&iov[k] - msgs[m].msg_hdr.msg_iov);
+            if(sock->ops == &socket_udp) {
+                udp_name(&names[m], sock->batch.to[i]);
+                msgs[m].msg_hdr.msg_name    = &names[m];
+                msgs[m].msg_hdr.msg_namelen = sizeof names[m];
+            }
+
+            if(rows[m] > 1) {
+                seg = (uint16_t)sock->batch.len[i];
+                msgs[m].msg_hdr.msg_control    = ctl[m].buf;
+                msgs[m].msg_hdr.msg_controllen = sizeof ctl[m].buf;
+
+                cmsg = CMSG_FIRSTHDR(&msgs[m].msg_hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type  = UDP_SEGMENT;
+                cmsg->cmsg_len   = CMSG_LEN(sizeof seg);
+                memcpy(CMSG_DATA(cmsg), &seg, sizeof seg);
+            }
+        }
+
+        n = sendmmsg(sock->fd, msgs, m, 0);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            if(errno == EIO && sock->gso) {
+                sock->gso = 0;
+                continue;
+            }
+
+            sock->batch.n = 0;
+            return 0;
+        }
+
+        for(i = 0; i < (size_t)n; i++) {
+            done += rows[i];
+        }
+    }
+
+    sock->batch.n = 0;
+
+    return 1;
+}
+
+/*
+ *  dgram_close() -
+ *
+ *  Releases the buffers the socket received its datagrams into.
+ *
+ *  @sock: Pointer to the socket.
+ */
+static void dgram_close(Socket* sock) {
+
+    free(sock->in.msgs);
+    free(sock->in.buf);
+}
+
+/*
+ *  udp_resolve() -
+ *
+ *  Resolves the address of a host, IPv4 addresses being mapped to IPv6
+ *  ones.
+ *
+ *  @host: Name or numeric address of the host, IPv6 ones in brackets.
+ *  @len : Length of the name.
+ *  @name: Pointer to the socket address to fill, port excluded.
+ *
+ *  return:
+ *    - '1' if the host was resolved.
+ *    - '0' on failure.
+ */
+static int udp_resolve(const char* host, size_t len, struct sockaddr_in6* name) {
+
+    int ret;
+    char buf[NI_MAXHOST];
+    struct addrinfo hints;
+    struct addrinfo* res;
+
+    if(len >= 2 && host[0] == '[' && host[len - 1] == ']') {
+        host++;
+        len -= 2;
+    }
+
+    if(!len || len >= sizeof buf) {
+        return 0;
+    }
+
+    memcpy(buf, host, len);
+    buf[len] = 0;
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family   = AF_INET6;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags    = AI_V4MAPPED;
+
+    if(getaddrinfo(buf, NULL, &hints, &res)) {
+        return 0;
+    }
+
+    ret = res->ai_addrlen == sizeof *name;
+    if(ret) {
+        memcpy(name, res->ai_addr, sizeof *name);
+    }
+
+    freeaddrinfo(res);
+
+    return ret;
+}
+
+/*
+ *  udp_open() -
+ *
+ *  Sets up a dual-stack UDP socket, either listening on a port, for the
+ *  address '<port>', or sending to a port of a host from any port, for
+ *  the address '<host>:<port>'. Listening sockets share their port with
+ *  the other listening sockets of the user, see 'socket_fanout()'. The
+ *  kernel is asked to segment the datagrams sent and to coalesce the ones
+ *  received, if it can.
+ *
+ *  @sock     : Pointer to the socket.
+ *  @where    : Address of the socket.
+ *  @ethertype: Unused.
+ *  @promisc  : Unused.
+ *
+ *  return:
+ *    - '1' if the socket was set up.
+ *    - '0' on failure.
+ */
+static int udp_open(Socket* sock, const char* where, int ethertype, int promisc) {
+
+    int one;
+    int off;
+    int seg;
+    long port;
+    char* end;
+    const char* sep;
+    socklen_t len;
+    struct sockaddr_in6 name;
+    struct sockaddr_in6 self;
+
+    (void)ethertype;
+    (void)promisc;
+
+    sep  = strrchr(where, ':');
+    port = strtol(sep ? sep + 1 : where, &end, 10);
+    if(*end || port <= 0 || port > UINT16_MAX) {
+        return 0;
+    }
+
+    memset(&self, 0, sizeof self);
+    self.sin6_family = AF_INET6;
+    self.sin6_addr   = in6addr_any;
+    if(sep) {
+        if(!udp_resolve(where, (size_t)(sep - where), &name)) {
+            return 0;
+        }
+        name.sin6_port = htons((uint16_t)port);
+        udp_addr(sock->bcast, &name);
+    } else {
+        self.sin6_port = htons((uint16_t)port);
+    }
+
+    sock->fd = socket(AF_INET6, SOCK_DGRAM, 0);
+    if(sock->fd < 0) {
+        return 0;
+    }
+
+    off = 0;
+    one = 1;
+    if(setsockopt(sock->fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof off) < 0) {
+        return 0;
+    }
+
+    if(!sep && setsockopt(sock->fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof one) < 0) {
+        return 0;
+    }
+
+    if(bind(sock->fd, (struct sockaddr*)&self, sizeof self) < 0) {
+        return 0;
+    }
+
+    seg = 0;
+    len = sizeof seg;
+    sock->gso = !getsockopt(sock->fd, SOL_UDP, UDP_SEGMENT, &seg, &len);
+    sock->gro = !setsockopt(sock->fd, SOL_UDP, UDP_GRO, &one, sizeof one);
+
+    return dgram_alloc(sock);
+}
+
+/*
+ *  udp_mtu() -
+ *
+ *  Gets the largest frame a UDP socket sends, one that fits a 1500-byte
+ *  packet even over IPv6.
+ *
+ *  @sock : Unused.
+ *  @where: Unused.
+ *
+ *  return:
+ *    - The largest frame in bytes.
+ */
+static size_t udp_mtu(const Socket* sock, const char* where) {
+
+    (void)sock;
+    (void)where;
+
+    return SOCKET_UDP_MTU;
+}
+
+/*
+ *  unix_mtu() -
+ *
+ *  Gets the largest frame a socket pair carries, the largest the protocol
+ *  supports.
+ *
+ *  @sock : Unused.
+ *  @where: Unused.
+ *
+ *  return:
+ *    - The largest frame in bytes.
+ */
+static size_t unix_mtu(const Socket* sock, const char* where) {
+
+    (void)sock;
+    (void)where;
+
+    return PKG_MAX_FRAME;
+}
+
+const SocketOps socket_udp  = { "udp",  udp_open, NULL, dgram_next, dgram_queue, dgram_flush, udp_mtu,  dgram_close };
+const SocketOps socket_unix = { "unix", NULL,     NULL, dgram_next, dgram_queue, dgram_flush, unix_mtu, dgram_close };
+
+/*
+ *  socket_pair() -
+ *
+ *  Creates two sockets connected to each other within the process, over
+ *  a pair of Unix datagram sockets, so the protocol can be run and
+ *  measured without a network.
+ *
+ *  @pair: Array that will hold the two sockets.
+ *
+ *  return:
+ *    - '1' if both sockets were created.
+ *    - '0' on failure.
+ */
+int socket_pair(Socket* pair[2]) {
+
+    int i;
+    int fds[2];
+
+    assert(pair);
+
+    if(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) < 0) {
+        return 0;
+    }
+
+    for(i = 0; i < 2; i++) {
+        pair[i] = calloc(1, sizeof *pair[i]);
+        if(!pair[i]) {
+            close(fds[i]);
+            continue;
+        }
+
+        pair[i]->ops = &socket_unix;
+        pair[i]->fd  = fds[i];
+    }
+
+    if(!pair[0] || !pair[1] || !dgram_alloc(pair[0]) || !dgram_alloc(pair[1])) {
+        socket_close(pair[0]);
+        socket_close(pair[1]);
+        pair[0] = NULL;
+        pair[1] = NULL;
+        return 0;
+    }
+
+    socket_peer(pair[0], NULL);
+    socket_peer(pair[1], NULL);
+
+    return 1;
+}
@@ -1,12 +1,21 @@
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 
 #include "context.h"
 #include "socket.h"
+#include "table.h"
 
-#define TIMEOUT 5000
 #define DELTA   40
+#define EVENTS  8
+#define WORKERS 64
+
+#define READ_AHEAD  0x01
+#define READ_DIRECT 0x02
 
 #define ERROR_MSG       "Invalid Operation."
 #define ERROR_MSG_SIZE  sizeof ERROR_MSG
@@ -22,147 +31,765 @@
 static void usage(const char* exec) {
 
     printf(
-        "usage: %s <network-interface>\n",
+        "usage: %s <network-interface | udp:<port>> [--rx-ring] [--tx-ring] [--xdp] [--ethertype <type>] [--promisc] [--window <bytes>] [--cc <aimd|bbr>] [--stats] [--workers <n>] [--read-ahead] [--direct]\n",
         exec
     );
 }
 
+/*
+ *  parse_args() -
+ *
+ *  Parses the options following the network interface.
+ *
+ *  @argc     : Number of arguments passed on the command line.
+ *  @argv     : List of arguments passed on the command line.
+ *  @rings    : Pointer to store the rings frames are exchanged through.
+ *  @ethertype: Pointer to store the EtherType of the frames to receive.
+ *  @promisc  : Pointer to store whether to use promiscuous mode.
+ *  @window   : Pointer to store the number of bytes kept in flight, best
+ *              set to the bandwidth-delay product of the link.
+ *  @cc       : Pointer to store the congestion control algorithm.
+ *  @stats    : Pointer to store whether to print per-context statistics.
+ *  @workers  : Pointer to store the number of worker threads, best set to
+ *              the number of cores.
+ *  @reads    : Pointer to store how assets are read: ahead of the windows
+ *              through io_uring, and bypassing the page cache.
+ *
+ *  return:
+ *    - '1' if the arguments were parsed correctly.
+ *    - '0' if there was an error parsing the arguments.
+ */
+static int parse_args(int argc, char** argv, int* rings, int* ethertype, int* promisc, size_t* window, const CcOps** cc, int* stats, size_t* workers, int* reads) {
+
+    int i;
+    char* end;
+    long val;
+
+    assert(argv);
+    assert(rings);
+    assert(ethertype);
+    assert(promisc);
+    assert(window);
+    assert(cc);
+    assert(stats);
+    assert(workers);
+    assert(reads);
+
+    if(argc < 2) {
+        return 0;
+    }
+
+    *rings = 0;
+    *ethertype = PKG_ETHERTYPE;
+    *promisc = 0;
+    *window = CTX_WINDOW;
+    *cc = cc_find(NULL);
+    *stats = 0;
+    *workers = 1;
+    *reads = 0;
+    for(i = 2; i < argc; i++) {
+        if(!strcmp(argv[i], "--rx-ring")) {
+            *rings |= SOCKET_RX_RING;
+            continue;
+        }
+
+        if(!strcmp(argv[i], "--tx-ring")) {
+            *rings |= SOCKET_TX_RING;
+            continue;
+        }
+
+        if(!strcmp(argv[i], "--xdp")) {
+            *rings |= SOCKET_XDP;
+            continue;
+        }
+
+        if(!strcmp(argv[i], "--promisc")) {
+            *promisc = 1;
+            continue;
+        }
+
+        if(!strcmp(argv[i], "--ethertype") && i + 1 < argc) {
+            val = strtol(argv[++i], &end, 0);
+            if(*end || val <= 0 || val > UINT16_MAX) {
+                return 0;
+            }
+            *ethertype = (int)val;
+            continue;
+        }
+
+        if(!strcmp(argv[i], "--window") && i + 1 < argc) {
+            val = strtol(argv[++i], &end, 0);
+            if(*end || val <= 0) {
+                return 0;
+            }
+            *window = (size_t)val;
+            continue;
+        }
+
+        if(!strcmp(argv[i], "--cc") && i + 1 < argc) {
+            *cc = cc_find(argv[++i]);
+            if(!*cc) {
+                return 0;
+            }
+            continue;
+        }
+
+        if(!strcmp(argv[i], "--stats")) {
+            *stats = 1;
+            continue;
+        }
+
+        if(!strcmp(argv[i], "--workers") && i + 1 < argc) {
+            val = strtol(argv[++i], &end, 0);
+            if(*end || val <= 0 || val > WORKERS) {
+                return 0;
+            }
+            *workers = (size_t)val;
+            continue;
+        }
+
+        if(!strcmp(argv[i], "--read-ahead")) {
+            *reads |= READ_AHEAD;
+            continue;
+        }
+
+        if(!strcmp(argv[i], "--direct")) {
+            *reads |= READ_AHEAD | READ_DIRECT;
+            continue;
+        }
+
+        return 0;
+    }
+
+    /*
+     *  An interface takes a single XDP program, so a single worker.
+     */
+    return !(*rings & SOCKET_XDP) || *workers == 1;
+}
+
+/*
+ *  sendpkg() -
+ *
+ *  Seals a package with its final flags and queues it, flushing the socket
+ *  once a batch worth of packages is queued so the buffers they were built
+ *  in can be reused. A package of an asset that shrank while it was sealed
+ *  is not sent.
+ *
+ *  @ctx  : Pointer to the 'Context' structure.
+ *  @sock : Pointer to the socket to send the package over.
+ *  @pkg  : Pointer to the package.
+ *  @vec  : Pointer to the pieces referencing its content, if any.
+ *  @flags: Header flags of the package.
+ *  @n    : Pointer to the number of packages queued so far.
+ */
+static inline void sendpkg(Context* ctx, Socket* sock, Pkg* pkg, const PkgVec* vec, uint16_t flags, size_t* n) {
+
+    pkg->data.flags = flags;
+    pkgsealv(pkg, vec, ctx->check);
+    if(CtxGone(ctx)) {
+        return;
+    }
+
+    debug("sending package %zu.\n", (size_t)PkgIndx(pkg));
+    pkgqueuev(pkg, vec, sock);
+    if(++*n % SOCKET_BATCH == 0) {
+        pkgflush(sock);
+    }
+}
+
 /*
  *  sendwin() -
  *
- *  Sends the packages stored in the window buffer over the 
- *  specified socket.
+ *  Sends the packages in flight deemed lost, in the order they were sent,
+ *  followed by as many new ones as the windows have room for, building
+ *  each of them as it goes, until the pacing rate holds the next one
+ *  back. Each package is queued once the next one is built, so the last
+ *  of the flight can ask the client to answer, unless more follow as soon
+ *  as the pacing rate lets them; its round trip is timed.
  *
- *  @ctx : Pointer to the 'Context' structure containing the window buffer.
- *  @sock: Socket file descriptor to send the packages over.
+ *  @ctx : Pointer to the 'Context' structure containing the window.
+ *  @sock: Pointer to the socket to send the packages over.
  */
-static inline void sendwin(Context* ctx, int sock) {
+static inline void sendwin(Context* ctx, Socket* sock) {
 
+    int paced;
     size_t i;
+    size_t n;
+    size_t seq;
+    size_t last;
+    Pkg* pkg;
+    Pkg* prev;
+    PkgVec* vec;
+    PkgVec* prevvec;
 
     assert(ctx);
 
-    for(i = 0; i < ctx->win.i; i++)  {
-        debug("sending package %zu.\n", (size_t)ctx->win.buf[i].data.indx);
-        pkgsend(&ctx->win.buf[i], sock);
+    i = 0;
+    n = 0;
+    last = 0;
+    paced = 0;
+    prev = NULL;
+    prevvec = NULL;
+    for(;;) {
+        if(!context_ready(ctx)) {
+            paced = 1;
+            break;
+        }
+
+        vec = CtxVec(ctx, i);
+        seq = context_lost(ctx);
+        if(seq < ctx->win.next) {
+            pkg = context_frame(ctx, seq, CtxOut(ctx, i), vec);
+        } else {
+            pkg = context_extend(ctx, CtxOut(ctx, i), vec);
+        }
+
+        if(!pkg) {
+            break;
+        }
+
+        if(prev) {
+            sendpkg(ctx, sock, prev, prevvec, 0, &n);
+        }
+
+        prev = pkg;
+        prevvec = vec;
+        last = seq;
+        i++;
+    }
+
+    if(prev) {
+        sendpkg(ctx, sock, prev, prevvec, paced ? 0 : PKG_FLAG_PUSH, &n);
+    }
+
+    pkgflush(sock);
+    if(prev) {
+        context_timer(ctx, last);
     }
 }
 
 /*
- *  process_context_end() -
- *
- *  Handles the finalization of the context by sending 
- *  'end' or 'error' packages
+ *  context_finish() -
  *
+ *  Moves a context on to sending an 'end' or 'error' package until the
+ *  client acknowledges it.
  *
  *  @ctx : Pointer to the 'Context' structure.
- *  @sock: Socket file descriptor.
+ *  @type: Type of the package, 'PKG_END' or 'PKG_ERROR'.
  */
-static void process_context_end(Context* ctx, int sock, PkgType type) {
+static void context_finish(Context* ctx, PkgType type) {
 
     char*  msg;
-    char*  tpe;
-    size_t count;
     size_t size;
 
-    Pkg pkg;
-    Pkg snd;
-
     assert(ctx);
 
     msg  = NULL;
-    tpe  = "end";
     size = 0;
     if(type == PKG_ERROR) {
         msg  = ERROR_MSG;
         size = ERROR_MSG_SIZE;
-        tpe  = "error";
     }
 
-    pkginit(&snd, size, 0, type, (uint8_t*)msg);
-    count = 0;
-    for(; count < DELTA;) {
-        debug("sending %s.\n", tpe);
-        pkgsend(&snd, sock);
-        if(pkgrecv(&pkg, sock, TIMEOUT) && pkgvalid(&pkg)) {
-            if(PkgAck(&pkg)) {
-                break;
+    pkginit(&ctx->win.ctl, size, 0, type, (uint8_t*)msg, ctx->check, ctx->sess);
+    ctx->state = CTX_ENDING;
+    ctx->idle  = 0;
+    ctx->rtt.deadline = 0;
+}
+
+/*
+ *  serve_ending() -
+ *
+ *  Sends the 'end' or 'error' package of a context whenever the previous
+ *  copy went unanswered for a retransmission timeout, backing the timeout
+ *  off every time. The context is dropped after 'DELTA' copies.
+ *
+ *  @ctx : Pointer to the 'Context' structure.
+ *  @sock: Pointer to the socket.
+ *
+ *  return:
+ *    - Number of microseconds until the context needs serving again.
+ *    - '0' if the context is done.
+ */
+static size_t serve_ending(Context* ctx, Socket* sock) {
+
+    size_t now;
+
+    assert(ctx);
+
+    now = pkgtime();
+    if(now >= ctx->rtt.deadline) {
+        if(ctx->idle++ == DELTA) {
+            ctx->state = CTX_DONE;
+            return 0;
+        }
+
+        debug("sending %s.\n", ctx->win.ctl.data.type == PKG_ERROR ? "error" : "end");
+        pkgsend(&ctx->win.ctl, sock);
+        if(ctx->idle > 1) {
+            ctx->rtt.rto = ctx->rtt.rto < CTX_RTO_MAX / 2 ? 2 * ctx->rtt.rto : CTX_RTO_MAX;
+        }
+        ctx->rtt.deadline = now + CtxRto(ctx);
+    }
+
+    return ctx->rtt.deadline - now;
+}
+
+/*
+ *  serve() -
+ *
+ *  Moves a context along without ever waiting: handles an expired
+ *  retransmission timeout, sends whatever the windows and the pacing rate
+ *  let through and, once the client holds the whole asset, goes on to
+ *  ending the context, or to failing it if the asset shrank under its
+ *  mapping. The context is dropped once the retransmission timeout
+ *  expires 'DELTA' times in a row.
+ *
+ *  @ctx  : Pointer to the 'Context' structure.
+ *  @sock : Pointer to the socket.
+ *  @stats: Whether to print the statistics of the context as it goes.
+ *
+ *  return:
+ *    - Number of microseconds until the context needs serving again.
+ *    - '0' if the context is done.
+ */
+static size_t serve(Context* ctx, Socket* sock, int stats) {
+
+    assert(ctx);
+
+    socket_to(sock, ctx->addr);
+    if(ctx->state == CTX_SENDING) {
+        if(context_expired(ctx)) {
+            context_timeout(ctx);
+            if(++ctx->idle == DELTA) {
+                debug("client gone.\n");
+                ctx->state = CTX_DONE;
+                return 0;
             }
         }
-        count++;
+
+        if(stats && pkgtime() - ctx->stats.shown >= CTX_STATS_INTERVAL) {
+            context_stats(ctx, stdout);
+            ctx->stats.shown = pkgtime();
+        }
+
+        if(!CtxCompleted(ctx)) {
+            sendwin(ctx, sock);
+            if(!CtxGone(ctx)) {
+                return context_wait(ctx);
+            }
+
+            debug("asset shrank while served.\n");
+            context_finish(ctx, PKG_ERROR);
+            return serve_ending(ctx, sock);
+        }
+
+        debug("context completed: %zu packages sent.\n", ctx->k);
+        if(stats) {
+            context_stats(ctx, stdout);
+        }
+
+        context_finish(ctx, PKG_END);
+    }
+
+    if(ctx->state == CTX_ENDING) {
+        return serve_ending(ctx, sock);
     }
+
+    return 0;
 }
 
 /*
- *  process_context() -
+ *  serve_all() -
  *
- *  Handles the context processing loop by sending windowed data and receiving
- *  packages, updating the context accordingly, and handling the context end
- *  condition.
+ *  Serves every context of the table, dropping those that are done.
  *
- *  @ctx : Pointer to the 'Context' structure.
- *  @sock: Socket file descriptor.
+ *  @tab  : Pointer to the table of contexts.
+ *  @sock : Pointer to the socket.
+ *  @stats: Whether to print the statistics of the contexts as they go.
+ *
+ *  return:
+ *    - Number of microseconds until a context needs serving again.
+ *    - '0' if no context is left.
+ */
+static size_t serve_all(CtxTable* tab, Socket* sock, int stats) {
+
+    size_t i;
+    size_t wait;
+    size_t next;
+    Context* ctx;
+
+    assert(tab);
+
+    next = 0;
+    for(i = 0; i < tab->n;) {
+        ctx  = tab->ctx[i];
+        wait = serve(ctx, sock, stats);
+        if(!wait) {
+            debug("context dropped.\n");
+            table_remove(tab, i);
+            context_free(&ctx);
+            continue;
+        }
+
+        if(!next || wait < next) {
+            next = wait;
+        }
+        i++;
+    }
+
+    pkgflush(sock);
+
+    return next;
+}
+
+/*
+ *  dispatch() -
+ *
+ *  Hands a received package to the context of the session it belongs
+ *  to. A request opening a session creates its context, answered with
+ *  the parameters agreed on or, if it cannot be served, with an error;
+ *  a repeated request means the answer was lost. An error from the
+ *  client cancels its context.
+ *
+ *  @tab   : Pointer to the table of contexts.
+ *  @sock  : Pointer to the socket the package came from.
+ *  @rcv   : Pointer to the package.
+ *  @mtu   : Largest frame the local interface can carry.
+ *  @window: Number of bytes a context may keep in flight.
+ *  @cc    : Congestion control algorithm of new contexts.
+ *  @ur    : Ring assets are read ahead through, or 'NULL'.
+ *  @direct: Whether reads ahead bypass the page cache.
  */
-static void process_context(Context* ctx, int sock) {
+static void dispatch(CtxTable* tab, Socket* sock, Pkg* rcv, size_t mtu, size_t window, const CcOps* cc, Uring* ur, int direct) {
 
     Pkg pkg;
+    Context* ctx;
 
-    assert(ctx);
+    assert(tab);
+    assert(rcv);
+
+    if(!pkgvalid(rcv)) {
+        return;
+    }
+
+    ctx = table_find(tab, sock->from, PkgSess(rcv));
+    if(!ctx) {
+        if(!iscontext(rcv) || TableFull(tab)) {
+            return;
+        }
+
+        pkg_rmv_sentinel_bytes(rcv);
+        ctx = context_create();
+        if(!ctx) {
+            return;
+        }
+
+        memcpy(ctx->addr, sock->from, SOCKET_ADDR_LEN);
+        ctx->sess = PkgSess(rcv);
+        table_add(tab, ctx);
+        socket_to(sock, ctx->addr);
+        debug("context created (session %x).\n", ctx->sess);
+        if(context_init(ctx, rcv, mtu, window, cc, ur, direct)) {
+            debug("context initialized (mtu %zu, window %zu)... sending ack.\n", ctx->mtu, ctx->win.size);
+            context_accept(ctx, &pkg);
+            pkgsend(&pkg, sock);
+        } else {
+            context_finish(ctx, PKG_ERROR);
+        }
+        return;
+    }
+
+    if(ctx->state != CTX_SENDING) {
+        if(ctx->state == CTX_ENDING && PkgAck(rcv) && PkgCheck(rcv) == ctx->check) {
+            ctx->state = CTX_DONE;
+        }
+        return;
+    }
+
+    if(PkgError(rcv) && PkgCheck(rcv) == ctx->check) {
+        debug("context cancelled.\n");
+        ctx->state = CTX_DONE;
+        return;
+    }
+
+    ctx->idle = 0;
+    debug("valid package received.\n");
+    if(iscontext(rcv)) {
+        socket_to(sock, ctx->addr);
+        context_accept(ctx, &pkg);
+        pkgsend(&pkg, sock);
+    } else {
+        context_update(ctx, rcv);
+    }
+}
+
+/*
+ *  timer_arm() -
+ *
+ *  Arms a timer to expire once, or disarms it.
+ *
+ *  @fd  : File descriptor of the timer.
+ *  @wait: Number of microseconds until it expires, or '0' to disarm it.
+ */
+static inline void timer_arm(int fd, size_t wait) {
+
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof its);
+    its.it_value.tv_sec  = wait / 1000000;
+    its.it_value.tv_nsec = (wait % 1000000) * 1000;
+    timerfd_settime(fd, 0, &its, NULL);
+}
+
+/*
+ *  process_events() -
+ *
+ *  Serves every client at once from a single thread. Contexts are served
+ *  whenever packages come in, reads ahead complete or a timer, armed for
+ *  the context that needs serving first, expires; serving them never
+ *  blocks.
+ *
+ *  @sock  : Pointer to the non-blocking socket.
+ *  @ur    : Ring assets are read ahead through, or 'NULL'.
+ *  @direct: Whether reads ahead bypass the page cache.
+ *  @mtu   : Largest frame the local interface can carry.
+ *  @window: Number of bytes a context may keep in flight.
+ *  @cc    : Congestion control algorithm of the contexts.
+ *  @stats : Whether to print the statistics of the contexts as they go.
+ *
+ *  return:
+ *    - '0' if the event loop could not be set up.
+ */
+static int process_events(Socket* sock, Uring* ur, int direct, size_t mtu, size_t window, const CcOps* cc, int stats) {
+
+    int i;
+    int n;
+    int ep;
+    int tfd;
+    size_t k;
+    uint64_t ticks;
+    Pkg pkg;
+    Pkg* rcv;
+    CtxTable* tab;
+    struct epoll_event ev;
+    struct epoll_event evs[EVENTS];
+
+    assert(sock);
+
+    tab = calloc(1, sizeof *tab);
+    ep  = epoll_create1(0);
+    tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if(!tab || ep < 0 || tfd < 0) {
+        free(tab);
+        return 0;
+    }
+
+    table_init(tab);
+
+    memset(&ev, 0, sizeof ev);
+    ev.events  = EPOLLIN;
+    ev.data.fd = SocketFd(sock);
+    epoll_ctl(ep, EPOLL_CTL_ADD, SocketFd(sock), &ev);
+    ev.data.fd = tfd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, tfd, &ev);
+    if(ur) {
+        ev.data.fd = UringFd(ur);
+        epoll_ctl(ep, EPOLL_CTL_ADD, UringFd(ur), &ev);
+    }
 
     for(;;) {
-        sendwin(ctx, sock);
-        if(pkgrecv(&pkg, sock, TIMEOUT)) {
-            debug("package received.\n");
-            if(pkgvalid(&pkg)) {
-                debug("valid package received.\n");
-                context_update(ctx, &pkg); 
-                if(CtxCompleted(ctx)) {
-                    debug("finalizing context.\n");
-                    process_context_end(ctx, sock, PKG_END);
-                    break;
+        timer_arm(tfd, serve_all(tab, sock, stats));
+
+        n = epoll_wait(ep, evs, EVENTS, -1);
+        for(i = 0; i < n; i++) {
+            if(evs[i].data.fd == tfd) {
+                if(read(tfd, &ticks, sizeof ticks) < 0) {
+                    debug("timer not read.\n");
                 }
-            } 
+                continue;
+            }
+
+            if(ur && evs[i].data.fd == UringFd(ur)) {
+                pkgstage_reap(ur);
+                continue;
+            }
+
+            for(k = 0; k < SOCKET_BATCH && (rcv = pkgrecv(&pkg, sock, 0)); k++) {
+                dispatch(tab, sock, rcv, mtu, window, cc, ur, direct);
+            }
         }
     }
 
-    debug("context completed: %zu packages sent.\n", ctx->k);
+    return 0;
+}
+
+/*
+ *  A worker serves the clients the kernel hands to its socket, from its
+ *  own thread, with its own contexts, files, buffers and ring to read
+ *  ahead through, bypassing the page cache if 'direct' is set: workers
+ *  share nothing once running.
+ */
+struct Worker {
+
+    pthread_t    thread;
+    Socket*      sock;
+    Uring*       ur;
+    int          direct;
+    size_t       mtu;
+    size_t       window;
+    const CcOps* cc;
+    int          stats;
+};
+
+typedef struct Worker Worker;
+
+/*
+ *  worker_open() -
+ *
+ *  Opens the socket of a worker and sets it up for its event loop. With
+ *  more than one worker the socket joins the fanout group of the server,
+ *  so the worker only sees the frames of its own clients.
+ *
+ *  @wrk      : Pointer to the worker.
+ *  @intf     : Network interface to serve on, or 'udp:<port>' to serve
+ *              over UDP.
+ *  @rings    : Rings frames are exchanged through.
+ *  @ethertype: EtherType of the frames to receive.
+ *  @promisc  : Whether to use promiscuous mode.
+ *  @group    : Fanout group to join, or '-1' for none.
+ *  @reads    : How assets are read.
+ *
+ *  return:
+ *    - '1' if the worker is ready to run.
+ *    - '0' on failure, with the reason printed.
+ */
+static int worker_open(Worker* wrk, const char* intf, int rings, int ethertype, int promisc, int group, int reads) {
+
+    assert(wrk);
+
+    wrk->sock = socket_create(intf, ethertype, promisc);
+    if(!wrk->sock) {
+        perror("error - failed to open socket");
+        return 0;
+    }
+
+    if(rings && !socket_ring(wrk->sock, rings)) {
+        perror("error - failed to map socket rings");
+        return 0;
+    }
+
+    wrk->mtu = socket_mtu(wrk->sock, intf);
+    if(!wrk->mtu) {
+        perror("error - failed to get interface mtu");
+        return 0;
+    }
+
+    if(!socket_buffer(wrk->sock, wrk->window)) {
+        perror("error - failed to size socket buffers");
+        return 0;
+    }
+
+    if(!socket_nonblock(wrk->sock)) {
+        perror("error - failed to set up the event loop");
+        return 0;
+    }
+
+    if(group >= 0 && !socket_fanout(wrk->sock, group)) {
+        perror("error - failed to join the fanout group");
+        return 0;
+    }
+
+    if(reads & READ_AHEAD) {
+        wrk->direct = (reads & READ_DIRECT) != 0;
+        wrk->ur = uring_open(URING_ENTRIES);
+        if(!wrk->ur) {
+            perror("error - failed to set up read-ahead");
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ *  worker_run() -
+ *
+ *  Runs the event loop of a worker.
+ *
+ *  @arg: Pointer to the worker.
+ *
+ *  return:
+ *    - 'NULL' once the event loop could not be set up.
+ */
+static void* worker_run(void* arg) {
+
+    Worker* wrk;
+
+    wrk = arg;
+    if(!process_events(wrk->sock, wrk->ur, wrk->direct, wrk->mtu, wrk->window, wrk->cc, wrk->stats)) {
+        perror("error - failed to set up the event loop");
+    }
+
+    return NULL;
 }
 
 int main(int argc, char** argv) {
 
-    int sock;
-    Pkg pkg;
-    Context* ctx;
+    int rings;
+    int promisc;
+    int ethertype;
+    int stats;
+    int group;
+    int reads;
+    int ok;
+    size_t i;
+    size_t n;
+    size_t workers;
+    size_t window;
+    const CcOps* cc;
+    Worker* wrk;
 
-    if(argc < 2) {
+    if(!parse_args(argc, argv, &rings, &ethertype, &promisc, &window, &cc, &stats, &workers, &reads)) {
         usage(argv[0]);
         exit(1);
     }
 
-    sock = socket_create(argv[1]);
-    if(sock < 0) {
-        perror("error - failed to open socket");
+    wrk = calloc(workers, sizeof *wrk);
+    if(!wrk) {
+        perror("error");
         return 1;
     }
 
-    for(;;) {
-        pkgrecv(&pkg, sock, 0);
-        if(pkgvalid(&pkg) && iscontext(&pkg)) {
-            ctx = context_create();
-            if(ctx) {
-                debug("context created.\n");
-                if(context_init(ctx, &pkg)) {
-                    debug("context initialized... sending ack.\n");
-                    pkgsend_ack(sock);
-                    process_context(ctx, sock);
-                } else {
-                    process_context_end(ctx, sock, PKG_ERROR);
-                }
+    ok = 1;
+    group = workers > 1 ? getpid() & 0xffff : -1;
+    for(n = 0; ok && n < workers; n++) {
+        wrk[n].window = window;
+        wrk[n].cc     = cc;
+        wrk[n].stats  = stats;
+        ok = worker_open(&wrk[n], argv[1], rings, ethertype, promisc, group, reads);
+    }
+
+    if(ok) {
+        for(i = 1; i < workers; i++) {
+            if(pthread_create(&wrk[i].thread, NULL, worker_run, &wrk[i])) {
+                perror("error - failed to start worker");
+                exit(1);
             }
-            context_free(&ctx);
-            memset(&pkg, 0, sizeof pkg);
         }
+
+        worker_run(&wrk[0]);
     }
 
-    return 0;
+    for(i = 0; i < n; i++) {
+        if(wrk[i].sock) {
+            socket_close(wrk[i].sock);
+        }
+
+        uring_close(wrk[i].ur);
+    }
+
+    free(wrk);
+
+    return 1;
 }
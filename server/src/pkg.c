@@ -1,247 +1,1037 @@
 
+#define _GNU_SOURCE
+
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <time.h>
+#include <signal.h>
 #include <assert.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 
 #include "pkg.h"
 #include "pkg.defs.h"
+#include "stuff.h"
+
+/*
+ *  Staging buffer of the mapped asset the calling thread touched last, and
+ *  the size of a page, for 'pkgstage_sigbus()'.
+ */
+static __thread PkgStage* pkg_mapped;
+static size_t pkg_page;
+
+/*
+ *  pkgstage_sigbus() -
+ *
+ *  Handles a fault on a page past the end of a mapped asset that shrank
+ *  while served: the page is replaced by one of zeros, so the access
+ *  completes, and the staging buffer is marked 'gone' for its context to
+ *  fail. Any other fault kills the process, as it would have.
+ *
+ *  @sig : Number of the signal.
+ *  @info: Pointer to the information about the fault.
+ *  @uctx: Unused.
+ */
+static void pkgstage_sigbus(int sig, siginfo_t* info, void* uctx) {
+
+    uintptr_t addr;
+    PkgStage* st;
+
+    (void)uctx;
+
+    st   = pkg_mapped;
+    addr = (uintptr_t)info->si_addr;
+    if(st && st->map && addr >= (uintptr_t)st->map && addr < (uintptr_t)st->map + st->size) {
+        addr &= ~(uintptr_t)(pkg_page - 1);
+        if(mmap((void*)addr, pkg_page, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+            st->gone = 1;
+            return;
+        }
+    }
+
+    signal(sig, SIG_DFL);
+}
+
+/*
+ *  pkgstage_sigbus_init() -
+ *
+ *  Installs 'pkgstage_sigbus()' before 'main()' runs, for every thread.
+ */
+__attribute__((constructor))
+static void pkgstage_sigbus_init(void) {
+
+    struct sigaction sa;
+
+    pkg_page = (size_t)sysconf(_SC_PAGESIZE);
+
+    memset(&sa, 0, sizeof sa);
+    sa.sa_sigaction = pkgstage_sigbus;
+    sa.sa_flags     = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGBUS, &sa, NULL);
+}
+
+/*
+ *  pkgahead_issue() -
+ *
+ *  Reads the bytes of a chunk that are not in yet, in the background.
+ *
+ *  @st: Pointer to the PkgStage structure of the chunk.
+ *  @ah: Pointer to the chunk.
+ *
+ *  return:
+ *    - '1' if the read is in flight.
+ *    - '0' if it could not be queued, which the chunk records.
+ */
+static int pkgahead_issue(PkgStage* st, PkgAhead* ah) {
+
+    ah->busy = 1;
+    if(!uring_read(st->ur, st->fd, ah->buf + ah->len, ah->want - ah->len, ah->off + (off_t)ah->len, ah)) {
+        ah->busy = 0;
+        ah->res  = -EIO;
+        return 0;
+    }
+
+    uring_submit(st->ur, 0);
+
+    return 1;
+}
+
+/*
+ *  pkgahead_next() -
+ *
+ *  Starts reading the next chunk of the file into a chunk that is free,
+ *  if the bytes served go on. The last chunk is read up to an aligned
+ *  length.
+ *
+ *  @st: Pointer to the PkgStage structure of the chunk.
+ *  @ah: Pointer to the free chunk.
+ */
+static void pkgahead_next(PkgStage* st, PkgAhead* ah) {
+
+    size_t left;
+
+    ah->len  = 0;
+    ah->res  = 0;
+    ah->want = 0;
+    if(st->next >= st->end) {
+        return;
+    }
+
+    left = (size_t)(st->end - st->next);
+    ah->off  = st->next;
+    ah->want = PKG_AHEAD_SIZE;
+    if(left < PKG_AHEAD_SIZE) {
+        ah->want = (left + PKG_STAGE_ALIGN - 1) & ~(size_t)(PKG_STAGE_ALIGN - 1);
+    }
+
+    st->next += PKG_AHEAD_SIZE;
+    pkgahead_issue(st, ah);
+}
+
+/*
+ *  pkgstage_init_ahead() -
+ *
+ *  Sets a staging buffer up to read a file ahead through a ring, opening
+ *  it to bypass the page cache if asked to, the file system allows it and
+ *  its bounce buffer can be allocated, and starts reading the first
+ *  chunks. The first one starts at the aligned offset at or before the
+ *  first byte served.
+ *
+ *  @st    : Pointer to the PkgStage structure.
+ *  @ur    : Pointer to the ring.
+ *  @direct: Whether to bypass the page cache.
+ *
+ *  return:
+ *    - '1' if the chunks were allocated.
+ *    - '0' otherwise.
+ */
+static int pkgstage_init_ahead(PkgStage* st, Uring* ur, int direct) {
+
+    int flags;
+    size_t k;
+    void* buf;
+
+    if(direct) {
+        flags = fcntl(st->fd, F_GETFL);
+        if(flags >= 0 && !fcntl(st->fd, F_SETFL, flags | O_DIRECT)) {
+            if(!posix_memalign(&buf, PKG_STAGE_ALIGN, PKG_BOUNCE_SIZE)) {
+                st->bounce = buf;
+            } else {
+                fcntl(st->fd, F_SETFL, flags);
+            }
+        }
+    }
+
+    for(k = 0; k < PKG_AHEAD_DEPTH; k++) {
+        if(posix_memalign(&buf, PKG_STAGE_ALIGN, PKG_AHEAD_SIZE)) {
+            while(k--) {
+                free(st->ahead[k].buf);
+            }
+            free(st->bounce);
+            return 0;
+        }
+        st->ahead[k].buf = buf;
+    }
+
+    st->ur   = ur;
+    st->next = st->start & ~(off_t)(PKG_STAGE_ALIGN - 1);
+    for(k = 0; k < PKG_AHEAD_DEPTH; k++) {
+        pkgahead_next(st, &st->ahead[k]);
+    }
+
+    return 1;
+}
+
+/*
+ *  pkgstage_init() -
+ *
+ *  Initializes a staging buffer reading a range of an open file: ahead of
+ *  the window through a ring if one is given, from a mapping of the file
+ *  if possible, and from an allocated buffer otherwise. A range ending
+ *  past the end of the file, or at offset zero, ends with the file.
+ *
+ *  @st    : Pointer to the PkgStage structure to be initialized.
+ *  @fd    : File descriptor the data will be read from.
+ *  @ur    : Pointer to the ring to read ahead through, or 'NULL'.
+ *  @direct: Whether reads ahead bypass the page cache.
+ *  @start : File offset of the first byte to read.
+ *  @end   : File offset to stop reading at.
+ *
+ *  return:
+ *    - '1' if the staging buffer is ready.
+ *    - '0' if the range starts past its end or on failure.
+ */
+int pkgstage_init(PkgStage* st, int fd, Uring* ur, int direct, off_t start, off_t end) {
+
+    void* map;
+    struct stat sb;
+
+    assert(st);
+
+    memset(st, 0, sizeof *st);
+    st->fd = fd;
+
+    if(fstat(fd, &sb) || start < 0 || end < 0) {
+        return 0;
+    }
+
+    if(!end || end > sb.st_size) {
+        end = sb.st_size;
+    }
+
+    if(start > end) {
+        return 0;
+    }
+
+    st->start = start;
+    st->end   = end;
+    st->off   = start;
+
+    if(S_ISREG(sb.st_mode) && sb.st_size > 0) {
+        st->size = (size_t)sb.st_size;
+        if(ur) {
+            return pkgstage_init_ahead(st, ur, direct);
+        }
+
+        map = mmap(NULL, st->size, PROT_READ, MAP_SHARED, fd, 0);
+        if(map != MAP_FAILED) {
+            madvise(map, st->size, MADV_SEQUENTIAL);
+            st->map = map;
+            return 1;
+        }
+    }
+
+    st->buf = malloc(PKG_STAGE_SIZE);
+
+    return st->buf != NULL;
+}
+
+/*
+ *  pkgstage_deinit() -
+ *
+ *  Releases the staging buffer, or the mapping, and closes the file it
+ *  reads from. Reads still in flight are waited for, as the kernel would
+ *  fill their chunks otherwise.
+ *
+ *  @st: Pointer to the PkgStage structure to be deinitialized.
+ */
+void pkgstage_deinit(PkgStage* st) {
+
+    size_t k;
+
+    if(st && (st->buf || st->map || st->ur)) {
+        if(st->ur) {
+            for(k = 0; k < PKG_AHEAD_DEPTH; k++) {
+                while(st->ahead[k].busy && uring_submit(st->ur, 1)) {
+                    pkgstage_reap(st->ur);
+                }
+                free(st->ahead[k].buf);
+            }
+            free(st->bounce);
+            st->buf = NULL;
+        }
+
+        close(st->fd);
+        if(st->map) {
+            munmap((void*)st->map, st->size);
+        }
+        if(pkg_mapped == st) {
+            pkg_mapped = NULL;
+        }
+        free(st->buf);
+        st->buf = NULL;
+        st->map = NULL;
+        st->ur  = NULL;
+    }
+}
+
+/*
+ *  pkgstage_reap() -
+ *
+ *  Takes in the completed reads of a ring, for whichever staging buffers
+ *  they were made.
+ *
+ *  @ur: Pointer to the ring.
+ */
+void pkgstage_reap(Uring* ur) {
+
+    int res;
+    PkgAhead* ah;
+
+    assert(ur);
+
+    while((ah = uring_reap(ur, &res))) {
+        ah->busy = 0;
+        ah->res  = res;
+        if(res > 0) {
+            ah->len += (size_t)res;
+        }
+    }
+}
+
+/*
+ *  pkgstage_ahead() -
+ *
+ *  Moves a staging buffer reading ahead on to its next chunk once every
+ *  byte of the current one has been consumed, reading the next chunk of
+ *  the file into the one consumed. A chunk read short is read on. The
+ *  first chunk is consumed from the first byte served on.
+ *
+ *  @st: Pointer to the PkgStage structure.
+ *
+ *  return:
+ *    -  '1' if there are staged bytes left to consume.
+ *    -  '0' if there is an error reading from the file.
+ *    - '-1' if there was nothing left to read.
+ *    - 'PKG_AGAIN' if the next chunk is still being read.
+ */
+static int pkgstage_ahead(PkgStage* st) {
+
+    PkgAhead* ah;
+
+    if(st->buf) {
+        pkgahead_next(st, &st->ahead[st->head]);
+        st->head = (st->head + 1) % PKG_AHEAD_DEPTH;
+        st->buf  = NULL;
+        st->len  = 0;
+        st->pos  = 0;
+    }
+
+    if(st->off >= st->end) {
+        return -1;
+    }
+
+    ah = &st->ahead[st->head];
+    if(ah->busy) {
+        uring_submit(st->ur, 0);
+        return PKG_AGAIN;
+    }
+
+    if(ah->res < 0) {
+        return 0;
+    }
+
+    if(ah->res > 0 && ah->len < ah->want && ah->off + (off_t)ah->len < st->end) {
+        return pkgahead_issue(st, ah) ? PKG_AGAIN : 0;
+    }
+
+    if(ah->off + (off_t)ah->len <= st->off) {
+        return -1;
+    }
+
+    st->buf = ah->buf;
+    st->len = ah->len < (size_t)(st->end - ah->off) ? ah->len : (size_t)(st->end - ah->off);
+    st->pos = (size_t)(st->off - ah->off);
+    st->off = ah->off + (off_t)st->len;
+
+    return 1;
+}
+
+/*
+ *  pkgstage_fill() -
+ *
+ *  Refills the staging buffer with one large read once every staged byte
+ *  has been consumed, never past the bytes served.
+ *
+ *  @st: Pointer to the PkgStage structure.
+ *
+ *  return:
+ *    -  '1' if there are staged bytes left to consume.
+ *    -  '0' if there is an error reading from the file.
+ *    - '-1' if there was nothing left to read.
+ *    - 'PKG_AGAIN' if the bytes read ahead are not in yet.
+ */
+static int pkgstage_fill(PkgStage* st) {
+
+    size_t want;
+    ssize_t n;
+
+    assert(st);
+
+    if(st->pos < st->len) {
+        return 1;
+    }
+
+    if(st->ur) {
+        return pkgstage_ahead(st);
+    }
+
+    if(st->off >= st->end) {
+        return -1;
+    }
+
+    want = PKG_STAGE_SIZE;
+    if((off_t)want > st->end - st->off) {
+        want = (size_t)(st->end - st->off);
+    }
+
+    do {
+        n = pread(st->fd, st->buf, want, st->off);
+    } while(n < 0 && errno == EINTR);
+
+    if(n <= 0) {
+        return n < 0 ? 0 : -1;
+    }
+
+    st->off += n;
+    st->len  = (size_t)n;
+    st->pos  = 0;
+
+    return 1;
+}
 
 /*
- *  add_byte_to_pkg() -
+ *  pkgref() -
+ *
+ *  References the content of a package in the pages of a mapped asset:
+ *  the runs of bytes between sentinels are left where they are, and each
+ *  sentinel is followed by a shared escape byte. Referencing stops once
+ *  the content is full, once the bytes run out, or once the pieces do.
  *
- *  Adds a byte to the package at the specified index, with special 
- *  handling for certain byte values.
+ *  @pkg: Pointer to the Pkg structure whose size will be set.
+ *  @vec: Pointer to the PkgVec structure that will reference the content.
+ *  @src: Pointer to the mapped bytes.
+ *  @n  : Number of mapped bytes available.
+ *  @cap: Number of content bytes the package may hold.
  *
- *  @pkg : Pointer to the Pkg structure where the byte will be added.
- *  @byte: Byte value to add to the package.
+ *  return:
+ *    - The number of mapped bytes referenced.
  */
-static void add_byte_to_pkg(Pkg* pkg, uint8_t byte) {
+static size_t pkgref(Pkg* pkg, PkgVec* vec, const uint8_t* src, size_t n, size_t cap) {
 
     size_t i;
+    size_t run;
+    size_t size;
 
-    assert(pkg);
+    static const uint8_t escape = STUFF_ESCAPE;
+
+    vec->iov[0].iov_base = pkg->raw;
+    vec->iov[0].iov_len  = PKG_HDR_SIZE;
+    vec->n = 1;
+
+    i    = 0;
+    size = 0;
+    while(i < n && size < cap && vec->n < SOCKET_IOV_MAX) {
 
-    i = pkg->data.size;
-    pkg->data.content[i] = byte;
-    if(byte == 0x81 || byte == 0x88) {
-        if(i + 1 < sizeof pkg->data.content) {
-            pkg->data.content[i + 1] = 0xff;
-            i++;
+        run = stuff_scan(src + i, n - i);
+        if(run == n - i || size + run + 2 > cap || vec->n + 2 > SOCKET_IOV_MAX) {
+            run = run < cap - size ? run : cap - size;
+            if(run) {
+                vec->iov[vec->n].iov_base = (void*)(src + i);
+                vec->iov[vec->n].iov_len  = run;
+                vec->n++;
+            }
+            i    += run;
+            size += run;
+            break;
+        }
+
+        vec->iov[vec->n].iov_base     = (void*)(src + i);
+        vec->iov[vec->n].iov_len      = run + 1;
+        vec->iov[vec->n + 1].iov_base = (void*)&escape;
+        vec->iov[vec->n + 1].iov_len  = 1;
+        vec->n += 2;
+
+        i    += run + 1;
+        size += run + 2;
+    }
+
+    pkg->data.size = (uint16_t)size;
+
+    return i;
+}
+
+/*
+ *  pkgread_map() -
+ *
+ *  Takes the content of a package from a mapped asset, referencing it
+ *  unless that takes too many pieces for even half the content the
+ *  package may hold, or unless the frame would need padding. The content
+ *  is copied out of the mapping then. The package is dropped if the asset
+ *  turns out to have shrunk.
+ *
+ *  @pkg: Pointer to the Pkg structure where the data will be stored.
+ *  @vec: Pointer to the PkgVec structure that will reference the content,
+ *        or 'NULL' to always copy it.
+ *  @st : Pointer to the PkgStage structure of the mapped asset.
+ *  @n  : Number of content bytes the package may hold.
+ *
+ *  return:
+ *    -  '1' if there are bytes left to read.
+ *    -  '0' if the asset shrank.
+ *    - '-1' if every byte served was read.
+ */
+static int pkgread_map(Pkg* pkg, PkgVec* vec, PkgStage* st, size_t n) {
+
+    size_t left;
+    size_t used;
+    const uint8_t* src;
+
+    pkg_mapped = st;
+    src  = st->map + st->off;
+    left = (size_t)(st->end - st->off);
+    used = 0;
+
+    if(vec) {
+        used = pkgref(pkg, vec, src, left, n);
+        if((used < left && pkg->data.size < n / 2) || PKG_HDR_SIZE + pkg->data.size < PKG_MIN_FRAME) {
+            used = 0;
         }
     }
-    pkg->data.size = ++i;
+
+    if(!used) {
+        if(vec) {
+            vec->n = 0;
+        }
+        pkg->data.size = (uint16_t)stuff(pkg->data.content, n, src, left, &used);
+    }
+
+    if(st->gone) {
+        return 0;
+    }
+
+    st->off += (off_t)used;
+
+    return st->off < st->end ? 1 : -1;
 }
 
 /*
  *  pkgread() - 
  *
- *  Reads data from a file into the package, handling special byte values.
+ *  Reads data from a staging buffer into the package, handling special
+ *  byte values. Runs of bytes that need no escaping are copied in bulk.
+ *  The content of a mapped asset is only referenced, in 'vec', unless it
+ *  takes too many pieces to.
  *
  *  @pkg: Pointer to the Pkg structure where the data will be stored.
- *  @fp : Pointer to the FILE object from which data will be read.
+ *  @vec: Pointer to the PkgVec structure that will reference the content,
+ *        or 'NULL' to always copy it.
+ *  @st : Pointer to the PkgStage structure from which data will be read.
+ *  @n  : Number of content bytes the package may hold, as negotiated
+ *        for the context.
  *
  *  return:
  *    -  '1' if the data is successfully read and stored in the package.
  *    -  '0' if there is an error reading from the file.
  *    - '-1' if there was nothing left to read.
+ *    - 'PKG_AGAIN' if the next bytes are still being read ahead.
  */
-int pkgread(Pkg* pkg, FILE* fp) {
+int pkgread(Pkg* pkg, PkgVec* vec, PkgStage* st, size_t n) {
 
     int ret;
-    uint8_t byte;
+    size_t i;
+    size_t used;
 
     assert(pkg);
-    assert(fp);
+    assert(st);
+    assert(n <= sizeof pkg->data.content);
+
+    if(st->map) {
+        return pkgread_map(pkg, vec, st, n);
+    }
+
+    if(vec) {
+        vec->n = 0;
+    }
    
+    i = 0;
     ret = 1;
-    pkg->data.size = 0;
-    for(; pkg->data.size < sizeof pkg->data.content;) {
-        if(fread(&byte, sizeof byte, 1, fp) != 1) {
-            if(feof(fp)) {
-                ret = -1;
-                break;
-            }
+    for(; i < n;) {
+        ret = pkgstage_fill(st);
+        if(ret <= 0) {
+            break;
+        }
+
+        if(ret == PKG_AGAIN) {
+            ret = i ? 1 : PKG_AGAIN;
+            break;
+        }
+
+        i += stuff(
+            pkg->data.content + i,
+            n - i,
+            st->buf + st->pos,
+            st->len - st->pos,
+            &used
+        );
+
+        st->pos += used;
+        if(st->pos < st->len) {
+            break;
         }
-        add_byte_to_pkg(pkg, byte);
     }
 
+    pkg->data.size = (uint16_t)i;
+
     return ret;
 }
 
 /*
- *  ispkg() - 
+ *  pkgreread() -
  *
- *  Checks if a package contains a valid marker.
+ *  Builds the content of a package again from the file bytes a previous
+ *  'pkgread()' consumed, taking them from the mapping, from the staging
+ *  buffer while it still holds them and from the page cache otherwise.
+ *  The content of a mapped asset is referenced as 'pkgread()' does, and
+ *  dropped if the asset shrank. A file bypassing the page cache is read in
+ *  aligned blocks.
  *
- *  @pkg: Pointer to the Pkg structure to be checked.
+ *  @pkg: Pointer to the Pkg structure where the data will be stored.
+ *  @vec: Pointer to the PkgVec structure that will reference the content,
+ *        or 'NULL' to always copy it.
+ *  @st : Pointer to the PkgStage structure of the file.
+ *  @off: File offset of the first byte.
+ *  @len: Number of file bytes the package carries.
  *
  *  return:
- *    - '1' if the package contains a valid marker.
- *    - '0' if the package does not contain a valid marker.
+ *    - '1' if the data is successfully read and stored in the package.
+ *    - '0' if there is an error reading from the file.
  */
-static inline int ispkg(const Pkg* pkg) {
+int pkgreread(Pkg* pkg, PkgVec* vec, PkgStage* st, off_t off, size_t len) {
+
+    size_t i;
+    size_t used;
+    size_t want;
+    size_t span;
+    ssize_t n;
+    off_t start;
+    off_t base;
+    uint8_t* dst;
+    const uint8_t* src;
+    uint8_t buf[sizeof pkg->data.content];
 
     assert(pkg);
-    return pkg->data.marker == PKG_MARKER;
+    assert(st);
+    assert(len <= sizeof buf);
+
+    if(st->map) {
+        pkg_mapped = st;
+    }
+
+    if(vec) {
+        if(st->map && pkgref(pkg, vec, st->map + off, len, sizeof pkg->data.content) == len) {
+            if(st->gone) {
+                return 0;
+            }
+            if(PKG_HDR_SIZE + pkg->data.size >= PKG_MIN_FRAME) {
+                return 1;
+            }
+        }
+        vec->n = 0;
+    }
+
+    if(st->map) {
+        src = st->map + off;
+    } else {
+        start = st->off - (off_t)st->len;
+        if(off >= start && off + (off_t)len <= st->off) {
+            src = st->buf + (off - start);
+        } else {
+            base = off;
+            dst  = buf;
+            if(st->bounce) {
+                base = off & ~(off_t)(PKG_STAGE_ALIGN - 1);
+                dst  = st->bounce;
+            }
+
+            want = (size_t)(off - base) + len;
+            span = want;
+            if(st->bounce) {
+                span = (want + PKG_STAGE_ALIGN - 1) & ~(size_t)(PKG_STAGE_ALIGN - 1);
+            }
+
+            for(i = 0; i < want; i += (size_t)n) {
+                do {
+                    n = pread(st->fd, dst + i, span - i, base + (off_t)i);
+                } while(n < 0 && errno == EINTR);
+
+                if(n <= 0) {
+                    return 0;
+                }
+            }
+            src = dst + (off - base);
+        }
+    }
+
+    pkg->data.size = (uint16_t)stuff(pkg->data.content, sizeof pkg->data.content, src, len, &used);
+
+    return !st->gone;
 }
 
 /*
- *  timestamp() -
+ *  pkgcsum() -
+ *
+ *  Computes the checksum of a package, covering the header fields that
+ *  follow the marker and precede the checksum, and then the content.
  *
- *  Gets the current timestamp in milliseconds.
+ *  @pkg: Pointer to the Pkg structure.
+ *  @vec: Pointer to the PkgVec structure referencing the content, or
+ *        'NULL' if the package holds it.
  *
  *  return:
- *    - The current timestamp in milliseconds since the Epoch.
+ *    - The checksum of the package, with the algorithm named in its header.
  */
-static inline size_t timestamp(void) {
-    
-    struct timeval t;
+static inline uint32_t pkgcsum(const Pkg* pkg, const PkgVec* vec) {
+
+    size_t i;
+    uint32_t crc;
+
+    assert(pkg);
+
+    crc = csum(
+        pkg->data.check,
+        0,
+        &pkg->data.version,
+        offsetof(Pkg, data.csum) - offsetof(Pkg, data.version)
+    );
+
+    if(!vec || !vec->n) {
+        return csum(pkg->data.check, crc, pkg->data.content, pkg->data.size);
+    }
+
+    for(i = 1; i < vec->n; i++) {
+        crc = csum(pkg->data.check, crc, vec->iov[i].iov_base, vec->iov[i].iov_len);
+    }
 
-    gettimeofday(&t, NULL);
-    return t.tv_sec * 1000 + t.tv_usec / 1000;
+    return crc;
 }
 
 /*
- *  settimeout() -
+ *  ispkg() - 
  *
- *  Sets the receive timeout option for a socket.
+ *  Checks if a package contains a valid marker.
  *
- *  @sock   : The socket file descriptor on which to set the timeout.
- *  @timeout: The timeout value in milliseconds. If 'timeout' 
- *            is zero, the timeout will be disabled.
+ *  @pkg: Pointer to the Pkg structure to be checked.
+ *
+ *  return:
+ *    - '1' if the package contains a valid marker.
+ *    - '0' if the package does not contain a valid marker.
  */
-static inline void settimeout(int sock, size_t timeout) {
+static inline int ispkg(const Pkg* pkg) {
 
-    struct timeval tval;
+    assert(pkg);
+    return pkg->data.marker == PKG_MARKER && pkg->data.version == PKG_VERSION;
+}
 
-    memset(&tval, 0, sizeof tval);
-    if(timeout) {
-        tval.tv_sec  = timeout / 1000;
-        tval.tv_usec = (timeout % 1000) * 1000;
-    }
+/*
+ *  pkgtime() -
+ *
+ *  Gets the current time of a clock that never jumps, in microseconds.
+ *
+ *  return:
+ *    - The current time in microseconds since an unspecified point.
+ */
+size_t pkgtime(void) {
     
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tval, sizeof tval);
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000 + t.tv_nsec / 1000;
 }
 
 /*
  *  pkgrecv_timeout() -
  *
  *  Receives data into a package from a socket with a specified timeout.
+ *  The timeout is left set on the socket for the next call, so packages
+ *  that keep coming cost a single system call each. Once a frame that is
+ *  no package arrived, the socket only waits for the time left.
  *
  *  @pkg    : Pointer to the Pkg structure where the received data will be
  *            stored.
- *  @sock   : File descriptor of the socket from which data will be received.
- *  @timeout: Timeout value in milliseconds for receiving data.
+ *  @sock   : Pointer to the socket from which data will be received.
+ *  @timeout: Timeout value in microseconds for receiving data.
  *
  *  return:
  *    - '1' if the data is successfully received within the timeout period.
  *    - '0' if there is an error or if the timeout period expires before
  *      receiving the data.
  */
-static int pkgrecv_timeout(Pkg* pkg, int sock, size_t timeout) {
+static int pkgrecv_timeout(Pkg* pkg, Socket* sock, size_t timeout) {
 
-    int ret;
-    int end;
+    ssize_t n;
+    size_t left;
     size_t start;
+    size_t spent;
 
     assert(pkg);
 
-    ret = 0;
-    end = 0;
+    start = pkgtime();
+    left  = timeout;
+    for(;;) {
+        socket_timeout(sock, left);
+        errno = 0;
+        n = socket_recv(sock, pkg->raw, sizeof pkg->raw);
+        if(n > 0 && ispkg(pkg)) {
+            return 1;
+        }
 
-    start = timestamp();
-    settimeout(sock, timeout);
-    for(; !end ;) {
-        if(recv(sock, pkg->raw, sizeof pkg->raw, 0) > 0) {
-            if(ispkg(pkg)) {
-                ret = 1;
-                break;
-            }
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
         }
-        end = timestamp() - start > timeout;
-    }
-    settimeout(sock, 0);
 
-    if(end) {
-        debug("timeout...\n");
+        spent = pkgtime() - start;
+        if(spent >= timeout) {
+            break;
+        }
+        left = timeout - spent;
     }
 
-    return ret ? ispkg(pkg) : ret;
+    debug("timeout...\n");
+
+    return 0;
 }
 /*
  *  pkgrecv_notimeout() - 
  *
  *  Receives data into a package from a socket without using a timeout.
  *
- *  @pkg   : Pointer to the Pkg structure where the received data will be stored.
- *  @sockfd: File descriptor of the socket from which data will be received.
+ *  @pkg : Pointer to the Pkg structure where the received data will be stored.
+ *  @sock: Pointer to the socket from which data will be received.
  *
  *  return:
  *    - '1' if the data receive refers to a pkg.
  *    - '0' otherwise.
  */
-static int pkgrecv_notimeout(Pkg* pkg, int sockfd) {
+static int pkgrecv_notimeout(Pkg* pkg, Socket* sock) {
 
     assert(pkg);
-    recv(sockfd, pkg->raw, sizeof pkg->raw, 0);
+
+    socket_timeout(sock, 0);
+    if(socket_recv(sock, pkg->raw, sizeof pkg->raw) < 0) {
+        return 0;
+    }
 
     return ispkg(pkg);
 }
 
+/*
+ *  pkgrecv_ring() -
+ *
+ *  Walks the receive ring, or the AF_XDP socket, of a socket up to its
+ *  next package, which is left in place instead of being copied out.
+ *
+ *  @sock   : Pointer to a socket handing out its frames in place.
+ *  @timeout: Timeout value in microseconds for receiving data. If zero, no
+ *            timeout is used.
+ *
+ *  return:
+ *    - Pointer to the package inside the ring.
+ *    - 'NULL' if the timeout period expires before receiving a package.
+ */
+static Pkg* pkgrecv_ring(Socket* sock, size_t timeout) {
+
+    Pkg* pkg;
+    size_t len;
+    size_t wait;
+    size_t start;
+    size_t elapsed;
+
+    assert(sock);
+
+    wait  = timeout;
+    start = pkgtime();
+    for(;;) {
+        pkg = (Pkg*)socket_next(sock, &len, wait);
+        if(!pkg) {
+            break;
+        }
+
+        if(len >= PKG_HDR_SIZE && ispkg(pkg) && PKG_HDR_SIZE + (size_t)pkg->data.size <= len) {
+            return pkg;
+        }
+
+        if(timeout) {
+            elapsed = pkgtime() - start;
+            if(elapsed >= timeout) {
+                break;
+            }
+            wait = timeout - elapsed;
+        }
+    }
+
+    return NULL;
+}
+
 /*
  *  pkgrecv() -
  *
- *  Receives data into a package from a socket, with optional timeout.
+ *  Receives a package from a socket, with optional timeout. Sockets with a
+ *  receive ring, an AF_XDP socket and datagram sockets hand out the
+ *  package in place, which stays valid until the next call; any other
+ *  socket copies it into the given buffer.
  *
  *  @pkg    : Pointer to the Pkg structure where the received data will be
- *            stored.
- *  @sock   : File descriptor of the socket from which data will be received.
- *  @timeout: Timeout value in milliseconds for receiving data. If zero, no
+ *            stored if the socket does not hand it out in place.
+ *  @sock   : Pointer to the socket from which data will be received.
+ *  @timeout: Timeout value in microseconds for receiving data. If zero, no
  *            timeout is used.
  *
  *  return:
- *    - '1' if the data is successfully received.
- *    - '0' if there is an error receiving the data.
+ *    - Pointer to the received package.
+ *    - 'NULL' if there is an error receiving the data.
  */
-int pkgrecv(Pkg* pkg, int sock, size_t timeout) {
+Pkg* pkgrecv(Pkg* pkg, Socket* sock, size_t timeout) {
 
     assert(pkg);
+    assert(sock);
+
+    if(SocketInPlace(sock)) {
+        return pkgrecv_ring(sock, timeout);
+    }
+
     if(timeout) {
-        return pkgrecv_timeout(pkg, sock, timeout);
+        return pkgrecv_timeout(pkg, sock, timeout) ? pkg : NULL;
     }
 
-    return pkgrecv_notimeout(pkg, sock);
+    return pkgrecv_notimeout(pkg, sock) ? pkg : NULL;
 }
 
 /*
- *  pkgsend() - 
+ *  pkgqueue() -
  *
- *  Sends the raw data of the package over a socket.
+ *  Queues the raw data of the package for transmission over a socket. It
+ *  reaches the wire on the next 'pkgflush()', and unless the socket has a
+ *  transmit ring the package must stay untouched until then. A frame
+ *  shorter than 'PKG_MIN_FRAME' is padded with zeros first.
  *
  *  @pkg : Pointer to the Pkg structure containing the data to be sent.
- *  @sock: File descriptor of the socket over which data will be sent.
+ *  @sock: Pointer to the socket over which data will be sent.
  *
  *  return:
- *    - '1' if the data is successfully sent.
+ *    - '1' if the package was queued.
  *    - '0' if there is an error sending the data.
  */
-int pkgsend(const Pkg* pkg, int sockfd) {
+int pkgqueue(Pkg* pkg, Socket* sock) {
+
+    size_t n;
 
     assert(pkg);
+    assert(sock);
 
-    if(send(sockfd, pkg->raw, sizeof pkg->raw, 0) < 0) {
-        return 0;
+    n = PKG_HDR_SIZE + pkg->data.size;
+    if(n < PKG_MIN_FRAME) {
+        memset(pkg->raw + n, 0, PKG_MIN_FRAME - n);
+        n = PKG_MIN_FRAME;
     }
 
-    return 1;
+    return socket_queue(sock, pkg->raw, n);
+}
+
+/*
+ *  pkgqueuev() -
+ *
+ *  Queues a package whose content may be referenced by a PkgVec structure
+ *  rather than held by the package, like 'pkgqueue()'. The referenced
+ *  content must stay untouched too until the next 'pkgflush()'.
+ *
+ *  @pkg : Pointer to the Pkg structure holding the header of the package.
+ *  @vec : Pointer to the PkgVec structure referencing its content, or
+ *         'NULL' if the package holds it.
+ *  @sock: Pointer to the socket over which data will be sent.
+ *
+ *  return:
+ *    - '1' if the package was queued.
+ *    - '0' if there is an error sending the data.
+ */
+int pkgqueuev(Pkg* pkg, const PkgVec* vec, Socket* sock) {
+
+    assert(pkg);
+    assert(sock);
+
+    if(!vec || !vec->n) {
+        return pkgqueue(pkg, sock);
+    }
+
+    return socket_queuev(sock, vec->iov, vec->n);
+}
+
+/*
+ *  pkgflush() -
+ *
+ *  Sends every package queued on a socket at once.
+ *
+ *  @sock: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if every queued package was sent.
+ *    - '0' if there is an error sending the data.
+ */
+int pkgflush(Socket* sock) {
+
+    assert(sock);
+    return socket_flush(sock);
+}
+
+/*
+ *  pkgsend() - 
+ *
+ *  Sends the raw data of the package over a socket, along with any
+ *  package queued before it.
+ *
+ *  @pkg : Pointer to the Pkg structure containing the data to be sent.
+ *  @sock: Pointer to the socket over which data will be sent.
+ *
+ *  return:
+ *    - '1' if the data is successfully sent.
+ *    - '0' if there is an error sending the data.
+ */
+int pkgsend(Pkg* pkg, Socket* sock) {
+
+    return pkgqueue(pkg, sock) && pkgflush(sock);
 }
 
 /*
  *  pkgvalid() -
  *
- *  Validates the integrity of a package by calculating the CRC8 checksum
- *  and comparing it with the stored checksum in the package data.
+ *  Validates the integrity of a package by calculating its checksum, with
+ *  the algorithm named in its header, and comparing it with the stored
+ *  checksum in the package data.
  *
  *  @pkg: Pointer to the package structure to validate.
  *
@@ -251,12 +1041,16 @@ int pkgsend(const Pkg* pkg, int sockfd) {
  */
 int pkgvalid(const Pkg* pkg) {
 
-    uint8_t crc;
-
     assert(pkg);
-    crc8(pkg->raw + sizeof pkg->data.marker, 2 + pkg->data.size, &crc);
+    if(pkg->data.size > sizeof pkg->data.content) {
+        return 0;
+    }
+
+    if(!csum_known(pkg->data.check)) {
+        return 0;
+    }
 
-    return crc == pkg->data.crc8;
+    return pkgcsum(pkg, NULL) == pkg->data.csum;
 }
 
 /*
@@ -264,32 +1058,106 @@ int pkgvalid(const Pkg* pkg) {
  *
  *  Initializes a Pkg structure with provided values and data buffer.
  *
- *  @pkg : Pointer to the Pkg structure to be initialized.
- *  @size: Size of the data buffer.
- *  @indx: Index value to be set in the Pkg structure.
- *  @type: Type value to be set in the Pkg structure.
- *  @buf : Pointer to the data buffer to be copied into the 'Pkg' structure.
+ *  @pkg  : Pointer to the Pkg structure to be initialized.
+ *  @size : Size of the data buffer.
+ *  @indx : Index value to be set in the Pkg structure.
+ *  @type : Type value to be set in the Pkg structure.
+ *  @buf  : Pointer to the data buffer to be copied into the 'Pkg' structure.
+ *  @check: Checksum algorithm protecting the package.
+ *  @sess : Session the package belongs to.
  */
-void pkginit(Pkg* pkg, uint8_t size, uint8_t indx, int type, const uint8_t* buf) {
+void pkginit(Pkg* pkg, size_t size, size_t indx, int type, const uint8_t* buf, int check, uint32_t sess) {
 
-    size_t i;
+    size_t n;
+    size_t used;
 
     assert(pkg);
-    memset(pkg, 0, sizeof *pkg);
+    memset(pkg, 0, PKG_HDR_SIZE);
 
-    pkg->data.marker = PKG_MARKER;
-    pkg->data.size   = 0;
-    pkg->data.indx   = indx;
-    pkg->data.type   = type;
+    pkg->data.marker  = PKG_MARKER;
+    pkg->data.version = PKG_VERSION;
+    pkg->data.size    = 0;
+    pkg->data.indx    = indx;
+    pkg->data.sess    = sess;
+    pkg->data.type    = type;
     
     if(buf) {
-        for(i = 0; i < size; i++) {
-            add_byte_to_pkg(pkg, buf[i]);
-        }
-        pkg->data.size++;
+        n = stuff(pkg->data.content, sizeof pkg->data.content - 1, buf, size, &used);
+        pkg->data.content[n++] = 0;
+        pkg->data.size = (uint16_t)n;
+    }
+
+    pkgseal(pkg, check);
+}
+
+/*
+ *  pkgseal() -
+ *
+ *  Sets the checksum algorithm of a package and computes its checksum.
+ *  Must be called again whenever the header or the content changes.
+ *
+ *  @pkg  : Pointer to the Pkg structure to be sealed.
+ *  @check: Checksum algorithm protecting the package.
+ */
+void pkgseal(Pkg* pkg, int check) {
+
+    assert(pkg);
+
+    pkg->data.check = check;
+    pkg->data.csum  = pkgcsum(pkg, NULL);
+}
+
+/*
+ *  pkgsealv() -
+ *
+ *  Seals a package whose content may be referenced by a PkgVec structure
+ *  rather than held by the package, like 'pkgseal()'.
+ *
+ *  @pkg  : Pointer to the Pkg structure to be sealed.
+ *  @vec  : Pointer to the PkgVec structure referencing its content, or
+ *          'NULL' if the package holds it.
+ *  @check: Checksum algorithm protecting the package.
+ */
+void pkgsealv(Pkg* pkg, const PkgVec* vec, int check) {
+
+    assert(pkg);
+
+    pkg->data.check = check;
+    pkg->data.csum  = pkgcsum(pkg, vec);
+}
+
+/*
+ *  pkgparams() -
+ *
+ *  Extracts the handshake parameters carried at the start of a request or
+ *  of the 'PKG_ACK' answering it.
+ *
+ *  @pkg   : Pointer to the Pkg structure, with sentinel bytes removed.
+ *  @params: Pointer to the PkgParams structure that will hold them.
+ *
+ *  return:
+ *    - '1' if the package carries parameters for a known version.
+ *    - '0' otherwise.
+ */
+int pkgparams(const Pkg* pkg, PkgParams* params) {
+
+    assert(pkg);
+    assert(params);
+
+    if(pkg->data.size < sizeof *params) {
+        return 0;
+    }
+
+    memcpy(params, pkg->data.content, sizeof *params);
+    if(params->version != PKG_VERSION || params->mtu < PKG_MIN_MTU || !params->window) {
+        return 0;
     }
 
-    crc8(pkg->raw + sizeof pkg->data.marker, 2 + pkg->data.size, &pkg->data.crc8);
+    if(params->mtu > PKG_MAX_FRAME) {
+        params->mtu = PKG_MAX_FRAME;
+    }
+
+    return 1;
 }
 
 /*
@@ -303,34 +1171,8 @@ void pkginit(Pkg* pkg, uint8_t size, uint8_t indx, int type, const uint8_t* buf)
  */
 void pkg_rmv_sentinel_bytes(Pkg* pkg) {
 
-    int flag;
-    size_t i;
-    size_t n;
-    size_t s;
-    uint8_t byte;
-    uint8_t buf[64];
-    
     assert(pkg);
-
-    flag = 0;
-
-    s = 0;
-    n = pkg->data.size;
-    for(i = 0; i < n; i++) {
-        byte = pkg->data.content[i];
-        if(!flag) {
-            if(byte == 0x81 || byte == 0x88) {
-                flag = 1;
-            }
-            buf[s] = byte;
-            s++;
-        } else {
-            flag = 0;
-        }
-    }
-
-    pkg->data.size = (uint8_t)s;
-    memcpy(pkg->data.content, buf, pkg->data.size);
+    pkg->data.size = (uint16_t)unstuff(pkg->data.content, pkg->data.size);
 }
 
 #ifdef DEBUG
@@ -349,15 +1191,19 @@ void (pkgprint)(const Pkg* pkg) {
     assert(pkg);
     
     debug("%x ", pkg->data.marker);
+    debug("%x ", pkg->data.version);
+    debug("%x ", pkg->data.check);
     debug("%x ", pkg->data.size);
+    debug("%llx ", (unsigned long long)pkg->data.off);
     debug("%x ", pkg->data.indx);
+    debug("%x ", pkg->data.sess);
     debug("%x ", pkg->data.type);
 
     for(i = 0; i < pkg->data.size; i++) {
         debug("%x ", pkg->data.content[i]);
     }
 
-    debug("%x\n", pkg->data.crc8);
+    debug("%x\n", pkg->data.csum);
 }
 
 #endif  /* DEBUG */
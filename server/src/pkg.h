@@ -4,14 +4,19 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <signal.h>
+#include <sys/types.h>
 
 #include "pkg.defs.h"
 #include "utils.h"
-#include "crc8.h"
+#include "csum.h"
+#include "socket.h"
+#include "uring.h"
 
 enum PkgType {
     PKG_ACK         = 0x00, 
     PKG_NACK        = 0x01, 
+    PKG_SACK        = 0x02,
     PKG_LS          = 0x0A, 
     PKG_DOWNLOAD    = 0x0B,
     PKG_SHOW        = 0x10,
@@ -23,72 +28,320 @@ enum PkgType {
 
 typedef enum PkgType PkgType;
 
+/*
+ *  Version 5 frame. Only the header and the first 'size' content bytes
+ *  are put on the wire, so 'raw' is just large enough to hold the biggest
+ *  (jumbo) frame. 'check' names the algorithm of the checksum 'csum', which
+ *  covers the rest of the header and the content. 'sess' names the session
+ *  the frame belongs to: the client picks it for its request and every
+ *  frame of the context carries it, both ways. A 'PKG_DATA' frame holds in
+ *  'off' the file offset of the first byte its content decodes to, so that
+ *  it can be written wherever it lands; other frames leave it at zero.
+ */
 union Pkg {
 
-    uint8_t raw[68];
+    uint8_t raw[PKG_MAX_FRAME];
     struct {
         uint8_t  marker;
-        uint16_t size : 6;
-        uint16_t indx : 5;
-        uint16_t type : 5;
-        uint8_t  content[63];
-        uint8_t  crc8;
+        uint8_t  version;
+        uint8_t  type;
+        uint8_t  check;
+        uint16_t size;
+        uint16_t flags;
+        uint64_t off;
+        uint32_t indx;
+        uint32_t sess;
+        uint32_t csum;
+        uint8_t  content[PKG_MAX_FRAME - PKG_HDR_SIZE];
     } data;
 };
 
 typedef union Pkg Pkg;
 
+/*
+ *  Parameters carried by the 'PKG_LS'/'PKG_DOWNLOAD' request, where they
+ *  are followed by the asset name, and by the 'PKG_ACK' answering it,
+ *  where they hold the values agreed on for the rest of the context. The
+ *  request offers a mask of checksum algorithms, the answer picks one. The
+ *  request also offers the number of frames the client can hold out of
+ *  order, the answer the window, never larger, used for the transfer. A
+ *  'PKG_DOWNLOAD' asks for the bytes of the asset from the file offset
+ *  'start' up to 'end', or up to its end if 'end' is zero; the answer
+ *  holds the range served, 'end' clamped to the size of the asset.
+ */
+struct PkgParams {
+
+    uint8_t  version;
+    uint8_t  csum;
+    uint16_t mtu;
+    uint32_t window;
+    uint64_t start;
+    uint64_t end;
+};
+
+typedef struct PkgParams PkgParams;
+
+/*
+ *  A 'PKG_SACK' acknowledges data frames selectively. Its 'indx' holds the
+ *  next sequence number the receiver expects, every frame before it having
+ *  arrived. Its content starts with the receive window, a 32-bit number of
+ *  frames from 'indx' on the receiver accepts, followed by a bitmap of the
+ *  frames it already holds past 'indx': bit 'j % 8' of byte 'j / 8' stands
+ *  for frame 'indx + 1 + j'.
+ */
+
+/*
+ *  Chunk of an asset read ahead: 'want' bytes from the file offset 'off'
+ *  into 'buf', 'len' of which were read so far. 'busy' tells a read is in
+ *  flight; 'res' is the result of the last one.
+ */
+struct PkgAhead {
+
+    uint8_t* buf;
+    off_t    off;
+    size_t   len;
+    size_t   want;
+    int      res;
+    int      busy;
+};
+
+typedef struct PkgAhead PkgAhead;
+
+/*
+ *  Staging buffer of an open asset, serving its bytes from the file offset
+ *  'start' up to 'end'. 'pkgread()' consumes it from 'pos' and refills it
+ *  with large positional reads starting at the file offset 'off'. An
+ *  asset that could be mapped is read from the 'size' bytes at 'map'
+ *  instead, from 'off' on, and has no staging buffer. Packages reference
+ *  those bytes until they are sent, so the asset is assumed not to change
+ *  while served; one that shrinks under the mapping is 'gone' once a
+ *  page past its new end is touched.
+ *
+ *  An asset read ahead through the ring 'ur' has 'PKG_AHEAD_DEPTH' chunks
+ *  instead: 'buf' is the chunk 'head' once its bytes are in, consumed
+ *  while the following ones are read, and a chunk consumed is read again
+ *  from 'next' on. A file bypassing the page cache has a 'bounce' buffer.
+ */
+struct PkgStage {
+
+    int            fd;
+    uint8_t*       buf;
+    size_t         len;
+    size_t         pos;
+    off_t          off;
+    off_t          start;
+    off_t          end;
+    const uint8_t* map;
+    size_t         size;
+    volatile sig_atomic_t gone;
+    Uring*         ur;
+    uint8_t*       bounce;
+    off_t          next;
+    size_t         head;
+    PkgAhead       ahead[PKG_AHEAD_DEPTH];
+};
+
+typedef struct PkgStage PkgStage;
+
+/*
+ *  Package whose content is left in the pages of a mapped asset instead of
+ *  being copied into it. Its frame is gathered from the first 'n' pieces
+ *  of 'iov': the header of the package, then runs of file bytes, each but
+ *  the last ending with a sentinel, which a piece holding the escape byte
+ *  follows. A package holding its content has no pieces.
+ */
+struct PkgVec {
+
+    size_t       n;
+    struct iovec iov[SOCKET_IOV_MAX];
+};
+
+typedef struct PkgVec PkgVec;
+
+/*
+ *  pkgstage_init() -
+ *
+ *  Initializes a staging buffer reading a range of an open file: ahead of
+ *  the window through a ring if one is given, from a mapping of the file
+ *  if possible, and from an allocated buffer otherwise. A range ending
+ *  past the end of the file, or at offset zero, ends with the file.
+ *
+ *  @st    : Pointer to the PkgStage structure to be initialized.
+ *  @fd    : File descriptor the data will be read from.
+ *  @ur    : Pointer to the ring to read ahead through, or 'NULL'.
+ *  @direct: Whether reads ahead bypass the page cache.
+ *  @start : File offset of the first byte to read.
+ *  @end   : File offset to stop reading at.
+ *
+ *  return:
+ *    - '1' if the staging buffer is ready.
+ *    - '0' if the range starts past its end or on failure.
+ */
+extern int pkgstage_init(PkgStage* st, int fd, Uring* ur, int direct, off_t start, off_t end);
+
+/*
+ *  pkgstage_deinit() -
+ *
+ *  Releases the staging buffer, or the mapping, and closes the file it
+ *  reads from. Reads still in flight are waited for.
+ *
+ *  @st: Pointer to the PkgStage structure to be deinitialized.
+ */
+extern void pkgstage_deinit(PkgStage* st);
+
+/*
+ *  pkgstage_reap() -
+ *
+ *  Takes in the completed reads of a ring, for whichever staging buffers
+ *  they were made.
+ *
+ *  @ur: Pointer to the ring.
+ */
+extern void pkgstage_reap(Uring* ur);
+
 /*
  *  pkgread() - 
  *
- *  Reads data from a file into the package, handling special byte values.
+ *  Reads data from a staging buffer into the package, handling special
+ *  byte values. Runs of bytes that need no escaping are copied in bulk.
+ *  The content of a mapped asset is only referenced, in 'vec', unless it
+ *  takes too many pieces to.
  *
  *  @pkg: Pointer to the Pkg structure where the data will be stored.
- *  @fp : Pointer to the FILE object from which data will be read.
+ *  @vec: Pointer to the PkgVec structure that will reference the content,
+ *        or 'NULL' to always copy it.
+ *  @st : Pointer to the PkgStage structure from which data will be read.
+ *  @n  : Number of content bytes the package may hold, as negotiated
+ *        for the context.
  *
  *  return:
  *    -  '1' if the data is successfully read and stored in the package.
  *    -  '0' if there is an error reading from the file.
  *    - '-1' if there was nothing left to read.
+ *    - 'PKG_AGAIN' if the next bytes are still being read ahead.
  */
-extern int pkgread(Pkg* pkg, FILE* fp);
+extern int pkgread(Pkg* pkg, PkgVec* vec, PkgStage* st, size_t n);
+
+/*
+ *  pkgreread() -
+ *
+ *  Builds the content of a package again from the file bytes a previous
+ *  'pkgread()' consumed, taking them from the mapping, from the staging
+ *  buffer while it still holds them and from the page cache otherwise.
+ *  The content of a mapped asset is referenced as 'pkgread()' does.
+ *
+ *  @pkg: Pointer to the Pkg structure where the data will be stored.
+ *  @vec: Pointer to the PkgVec structure that will reference the content,
+ *        or 'NULL' to always copy it.
+ *  @st : Pointer to the PkgStage structure of the file.
+ *  @off: File offset of the first byte.
+ *  @len: Number of file bytes the package carries.
+ *
+ *  return:
+ *    - '1' if the data is successfully read and stored in the package.
+ *    - '0' if there is an error reading from the file.
+ */
+extern int pkgreread(Pkg* pkg, PkgVec* vec, PkgStage* st, off_t off, size_t len);
 
 /*
  *  pkgrecv() -
  *
- *  Receives data into a package from a socket, with optional timeout.
+ *  Receives a package from a socket, with optional timeout. Sockets with a
+ *  receive ring, an AF_XDP socket and datagram sockets hand out the
+ *  package in place, which stays valid until the next call; any other
+ *  socket copies it into the given buffer.
  *
  *  @pkg    : Pointer to the Pkg structure where the received data will be
- *            stored.
- *  @sock   : File descriptor of the socket from which data will be received.
- *  @timeout: Timeout value in milliseconds for receiving data. If zero, no
+ *            stored if the socket does not hand it out in place.
+ *  @sock   : Pointer to the socket from which data will be received.
+ *  @timeout: Timeout value in microseconds for receiving data. If zero, no
  *            timeout is used.
  *
  *  return:
- *    - '1' if the data is successfully received.
- *    - '0' if there is an error receiving the data.
+ *    - Pointer to the received package.
+ *    - 'NULL' if there is an error receiving the data.
+ */
+extern Pkg* pkgrecv(Pkg* pkg, Socket* sock, size_t timeout);
+
+/*
+ *  pkgqueue() -
+ *
+ *  Queues the raw data of the package for transmission over a socket. It
+ *  reaches the wire on the next 'pkgflush()', and unless the socket has a
+ *  transmit ring the package must stay untouched until then. A frame
+ *  shorter than 'PKG_MIN_FRAME' is padded with zeros first.
+ *
+ *  @pkg : Pointer to the Pkg structure containing the data to be sent.
+ *  @sock: Pointer to the socket over which data will be sent.
+ *
+ *  return:
+ *    - '1' if the package was queued.
+ *    - '0' if there is an error sending the data.
+ */
+extern int pkgqueue(Pkg* pkg, Socket* sock);
+
+/*
+ *  pkgqueuev() -
+ *
+ *  Queues a package whose content may be referenced by a PkgVec structure
+ *  rather than held by the package, like 'pkgqueue()'. The referenced
+ *  content must stay untouched too until the next 'pkgflush()'.
+ *
+ *  @pkg : Pointer to the Pkg structure holding the header of the package.
+ *  @vec : Pointer to the PkgVec structure referencing its content, or
+ *         'NULL' if the package holds it.
+ *  @sock: Pointer to the socket over which data will be sent.
+ *
+ *  return:
+ *    - '1' if the package was queued.
+ *    - '0' if there is an error sending the data.
  */
-extern int pkgrecv(Pkg* pkg, int sock, size_t timeout);
+extern int pkgqueuev(Pkg* pkg, const PkgVec* vec, Socket* sock);
+
+/*
+ *  pkgflush() -
+ *
+ *  Sends every package queued on a socket at once.
+ *
+ *  @sock: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if every queued package was sent.
+ *    - '0' if there is an error sending the data.
+ */
+extern int pkgflush(Socket* sock);
 
 /*
  *  pkgsend() - 
  *
- *  Sends the raw data of the package over a socket.
+ *  Sends the raw data of the package over a socket, along with any
+ *  package queued before it.
  *
  *  @pkg : Pointer to the Pkg structure containing the data to be sent.
- *  @sock: File descriptor of the socket over which data will be sent.
+ *  @sock: Pointer to the socket over which data will be sent.
  *
  *  return:
  *    - '1' if the data is successfully sent.
  *    - '0' if there is an error sending the data.
  */
-extern int pkgsend(const Pkg* pkg, int sock);
+extern int pkgsend(Pkg* pkg, Socket* sock);
+
+/*
+ *  pkgtime() -
+ *
+ *  Gets the current time of a clock that never jumps, in microseconds.
+ *
+ *  return:
+ *    - The current time in microseconds since an unspecified point.
+ */
+extern size_t pkgtime(void);
 
 /*
  *  pkgvalid() -
  *
- *  Validates the integrity of a package by calculating the CRC8 checksum
- *  and comparing it with the stored checksum in the package data.
+ *  Validates the integrity of a package by calculating its checksum, with
+ *  the algorithm named in its header, and comparing it with the stored
+ *  checksum in the package data.
  *
  *  @pkg: Pointer to the package structure to validate.
  *
@@ -106,10 +359,51 @@ extern int pkgvalid(const Pkg* pkg);
  *  @pkg : Pointer to the Pkg structure to be initialized.
  *  @size: Size of the data buffer.
  *  @indx: Index value to be set in the Pkg structure.
- *  @type: Type value to be set in the Pkg structure.
- *  @buf : Pointer to the data buffer to be copied into the 'Pkg' structure.
+ *  @type : Type value to be set in the Pkg structure.
+ *  @buf  : Pointer to the data buffer to be copied into the 'Pkg' structure.
+ *  @check: Checksum algorithm protecting the package.
+ *  @sess : Session the package belongs to.
+ */
+extern void pkginit(Pkg* pkg, size_t size, size_t indx, int type, const uint8_t* buf, int check, uint32_t sess);
+
+/*
+ *  pkgseal() -
+ *
+ *  Sets the checksum algorithm of a package and computes its checksum.
+ *  Must be called again whenever the header or the content changes.
+ *
+ *  @pkg  : Pointer to the Pkg structure to be sealed.
+ *  @check: Checksum algorithm protecting the package.
+ */
+extern void pkgseal(Pkg* pkg, int check);
+
+/*
+ *  pkgsealv() -
+ *
+ *  Seals a package whose content may be referenced by a PkgVec structure
+ *  rather than held by the package, like 'pkgseal()'.
+ *
+ *  @pkg  : Pointer to the Pkg structure to be sealed.
+ *  @vec  : Pointer to the PkgVec structure referencing its content, or
+ *          'NULL' if the package holds it.
+ *  @check: Checksum algorithm protecting the package.
+ */
+extern void pkgsealv(Pkg* pkg, const PkgVec* vec, int check);
+
+/*
+ *  pkgparams() -
+ *
+ *  Extracts the handshake parameters carried at the start of a request or
+ *  of the 'PKG_ACK' answering it.
+ *
+ *  @pkg   : Pointer to the Pkg structure, with sentinel bytes removed.
+ *  @params: Pointer to the PkgParams structure that will hold them.
+ *
+ *  return:
+ *    - '1' if the package carries parameters for a known version.
+ *    - '0' otherwise.
  */
-extern void pkginit(Pkg* pkg, uint8_t size, uint8_t indx, int type, const uint8_t* buf);
+extern int pkgparams(const Pkg* pkg, PkgParams* params);
 
 /*
  *  pkg_rmv_sentinel_bytes() -
@@ -1,26 +1,38 @@
+#define _GNU_SOURCE
 
 #include <linux/if_packet.h>
+#include <linux/filter.h>
 #include <net/ethernet.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <arpa/inet.h>
 #include <net/if.h>
 #include <assert.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
 
 #include "socket.h"
+#include "pkg.h"
 
 /*
  *  sockaddr_ll_init() - 
  *
  *  Initializes a sockaddr_ll structure.
  *
- *  @addr   : Pointer to the sockaddr_ll structure to initialize.
- *  @ifindex: Interface index.
+ *  @addr     : Pointer to the sockaddr_ll structure to initialize.
+ *  @ifindex  : Interface index.
+ *  @ethertype: EtherType of the frames to receive.
  */
-static inline void sockaddr_ll_init(struct sockaddr_ll* addr, int ifindex) {
+static inline void sockaddr_ll_init(struct sockaddr_ll* addr, int ifindex, int ethertype) {
 
     addr->sll_family = AF_PACKET;
-    addr->sll_protocol = htons(ETH_P_ALL);
+    addr->sll_protocol = htons(ethertype);
     addr->sll_ifindex = ifindex;
 }
 
@@ -39,60 +51,1255 @@ static inline void packet_mreq_init(struct packet_mreq* mreq, int ifindex) {
 }
 
 /*
- *  socket_create() - 
+ *  socket_filter() -
+ *
+ *  Attaches a classic BPF program to the socket so the kernel drops every
+ *  frame that does not carry the protocol EtherType followed by a package
+ *  header of the current version and a known type, before it wakes the
+ *  process up. With a session given, frames of other sessions are
+ *  dropped too. Words are loaded in network byte order, so the session
+ *  is compared in that order.
+ *
+ *  @sock     : Pointer to the socket.
+ *  @ethertype: EtherType of the protocol frames.
+ *  @sess     : Pointer to the session to keep the frames of, or 'NULL'.
+ *
+ *  return:
+ *    - '1' if the filter was attached.
+ *    - '0' on failure.
+ */
+static int socket_filter(Socket* sock, int ethertype, const uint32_t* sess) {
+
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, offsetof(struct ether_header, ether_type)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   ethertype, 0, 9),
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, ETHER_HDR_LEN + offsetof(Pkg, data.marker)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   PKG_MARKER, 0, 7),
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, ETHER_HDR_LEN + offsetof(Pkg, data.version)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   PKG_VERSION, 0, 5),
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, ETHER_HDR_LEN + offsetof(Pkg, data.type)),
+        BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K,   PKG_TYPE_MAX, 3, 0),
+        BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, ETHER_HDR_LEN + offsetof(Pkg, data.sess)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   sess ? htonl(*sess) : 0, 0, sess ? 1 : 0),
+        BPF_STMT(BPF_RET | BPF_K,             UINT32_MAX),
+        BPF_STMT(BPF_RET | BPF_K,             0)
+    };
+    struct sock_fprog prog;
+
+    memset(&prog, 0, sizeof prog);
+    prog.len    = sizeof code / sizeof code[0];
+    prog.filter = code;
+
+    return setsockopt(sock->fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof prog) == 0;
+}
+
+/*
+ *  socket_hwaddr() -
+ *
+ *  Retrieves the hardware address of the network interface.
+ *
+ *  @sock     : Pointer to the socket.
+ *  @interface: Name of the network interface.
  *
- *  Creates a raw socket and sets it to promiscuous mode.
+ *  return:
+ *    - '1' if the address was stored in 'sock->mac'.
+ *    - '0' on failure.
+ */
+static int socket_hwaddr(Socket* sock, const char* interface) {
+
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof ifr);
+    strncpy(ifr.ifr_name, interface, sizeof ifr.ifr_name - 1);
+    if(ioctl(sock->fd, SIOCGIFHWADDR, &ifr) < 0) {
+        return 0;
+    }
+
+    memcpy(sock->mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+
+    return 1;
+}
+
+/*
+ *  raw_open() -
+ *
+ *  Sets up a raw socket that only receives package frames, optionally in
+ *  promiscuous mode. The filter is attached before the socket is bound,
+ *  so not a single unrelated frame is queued on it.
  *
+ *  @sock     : Pointer to the socket.
  *  @interface: Name of the network interface.
+ *  @ethertype: EtherType of the frames sent and received.
+ *  @promisc  : Whether to set the interface to promiscuous mode.
  *
  *  return:
- *    - File descriptor of the created socket on success.
- *    - '-1' on failure.
+ *    - '1' if the socket was set up.
+ *    - '0' on failure.
  */
-int socket_create(const char* interface) {
+static int raw_open(Socket* sock, const char* interface, int ethertype, int promisc) {
 
-    int sockfd;
     int ifindex;
     struct sockaddr_ll addr;
     struct packet_mreq mreq;
 
-    assert(interface);
-
     memset(&addr, 0, sizeof addr);
     memset(&mreq, 0, sizeof mreq);
 
-    ifindex = if_nametoindex(interface); 
-    sockfd  = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
-    if(sockfd < 0) {
-        return -1;
+    ifindex  = if_nametoindex(interface); 
+    sock->fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if(sock->fd < 0) {
+        return 0;
     }
 
-    sockaddr_ll_init(&addr, ifindex);
+    sock->ethertype = ethertype;
+    memset(sock->bcast, 0xff, ETH_ALEN);
+
+    if(!socket_hwaddr(sock, interface) || !socket_filter(sock, ethertype, NULL)) {
+        return 0;
+    }
+
+    sockaddr_ll_init(&addr, ifindex, ethertype);
     packet_mreq_init(&mreq, ifindex);
 
-    if(bind(sockfd, (struct sockaddr*)&addr, sizeof addr) < 0) {
-        close(sockfd);
-        return -1;
+    if(bind(sock->fd, (struct sockaddr*)&addr, sizeof addr) < 0) {
+        return 0;
+    }
+
+    if(promisc && setsockopt(sock->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof mreq) < 0) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ *  socket_create() - 
+ *
+ *  Creates a socket on the transport named at the start of 'where', up to
+ *  a colon, and on a raw socket bound to the network interface 'where'
+ *  when no known transport is named. A raw socket only receives package
+ *  frames, optionally in promiscuous mode: the filter is attached before
+ *  the socket is bound, so not a single unrelated frame is queued on it.
+ *  'udp:<port>' listens for datagrams on a UDP port, 'udp:<host>:<port>'
+ *  sends to a UDP port of a host, from any port.
+ *
+ *  @where    : Transport and address, or name of the network interface.
+ *  @ethertype: EtherType of the frames sent and received.
+ *  @promisc  : Whether to set the interface to promiscuous mode.
+ *
+ *  return:
+ *    - Pointer to the created socket on success.
+ *    - 'NULL' on failure.
+ */
+Socket* socket_create(const char* where, int ethertype, int promisc) {
+
+    size_t i;
+    size_t n;
+    Socket* sock;
+    const SocketOps* ops;
+    static const SocketOps* const transports[] = {
+        &socket_udp
+    };
+
+    assert(where);
+
+    ops = &socket_raw;
+    for(i = 0; i < sizeof transports / sizeof transports[0]; i++) {
+        n = strlen(transports[i]->name);
+        if(!strncmp(where, transports[i]->name, n) && where[n] == ':') {
+            ops    = transports[i];
+            where += n + 1;
+            break;
+        }
+    }
+
+    sock = calloc(1, sizeof *sock);
+    if(!sock) {
+        return NULL;
+    }
+
+    sock->ops = ops;
+    sock->fd  = -1;
+    if(!ops->open(sock, where, ethertype, promisc)) {
+        socket_close(sock);
+        return NULL;
+    }
+
+    socket_peer(sock, NULL);
+
+    return sock;
+}
+
+/*
+ *  socket_peer() -
+ *
+ *  Sets the host every later frame is sent to and the only one frames are
+ *  accepted from.
+ *
+ *  @sock: Pointer to the socket.
+ *  @addr: Address of the peer, or 'NULL' to go back to the default
+ *         address and accepting frames from any host.
+ */
+void socket_peer(Socket* sock, const uint8_t* addr) {
+
+    assert(sock);
+
+    sock->connected = addr != NULL;
+    memmove(sock->peer, addr ? addr : sock->bcast, SOCKET_ADDR_LEN);
+}
+
+/*
+ *  socket_to() -
+ *
+ *  Sets the host every later frame is sent to, still accepting frames
+ *  from any host, so a socket can serve several peers in turn.
+ *
+ *  @sock: Pointer to the socket.
+ *  @addr: Address of the destination.
+ */
+void socket_to(Socket* sock, const uint8_t* addr) {
+
+    assert(sock);
+    assert(addr);
+
+    memmove(sock->peer, addr, SOCKET_ADDR_LEN);
+}
+
+/*
+ *  socket_nonblock() -
+ *
+ *  Switches the socket to non-blocking mode: receiving without a timeout
+ *  returns right away when no frame is pending, so the socket can be
+ *  watched by an event loop.
+ *
+ *  @sock: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if the socket no longer blocks.
+ *    - '0' on failure.
+ */
+int socket_nonblock(Socket* sock) {
+
+    int flags;
+
+    assert(sock);
+
+    flags = fcntl(sock->fd, F_GETFL);
+    if(flags < 0 || fcntl(sock->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return 0;
     }
 
-    if(setsockopt(sockfd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof mreq) < 0) {
-        close(sockfd);
+    sock->nonblock = 1;
+
+    return 1;
+}
+
+/*
+ *  socket_fanout() -
+ *
+ *  Joins the socket to a fanout group, among whose sockets the kernel
+ *  spreads the frames received on the interface. The kernel hash mode
+ *  only dissects IP flows and would hand every frame of this protocol to
+ *  the same socket, so a classic BPF program hashes the client address
+ *  and the session of each frame instead: all the frames of a session
+ *  go to the same socket. The frames a socket of the group sends would
+ *  reach the others, so sockets of the group ignore outgoing frames.
+ *  UDP sockets listening on the same port make up a group of their own,
+ *  the kernel spreading datagrams among them by the address they come
+ *  from. Sockets of other transports cannot join a group.
+ *
+ *  @sock : Pointer to the socket.
+ *  @group: Identifier of the fanout group, shared by its sockets.
+ *
+ *  return:
+ *    - '1' if the socket joined the group.
+ *    - '0' on failure.
+ */
+int socket_fanout(Socket* sock, int group) {
+
+    int arg;
+    int one;
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, (uint32_t)(SKF_LL_OFF + (int)offsetof(struct ether_header, ether_shost) + 2)),
+        BPF_STMT(BPF_MISC | BPF_TAX,          0),
+        BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, (uint32_t)(SKF_LL_OFF + ETHER_HDR_LEN + (int)offsetof(Pkg, data.sess))),
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X,   0),
+        BPF_STMT(BPF_ALU | BPF_MUL | BPF_K,   SOCKET_FANOUT_MIX),
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K,   16),
+        BPF_STMT(BPF_RET | BPF_A,             0)
+    };
+    struct sock_fprog prog;
+
+    assert(sock);
+
+    /*
+     *  Listening UDP sockets share their port, among whose sockets the
+     *  kernel already spreads datagrams by the address they come from.
+     */
+    if(sock->ops == &socket_udp) {
+        return 1;
+    }
+
+    if(sock->ops != &socket_raw) {
+        errno = EOPNOTSUPP;
+        return 0;
+    }
+
+    memset(&prog, 0, sizeof prog);
+    prog.len    = sizeof code / sizeof code[0];
+    prog.filter = code;
+
+    one = 1;
+    arg = (group & 0xffff) | (PACKET_FANOUT_CBPF << 16);
+
+    return !setsockopt(sock->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof one)
+        && !setsockopt(sock->fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof arg)
+        && !setsockopt(sock->fd, SOL_PACKET, PACKET_FANOUT_DATA, &prog, sizeof prog);
+}
+
+/*
+ *  socket_session() -
+ *
+ *  Narrows the frames a raw socket receives down to those of a session,
+ *  so that sockets of the same host on the same interface, each running
+ *  a session of its own, do not all wake up for every frame. Sockets of
+ *  other transports, and raw ones whose frames go through an AF_XDP
+ *  socket, are left as they are.
+ *
+ *  @sock: Pointer to the socket.
+ *  @sess: Session to keep the frames of.
+ *
+ *  return:
+ *    - '1' if the socket only receives frames of the session, or if it
+ *      is left as it is.
+ *    - '0' on failure.
+ */
+int socket_session(Socket* sock, uint32_t sess) {
+
+    assert(sock);
+
+    if(sock->ops != &socket_raw || sock->xsk) {
+        return 1;
+    }
+
+    return socket_filter(sock, sock->ethertype, &sess);
+}
+
+/*
+ *  socket_accept() -
+ *
+ *  Tells whether the frame last received, whose source address is in
+ *  'sock->from', comes from the peer.
+ *
+ *  @sock: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if the frame is to be handed out.
+ *    - '0' if it comes from a host other than the peer.
+ */
+int socket_accept(const Socket* sock) {
+
+    return !sock->connected || !memcmp(sock->from, sock->peer, SOCKET_ADDR_LEN);
+}
+
+/*
+ *  raw_accept() -
+ *
+ *  Records the source address of a frame received on a raw socket and
+ *  tells whether the frame comes from the peer.
+ *
+ *  @sock: Pointer to the socket.
+ *  @eth : Pointer to the Ethernet header of the frame.
+ *
+ *  return:
+ *    - '1' if the frame is to be handed out.
+ *    - '0' if it comes from a host other than the peer.
+ */
+static inline int raw_accept(Socket* sock, const struct ether_header* eth) {
+
+    memcpy(sock->from, eth->ether_shost, ETH_ALEN);
+    return socket_accept(sock);
+}
+
+/*
+ *  raw_recv() -
+ *
+ *  Receives a frame through a plain 'recv()' call, keeping its Ethernet
+ *  header apart from the payload.
+ *
+ *  @sock: Pointer to the socket.
+ *  @buf : Pointer to the buffer the payload will be stored in.
+ *  @n   : Size of the buffer.
+ *
+ *  return:
+ *    - Length of the payload.
+ *    - '-1' on error, timeout, or if the frame came from a host other
+ *      than the peer.
+ */
+static ssize_t raw_recv(Socket* sock, uint8_t* buf, size_t n) {
+
+    ssize_t len;
+    struct msghdr msg;
+    struct iovec iov[2];
+    struct ether_header eth;
+
+    iov[0].iov_base = &eth;
+    iov[0].iov_len  = sizeof eth;
+    iov[1].iov_base = buf;
+    iov[1].iov_len  = n;
+
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 2;
+
+    len = recvmsg(sock->fd, &msg, 0);
+    if(len < (ssize_t)sizeof eth || !raw_accept(sock, &eth)) {
         return -1;
     }
 
-    return sockfd;
+    return len - (ssize_t)sizeof eth;
+}
+
+/*
+ *  socket_recv() -
+ *
+ *  Receives a frame through a plain 'recv()' call, keeping its Ethernet
+ *  header apart from the payload. Only raw sockets without a receive ring
+ *  receive this way, see 'SocketInPlace()'.
+ *
+ *  @sock: Pointer to the socket.
+ *  @buf : Pointer to the buffer the payload will be stored in.
+ *  @n   : Size of the buffer.
+ *
+ *  return:
+ *    - Length of the payload.
+ *    - '-1' on error, timeout, or if the frame came from a host other
+ *      than the peer.
+ */
+ssize_t socket_recv(Socket* sock, uint8_t* buf, size_t n) {
+
+    assert(sock);
+    assert(sock->ops->recv);
+    assert(buf);
+
+    return sock->ops->recv(sock, buf, n);
+}
+
+/*
+ *  socket_timeout() -
+ *
+ *  Sets how long a plain receive call waits for a frame. The option is
+ *  only changed when the timeout does, so receiving with the same one
+ *  frame after frame costs no extra system call.
+ *
+ *  @sock   : Pointer to the socket.
+ *  @timeout: Timeout value in microseconds. If zero, no timeout is used.
+ */
+void socket_timeout(Socket* sock, size_t timeout) {
+
+    struct timeval tval;
+
+    assert(sock);
+
+    if(timeout == sock->rcvtimeo) {
+        return;
+    }
+
+    memset(&tval, 0, sizeof tval);
+    tval.tv_sec  = timeout / 1000000;
+    tval.tv_usec = timeout % 1000000;
+    if(!setsockopt(sock->fd, SOL_SOCKET, SO_RCVTIMEO, &tval, sizeof tval)) {
+        sock->rcvtimeo = timeout;
+    }
+}
+
+/*
+ *  tpacket_req3_rx_init() -
+ *
+ *  Initializes a tpacket_req3 structure describing the receive ring.
+ *
+ *  @req: Pointer to the tpacket_req3 structure to initialize.
+ */
+static inline void tpacket_req3_rx_init(struct tpacket_req3* req) {
+
+    req->tp_block_size     = SOCKET_RING_BLOCK_SIZE;
+    req->tp_block_nr       = SOCKET_RING_BLOCKS;
+    req->tp_frame_size     = SOCKET_RING_FRAME_SIZE;
+    req->tp_frame_nr       = SOCKET_RING_BLOCKS * (SOCKET_RING_BLOCK_SIZE / SOCKET_RING_FRAME_SIZE);
+    req->tp_retire_blk_tov = SOCKET_RING_TIMEOUT;
+}
+
+/*
+ *  tpacket_req3_tx_init() -
+ *
+ *  Initializes a tpacket_req3 structure describing the transmit ring.
+ *
+ *  @req: Pointer to the tpacket_req3 structure to initialize.
+ */
+static inline void tpacket_req3_tx_init(struct tpacket_req3* req) {
+
+    req->tp_block_size = SOCKET_TX_BLOCK_SIZE;
+    req->tp_block_nr   = SOCKET_TX_BLOCKS;
+    req->tp_frame_size = SOCKET_TX_FRAME_SIZE;
+    req->tp_frame_nr   = SOCKET_TX_BLOCKS * (SOCKET_TX_BLOCK_SIZE / SOCKET_TX_FRAME_SIZE);
+}
+
+/*
+ *  ring_setup() -
+ *
+ *  Asks the kernel for one of the rings of the socket, or for none.
+ *
+ *  @sock: Pointer to the socket.
+ *  @opt : 'PACKET_RX_RING' or 'PACKET_TX_RING'.
+ *  @req : Pointer to the ring description, or 'NULL' to drop the ring.
+ *
+ *  return:
+ *    - '1' on success.
+ *    - '0' on failure.
+ */
+static int ring_setup(Socket* sock, int opt, const struct tpacket_req3* req) {
+
+    struct tpacket_req3 none;
+
+    if(!req) {
+        memset(&none, 0, sizeof none);
+        req = &none;
+    }
+
+    return setsockopt(sock->fd, SOL_PACKET, opt, req, sizeof *req) == 0;
+}
+
+/*
+ *  socket_xdp() -
+ *
+ *  Moves the traffic of the socket to an AF_XDP socket on the first queue
+ *  of the interface it is bound to. The raw socket stays open for its
+ *  ioctls but drops every frame from then on.
+ *
+ *  @sock: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if the AF_XDP socket was set up.
+ *    - '0' on failure.
+ */
+static int socket_xdp(Socket* sock) {
+
+    socklen_t len;
+    struct sockaddr_ll addr;
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_RET | BPF_K, 0)
+    };
+    struct sock_fprog prog;
+
+    len = sizeof addr;
+    if(getsockname(sock->fd, (struct sockaddr*)&addr, &len) < 0) {
+        return 0;
+    }
+
+    sock->xsk = xsk_open(addr.sll_ifindex, XSK_QUEUE, sock->ethertype);
+    if(!sock->xsk) {
+        return 0;
+    }
+
+    memset(&prog, 0, sizeof prog);
+    prog.len    = sizeof code / sizeof code[0];
+    prog.filter = code;
+    setsockopt(sock->fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof prog);
+
+    return 1;
+}
+
+/*
+ *  socket_ring() -
+ *
+ *  Maps rings shared with the kernel into memory. A receive ring switches
+ *  the socket to TPACKET_V3 block-based delivery, a transmit ring lets
+ *  queued frames be sent with a single kick. 'SOCKET_XDP' moves both ways
+ *  to the rings of an AF_XDP socket on the first queue of the interface
+ *  instead, whose frames bypass the kernel stack. Only raw sockets have
+ *  rings.
+ *
+ *  @sock : Pointer to the socket.
+ *  @rings: Rings to set up, a mask of 'SOCKET_RX_RING' and 'SOCKET_TX_RING',
+ *          or 'SOCKET_XDP'.
+ *
+ *  return:
+ *    - '1' if the rings were set up.
+ *    - '0' on failure, in which case the socket keeps receiving through
+ *      plain 'recv()' calls and sending through 'sendmmsg()'.
+ */
+int socket_ring(Socket* sock, int rings) {
+
+    int version;
+    size_t rxsize;
+    size_t txsize;
+    uint8_t* map;
+    struct tpacket_req3 rx;
+    struct tpacket_req3 tx;
+
+    assert(sock);
+    assert(!sock->map);
+
+    if(sock->ops != &socket_raw) {
+        errno = EOPNOTSUPP;
+        return 0;
+    }
+
+    if(rings & SOCKET_XDP) {
+        return socket_xdp(sock);
+    }
+
+    version = TPACKET_V3;
+    if(setsockopt(sock->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof version) < 0) {
+        return 0;
+    }
+
+    memset(&rx, 0, sizeof rx);
+    memset(&tx, 0, sizeof tx);
+
+    rxsize = 0;
+    if(rings & SOCKET_RX_RING) {
+        tpacket_req3_rx_init(&rx);
+        if(!ring_setup(sock, PACKET_RX_RING, &rx)) {
+            return 0;
+        }
+        rxsize = (size_t)rx.tp_block_size * rx.tp_block_nr;
+    }
+
+    txsize = 0;
+    if(rings & SOCKET_TX_RING) {
+        tpacket_req3_tx_init(&tx);
+        if(!ring_setup(sock, PACKET_TX_RING, &tx)) {
+            ring_setup(sock, PACKET_RX_RING, NULL);
+            return 0;
+        }
+        txsize = (size_t)tx.tp_block_size * tx.tp_block_nr;
+    }
+
+    if(!rxsize && !txsize) {
+        return 1;
+    }
+
+    /*
+     *  Both rings share a single mapping, the receive ring first.
+     */
+    map = mmap(NULL, rxsize + txsize, PROT_READ | PROT_WRITE, MAP_SHARED, sock->fd, 0);
+    if(map == MAP_FAILED) {
+        ring_setup(sock, PACKET_RX_RING, NULL);
+        ring_setup(sock, PACKET_TX_RING, NULL);
+        return 0;
+    }
+
+    sock->map  = map;
+    sock->size = rxsize + txsize;
+    if(rxsize) {
+        sock->rx.map  = map;
+        sock->rx.nblk = rx.tp_block_nr;
+    }
+
+    if(txsize) {
+        sock->tx.map    = map + rxsize;
+        sock->tx.nframe = tx.tp_frame_nr;
+    }
+
+    return 1;
+}
+
+/*
+ *  ring_block() -
+ *
+ *  Gets the descriptor of a block of the receive ring.
+ *
+ *  @sock: Pointer to the socket.
+ *  @blk : Number of the block.
+ *
+ *  return:
+ *    - Pointer to the block descriptor.
+ */
+static inline struct tpacket_block_desc* ring_block(const Socket* sock, size_t blk) {
+
+    return (struct tpacket_block_desc*)(sock->rx.map + blk * SOCKET_RING_BLOCK_SIZE);
+}
+
+/*
+ *  ring_wait() -
+ *
+ *  Waits for the kernel to hand the current block of the receive ring
+ *  over to user space. A non-blocking socket does not wait unless given a
+ *  timeout.
+ *
+ *  @sock   : Pointer to the socket.
+ *  @timeout: Timeout value in microseconds. If zero, no timeout is used.
+ *
+ *  return:
+ *    - '1' if the current block is ready to be walked.
+ *    - '0' if the timeout expired or on error.
+ */
+static int ring_wait(Socket* sock, size_t timeout) {
+
+    struct tpacket_block_desc* bd;
+    struct pollfd pfd;
+    struct timespec ts;
+    struct timespec* tsp;
+
+    ts.tv_sec  = timeout / 1000000;
+    ts.tv_nsec = (timeout % 1000000) * 1000;
+    tsp = timeout || sock->nonblock ? &ts : NULL;
+
+    bd = ring_block(sock, sock->rx.blk);
+    while(!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+
+        memset(&pfd, 0, sizeof pfd);
+        pfd.fd     = sock->fd;
+        pfd.events = POLLIN | POLLERR;
+        if(ppoll(&pfd, 1, tsp, NULL) <= 0) {
+            return __atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER;
+        }
+    }
+
+    sock->rx.left  = bd->hdr.bh1.num_pkts;
+    sock->rx.frame = (uint8_t*)bd + bd->hdr.bh1.offset_to_first_pkt;
+
+    return 1;
+}
+
+/*
+ *  raw_next() -
+ *
+ *  Walks the receive ring, or the AF_XDP socket, to its next frame,
+ *  waiting for the kernel to hand over a block if none is ready. A block
+ *  is given back to the kernel as soon as the walk moves past its last
+ *  frame, so the returned frame stays valid until the next call. Frames
+ *  from hosts other than the peer are skipped.
+ *
+ *  @sock   : Pointer to a socket with a receive ring or an AF_XDP socket.
+ *  @len    : Pointer to store the length of the payload.
+ *  @timeout: Timeout value in microseconds. If zero, no timeout is used.
+ *
+ *  return:
+ *    - Pointer to the payload of the frame, past its Ethernet header.
+ *    - 'NULL' if the timeout expired or on error.
+ */
+static uint8_t* raw_next(Socket* sock, size_t* len, size_t timeout) {
+
+    uint8_t* frame;
+    struct tpacket3_hdr* hdr;
+    struct tpacket_block_desc* bd;
+
+    assert(sock->rx.map || sock->xsk);
+
+    if(sock->xsk) {
+        while((frame = xsk_next(sock->xsk, len, timeout, sock->nonblock))) {
+            if(*len >= ETHER_HDR_LEN && raw_accept(sock, (struct ether_header*)frame)) {
+                *len -= ETHER_HDR_LEN;
+                return frame + ETHER_HDR_LEN;
+            }
+        }
+
+        return NULL;
+    }
+
+    for(;;) {
+        while(!sock->rx.left) {
+
+            bd = ring_block(sock, sock->rx.blk);
+            if(sock->rx.frame) {
+                __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+                sock->rx.blk   = (sock->rx.blk + 1) % sock->rx.nblk;
+                sock->rx.frame = NULL;
+            }
+
+            if(!ring_wait(sock, timeout)) {
+                return NULL;
+            }
+        }
+
+        hdr   = (struct tpacket3_hdr*)sock->rx.frame;
+        frame = sock->rx.frame + hdr->tp_mac;
+
+        sock->rx.left--;
+        sock->rx.frame += hdr->tp_next_offset;
+
+        if(hdr->tp_snaplen >= ETHER_HDR_LEN && raw_accept(sock, (struct ether_header*)frame)) {
+            *len = hdr->tp_snaplen - ETHER_HDR_LEN;
+            return frame + ETHER_HDR_LEN;
+        }
+    }
+}
+
+/*
+ *  socket_next() -
+ *
+ *  Walks the receive ring, the AF_XDP socket or the received datagrams to
+ *  the next frame, waiting for the kernel to hand over a block, or a batch
+ *  of datagrams, if none is ready. A block is given back to the kernel as
+ *  soon as the walk moves past its last frame, so the returned frame stays
+ *  valid until the next call. Frames from hosts other than the peer are
+ *  skipped.
+ *
+ *  @sock   : Pointer to a socket handing out frames in place.
+ *  @len    : Pointer to store the length of the payload.
+ *  @timeout: Timeout value in microseconds. If zero, no timeout is used.
+ *
+ *  return:
+ *    - Pointer to the payload of the frame, past its Ethernet header if any.
+ *    - 'NULL' if the timeout expired or on error.
+ */
+uint8_t* socket_next(Socket* sock, size_t* len, size_t timeout) {
+
+    assert(sock);
+    assert(len);
+
+    return sock->ops->next(sock, len, timeout);
+}
+
+/*
+ *  tx_slot() -
+ *
+ *  Gets the header of a slot of the transmit ring.
+ *
+ *  @sock: Pointer to the socket.
+ *  @slot: Number of the slot.
+ *
+ *  return:
+ *    - Pointer to the slot header.
+ */
+static inline struct tpacket3_hdr* tx_slot(const Socket* sock, size_t slot) {
+
+    return (struct tpacket3_hdr*)(sock->tx.map + slot * SOCKET_TX_FRAME_SIZE);
+}
+
+/*
+ *  tx_wait() -
+ *
+ *  Waits until a slot of the transmit ring is no longer owned by the
+ *  kernel, flushing the frames queued before it if needed.
+ *
+ *  @sock: Pointer to the socket.
+ *  @hdr : Pointer to the slot header.
+ *
+ *  return:
+ *    - '1' once the slot can be filled.
+ *    - '0' on error.
+ */
+static int tx_wait(Socket* sock, struct tpacket3_hdr* hdr) {
+
+    struct pollfd pfd;
+
+    while(__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING)) {
+
+        if(sock->tx.queued) {
+            if(!socket_flush(sock)) {
+                return 0;
+            }
+            continue;
+        }
+
+        memset(&pfd, 0, sizeof pfd);
+        pfd.fd     = sock->fd;
+        pfd.events = POLLOUT;
+        if(poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ *  ether_header_init() -
+ *
+ *  Initializes the Ethernet header of a frame sent to the peer.
+ *
+ *  @eth : Pointer to the ether_header structure to initialize.
+ *  @sock: Pointer to the socket.
+ */
+static inline void ether_header_init(struct ether_header* eth, const Socket* sock) {
+
+    memcpy(eth->ether_dhost, sock->peer, ETH_ALEN);
+    memcpy(eth->ether_shost, sock->mac, ETH_ALEN);
+    eth->ether_type = htons(sock->ethertype);
+}
+
+/*
+ *  iov_gather() -
+ *
+ *  Copies the pieces of a frame one after the other.
+ *
+ *  @dst: Pointer to the destination buffer, or 'NULL' to only count.
+ *  @iov: Pieces of the frame.
+ *  @n  : Number of pieces.
+ *
+ *  return:
+ *    - Length of the frame.
+ */
+static inline size_t iov_gather(uint8_t* dst, const struct iovec* iov, size_t n) {
+
+    size_t i;
+    size_t len;
+
+    len = 0;
+    for(i = 0; i < n; i++) {
+        if(dst) {
+            memcpy(dst + len, iov[i].iov_base, iov[i].iov_len);
+        }
+        len += iov[i].iov_len;
+    }
+
+    return len;
+}
+
+/*
+ *  raw_queue() -
+ *
+ *  Queues a frame for transmission to the peer, prefixing the payload with
+ *  an Ethernet header. A socket with a transmit ring or an AF_XDP socket
+ *  gathers it into shared memory, any other socket only records where its
+ *  pieces are, so they must then stay untouched until the next flush. The
+ *  queue is flushed first whenever it is full.
+ *
+ *  @sock: Pointer to the socket.
+ *  @iov : Pieces of the payload of the frame.
+ *  @n   : Number of pieces.
+ *
+ *  return:
+ *    - '1' if the frame was queued.
+ *    - '0' on failure.
+ */
+static int raw_queue(Socket* sock, const struct iovec* iov, size_t n) {
+
+    size_t len;
+    uint8_t* data;
+    struct tpacket3_hdr* hdr;
+    struct ether_header* eth;
+
+    if(sock->xsk) {
+
+        assert(iov_gather(NULL, iov, n) <= XSK_MTU);
+
+        data = xsk_slot(sock->xsk);
+        if(!data) {
+            return 0;
+        }
+
+        ether_header_init((struct ether_header*)data, sock);
+        len = iov_gather(data + ETHER_HDR_LEN, iov, n);
+        xsk_queue(sock->xsk, ETHER_HDR_LEN + len);
+
+        return 1;
+    }
+
+    if(sock->tx.map) {
+
+        assert(ETHER_HDR_LEN + iov_gather(NULL, iov, n) <= SOCKET_TX_FRAME_SIZE - (TPACKET3_HDRLEN - sizeof(struct sockaddr_ll)));
+
+        hdr = tx_slot(sock, sock->tx.head);
+        if(!tx_wait(sock, hdr)) {
+            return 0;
+        }
+
+        data = (uint8_t*)hdr + TPACKET3_HDRLEN - sizeof(struct sockaddr_ll);
+        ether_header_init((struct ether_header*)data, sock);
+        len = iov_gather(data + ETHER_HDR_LEN, iov, n);
+        hdr->tp_len         = ETHER_HDR_LEN + len;
+        hdr->tp_snaplen     = ETHER_HDR_LEN + len;
+        hdr->tp_next_offset = 0;
+        __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+        sock->tx.head = (sock->tx.head + 1) % sock->tx.nframe;
+        sock->tx.queued++;
+
+        return 1;
+    }
+
+    if(sock->batch.n == SOCKET_BATCH && !socket_flush(sock)) {
+        return 0;
+    }
+
+    eth = &sock->batch.hdr[sock->batch.n];
+    ether_header_init(eth, sock);
+
+    sock->batch.iov[sock->batch.n][0].iov_base = eth;
+    sock->batch.iov[sock->batch.n][0].iov_len  = sizeof *eth;
+    memcpy(&sock->batch.iov[sock->batch.n][1], iov, n * sizeof *iov);
+    sock->batch.cnt[sock->batch.n] = n + 1;
+    sock->batch.n++;
+
+    return 1;
+}
+
+/*
+ *  socket_queue() -
+ *
+ *  Queues a frame for transmission to the peer, prefixing the payload with
+ *  an Ethernet header on raw sockets. A socket with a transmit ring or an
+ *  AF_XDP socket copies it into shared memory, any other socket only
+ *  records where it is, so the payload must then stay untouched until the
+ *  next flush. The queue is flushed first whenever it is full.
+ *
+ *  @sock : Pointer to the socket.
+ *  @frame: Pointer to the payload of the frame.
+ *  @len  : Length of the payload.
+ *
+ *  return:
+ *    - '1' if the frame was queued.
+ *    - '0' on failure.
+ */
+int socket_queue(Socket* sock, const uint8_t* frame, size_t len) {
+
+    struct iovec iov;
+
+    assert(sock);
+    assert(frame);
+
+    iov.iov_base = (void*)frame;
+    iov.iov_len  = len;
+
+    return sock->ops->queue(sock, &iov, 1);
+}
+
+/*
+ *  socket_queuev() -
+ *
+ *  Queues a frame gathered from several pieces, like 'socket_queue()'.
+ *  Unless the frame is copied into shared memory, the pieces must stay
+ *  untouched until the next flush.
+ *
+ *  @sock: Pointer to the socket.
+ *  @iov : Pieces of the frame, in order.
+ *  @n   : Number of pieces, at most 'SOCKET_IOV_MAX'.
+ *
+ *  return:
+ *    - '1' if the frame was queued.
+ *    - '0' on failure.
+ */
+int socket_queuev(Socket* sock, const struct iovec* iov, size_t n) {
+
+    assert(sock);
+    assert(iov);
+    assert(n && n <= SOCKET_IOV_MAX);
+
+    return sock->ops->queue(sock, iov, n);
+}
+
+/*
+ *  raw_flush() -
+ *
+ *  Hands every queued frame to the kernel with a single kick of the
+ *  transmit ring, of the AF_XDP socket, or a single 'sendmmsg()' call.
+ *
+ *  @sock: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if every queued frame was sent.
+ *    - '0' on failure.
+ */
+static int raw_flush(Socket* sock) {
+
+    int n;
+    size_t i;
+    size_t sent;
+    struct mmsghdr msgs[SOCKET_BATCH];
+
+    if(sock->xsk) {
+        return xsk_flush(sock->xsk);
+    }
+
+    if(sock->tx.map) {
+        if(!sock->tx.queued) {
+            return 1;
+        }
+
+        sock->tx.queued = 0;
+        while(send(sock->fd, NULL, 0, 0) < 0) {
+            if(errno != EINTR) {
+                return 0;
+            }
+        }
+
+        return 1;
+    }
+
+    memset(msgs, 0, sizeof msgs[0] * sock->batch.n);
+    for(i = 0; i < sock->batch.n; i++) {
+        msgs[i].msg_hdr.msg_iov    = sock->batch.iov[i];
+        msgs[i].msg_hdr.msg_iovlen = sock->batch.cnt[i];
+    }
+
+    for(sent = 0; sent < sock->batch.n; sent += n) {
+        n = sendmmsg(sock->fd, msgs + sent, sock->batch.n - sent, 0);
+        if(n < 0) {
+            if(errno == EINTR) {
+                n = 0;
+                continue;
+            }
+            sock->batch.n = 0;
+            return 0;
+        }
+    }
+
+    sock->batch.n = 0;
+
+    return 1;
+}
+
+/*
+ *  socket_flush() -
+ *
+ *  Hands every queued frame to the kernel with a single kick of the
+ *  transmit ring, of the AF_XDP socket, or a single 'sendmmsg()' call, in
+ *  which a UDP socket sends the frames of a row going to the same host
+ *  as a single datagram the kernel segments.
+ *
+ *  @sock: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if every queued frame was sent.
+ *    - '0' on failure.
+ */
+int socket_flush(Socket* sock) {
+
+    assert(sock);
+
+    return sock->ops->flush(sock);
+}
+
+/*
+ *  socket_buffer_opt() -
+ *
+ *  Sets a buffer size option, through its privileged variant first.
+ *
+ *  @sock : Pointer to the socket.
+ *  @force: Privileged option ignoring the system limit.
+ *  @opt  : Option capped by the system limit.
+ *  @val  : Size to set.
+ *
+ *  return:
+ *    - '1' if the size was set.
+ *    - '0' on failure.
+ */
+static inline int socket_buffer_opt(Socket* sock, int force, int opt, int val) {
+
+    return !setsockopt(sock->fd, SOL_SOCKET, force, &val, sizeof val)
+        || !setsockopt(sock->fd, SOL_SOCKET, opt, &val, sizeof val);
+}
+
+/*
+ *  socket_buffer() -
+ *
+ *  Sizes the kernel buffers of the socket so a whole window of frames
+ *  fits in them, going past the system limits when privileged.
+ *
+ *  @sock : Pointer to the socket.
+ *  @bytes: Number of bytes the buffers should hold.
+ *
+ *  return:
+ *    - '1' if the buffers were sized.
+ *    - '0' on failure.
+ */
+int socket_buffer(Socket* sock, size_t bytes) {
+
+    int val;
+
+    assert(sock);
+
+    val = bytes > INT_MAX / 2 ? INT_MAX / 2 : (int)bytes;
+
+    return socket_buffer_opt(sock, SO_RCVBUFFORCE, SO_RCVBUF, val)
+        && socket_buffer_opt(sock, SO_SNDBUFFORCE, SO_SNDBUF, val);
+}
+
+/*
+ *  raw_mtu() -
+ *
+ *  Retrieves the largest frame the network interface can carry, bounded
+ *  by the largest frame the protocol supports and, once the socket has
+ *  an AF_XDP socket, by the size of its frames.
+ *
+ *  @sock     : Pointer to the socket.
+ *  @interface: Name of the network interface.
+ *
+ *  return:
+ *    - The usable MTU of the interface in bytes.
+ *    - '0' on failure.
+ */
+static size_t raw_mtu(const Socket* sock, const char* interface) {
+
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof ifr);
+    strncpy(ifr.ifr_name, interface, sizeof ifr.ifr_name - 1);
+    if(ioctl(sock->fd, SIOCGIFMTU, &ifr) < 0 || ifr.ifr_mtu < PKG_MIN_MTU) {
+        return 0;
+    }
+
+    if(sock->xsk && ifr.ifr_mtu > XSK_MTU) {
+        return XSK_MTU;
+    }
+
+    if(ifr.ifr_mtu > PKG_MAX_FRAME) {
+        return PKG_MAX_FRAME;
+    }
+
+    return (size_t)ifr.ifr_mtu;
+}
+
+/*
+ *  socket_mtu() -
+ *
+ *  Retrieves the largest frame the network interface can carry, bounded
+ *  by the largest frame the protocol supports and, once the socket has
+ *  an AF_XDP socket, by the size of its frames. A UDP socket carries
+ *  frames that fit a 1500-byte IPv6 packet, a socket pair the largest.
+ *
+ *  @sock : Pointer to the socket.
+ *  @where: Address the socket was created with.
+ *
+ *  return:
+ *    - The usable MTU of the interface in bytes.
+ *    - '0' on failure.
+ */
+size_t socket_mtu(const Socket* sock, const char* where) {
+
+    assert(sock);
+    assert(where);
+
+    return sock->ops->mtu(sock, where);
+}
+
+/*
+ *  raw_close() -
+ *
+ *  Unmaps the rings, if any, and closes the AF_XDP socket, if any.
+ *
+ *  @sock: Pointer to the socket.
+ */
+static void raw_close(Socket* sock) {
+
+    xsk_close(sock->xsk);
+    if(sock->map) {
+        munmap(sock->map, sock->size);
+    }
 }
 
 /*
  *  socket_close() - 
  *
- *  Closes the specified socket file descriptor.
+ *  Unmaps the rings, if any, closes the AF_XDP socket, if any, closes
+ *  the socket and releases it, along with its receive buffers.
  *
- *  @sockfd: File descriptor of the socket to close.
+ *  @sock: Pointer to the socket to close.
  */
-void socket_close(int sockfd) {
+void socket_close(Socket* sock) {
+
+    if(sock) {
+        sock->ops->close(sock);
+        if(sock->fd >= 0) {
+            close(sock->fd);
+        }
 
-    if(sockfd >= 0) {
-        close(sockfd);
+        free(sock);
     }
 }
+
+const SocketOps socket_raw = { "raw", raw_open, raw_recv, raw_next, raw_queue, raw_flush, raw_mtu, raw_close };
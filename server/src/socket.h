@@ -1,26 +1,415 @@
 #ifndef SOCKET_H
 #define SOCKET_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <net/ethernet.h>
+#include <sys/socket.h>
+
+#include "socket.defs.h"
+#include "xsk.h"
+
+typedef struct Socket Socket;
+typedef struct SocketOps SocketOps;
+
+/*
+ *  Transport a socket moves frames over. 'open' sets up a socket from the
+ *  part of the address following the transport name, if the transport
+ *  can be opened by address at all. 'recv' copies the next frame into a
+ *  buffer and is left unset by transports that only hand out frames in
+ *  place through 'next'. 'queue' and 'flush' send, 'mtu' bounds the
+ *  frames and 'close' releases whatever 'open' set up.
+ */
+struct SocketOps {
+
+    const char* name;
+    int      (*open)(Socket* sock, const char* where, int ethertype, int promisc);
+    ssize_t  (*recv)(Socket* sock, uint8_t* buf, size_t n);
+    uint8_t* (*next)(Socket* sock, size_t* len, size_t timeout);
+    int      (*queue)(Socket* sock, const struct iovec* iov, size_t n);
+    int      (*flush)(Socket* sock);
+    size_t   (*mtu)(const Socket* sock, const char* where);
+    void     (*close)(Socket* sock);
+};
+
+/*
+ *  Socket moving frames over the transport 'ops'. Hosts are known by
+ *  addresses of 'SOCKET_ADDR_LEN' bytes whose meaning is up to the
+ *  transport. Every frame goes to 'peer', which is the default address
+ *  'bcast' of the transport until a peer or a destination is set; once a
+ *  peer is set ('connected'), frames from any other host are dropped.
+ *  'from' holds the source address of the last frame received. A
+ *  'nonblock' socket never waits for frames unless told how long to. A
+ *  plain receive call gives up after 'rcvtimeo' microseconds, if set.
+ *
+ *  A raw socket is bound to a network interface and to the EtherType
+ *  'ethertype', and every frame it sends carries an Ethernet header from
+ *  the interface address 'mac'. Its rings are mapped at 'map'. When
+ *  'rx.map' is set the socket delivers its frames through a TPACKET_V3
+ *  ring of 'rx.nblk' blocks, walked from the frame 'rx.frame' of block
+ *  'rx.blk', which still holds 'rx.left' frames. When 'tx.map' is set,
+ *  queued frames are copied into the slots of a transmit ring from
+ *  'tx.head' on; otherwise the pieces of each are recorded in 'batch',
+ *  after its Ethernet header, 'cnt' pieces in all. Either way they reach
+ *  the wire on the next flush. When 'xsk' is set, frames go through an
+ *  AF_XDP socket instead, both ways, and the raw socket receives none.
+ *
+ *  Datagram sockets record the pieces of queued frames in 'batch' too,
+ *  along with the length of each frame and the address it goes to, and
+ *  receive a batch of datagrams at a time into 'in', handing out the
+ *  frames of datagram 'in.cur' from 'in.off' on. A datagram the kernel
+ *  coalesced holds frames of 'in.seg' bytes, but its last one. 'gso' and
+ *  'gro' tell whether the kernel segments and coalesces datagrams for the
+ *  socket.
+ */
+struct Socket {
+
+    const SocketOps* ops;
+    int      fd;
+    int      ethertype;
+    int      connected;
+    int      nonblock;
+    size_t   rcvtimeo;
+    uint8_t  mac[ETH_ALEN];
+    uint8_t  bcast[SOCKET_ADDR_LEN];
+    uint8_t  peer[SOCKET_ADDR_LEN];
+    uint8_t  from[SOCKET_ADDR_LEN];
+    uint8_t* map;
+    size_t   size;
+    struct {
+        uint8_t* map;
+        size_t   nblk;
+        size_t   blk;
+        size_t   left;
+        uint8_t* frame;
+    } rx;
+    struct {
+        uint8_t* map;
+        size_t   nframe;
+        size_t   head;
+        size_t   queued;
+    } tx;
+    struct {
+        size_t               n;
+        struct ether_header  hdr[SOCKET_BATCH];
+        struct iovec         iov[SOCKET_BATCH][SOCKET_IOV_MAX + 1];
+        size_t               cnt[SOCKET_BATCH];
+        size_t               len[SOCKET_BATCH];
+        uint8_t              to[SOCKET_BATCH][SOCKET_ADDR_LEN];
+    } batch;
+    struct {
+        uint8_t*             buf;
+        size_t               n;
+        size_t               cur;
+        size_t               off;
+        size_t               seg;
+        struct mmsghdr*      msgs;
+    } in;
+    int      gso;
+    int      gro;
+    Xsk*     xsk;
+};
+
+/*
+ *  Transports a socket can be created on.
+ */
+extern const SocketOps socket_raw;
+extern const SocketOps socket_udp;
+extern const SocketOps socket_unix;
+
 /*
  *  socket_create() - 
  *
- *  Creates a raw socket and sets it to promiscuous mode.
+ *  Creates a socket on the transport named at the start of 'where', up to
+ *  a colon, and on a raw socket bound to the network interface 'where'
+ *  when no known transport is named. A raw socket only receives package
+ *  frames, optionally in promiscuous mode: the filter is attached before
+ *  the socket is bound, so not a single unrelated frame is queued on it.
+ *  'udp:<port>' listens for datagrams on a UDP port, 'udp:<host>:<port>'
+ *  sends to a UDP port of a host, from any port.
+ *
+ *  @where    : Transport and address, or name of the network interface.
+ *  @ethertype: EtherType of the frames sent and received.
+ *  @promisc  : Whether to set the interface to promiscuous mode.
+ *
+ *  return:
+ *    - Pointer to the created socket on success.
+ *    - 'NULL' on failure.
+ */
+extern Socket* socket_create(const char* where, int ethertype, int promisc);
+
+/*
+ *  socket_pair() -
+ *
+ *  Creates two sockets connected to each other within the process, over
+ *  a pair of Unix datagram sockets, so the protocol can be run and
+ *  measured without a network.
+ *
+ *  @pair: Array that will hold the two sockets.
+ *
+ *  return:
+ *    - '1' if both sockets were created.
+ *    - '0' on failure.
+ */
+extern int socket_pair(Socket* pair[2]);
+
+/*
+ *  socket_peer() -
+ *
+ *  Sets the host every later frame is sent to and the only one frames are
+ *  accepted from.
+ *
+ *  @sock: Pointer to the socket.
+ *  @addr: Address of the peer, or 'NULL' to go back to the default
+ *         address and accepting frames from any host.
+ */
+extern void socket_peer(Socket* sock, const uint8_t* addr);
+
+/*
+ *  socket_to() -
+ *
+ *  Sets the host every later frame is sent to, still accepting frames
+ *  from any host, so a socket can serve several peers in turn.
+ *
+ *  @sock: Pointer to the socket.
+ *  @addr: Address of the destination.
+ */
+extern void socket_to(Socket* sock, const uint8_t* addr);
+
+/*
+ *  socket_nonblock() -
+ *
+ *  Switches the socket to non-blocking mode: receiving without a timeout
+ *  returns right away when no frame is pending, so the socket can be
+ *  watched by an event loop.
+ *
+ *  @sock: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if the socket no longer blocks.
+ *    - '0' on failure.
+ */
+extern int socket_nonblock(Socket* sock);
+
+/*
+ *  socket_fanout() -
+ *
+ *  Joins the socket to a fanout group, among whose sockets the kernel
+ *  spreads the frames received on the interface. The kernel hash mode
+ *  only dissects IP flows and would hand every frame of this protocol to
+ *  the same socket, so a classic BPF program hashes the client address
+ *  and the session of each frame instead: all the frames of a session
+ *  go to the same socket. The frames a socket of the group sends would
+ *  reach the others, so sockets of the group ignore outgoing frames.
+ *  UDP sockets listening on the same port make up a group of their own,
+ *  the kernel spreading datagrams among them by the address they come
+ *  from. Sockets of other transports cannot join a group.
+ *
+ *  @sock : Pointer to the socket.
+ *  @group: Identifier of the fanout group, shared by its sockets.
+ *
+ *  return:
+ *    - '1' if the socket joined the group.
+ *    - '0' on failure.
+ */
+extern int socket_fanout(Socket* sock, int group);
+
+/*
+ *  socket_session() -
+ *
+ *  Narrows the frames a raw socket receives down to those of a session,
+ *  so that sockets of the same host on the same interface, each running
+ *  a session of its own, do not all wake up for every frame. Sockets of
+ *  other transports, and raw ones whose frames go through an AF_XDP
+ *  socket, are left as they are.
+ *
+ *  @sock: Pointer to the socket.
+ *  @sess: Session to keep the frames of.
+ *
+ *  return:
+ *    - '1' if the socket only receives frames of the session, or if it
+ *      is left as it is.
+ *    - '0' on failure.
+ */
+extern int socket_session(Socket* sock, uint32_t sess);
+
+/*
+ *  socket_accept() -
+ *
+ *  Tells whether the frame last received, whose source address is in
+ *  'sock->from', comes from the peer.
+ *
+ *  @sock: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if the frame is to be handed out.
+ *    - '0' if it comes from a host other than the peer.
+ */
+extern int socket_accept(const Socket* sock);
+
+/*
+ *  socket_recv() -
+ *
+ *  Receives a frame through a plain 'recv()' call, keeping its Ethernet
+ *  header apart from the payload. Only raw sockets without a receive ring
+ *  receive this way, see 'SocketInPlace()'.
+ *
+ *  @sock: Pointer to the socket.
+ *  @buf : Pointer to the buffer the payload will be stored in.
+ *  @n   : Size of the buffer.
+ *
+ *  return:
+ *    - Length of the payload.
+ *    - '-1' on error, timeout, or if the frame came from a host other
+ *      than the peer.
+ */
+extern ssize_t socket_recv(Socket* sock, uint8_t* buf, size_t n);
+
+/*
+ *  socket_ring() -
+ *
+ *  Maps rings shared with the kernel into memory. A receive ring switches
+ *  the socket to TPACKET_V3 block-based delivery, a transmit ring lets
+ *  queued frames be sent with a single kick. 'SOCKET_XDP' moves both ways
+ *  to the rings of an AF_XDP socket on the first queue of the interface
+ *  instead, whose frames bypass the kernel stack. Only raw sockets have
+ *  rings.
+ *
+ *  @sock : Pointer to the socket.
+ *  @rings: Rings to set up, a mask of 'SOCKET_RX_RING' and 'SOCKET_TX_RING',
+ *          or 'SOCKET_XDP'.
+ *
+ *  return:
+ *    - '1' if the rings were set up.
+ *    - '0' on failure, in which case the socket keeps receiving through
+ *      plain 'recv()' calls and sending through 'sendmmsg()'.
+ */
+extern int socket_ring(Socket* sock, int rings);
+
+/*
+ *  socket_timeout() -
+ *
+ *  Sets how long a plain receive call waits for a frame.
+ *
+ *  @sock   : Pointer to the socket.
+ *  @timeout: Timeout value in microseconds. If zero, no timeout is used.
+ */
+extern void socket_timeout(Socket* sock, size_t timeout);
+
+/*
+ *  socket_buffer() -
+ *
+ *  Sizes the kernel buffers of the socket so a whole window of frames
+ *  fits in them, going past the system limits when privileged.
+ *
+ *  @sock : Pointer to the socket.
+ *  @bytes: Number of bytes the buffers should hold.
+ *
+ *  return:
+ *    - '1' if the buffers were sized.
+ *    - '0' on failure.
+ */
+extern int socket_buffer(Socket* sock, size_t bytes);
+
+/*
+ *  socket_next() -
+ *
+ *  Walks the receive ring, the AF_XDP socket or the received datagrams to
+ *  the next frame, waiting for the kernel to hand over a block, or a batch
+ *  of datagrams, if none is ready. A block is given back to the kernel as
+ *  soon as the walk moves past its last frame, so the returned frame stays
+ *  valid until the next call. Frames from hosts other than the peer are
+ *  skipped.
+ *
+ *  @sock   : Pointer to a socket handing out frames in place.
+ *  @len    : Pointer to store the length of the payload.
+ *  @timeout: Timeout value in microseconds. If zero, no timeout is used.
+ *
+ *  return:
+ *    - Pointer to the payload of the frame, past its Ethernet header if any.
+ *    - 'NULL' if the timeout expired or on error.
+ */
+extern uint8_t* socket_next(Socket* sock, size_t* len, size_t timeout);
+
+/*
+ *  socket_queue() -
+ *
+ *  Queues a frame for transmission to the peer, prefixing the payload with
+ *  an Ethernet header on raw sockets. A socket with a transmit ring or an
+ *  AF_XDP socket copies it into shared memory, any other socket only
+ *  records where it is, so the payload must then stay untouched until the
+ *  next flush. The queue is flushed first whenever it is full.
+ *
+ *  @sock : Pointer to the socket.
+ *  @frame: Pointer to the payload of the frame.
+ *  @len  : Length of the payload.
+ *
+ *  return:
+ *    - '1' if the frame was queued.
+ *    - '0' on failure.
+ */
+extern int socket_queue(Socket* sock, const uint8_t* frame, size_t len);
+
+/*
+ *  socket_queuev() -
+ *
+ *  Queues a frame gathered from several pieces, like 'socket_queue()'.
+ *  Unless the frame is copied into shared memory, the pieces must stay
+ *  untouched until the next flush.
+ *
+ *  @sock: Pointer to the socket.
+ *  @iov : Pieces of the frame, in order.
+ *  @n   : Number of pieces, at most 'SOCKET_IOV_MAX'.
+ *
+ *  return:
+ *    - '1' if the frame was queued.
+ *    - '0' on failure.
+ */
+extern int socket_queuev(Socket* sock, const struct iovec* iov, size_t n);
+
+/*
+ *  socket_flush() -
+ *
+ *  Hands every queued frame to the kernel with a single kick of the
+ *  transmit ring, of the AF_XDP socket, or a single 'sendmmsg()' call, in
+ *  which a UDP socket sends the frames of a row going to the same host
+ *  as a single datagram the kernel segments.
+ *
+ *  @sock: Pointer to the socket.
+ *
+ *  return:
+ *    - '1' if every queued frame was sent.
+ *    - '0' on failure.
+ */
+extern int socket_flush(Socket* sock);
+
+/*
+ *  socket_mtu() -
+ *
+ *  Retrieves the largest frame the network interface can carry, bounded
+ *  by the largest frame the protocol supports and, once the socket has
+ *  an AF_XDP socket, by the size of its frames. A UDP socket carries
+ *  frames that fit a 1500-byte IPv6 packet, a socket pair the largest.
  *
- *  @interface: Name of the network interface.
+ *  @sock : Pointer to the socket.
+ *  @where: Address the socket was created with.
  *
  *  return:
- *    - File descriptor of the created socket on success.
- *    - '-1' on failure.
+ *    - The usable MTU of the interface in bytes.
+ *    - '0' on failure.
  */
-extern int socket_create(const char* interface);
+extern size_t socket_mtu(const Socket* sock, const char* where);
 
 /*
  *  socket_close() - 
  *
- *  Closes the specified socket file descriptor.
+ *  Unmaps the rings, if any, closes the AF_XDP socket, if any, closes
+ *  the socket and releases it, along with its receive buffers.
  *
- *  @sockfd: File descriptor of the socket to close.
+ *  @sock: Pointer to the socket to close.
  */
-extern void socket_close(int sockfd);
+extern void socket_close(Socket* sock);
 
 #endif
@@ -0,0 +1,494 @@
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <immintrin.h>
+#   define STUFF_X86
+#endif
+
+#include "stuff.h"
+
+typedef size_t (*StuffFn)(uint8_t*, size_t, const uint8_t*, size_t, size_t*);
+typedef size_t (*UnstuffFn)(uint8_t*, size_t);
+
+static StuffFn   stuff_fn;
+static UnstuffFn unstuff_fn;
+
+/*
+ *  hassentinel() -
+ *
+ *  Checks, eight bytes at a time, whether a word may hold a sentinel byte.
+ *  False positives are possible for the bytes that follow a real match, so
+ *  callers confirm byte by byte.
+ *
+ *  @w: Word to be checked.
+ *
+ *  return:
+ *    - A non-zero value if the word may hold a sentinel byte.
+ *    - '0' if it certainly does not.
+ */
+static inline uint64_t hassentinel(uint64_t w) {
+
+    uint64_t a;
+    uint64_t b;
+
+    a = w ^ (STUFF_SWAR_ONES * STUFF_SENTINEL_A);
+    b = w ^ (STUFF_SWAR_ONES * STUFF_SENTINEL_B);
+
+    return ((a - STUFF_SWAR_ONES) & ~a & STUFF_SWAR_HIGHS) |
+           ((b - STUFF_SWAR_ONES) & ~b & STUFF_SWAR_HIGHS);
+}
+
+/*
+ *  find_sentinel() -
+ *
+ *  Finds the first sentinel byte in a buffer.
+ *
+ *  @buf: Pointer to the buffer to be scanned.
+ *  @n  : Number of bytes in the buffer.
+ *
+ *  return:
+ *    - The position of the first sentinel byte.
+ *    - 'n' if the buffer holds none.
+ */
+static size_t find_sentinel(const uint8_t* buf, size_t n) {
+
+    size_t i;
+    uint64_t w;
+
+    for(i = 0; i + sizeof w <= n; i += sizeof w) {
+        memcpy(&w, buf + i, sizeof w);
+        if(hassentinel(w)) {
+            break;
+        }
+    }
+
+    for(; i < n; i++) {
+        if(issentinel(buf[i])) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/*
+ *  stuff_scalar() -
+ *
+ *  Portable 'stuff()' kernel: runs of bytes between sentinels are found
+ *  a word at a time and copied in bulk.
+ */
+static size_t stuff_scalar(uint8_t* dst, size_t cap, const uint8_t* src, size_t n, size_t* used) {
+
+    size_t i;
+    size_t k;
+    size_t m;
+    size_t o;
+
+    i = 0;
+    o = 0;
+    while(i < n && o < cap) {
+
+        m = n - i;
+        if(m > cap - o) {
+            m = cap - o;
+        }
+
+        k = find_sentinel(src + i, m);
+        memcpy(dst + o, src + i, k);
+        i += k;
+        o += k;
+
+        if(k < m) {
+            if(o + 2 > cap) {
+                break;
+            }
+            dst[o++] = src[i++];
+            dst[o++] = STUFF_ESCAPE;
+        }
+    }
+
+    *used = i;
+
+    return o;
+}
+
+/*
+ *  unstuff_from() -
+ *
+ *  Portable 'unstuff()' kernel, resuming with 'o' bytes already kept and
+ *  the byte at 'i' as the next one to be read.
+ *
+ *  @buf: Pointer to the buffer.
+ *  @o  : Number of bytes already kept.
+ *  @i  : Position of the next byte to be read.
+ *  @n  : Number of bytes in the buffer.
+ *
+ *  return:
+ *    - The number of bytes left in the buffer.
+ */
+static size_t unstuff_from(uint8_t* buf, size_t o, size_t i, size_t n) {
+
+    size_t k;
+
+    while(i < n) {
+        k = find_sentinel(buf + i, n - i);
+        memmove(buf + o, buf + i, k);
+        i += k;
+        o += k;
+
+        if(i < n) {
+            buf[o++] = buf[i];
+            i += 2;
+        }
+    }
+
+    return o;
+}
+
+/*
+ *  unstuff_scalar() -
+ *
+ *  Portable 'unstuff()' kernel.
+ */
+static size_t unstuff_scalar(uint8_t* buf, size_t n) {
+
+    return unstuff_from(buf, 0, 0, n);
+}
+
+#ifdef STUFF_X86
+
+/*
+ *  stuff_sse2() -
+ *
+ *  SSE2 'stuff()' kernel. Sixteen bytes are compared against both sentinels
+ *  at once; blocks holding none are stored as they are, the others are
+ *  split at the positions given by the comparison mask.
+ */
+__attribute__((target("sse2")))
+static size_t stuff_sse2(uint8_t* dst, size_t cap, const uint8_t* src, size_t n, size_t* used) {
+
+    size_t b;
+    size_t i;
+    size_t k;
+    size_t o;
+    size_t p;
+    uint32_t m;
+    __m128i v;
+    __m128i sa;
+    __m128i sb;
+
+    sa = _mm_set1_epi8((char)STUFF_SENTINEL_A);
+    sb = _mm_set1_epi8((char)STUFF_SENTINEL_B);
+
+    o = 0;
+    for(i = 0; i + sizeof v <= n && o + 2 * sizeof v <= cap; i += sizeof v) {
+
+        v = _mm_loadu_si128((const __m128i*)(src + i));
+        m = (uint32_t)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, sa), _mm_cmpeq_epi8(v, sb))
+        );
+
+        if(!m) {
+            _mm_storeu_si128((__m128i*)(dst + o), v);
+            o += sizeof v;
+            continue;
+        }
+
+        for(p = 0; m; m &= m - 1) {
+            b = (size_t)__builtin_ctz(m);
+            memcpy(dst + o, src + i + p, b + 1 - p);
+            o += b + 1 - p;
+            dst[o++] = STUFF_ESCAPE;
+            p = b + 1;
+        }
+        memcpy(dst + o, src + i + p, sizeof v - p);
+        o += sizeof v - p;
+    }
+
+    o += stuff_scalar(dst + o, cap - o, src + i, n - i, &k);
+    *used = i + k;
+
+    return o;
+}
+
+/*
+ *  unstuff_sse2() -
+ *
+ *  SSE2 'unstuff()' kernel. Blocks holding no sentinel are moved down as
+ *  they are; in the others the escape byte after each sentinel is dropped.
+ */
+__attribute__((target("sse2")))
+static size_t unstuff_sse2(uint8_t* buf, size_t n) {
+
+    size_t b;
+    size_t i;
+    size_t o;
+    size_t p;
+    uint32_t m;
+    __m128i v;
+    __m128i sa;
+    __m128i sb;
+
+    sa = _mm_set1_epi8((char)STUFF_SENTINEL_A);
+    sb = _mm_set1_epi8((char)STUFF_SENTINEL_B);
+
+    i = 0;
+    o = 0;
+    while(i + sizeof v <= n) {
+
+        v = _mm_loadu_si128((const __m128i*)(buf + i));
+        m = (uint32_t)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, sa), _mm_cmpeq_epi8(v, sb))
+        );
+
+        if(!m) {
+            _mm_storeu_si128((__m128i*)(buf + o), v);
+            i += sizeof v;
+            o += sizeof v;
+            continue;
+        }
+
+        for(p = 0; m; m &= ~(2u << b)) {
+            b = (size_t)__builtin_ctz(m);
+            memmove(buf + o, buf + i + p, b + 1 - p);
+            o += b + 1 - p;
+            p  = b + 2;
+            m &= m - 1;
+        }
+
+        if(p < sizeof v) {
+            memmove(buf + o, buf + i + p, sizeof v - p);
+            o += sizeof v - p;
+            p  = sizeof v;
+        }
+        i += p;
+    }
+
+    return unstuff_from(buf, o, i, n);
+}
+
+/*
+ *  stuff_avx2() -
+ *
+ *  AVX2 'stuff()' kernel, working on 32-byte blocks.
+ */
+__attribute__((target("avx2")))
+static size_t stuff_avx2(uint8_t* dst, size_t cap, const uint8_t* src, size_t n, size_t* used) {
+
+    size_t b;
+    size_t i;
+    size_t k;
+    size_t o;
+    size_t p;
+    uint32_t m;
+    __m256i v;
+    __m256i sa;
+    __m256i sb;
+
+    sa = _mm256_set1_epi8((char)STUFF_SENTINEL_A);
+    sb = _mm256_set1_epi8((char)STUFF_SENTINEL_B);
+
+    o = 0;
+    for(i = 0; i + sizeof v <= n && o + 2 * sizeof v <= cap; i += sizeof v) {
+
+        v = _mm256_loadu_si256((const __m256i*)(src + i));
+        m = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, sa), _mm256_cmpeq_epi8(v, sb))
+        );
+
+        if(!m) {
+            _mm256_storeu_si256((__m256i*)(dst + o), v);
+            o += sizeof v;
+            continue;
+        }
+
+        for(p = 0; m; m &= m - 1) {
+            b = (size_t)__builtin_ctz(m);
+            memcpy(dst + o, src + i + p, b + 1 - p);
+            o += b + 1 - p;
+            dst[o++] = STUFF_ESCAPE;
+            p = b + 1;
+        }
+        memcpy(dst + o, src + i + p, sizeof v - p);
+        o += sizeof v - p;
+    }
+
+    o += stuff_scalar(dst + o, cap - o, src + i, n - i, &k);
+    *used = i + k;
+
+    return o;
+}
+
+/*
+ *  unstuff_avx2() -
+ *
+ *  AVX2 'unstuff()' kernel, working on 32-byte blocks.
+ */
+__attribute__((target("avx2")))
+static size_t unstuff_avx2(uint8_t* buf, size_t n) {
+
+    size_t b;
+    size_t i;
+    size_t o;
+    size_t p;
+    uint32_t m;
+    __m256i v;
+    __m256i sa;
+    __m256i sb;
+
+    sa = _mm256_set1_epi8((char)STUFF_SENTINEL_A);
+    sb = _mm256_set1_epi8((char)STUFF_SENTINEL_B);
+
+    i = 0;
+    o = 0;
+    while(i + sizeof v <= n) {
+
+        v = _mm256_loadu_si256((const __m256i*)(buf + i));
+        m = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, sa), _mm256_cmpeq_epi8(v, sb))
+        );
+
+        if(!m) {
+            _mm256_storeu_si256((__m256i*)(buf + o), v);
+            i += sizeof v;
+            o += sizeof v;
+            continue;
+        }
+
+        for(p = 0; m; m &= ~(2u << b)) {
+            b = (size_t)__builtin_ctz(m);
+            memmove(buf + o, buf + i + p, b + 1 - p);
+            o += b + 1 - p;
+            p  = b + 2;
+            m &= m - 1;
+        }
+
+        if(p < sizeof v) {
+            memmove(buf + o, buf + i + p, sizeof v - p);
+            o += sizeof v - p;
+            p  = sizeof v;
+        }
+        i += p;
+    }
+
+    return unstuff_from(buf, o, i, n);
+}
+
+#endif  /* STUFF_X86 */
+
+/*
+ *  stuff_init() -
+ *
+ *  Selects the fastest kernels before 'main()' runs, so that threads never
+ *  race to select them.
+ */
+__attribute__((constructor))
+static void stuff_init(void) {
+
+    stuff_kernel(NULL);
+}
+
+/*
+ *  stuff_kernel() -
+ *
+ *  Selects the kernels used by 'stuff()' and 'unstuff()'.
+ *
+ *  @name: Name of the kernels ("avx2", "sse2" or "scalar"), or 'NULL' to
+ *         pick the fastest ones the CPU supports.
+ *
+ *  return:
+ *    - The name of the selected kernels.
+ *    - 'NULL' if the requested kernels are not supported.
+ */
+const char* stuff_kernel(const char* name) {
+
+#ifdef STUFF_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && (!name || !strcmp(name, "avx2"))) {
+        stuff_fn   = stuff_avx2;
+        unstuff_fn = unstuff_avx2;
+        return "avx2";
+    }
+
+    if(__builtin_cpu_supports("sse2") && (!name || !strcmp(name, "sse2"))) {
+        stuff_fn   = stuff_sse2;
+        unstuff_fn = unstuff_sse2;
+        return "sse2";
+    }
+#endif  /* STUFF_X86 */
+
+    if(!name || !strcmp(name, "scalar")) {
+        stuff_fn   = stuff_scalar;
+        unstuff_fn = unstuff_scalar;
+        return "scalar";
+    }
+
+    return NULL;
+}
+
+/*
+ *  stuff() -
+ *
+ *  Copies a buffer, following every sentinel byte (0x81 and 0x88) with an
+ *  escape byte. Copying stops when the destination is full; a sentinel is
+ *  never copied without its escape byte.
+ *
+ *  @dst : Pointer to the destination buffer.
+ *  @cap : Number of bytes the destination buffer may hold.
+ *  @src : Pointer to the source buffer.
+ *  @n   : Number of bytes in the source buffer.
+ *  @used: Pointer to a variable where the number of source bytes consumed
+ *         will be stored.
+ *
+ *  return:
+ *    - The number of bytes written to the destination buffer.
+ */
+size_t stuff(uint8_t* dst, size_t cap, const uint8_t* src, size_t n, size_t* used) {
+
+    assert(dst || !cap);
+    assert(src || !n);
+    assert(used);
+
+    return stuff_fn(dst, cap, src, n, used);
+}
+
+/*
+ *  stuff_scan() -
+ *
+ *  Finds the first sentinel byte (0x81 or 0x88) in a buffer, so that the
+ *  runs of bytes between sentinels can be sent as they are.
+ *
+ *  @buf: Pointer to the buffer to be scanned.
+ *  @n  : Number of bytes in the buffer.
+ *
+ *  return:
+ *    - The position of the first sentinel byte.
+ *    - 'n' if the buffer holds none.
+ */
+size_t stuff_scan(const uint8_t* buf, size_t n) {
+
+    assert(buf || !n);
+
+    return find_sentinel(buf, n);
+}
+
+/*
+ *  unstuff() -
+ *
+ *  Removes, in place, the escape byte that follows every sentinel byte
+ *  (0x81 and 0x88) of a buffer.
+ *
+ *  @buf: Pointer to the buffer.
+ *  @n  : Number of bytes in the buffer.
+ *
+ *  return:
+ *    - The number of bytes left in the buffer.
+ */
+size_t unstuff(uint8_t* buf, size_t n) {
+
+    assert(buf || !n);
+
+    return unstuff_fn(buf, n);
+}
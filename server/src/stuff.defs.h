@@ -0,0 +1,17 @@
+#ifndef STUFF_DEFS_H
+#define STUFF_DEFS_H
+
+/*
+ *  Byte values some network cards treat as the start of a VLAN tag, and
+ *  the escape byte that follows each of them on the wire.
+ */
+#define STUFF_SENTINEL_A    0x81
+#define STUFF_SENTINEL_B    0x88
+#define STUFF_ESCAPE        0xff
+
+#define STUFF_SWAR_ONES     0x0101010101010101ULL
+#define STUFF_SWAR_HIGHS    0x8080808080808080ULL
+
+#define issentinel(byte)    ((byte) == STUFF_SENTINEL_A || (byte) == STUFF_SENTINEL_B)
+
+#endif  /* STUFF_DEFS_H */
@@ -0,0 +1,73 @@
+#ifndef STUFF_H
+#define STUFF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stuff.defs.h"
+
+/*
+ *  stuff() -
+ *
+ *  Copies a buffer, following every sentinel byte (0x81 and 0x88) with an
+ *  escape byte. Copying stops when the destination is full; a sentinel is
+ *  never copied without its escape byte.
+ *
+ *  @dst : Pointer to the destination buffer.
+ *  @cap : Number of bytes the destination buffer may hold.
+ *  @src : Pointer to the source buffer.
+ *  @n   : Number of bytes in the source buffer.
+ *  @used: Pointer to a variable where the number of source bytes consumed
+ *         will be stored.
+ *
+ *  return:
+ *    - The number of bytes written to the destination buffer.
+ */
+extern size_t stuff(uint8_t* dst, size_t cap, const uint8_t* src, size_t n, size_t* used);
+
+/*
+ *  stuff_scan() -
+ *
+ *  Finds the first sentinel byte (0x81 or 0x88) in a buffer, so that the
+ *  runs of bytes between sentinels can be sent as they are.
+ *
+ *  @buf: Pointer to the buffer to be scanned.
+ *  @n  : Number of bytes in the buffer.
+ *
+ *  return:
+ *    - The position of the first sentinel byte.
+ *    - 'n' if the buffer holds none.
+ */
+extern size_t stuff_scan(const uint8_t* buf, size_t n);
+
+/*
+ *  unstuff() -
+ *
+ *  Removes, in place, the escape byte that follows every sentinel byte
+ *  (0x81 and 0x88) of a buffer.
+ *
+ *  @buf: Pointer to the buffer.
+ *  @n  : Number of bytes in the buffer.
+ *
+ *  return:
+ *    - The number of bytes left in the buffer.
+ */
+extern size_t unstuff(uint8_t* buf, size_t n);
+
+/*
+ *  stuff_kernel() -
+ *
+ *  Selects the kernels used by 'stuff()' and 'unstuff()'. The fastest ones
+ *  are picked at startup, so this is only needed to force a choice, before
+ *  any thread stuffs or unstuffs.
+ *
+ *  @name: Name of the kernels ("avx2", "sse2" or "scalar"), or 'NULL' to
+ *         pick the fastest ones the CPU supports.
+ *
+ *  return:
+ *    - The name of the selected kernels.
+ *    - 'NULL' if the requested kernels are not supported.
+ */
+extern const char* stuff_kernel(const char* name);
+
+#endif  /* STUFF_H */
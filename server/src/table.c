@@ -0,0 +1,165 @@
+#include <assert.h>
+#include <string.h>
+
+#include "table.h"
+
+/*
+ *  table_hash() -
+ *
+ *  Hashes the key of a context, FNV-1a over the address of the client
+ *  followed by the session.
+ *
+ *  @addr: Address of the client.
+ *  @sess: Session picked by the client.
+ *
+ *  return:
+ *    - Bucket the key belongs to.
+ */
+static inline size_t table_hash(const uint8_t* addr, uint32_t sess) {
+
+    size_t i;
+    uint32_t h;
+
+    h = 2166136261u;
+    for(i = 0; i < SOCKET_ADDR_LEN; i++) {
+        h = (h ^ addr[i]) * 16777619u;
+    }
+
+    for(i = 0; i < sizeof sess; i++) {
+        h = (h ^ ((sess >> (8 * i)) & 0xff)) * 16777619u;
+    }
+
+    return h & (TABLE_BUCKETS - 1);
+}
+
+/*
+ *  table_link() -
+ *
+ *  Finds the link pointing at a slot in the chain of its bucket.
+ *
+ *  @tab: Pointer to the table.
+ *  @i  : Slot of the context, below 'tab->n'.
+ *
+ *  return:
+ *    - Pointer to the link holding 'i'.
+ */
+static uint8_t* table_link(CtxTable* tab, size_t i) {
+
+    uint8_t* link;
+    Context* ctx;
+
+    ctx  = tab->ctx[i];
+    link = &tab->head[table_hash(ctx->addr, ctx->sess)];
+    while(*link != i) {
+        link = &tab->next[*link];
+    }
+
+    return link;
+}
+
+/*
+ *  table_init() -
+ *
+ *  Initializes an empty table.
+ *
+ *  @tab: Pointer to the table.
+ */
+void table_init(CtxTable* tab) {
+
+    assert(tab);
+
+    tab->n = 0;
+    memset(tab->head, TABLE_NONE, sizeof tab->head);
+}
+
+/*
+ *  table_find() -
+ *
+ *  Looks up the context serving a session of a client.
+ *
+ *  @tab : Pointer to the table.
+ *  @addr: Address of the client.
+ *  @sess: Session picked by the client.
+ *
+ *  return:
+ *    - Pointer to the context.
+ *    - 'NULL' if the session has none.
+ */
+Context* table_find(const CtxTable* tab, const uint8_t* addr, uint32_t sess) {
+
+    size_t i;
+    Context* ctx;
+
+    assert(tab);
+    assert(addr);
+
+    for(i = tab->head[table_hash(addr, sess)]; i != TABLE_NONE; i = tab->next[i]) {
+        ctx = tab->ctx[i];
+        if(ctx->sess == sess && !memcmp(ctx->addr, addr, SOCKET_ADDR_LEN)) {
+            return ctx;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ *  table_add() -
+ *
+ *  Adds a context to the table, keyed by the address of its client and
+ *  its session.
+ *
+ *  @tab: Pointer to the table.
+ *  @ctx: Pointer to the context.
+ *
+ *  return:
+ *    - '1' if the context was added.
+ *    - '0' if the table is full.
+ */
+int table_add(CtxTable* tab, Context* ctx) {
+
+    size_t h;
+
+    assert(tab);
+    assert(ctx);
+
+    if(TableFull(tab)) {
+        return 0;
+    }
+
+    h = table_hash(ctx->addr, ctx->sess);
+    tab->ctx[tab->n]  = ctx;
+    tab->next[tab->n] = tab->head[h];
+    tab->head[h]      = (uint8_t)tab->n++;
+
+    return 1;
+}
+
+/*
+ *  table_remove() -
+ *
+ *  Removes the context in a slot of the table, moving the last one into
+ *  it. The context itself is left alone.
+ *
+ *  @tab: Pointer to the table.
+ *  @i  : Slot of the context, below 'tab->n'.
+ */
+void table_remove(CtxTable* tab, size_t i) {
+
+    size_t last;
+    uint8_t* link;
+
+    assert(tab);
+    assert(i < tab->n);
+
+    link  = table_link(tab, i);
+    *link = tab->next[i];
+
+    last = --tab->n;
+    if(i != last) {
+        link  = table_link(tab, last);
+        *link = (uint8_t)i;
+        tab->ctx[i]  = tab->ctx[last];
+        tab->next[i] = tab->next[last];
+    }
+}
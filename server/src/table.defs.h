@@ -0,0 +1,24 @@
+#ifndef TABLE_DEFS_H
+#define TABLE_DEFS_H
+
+/*
+ *  Largest number of contexts served at once. Requests from further
+ *  clients are ignored until a context completes; they ask again. Slots
+ *  are chained by bytes, so it stays below 255.
+ */
+#define TABLE_SIZE  128
+
+/*
+ *  Number of hash buckets contexts are chained in, a power of two large
+ *  enough to keep the chains short when the table is full.
+ */
+#define TABLE_BUCKETS   256
+
+/*
+ *  Marks the end of a chain.
+ */
+#define TABLE_NONE  TABLE_SIZE
+
+#define TableFull(tab)  ((tab)->n == TABLE_SIZE)
+
+#endif  /* TABLE_DEFS_H */
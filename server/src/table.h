@@ -0,0 +1,76 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "table.defs.h"
+#include "context.h"
+
+/*
+ *  Contexts being served, 'n' of them in the first slots of 'ctx', each
+ *  found by the address of its client and its session. Slots with keys
+ *  hashing to the same bucket are chained from 'head' through 'next',
+ *  both holding slots and 'TABLE_NONE' at the end of a chain.
+ */
+struct CtxTable {
+
+    size_t   n;
+    Context* ctx[TABLE_SIZE];
+    uint8_t  next[TABLE_SIZE];
+    uint8_t  head[TABLE_BUCKETS];
+};
+
+typedef struct CtxTable CtxTable;
+
+/*
+ *  table_init() -
+ *
+ *  Initializes an empty table.
+ *
+ *  @tab: Pointer to the table.
+ */
+extern void table_init(CtxTable* tab);
+
+/*
+ *  table_find() -
+ *
+ *  Looks up the context serving a session of a client.
+ *
+ *  @tab : Pointer to the table.
+ *  @addr: Address of the client.
+ *  @sess: Session picked by the client.
+ *
+ *  return:
+ *    - Pointer to the context.
+ *    - 'NULL' if the session has none.
+ */
+extern Context* table_find(const CtxTable* tab, const uint8_t* addr, uint32_t sess);
+
+/*
+ *  table_add() -
+ *
+ *  Adds a context to the table, keyed by the address of its client and
+ *  its session.
+ *
+ *  @tab: Pointer to the table.
+ *  @ctx: Pointer to the context.
+ *
+ *  return:
+ *    - '1' if the context was added.
+ *    - '0' if the table is full.
+ */
+extern int table_add(CtxTable* tab, Context* ctx);
+
+/*
+ *  table_remove() -
+ *
+ *  Removes the context in a slot of the table, moving the last one into
+ *  it. The context itself is left alone.
+ *
+ *  @tab: Pointer to the table.
+ *  @i  : Slot of the context, below 'tab->n'.
+ */
+extern void table_remove(CtxTable* tab, size_t i);
+
+#endif  /* TABLE_H */
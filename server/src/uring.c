@@ -0,0 +1,288 @@
+#define _GNU_SOURCE
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "uring.h"
+
+/*
+ *  sys_io_uring_setup() -
+ *
+ *  Issues an 'io_uring_setup()' system call, which the C library does not
+ *  wrap.
+ *
+ *  @entries: Number of submission slots.
+ *  @p      : Pointer to the parameters, filled in by the kernel.
+ *
+ *  return:
+ *    - Descriptor of the instance.
+ *    - '-1' on failure.
+ */
+static inline int sys_io_uring_setup(unsigned entries, struct io_uring_params* p) {
+
+    return (int)syscall(SYS_io_uring_setup, entries, p);
+}
+
+/*
+ *  sys_io_uring_enter() -
+ *
+ *  Issues an 'io_uring_enter()' system call, which the C library does not
+ *  wrap.
+ *
+ *  @fd    : Descriptor of the instance.
+ *  @submit: Number of queued entries to submit.
+ *  @wait  : Number of completions to wait for.
+ *  @flags : Flags of the call.
+ *
+ *  return:
+ *    - Number of entries submitted.
+ *    - '-1' on failure.
+ */
+static inline int sys_io_uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+
+    return (int)syscall(SYS_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+/*
+ *  uring_map() -
+ *
+ *  Maps one of the queues of the instance.
+ *
+ *  @ur   : Pointer to the instance.
+ *  @q    : Pointer to the queue.
+ *  @pgoff: Offset the queue is mapped at.
+ *  @size : Size of the mapping.
+ *
+ *  return:
+ *    - Pointer to the mapping.
+ *    - 'NULL' on failure.
+ */
+static uint8_t* uring_map(Uring* ur, UringQueue* q, off_t pgoff, size_t size) {
+
+    void* map;
+
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->fd, pgoff);
+    if(map == MAP_FAILED) {
+        return NULL;
+    }
+
+    q->map  = map;
+    q->size = size;
+
+    return map;
+}
+
+/*
+ *  uring_open() -
+ *
+ *  Sets up an io_uring instance and maps its queues. Every submission
+ *  slot is indexed by the entry of the same number once and for all.
+ *
+ *  @entries: Number of submission slots.
+ *
+ *  return:
+ *    - Pointer to the instance.
+ *    - 'NULL' on failure.
+ */
+Uring* uring_open(unsigned entries) {
+
+    uint32_t i;
+    uint8_t* sq;
+    uint8_t* cq;
+    void* sqes;
+    Uring* ur;
+    struct io_uring_params p;
+
+    ur = calloc(1, sizeof *ur);
+    if(!ur) {
+        return NULL;
+    }
+
+    memset(&p, 0, sizeof p);
+    ur->fd = sys_io_uring_setup(entries, &p);
+    if(ur->fd < 0) {
+        free(ur);
+        return NULL;
+    }
+
+    sq = uring_map(ur, &ur->sq, IORING_OFF_SQ_RING, p.sq_off.array + p.sq_entries * sizeof(uint32_t));
+    cq = uring_map(ur, &ur->cq, IORING_OFF_CQ_RING, p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe));
+    sqes = mmap(NULL, p.sq_entries * sizeof *ur->sqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQES);
+    if(!sq || !cq || sqes == MAP_FAILED) {
+        if(sqes != MAP_FAILED) {
+            munmap(sqes, p.sq_entries * sizeof *ur->sqes);
+        }
+        uring_close(ur);
+        return NULL;
+    }
+
+    ur->sqes = sqes;
+    ur->nsqe = p.sq_entries;
+
+    ur->sq.head    = (uint32_t*)(sq + p.sq_off.head);
+    ur->sq.tail    = (uint32_t*)(sq + p.sq_off.tail);
+    ur->sq.array   = (uint32_t*)(sq + p.sq_off.array);
+    ur->sq.entries = ur->sqes;
+    ur->sq.mask    = *(uint32_t*)(sq + p.sq_off.ring_mask);
+
+    ur->cq.head    = (uint32_t*)(cq + p.cq_off.head);
+    ur->cq.tail    = (uint32_t*)(cq + p.cq_off.tail);
+    ur->cq.entries = cq + p.cq_off.cqes;
+    ur->cq.mask    = *(uint32_t*)(cq + p.cq_off.ring_mask);
+
+    for(i = 0; i < ur->nsqe; i++) {
+        ur->sq.array[i] = i;
+    }
+
+    return ur;
+}
+
+/*
+ *  uring_read() -
+ *
+ *  Queues a positional read, submitting the queued ones first if every
+ *  slot is taken.
+ *
+ *  @ur  : Pointer to the instance.
+ *  @fd  : File descriptor to read from.
+ *  @buf : Pointer to the buffer the bytes will be stored in.
+ *  @len : Number of bytes to read.
+ *  @off : File offset of the first byte.
+ *  @data: Pointer handed back with the completion of the read.
+ *
+ *  return:
+ *    - '1' if the read was queued.
+ *    - '0' on failure.
+ */
+int uring_read(Uring* ur, int fd, void* buf, size_t len, off_t off, void* data) {
+
+    uint32_t tail;
+    struct io_uring_sqe* sqe;
+
+    assert(ur);
+
+    tail = *ur->sq.tail;
+    if(tail - __atomic_load_n(ur->sq.head, __ATOMIC_ACQUIRE) == ur->nsqe) {
+        if(!uring_submit(ur, 0) || tail - __atomic_load_n(ur->sq.head, __ATOMIC_ACQUIRE) == ur->nsqe) {
+            return 0;
+        }
+    }
+
+    sqe = UringAt(&ur->sq, struct io_uring_sqe, tail);
+    memset(sqe, 0, sizeof *sqe);
+    sqe->opcode    = IORING_OP_READ;
+    sqe->fd        = fd;
+    sqe->addr      = (uint64_t)(uintptr_t)buf;
+    sqe->len       = (uint32_t)len;
+    sqe->off       = (uint64_t)off;
+    sqe->user_data = (uint64_t)(uintptr_t)data;
+
+    __atomic_store_n(ur->sq.tail, tail + 1, __ATOMIC_RELEASE);
+    ur->queued++;
+
+    return 1;
+}
+
+/*
+ *  uring_submit() -
+ *
+ *  Hands the queued reads to the kernel, optionally waiting for at least
+ *  one completion.
+ *
+ *  @ur  : Pointer to the instance.
+ *  @wait: Whether to wait for a completion.
+ *
+ *  return:
+ *    - '1' if the reads were handed over.
+ *    - '0' on failure.
+ */
+int uring_submit(Uring* ur, int wait) {
+
+    int n;
+
+    assert(ur);
+
+    if(!ur->queued && !wait) {
+        return 1;
+    }
+
+    do {
+        n = sys_io_uring_enter(ur->fd, ur->queued, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0);
+    } while(n < 0 && errno == EINTR);
+
+    if(n < 0) {
+        return 0;
+    }
+
+    ur->queued -= (uint32_t)n;
+
+    return 1;
+}
+
+/*
+ *  uring_reap() -
+ *
+ *  Takes the next completion off the completion queue, without waiting.
+ *
+ *  @ur : Pointer to the instance.
+ *  @res: Pointer to store the result of the read: the number of bytes
+ *        read, or a negated error number.
+ *
+ *  return:
+ *    - The pointer the read was queued with.
+ *    - 'NULL' if no completion is pending.
+ */
+void* uring_reap(Uring* ur, int* res) {
+
+    uint32_t head;
+    void* data;
+    struct io_uring_cqe* cqe;
+
+    assert(ur);
+    assert(res);
+
+    head = *ur->cq.head;
+    if(head == __atomic_load_n(ur->cq.tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    cqe  = UringAt(&ur->cq, struct io_uring_cqe, head);
+    *res = cqe->res;
+    data = (void*)(uintptr_t)cqe->user_data;
+    __atomic_store_n(ur->cq.head, head + 1, __ATOMIC_RELEASE);
+
+    return data;
+}
+
+/*
+ *  uring_close() -
+ *
+ *  Unmaps the queues, closes the instance and releases it. The buffers
+ *  of reads still in flight must outlive it.
+ *
+ *  @ur: Pointer to the instance.
+ */
+void uring_close(Uring* ur) {
+
+    if(ur) {
+        if(ur->sqes) {
+            munmap(ur->sqes, ur->nsqe * sizeof *ur->sqes);
+        }
+
+        if(ur->sq.map) {
+            munmap(ur->sq.map, ur->sq.size);
+        }
+
+        if(ur->cq.map) {
+            munmap(ur->cq.map, ur->cq.size);
+        }
+
+        close(ur->fd);
+        free(ur);
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef URING_DEFS_H
+#define URING_DEFS_H
+
+/*
+ *  Number of submission slots of a ring. Reads are submitted as soon as
+ *  they are queued, so a few slots suffice; the kernel sizes the
+ *  completion ring twice as large and keeps what overflows it.
+ */
+#define URING_ENTRIES       64
+
+#define UringAt(q, type, idx)   (&((type*)(q)->entries)[(idx) & (q)->mask])
+#define UringFd(ur)             ((ur)->fd)
+
+#endif  /* URING_DEFS_H */
@@ -0,0 +1,119 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <linux/io_uring.h>
+
+#include "uring.defs.h"
+
+/*
+ *  One of the queues shared with the kernel, of 'mask + 1' slots at
+ *  'entries'. The submission queue indexes its slots through 'array'.
+ *  The mapping is 'size' bytes at 'map'.
+ */
+struct UringQueue {
+
+    uint32_t* head;
+    uint32_t* tail;
+    uint32_t* array;
+    void*     entries;
+    uint32_t  mask;
+    uint8_t*  map;
+    size_t    size;
+};
+
+typedef struct UringQueue UringQueue;
+
+/*
+ *  io_uring instance, driven through raw system calls, that reads files
+ *  without the thread that asked waiting for the disk. Its descriptor
+ *  becomes readable once completions are pending. The submission entries
+ *  are the 'nsqe' at 'sqes'; 'queued' of them wait for the next submit.
+ */
+struct Uring {
+
+    int                  fd;
+    UringQueue           sq;
+    UringQueue           cq;
+    struct io_uring_sqe* sqes;
+    uint32_t             nsqe;
+    uint32_t             queued;
+};
+
+typedef struct Uring Uring;
+
+/*
+ *  uring_open() -
+ *
+ *  Sets up an io_uring instance and maps its queues.
+ *
+ *  @entries: Number of submission slots.
+ *
+ *  return:
+ *    - Pointer to the instance.
+ *    - 'NULL' on failure.
+ */
+extern Uring* uring_open(unsigned entries);
+
+/*
+ *  uring_read() -
+ *
+ *  Queues a positional read, submitting the queued ones first if every
+ *  slot is taken.
+ *
+ *  @ur  : Pointer to the instance.
+ *  @fd  : File descriptor to read from.
+ *  @buf : Pointer to the buffer the bytes will be stored in.
+ *  @len : Number of bytes to read.
+ *  @off : File offset of the first byte.
+ *  @data: Pointer handed back with the completion of the read.
+ *
+ *  return:
+ *    - '1' if the read was queued.
+ *    - '0' on failure.
+ */
+extern int uring_read(Uring* ur, int fd, void* buf, size_t len, off_t off, void* data);
+
+/*
+ *  uring_submit() -
+ *
+ *  Hands the queued reads to the kernel, optionally waiting for at least
+ *  one completion.
+ *
+ *  @ur  : Pointer to the instance.
+ *  @wait: Whether to wait for a completion.
+ *
+ *  return:
+ *    - '1' if the reads were handed over.
+ *    - '0' on failure.
+ */
+extern int uring_submit(Uring* ur, int wait);
+
+/*
+ *  uring_reap() -
+ *
+ *  Takes the next completion off the completion queue, without waiting.
+ *
+ *  @ur : Pointer to the instance.
+ *  @res: Pointer to store the result of the read: the number of bytes
+ *        read, or a negated error number.
+ *
+ *  return:
+ *    - The pointer the read was queued with.
+ *    - 'NULL' if no completion is pending.
+ */
+extern void* uring_reap(Uring* ur, int* res);
+
+/*
+ *  uring_close() -
+ *
+ *  Unmaps the queues, closes the instance and releases it. The buffers
+ *  of reads still in flight must outlive it.
+ *
+ *  @ur: Pointer to the instance.
+ */
+extern void uring_close(Uring* ur);
+
+#endif  /* URING_H */
@@ -0,0 +1,48 @@
+#ifndef XSK_DEFS_H
+#define XSK_DEFS_H
+
+/*
+ *  Geometry of the UMEM shared with the kernel: 'XSK_FRAMES' chunks of
+ *  'XSK_FRAME_SIZE' bytes, the first half lent to the kernel for received
+ *  frames through the fill ring, the second half kept for frames to send.
+ *  Every ring has as many slots as the frames it may ever hold.
+ */
+#define XSK_FRAME_SIZE      4096
+#define XSK_FRAMES          4096
+#define XSK_RX_FRAMES       (XSK_FRAMES / 2)
+#define XSK_TX_FRAMES       (XSK_FRAMES - XSK_RX_FRAMES)
+
+/*
+ *  Bytes left free in front of every frame, so that the package following
+ *  the Ethernet header starts on a 4-byte boundary.
+ */
+#define XSK_HEADROOM        2
+
+/*
+ *  Largest frame, Ethernet header excluded, a chunk can hold once the
+ *  kernel headroom is taken from it.
+ */
+#define XSK_MTU             (XSK_FRAME_SIZE - XDP_PACKET_HEADROOM - XSK_HEADROOM - ETHER_HDR_LEN)
+
+/*
+ *  Number of receive queues the steering program can redirect from; the
+ *  socket itself serves queue 'XSK_QUEUE'.
+ */
+#define XSK_QUEUES          64
+#define XSK_QUEUE           0
+
+/*
+ *  No frame handed out.
+ */
+#define XSK_NONE            UINT64_MAX
+
+/*
+ *  Builds an eBPF instruction.
+ */
+#define XSK_INSN(c, dst, src, o, i) \
+    ((struct bpf_insn){ .code = (c), .dst_reg = (dst), .src_reg = (src), .off = (o), .imm = (i) })
+
+#define XskRingAt(ring, type, idx)  (&((type*)(ring)->desc)[(idx) & (ring)->mask])
+#define XskNeedWakeup(ring)         (__atomic_load_n((ring)->flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP)
+
+#endif  /* XSK_DEFS_H */